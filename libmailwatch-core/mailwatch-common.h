@@ -36,6 +36,20 @@ GQuark xfce_mailwatch_get_error_quark();
 void xfce_mailwatch_threads_enter();
 void xfce_mailwatch_threads_leave();
 
+/* times a check for the statistics debug builds print; other builds have
+ * nothing to print, so they don't keep a timer */
+#ifdef DEBUG
+#define CHECK_TIMER_INIT     GTimer *__check_timer = NULL
+#define CHECK_TIMER_START    __check_timer = g_timer_new()
+#define CHECK_TIMER_ELAPSED  g_timer_elapsed(__check_timer, NULL)
+#define CHECK_TIMER_FREE     g_timer_destroy(__check_timer)
+#else
+#define CHECK_TIMER_INIT     G_GNUC_UNUSED gpointer __check_timer = NULL
+#define CHECK_TIMER_START    G_STMT_START { } G_STMT_END
+#define CHECK_TIMER_ELAPSED  0.0
+#define CHECK_TIMER_FREE     G_STMT_START { } G_STMT_END
+#endif
+
 G_END_DECLS
 
 #endif  /* __XFCE_MAILWATCH_COMMON_H__ */
@@ -0,0 +1,499 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* pulls the new message count and the entries out of an Atom (or RSS) feed
+ * as the bytes come in.  it's not a real XML parser: it knows just enough (tags,
+ * attributes, comments, CDATA, processing instructions and entities) to
+ * find its way around a feed, and doesn't care about well-formedness. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "mailwatch-feed.h"
+
+enum
+{
+    SCAN_TEXT = 0,
+    SCAN_ENTITY,
+    SCAN_TAG_OPEN,      /* just after '<' */
+    SCAN_TAG_NAME,
+    SCAN_TAG_ATTRS,
+    SCAN_ATTR_VALUE,
+    SCAN_MARKUP_START,  /* just after "<!" */
+    SCAN_COMMENT,
+    SCAN_CDATA,
+    SCAN_DECL,
+    SCAN_PI,
+};
+
+/* where the entry's date comes from, best first */
+enum
+{
+    RANK_NONE = 0,
+    RANK_UPDATED,
+    RANK_PUBLISHED,
+    RANK_ISSUED,
+};
+
+
+/* |count_element| names an element outside the entries (like GMail's
+ * <fullcount>) whose value is the new message count, if there is one. */
+void
+xfce_mailwatch_feed_scanner_init(XfceMailwatchFeedScanner *scanner,
+                                 const gchar *count_element,
+                                 XMFeedEntryFunc entry_func,
+                                 gpointer user_data)
+{
+    g_return_if_fail(scanner);
+
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->state = SCAN_TEXT;
+    scanner->count = -1;
+    if(count_element) {
+        g_strlcpy(scanner->count_tag, count_element,
+                  sizeof(scanner->count_tag));
+    }
+    scanner->entry_func = entry_func;
+    scanner->user_data = user_data;
+}
+
+static void
+xfce_mailwatch_feed_scanner_start_field(XfceMailwatchFeedScanner *scanner,
+                                        gchar *field,
+                                        gsize field_size,
+                                        const gchar *tag)
+{
+    scanner->field = field;
+    scanner->field_size = field_size;
+    scanner->field_len = 0;
+    *field = 0;
+    g_strlcpy(scanner->field_tag, tag, sizeof(scanner->field_tag));
+}
+
+/* keeps text for the current field, collapsing runs of whitespace */
+static void
+xfce_mailwatch_feed_scanner_append(XfceMailwatchFeedScanner *scanner,
+                                   const gchar *text,
+                                   gsize len)
+{
+    gsize i;
+    gchar c;
+
+    if(!scanner->field)
+        return;
+
+    for(i = 0; i < len && scanner->field_len + 1 < scanner->field_size; i++) {
+        c = text[i];
+        if(c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if(!scanner->field_len
+               || scanner->field[scanner->field_len - 1] == ' ')
+            {
+                continue;
+            }
+            c = ' ';
+        }
+        scanner->field[scanner->field_len++] = c;
+    }
+
+    scanner->field[scanner->field_len] = 0;
+}
+
+static void
+xfce_mailwatch_feed_scanner_end_field(XfceMailwatchFeedScanner *scanner)
+{
+    const gchar *valid_end = NULL;
+
+    /* drop trailing space, and any character that got cut in half */
+    if(scanner->field_len && scanner->field[scanner->field_len - 1] == ' ')
+        scanner->field[--scanner->field_len] = 0;
+    if(!g_utf8_validate(scanner->field, scanner->field_len, &valid_end))
+        scanner->field[valid_end - scanner->field] = 0;
+
+    scanner->field = NULL;
+}
+
+static void
+xfce_mailwatch_feed_scanner_decode_entity(XfceMailwatchFeedScanner *scanner)
+{
+    gchar utf8[8];
+    gint len = 0;
+    gunichar ch = 0;
+    const gchar *entity = scanner->entity;
+
+    scanner->entity[scanner->entity_len] = 0;
+
+    if(entity[0] == '#') {
+        if(entity[1] == 'x' || entity[1] == 'X')
+            ch = strtoul(entity + 2, NULL, 16);
+        else
+            ch = strtoul(entity + 1, NULL, 10);
+        if(ch && g_unichar_validate(ch))
+            len = g_unichar_to_utf8(ch, utf8);
+    } else if(!strcmp(entity, "amp"))
+        utf8[len++] = '&';
+    else if(!strcmp(entity, "lt"))
+        utf8[len++] = '<';
+    else if(!strcmp(entity, "gt"))
+        utf8[len++] = '>';
+    else if(!strcmp(entity, "quot"))
+        utf8[len++] = '"';
+    else if(!strcmp(entity, "apos"))
+        utf8[len++] = '\'';
+
+    if(len)
+        xfce_mailwatch_feed_scanner_append(scanner, utf8, len);
+    else {
+        /* something we don't know; keep it as it was */
+        xfce_mailwatch_feed_scanner_append(scanner, "&", 1);
+        xfce_mailwatch_feed_scanner_append(scanner, scanner->entity,
+                                           scanner->entity_len);
+        xfce_mailwatch_feed_scanner_append(scanner, ";", 1);
+    }
+}
+
+static void
+xfce_mailwatch_feed_scanner_close_tag(XfceMailwatchFeedScanner *scanner,
+                                      const gchar *name)
+{
+    if(scanner->field && !strcmp(name, scanner->field_tag)) {
+        xfce_mailwatch_feed_scanner_end_field(scanner);
+
+        if(!scanner->in_entry && !strcmp(name, scanner->count_tag)) {
+            scanner->count = atoi(scanner->count_text);
+            /* that's all anyone wants out of the feed if they don't care
+             * about the entries */
+            if(!scanner->entry_func)
+                scanner->done = TRUE;
+        }
+    }
+
+    if(!strcmp(name, "author"))
+        scanner->in_author = FALSE;
+    else if((!strcmp(name, "entry") || !strcmp(name, "item"))
+            && scanner->in_entry)
+    {
+        scanner->in_entry = FALSE;
+        scanner->n_entries++;
+        if(scanner->entry_func
+           && !scanner->entry_func(&scanner->entry, scanner->user_data))
+        {
+            scanner->done = TRUE;
+        }
+    } else if(!strcmp(name, "feed") || !strcmp(name, "rss")
+              || !strcmp(name, "RDF"))
+    {
+        scanner->done = TRUE;
+    }
+}
+
+static void
+xfce_mailwatch_feed_scanner_open_tag(XfceMailwatchFeedScanner *scanner,
+                                     const gchar *name)
+{
+    XfceMailwatchFeedEntry *entry = &scanner->entry;
+    guint rank = RANK_NONE;
+
+    if(!strcmp(name, "entry") || !strcmp(name, "item")) {
+        memset(entry, 0, sizeof(*entry));
+        scanner->author_rank = scanner->issued_rank = RANK_NONE;
+        scanner->in_entry = TRUE;
+        scanner->in_author = FALSE;
+        return;
+    }
+
+    /* an RSS <author> is just text, but an Atom one has children */
+    if(scanner->in_author && scanner->field == entry->author
+       && !strcmp(scanner->field_tag, "author"))
+    {
+        scanner->field = NULL;
+        *entry->author = 0;
+        scanner->author_rank = RANK_NONE;
+    }
+
+    /* fields don't nest */
+    if(scanner->field)
+        return;
+
+    if(!scanner->in_entry) {
+        if(*scanner->count_tag && !strcmp(name, scanner->count_tag)) {
+            xfce_mailwatch_feed_scanner_start_field(scanner,
+                                                    scanner->count_text,
+                                                    sizeof(scanner->count_text),
+                                                    name);
+        }
+        return;
+    }
+
+    if(scanner->in_author) {
+        /* a name beats an email address */
+        if(!strcmp(name, "name"))
+            rank = 3;
+        else if(!strcmp(name, "email"))
+            rank = 2;
+        if(rank > scanner->author_rank) {
+            scanner->author_rank = rank;
+            xfce_mailwatch_feed_scanner_start_field(scanner, entry->author,
+                                                    sizeof(entry->author),
+                                                    name);
+        }
+        return;
+    }
+
+    if(!strcmp(name, "author") || !strcmp(name, "creator")) {
+        scanner->in_author = !strcmp(name, "author");
+        if(scanner->author_rank == RANK_NONE) {
+            scanner->author_rank = 1;
+            xfce_mailwatch_feed_scanner_start_field(scanner, entry->author,
+                                                    sizeof(entry->author),
+                                                    name);
+        }
+    } else if(!strcmp(name, "title") && !*entry->title) {
+        xfce_mailwatch_feed_scanner_start_field(scanner, entry->title,
+                                                sizeof(entry->title), name);
+    } else if((!strcmp(name, "id") || !strcmp(name, "guid")) && !*entry->id) {
+        xfce_mailwatch_feed_scanner_start_field(scanner, entry->id,
+                                                sizeof(entry->id), name);
+    } else {
+        if(!strcmp(name, "issued"))
+            rank = RANK_ISSUED;
+        else if(!strcmp(name, "published") || !strcmp(name, "pubDate"))
+            rank = RANK_PUBLISHED;
+        else if(!strcmp(name, "updated"))
+            rank = RANK_UPDATED;
+        if(rank > scanner->issued_rank) {
+            scanner->issued_rank = rank;
+            xfce_mailwatch_feed_scanner_start_field(scanner, entry->issued,
+                                                    sizeof(entry->issued),
+                                                    name);
+        }
+    }
+}
+
+static void
+xfce_mailwatch_feed_scanner_handle_tag(XfceMailwatchFeedScanner *scanner)
+{
+    const gchar *name;
+
+    scanner->name[scanner->name_len] = 0;
+
+    /* ignore namespace prefixes */
+    name = strrchr(scanner->name, ':');
+    name = name ? name + 1 : scanner->name;
+
+    if(scanner->closing)
+        xfce_mailwatch_feed_scanner_close_tag(scanner, name);
+    else if(!scanner->self_closing)
+        xfce_mailwatch_feed_scanner_open_tag(scanner, name);
+}
+
+/* scans the next |len| bytes of the feed.  returns FALSE once the scanner
+ * has everything it's going to get, and the rest of the feed can be
+ * skipped. */
+gboolean
+xfce_mailwatch_feed_scanner_feed(XfceMailwatchFeedScanner *scanner,
+                                 const gchar *data,
+                                 gsize len)
+{
+    const gchar *p = data, *end = data + len, *lt;
+    gboolean again;
+    gchar c;
+
+    g_return_val_if_fail(scanner && (data || !len), FALSE);
+
+    while(p < end && !scanner->done) {
+        c = *p;
+        again = FALSE;
+
+        switch(scanner->state) {
+            case SCAN_TEXT:
+                if(!scanner->field) {
+                    /* nothing worth keeping, so skip to the next tag */
+                    lt = memchr(p, '<', end - p);
+                    if(!lt)
+                        return TRUE;
+                    p = lt;
+                    c = '<';
+                }
+                if(c == '<') {
+                    scanner->state = SCAN_TAG_OPEN;
+                    scanner->name_len = 0;
+                    scanner->closing = scanner->self_closing = FALSE;
+                } else if(c == '&') {
+                    scanner->state = SCAN_ENTITY;
+                    scanner->entity_len = 0;
+                } else
+                    xfce_mailwatch_feed_scanner_append(scanner, &c, 1);
+                break;
+
+            case SCAN_ENTITY:
+                if(c == ';') {
+                    xfce_mailwatch_feed_scanner_decode_entity(scanner);
+                    scanner->state = SCAN_TEXT;
+                } else if((g_ascii_isalnum(c) || c == '#')
+                          && scanner->entity_len < sizeof(scanner->entity) - 1)
+                {
+                    scanner->entity[scanner->entity_len++] = c;
+                } else {
+                    /* a stray '&' */
+                    xfce_mailwatch_feed_scanner_append(scanner, "&", 1);
+                    xfce_mailwatch_feed_scanner_append(scanner,
+                                                       scanner->entity,
+                                                       scanner->entity_len);
+                    scanner->state = SCAN_TEXT;
+                    again = TRUE;
+                }
+                break;
+
+            case SCAN_TAG_OPEN:
+                if(c == '/') {
+                    scanner->closing = TRUE;
+                    scanner->state = SCAN_TAG_NAME;
+                } else if(c == '!') {
+                    scanner->markup_len = 0;
+                    scanner->state = SCAN_MARKUP_START;
+                } else if(c == '?') {
+                    scanner->match = 0;
+                    scanner->state = SCAN_PI;
+                } else {
+                    scanner->state = SCAN_TAG_NAME;
+                    again = TRUE;
+                }
+                break;
+
+            case SCAN_TAG_NAME:
+                if(c == '>' || c == '/' || g_ascii_isspace(c)) {
+                    scanner->state = SCAN_TAG_ATTRS;
+                    again = TRUE;
+                } else if(scanner->name_len < sizeof(scanner->name) - 1)
+                    scanner->name[scanner->name_len++] = c;
+                break;
+
+            case SCAN_TAG_ATTRS:
+                if(c == '>') {
+                    scanner->state = SCAN_TEXT;
+                    xfce_mailwatch_feed_scanner_handle_tag(scanner);
+                } else if(c == '/')
+                    scanner->self_closing = TRUE;
+                else if(c == '"' || c == '\'') {
+                    scanner->quote = c;
+                    scanner->state = SCAN_ATTR_VALUE;
+                } else if(!g_ascii_isspace(c))
+                    scanner->self_closing = FALSE;
+                break;
+
+            case SCAN_ATTR_VALUE:
+                if(c == scanner->quote)
+                    scanner->state = SCAN_TAG_ATTRS;
+                break;
+
+            case SCAN_MARKUP_START:
+                scanner->markup[scanner->markup_len++] = c;
+                if(scanner->markup_len == 2
+                   && !memcmp(scanner->markup, "--", 2))
+                {
+                    scanner->match = 0;
+                    scanner->state = SCAN_COMMENT;
+                } else if(scanner->markup_len == 7
+                          && !memcmp(scanner->markup, "[CDATA[", 7))
+                {
+                    scanner->match = 0;
+                    scanner->state = SCAN_CDATA;
+                } else if(strncmp(scanner->markup, "--", scanner->markup_len)
+                          && strncmp(scanner->markup, "[CDATA[",
+                                     scanner->markup_len))
+                {
+                    /* <!DOCTYPE> and friends */
+                    scanner->state = SCAN_DECL;
+                    again = TRUE;
+                }
+                break;
+
+            case SCAN_COMMENT:
+                /* until "-->" */
+                if(c == '-') {
+                    if(scanner->match < 2)
+                        scanner->match++;
+                } else if(c == '>' && scanner->match == 2)
+                    scanner->state = SCAN_TEXT;
+                else
+                    scanner->match = 0;
+                break;
+
+            case SCAN_CDATA:
+                /* until "]]>", keeping everything before it */
+                if(c == ']') {
+                    if(scanner->match < 2)
+                        scanner->match++;
+                    else
+                        xfce_mailwatch_feed_scanner_append(scanner, "]", 1);
+                } else if(c == '>' && scanner->match == 2)
+                    scanner->state = SCAN_TEXT;
+                else {
+                    xfce_mailwatch_feed_scanner_append(scanner, "]]",
+                                                       scanner->match);
+                    scanner->match = 0;
+                    xfce_mailwatch_feed_scanner_append(scanner, &c, 1);
+                }
+                break;
+
+            case SCAN_DECL:
+                if(c == '>')
+                    scanner->state = SCAN_TEXT;
+                break;
+
+            case SCAN_PI:
+                /* until "?>" */
+                if(c == '>' && scanner->match)
+                    scanner->state = SCAN_TEXT;
+                else
+                    scanner->match = (c == '?');
+                break;
+        }
+
+        if(!again)
+            p++;
+    }
+
+    return !scanner->done;
+}
+
+/* returns the value of the count element, or -1 if there wasn't one */
+gint
+xfce_mailwatch_feed_scanner_get_count(XfceMailwatchFeedScanner *scanner)
+{
+    g_return_val_if_fail(scanner, -1);
+    return scanner->count;
+}
+
+guint
+xfce_mailwatch_feed_scanner_get_n_entries(XfceMailwatchFeedScanner *scanner)
+{
+    g_return_val_if_fail(scanner, 0);
+    return scanner->n_entries;
+}
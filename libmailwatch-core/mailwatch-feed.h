@@ -0,0 +1,99 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __MAILWATCH_FEED_H__
+#define __MAILWATCH_FEED_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define XFCE_MAILWATCH_FEED_FIELD_SIZE  256
+
+/* longer values are cut off (at a character boundary) */
+typedef struct
+{
+    gchar title[XFCE_MAILWATCH_FEED_FIELD_SIZE];
+    gchar author[XFCE_MAILWATCH_FEED_FIELD_SIZE];
+    gchar id[XFCE_MAILWATCH_FEED_FIELD_SIZE];
+    gchar issued[XFCE_MAILWATCH_FEED_FIELD_SIZE];
+} XfceMailwatchFeedEntry;
+
+/* called for each <entry> (or RSS <item>) as soon as it's complete.  return FALSE to stop
+ * scanning. */
+typedef gboolean (*XMFeedEntryFunc)(const XfceMailwatchFeedEntry *entry,
+                                    gpointer user_data);
+
+/* an incremental Atom scanner that never allocates, so it can live on the
+ * stack.  the members are private. */
+typedef struct
+{
+    gint state;
+    gboolean done;
+
+    /* the tag being read */
+    gchar name[32];
+    guint name_len;
+    gboolean closing;
+    gboolean self_closing;
+    gchar quote;
+
+    /* markup after "<!", entities, and partial terminators */
+    gchar markup[8];
+    guint markup_len;
+    gchar entity[12];
+    guint entity_len;
+    guint match;
+
+    /* the element whose text we're keeping, if any */
+    gchar *field;
+    gsize field_size;
+    gsize field_len;
+    gchar field_tag[32];
+
+    gboolean in_entry;
+    gboolean in_author;
+    guint author_rank;
+    guint issued_rank;
+    XfceMailwatchFeedEntry entry;
+    guint n_entries;
+
+    gchar count_tag[32];
+    gchar count_text[16];
+    gint count;
+
+    XMFeedEntryFunc entry_func;
+    gpointer user_data;
+} XfceMailwatchFeedScanner;
+
+
+void xfce_mailwatch_feed_scanner_init(XfceMailwatchFeedScanner *scanner,
+                                      const gchar *count_element,
+                                      XMFeedEntryFunc entry_func,
+                                      gpointer user_data);
+
+gboolean xfce_mailwatch_feed_scanner_feed(XfceMailwatchFeedScanner *scanner,
+                                          const gchar *data,
+                                          gsize len);
+
+gint xfce_mailwatch_feed_scanner_get_count(XfceMailwatchFeedScanner *scanner);
+guint xfce_mailwatch_feed_scanner_get_n_entries(XfceMailwatchFeedScanner *scanner);
+
+G_END_DECLS
+
+#endif  /* __MAILWATCH_FEED_H__ */
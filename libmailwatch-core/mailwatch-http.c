@@ -0,0 +1,659 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* a minimal HTTP/1.1 client for the feed-based mailboxes: GET only, with
+ * persistent connections, chunked transfer coding, gzip content coding and
+ * conditional requests */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <libxfce4util/libxfce4util.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "mailwatch-http.h"
+#include "mailwatch-common.h"
+
+#define HTTP_CRLF_LEN    2
+#define HTTP_BUFSIZE     8192
+/* once the caller has what it wants, up to this much of the rest of the
+ * body is still read and thrown away to keep the connection usable */
+#define HTTP_DRAIN_MAX   (64 * 1024)
+
+struct _XfceMailwatchHTTPConn
+{
+    gchar *hostname;
+    guint port;
+    gboolean secure;
+
+    XfceMailwatchNetConn *net_conn;
+    guint requests;  /* sent over |net_conn| so far */
+
+    XMNCShouldContinueFunc should_continue;
+    gpointer should_continue_user_data;
+};
+
+typedef struct
+{
+    gint status;
+    gboolean keep_alive;
+    gboolean chunked;
+    gboolean gzipped;
+    gint64 content_length;  /* -1 if the server didn't say */
+    gchar *etag;
+    gchar *last_modified;
+} XMHTTPResponse;
+
+/* where the body of a response goes.  with no |func|, it's read and thrown
+ * away, so the connection can be used again */
+typedef struct
+{
+    XMHTTPBodyFunc func;
+    gpointer user_data;
+    gboolean aborted;    /* |func| doesn't want any more */
+    gsize drained;       /* bytes thrown away since */
+    gboolean truncated;  /* stopped before the end of the body */
+#ifdef HAVE_ZLIB
+    gboolean gzipped;
+    z_stream inflater;
+#endif
+} XMHTTPBodySink;
+
+
+XfceMailwatchHTTPConn *
+xfce_mailwatch_http_conn_new(const gchar *hostname,
+                             guint port,
+                             gboolean secure)
+{
+    XfceMailwatchHTTPConn *http_conn;
+
+    g_return_val_if_fail(hostname && *hostname, NULL);
+
+    http_conn = g_new0(XfceMailwatchHTTPConn, 1);
+    http_conn->hostname = g_strdup(hostname);
+    http_conn->port = port;
+    http_conn->secure = secure;
+
+    return http_conn;
+}
+
+void
+xfce_mailwatch_http_conn_set_should_continue_func(XfceMailwatchHTTPConn *http_conn,
+                                                  XMNCShouldContinueFunc func,
+                                                  gpointer user_data)
+{
+    g_return_if_fail(http_conn);
+
+    http_conn->should_continue = func;
+    http_conn->should_continue_user_data = user_data;
+
+    if(http_conn->net_conn) {
+        xfce_mailwatch_net_conn_set_should_continue_func(http_conn->net_conn,
+                                                         func, user_data);
+    }
+}
+
+static gboolean
+xfce_mailwatch_http_conn_connect(XfceMailwatchHTTPConn *http_conn,
+                                 GError **error)
+{
+    GError *error1 = NULL;
+
+    http_conn->net_conn = xfce_mailwatch_net_conn_new(http_conn->hostname,
+                                                      http_conn->secure
+                                                      ? "https" : "http");
+    if(http_conn->port)
+        xfce_mailwatch_net_conn_set_port(http_conn->net_conn, http_conn->port);
+    xfce_mailwatch_net_conn_set_should_continue_func(http_conn->net_conn,
+                                                     http_conn->should_continue,
+                                                     http_conn->should_continue_user_data);
+    http_conn->requests = 0;
+
+    if(!xfce_mailwatch_net_conn_connect(http_conn->net_conn, error))
+        goto fail;
+
+    if(http_conn->secure
+       && !xfce_mailwatch_net_conn_make_secure(http_conn->net_conn, &error1))
+    {
+        g_set_error(error, XFCE_MAILWATCH_ERROR, error1->code,
+                    _("TLS handshake failed: %s"), error1->message);
+        g_error_free(error1);
+        goto fail;
+    }
+
+    return TRUE;
+
+fail:
+    xfce_mailwatch_net_conn_destroy(http_conn->net_conn);
+    http_conn->net_conn = NULL;
+
+    return FALSE;
+}
+
+static gboolean
+xfce_mailwatch_http_conn_send_request(XfceMailwatchHTTPConn *http_conn,
+                                      const gchar *path,
+                                      const gchar *authorization,
+                                      XfceMailwatchHTTPValidators *validators,
+                                      GError **error)
+{
+    GString *request = g_string_sized_new(512);
+    gint sent;
+    gboolean ret;
+
+    g_string_append_printf(request, "GET %s HTTP/1.1\r\n", path);
+    /* IPv6 addresses need brackets to keep their colons apart from the port */
+    if(strchr(http_conn->hostname, ':'))
+        g_string_append_printf(request, "Host: [%s]", http_conn->hostname);
+    else
+        g_string_append_printf(request, "Host: %s", http_conn->hostname);
+    if(http_conn->port)
+        g_string_append_printf(request, ":%u", http_conn->port);
+    g_string_append(request, "\r\n");
+    g_string_append_printf(request, "User-Agent: %s/%s\r\n", PACKAGE, VERSION);
+    if(authorization)
+        g_string_append_printf(request, "Authorization: %s\r\n", authorization);
+#ifdef HAVE_ZLIB
+    g_string_append(request, "Accept-Encoding: gzip\r\n");
+#endif
+    if(validators && validators->etag) {
+        g_string_append_printf(request, "If-None-Match: %s\r\n",
+                               validators->etag);
+    }
+    if(validators && validators->last_modified) {
+        g_string_append_printf(request, "If-Modified-Since: %s\r\n",
+                               validators->last_modified);
+    }
+    g_string_append(request, "\r\n");
+
+    sent = xfce_mailwatch_net_conn_send_data(http_conn->net_conn,
+                                             (const guchar *)request->str,
+                                             request->len, error);
+    ret = (sent == (gint)request->len);
+    g_string_free(request, TRUE);
+
+    return ret;
+}
+
+static void
+xfce_mailwatch_http_response_parse_header(XMHTTPResponse *resp,
+                                          gchar *header)
+{
+    gchar *value, *lvalue;
+
+    value = strchr(header, ':');
+    if(!value)
+        return;
+    *value++ = 0;
+    while(*value == ' ' || *value == '\t')
+        value++;
+    g_strchomp(value);
+
+    if(!g_ascii_strcasecmp(header, "Content-Length"))
+        resp->content_length = g_ascii_strtoll(value, NULL, 10);
+    else if(!g_ascii_strcasecmp(header, "Transfer-Encoding")) {
+        lvalue = g_ascii_strdown(value, -1);
+        resp->chunked = (strstr(lvalue, "chunked") != NULL);
+        g_free(lvalue);
+    } else if(!g_ascii_strcasecmp(header, "Content-Encoding")) {
+        resp->gzipped = (!g_ascii_strcasecmp(value, "gzip")
+                         || !g_ascii_strcasecmp(value, "x-gzip"));
+    } else if(!g_ascii_strcasecmp(header, "Connection")) {
+        lvalue = g_ascii_strdown(value, -1);
+        if(strstr(lvalue, "close"))
+            resp->keep_alive = FALSE;
+        else if(strstr(lvalue, "keep-alive"))
+            resp->keep_alive = TRUE;
+        g_free(lvalue);
+    } else if(!g_ascii_strcasecmp(header, "ETag")) {
+        g_free(resp->etag);
+        resp->etag = g_strdup(value);
+    } else if(!g_ascii_strcasecmp(header, "Last-Modified")) {
+        g_free(resp->last_modified);
+        resp->last_modified = g_strdup(value);
+    }
+}
+
+static gchar *
+xfce_mailwatch_http_conn_read_line(XfceMailwatchHTTPConn *http_conn,
+                                   GError **error)
+{
+    const gchar *line;
+    gsize line_len;
+    gchar *text;
+
+    line = xfce_mailwatch_net_conn_peek_line(http_conn->net_conn, &line_len,
+                                             error);
+    if(!line)
+        return NULL;
+
+    text = g_strndup(line, line_len);
+    xfce_mailwatch_net_conn_consume(http_conn->net_conn,
+                                    line_len + HTTP_CRLF_LEN);
+
+    return text;
+}
+
+/* reads the status line and headers, skipping any 1xx responses */
+static gboolean
+xfce_mailwatch_http_conn_read_head(XfceMailwatchHTTPConn *http_conn,
+                                   XMHTTPResponse *resp,
+                                   GError **error)
+{
+    gchar *line;
+
+    do {
+        line = xfce_mailwatch_http_conn_read_line(http_conn, error);
+        if(!line)
+            return FALSE;
+
+        DBG("< %s", line);
+
+        /* "HTTP/1.x NNN reason" */
+        if(!g_str_has_prefix(line, "HTTP/1.") || strlen(line) < 12) {
+            if(error) {
+                g_set_error(error, XFCE_MAILWATCH_ERROR,
+                            XFCE_MAILWATCH_ERROR_FAILED,
+                            _("Malformed HTTP response from %s"),
+                            http_conn->hostname);
+            }
+            g_free(line);
+            return FALSE;
+        }
+
+        resp->status = atoi(line + 9);
+        resp->keep_alive = (line[7] != '0');
+        resp->chunked = resp->gzipped = FALSE;
+        resp->content_length = -1;
+        g_free(line);
+
+        while((line = xfce_mailwatch_http_conn_read_line(http_conn, error))
+              && *line)
+        {
+            xfce_mailwatch_http_response_parse_header(resp, line);
+            g_free(line);
+        }
+
+        if(!line)
+            return FALSE;
+        g_free(line);
+    } while(resp->status >= 100 && resp->status < 200);
+
+    return TRUE;
+}
+
+static gboolean
+xfce_mailwatch_http_sink_write(XMHTTPBodySink *sink,
+                               const gchar *data,
+                               gsize len,
+                               GError **error)
+{
+    if(!sink->func || sink->aborted)
+        return TRUE;
+
+#ifdef HAVE_ZLIB
+    if(sink->gzipped) {
+        gchar out[HTTP_BUFSIZE];
+        gsize produced;
+        gint zret;
+
+        sink->inflater.next_in = (Bytef *)data;
+        sink->inflater.avail_in = len;
+
+        do {
+            sink->inflater.next_out = (Bytef *)out;
+            sink->inflater.avail_out = sizeof(out);
+
+            zret = inflate(&sink->inflater, Z_NO_FLUSH);
+            if(zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR) {
+                if(error) {
+                    g_set_error(error, XFCE_MAILWATCH_ERROR,
+                                XFCE_MAILWATCH_ERROR_FAILED,
+                                _("Unable to decompress HTTP response: %s"),
+                                sink->inflater.msg ? sink->inflater.msg : "");
+                }
+                return FALSE;
+            }
+
+            produced = sizeof(out) - sink->inflater.avail_out;
+            if(produced && !sink->func(out, produced, sink->user_data)) {
+                sink->aborted = TRUE;
+                return TRUE;
+            }
+        } while(zret == Z_OK
+                && (sink->inflater.avail_in > 0
+                    || sink->inflater.avail_out == 0));
+
+        return TRUE;
+    }
+#endif
+
+    if(!sink->func(data, len, sink->user_data))
+        sink->aborted = TRUE;
+
+    return TRUE;
+}
+
+/* passes the next |len| bytes of the body to |sink|, or everything up to
+ * EOF if |len| is -1.  after the sink gives up, the bytes are only read to
+ * get past them, and not for long. */
+static gboolean
+xfce_mailwatch_http_conn_read_bytes(XfceMailwatchHTTPConn *http_conn,
+                                    gint64 len,
+                                    XMHTTPBodySink *sink,
+                                    GError **error)
+{
+    gchar buf[HTTP_BUFSIZE];
+    gint bin;
+
+    while(len != 0) {
+        if(sink->aborted && (len < 0 || sink->drained >= HTTP_DRAIN_MAX)) {
+            /* cheaper to hang up and reconnect next time */
+            sink->truncated = TRUE;
+            return TRUE;
+        }
+
+        bin = xfce_mailwatch_net_conn_recv_data(http_conn->net_conn,
+                                                (guchar *)buf,
+                                                len < 0 || len > (gint64)sizeof(buf)
+                                                ? sizeof(buf) : (gsize)len,
+                                                error);
+        if(bin < 0)
+            return FALSE;
+        if(!bin) {
+            if(len < 0)
+                return TRUE;
+            if(error) {
+                g_set_error(error, XFCE_MAILWATCH_ERROR,
+                            XFCE_MAILWATCH_ERROR_FAILED, "%s",
+                            _("Connection closed by server"));
+            }
+            return FALSE;
+        }
+
+        if(sink->aborted)
+            sink->drained += bin;
+        else if(!xfce_mailwatch_http_sink_write(sink, buf, bin, error))
+            return FALSE;
+
+        if(len > 0)
+            len -= bin;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+xfce_mailwatch_http_conn_read_body(XfceMailwatchHTTPConn *http_conn,
+                                   XMHTTPResponse *resp,
+                                   XMHTTPBodySink *sink,
+                                   GError **error)
+{
+    gchar *line;
+    gint64 chunk_len;
+
+    if(resp->status == 204 || resp->status == XFCE_MAILWATCH_HTTP_NOT_MODIFIED)
+        return TRUE;
+
+    if(resp->chunked) {
+        for(;;) {
+            /* "<hex size>[;extensions]" */
+            line = xfce_mailwatch_http_conn_read_line(http_conn, error);
+            if(!line)
+                return FALSE;
+            chunk_len = g_ascii_strtoll(line, NULL, 16);
+            g_free(line);
+
+            if(chunk_len <= 0)
+                break;
+
+            if(!xfce_mailwatch_http_conn_read_bytes(http_conn, chunk_len,
+                                                    sink, error))
+            {
+                return FALSE;
+            }
+            if(sink->truncated)
+                return TRUE;
+
+            /* the CRLF after the chunk data */
+            line = xfce_mailwatch_http_conn_read_line(http_conn, error);
+            if(!line)
+                return FALSE;
+            g_free(line);
+        }
+
+        /* skip any trailers */
+        while((line = xfce_mailwatch_http_conn_read_line(http_conn, error))
+              && *line)
+        {
+            g_free(line);
+        }
+        if(!line)
+            return FALSE;
+        g_free(line);
+
+        return TRUE;
+    } else if(resp->content_length >= 0) {
+        return xfce_mailwatch_http_conn_read_bytes(http_conn,
+                                                   resp->content_length,
+                                                   sink, error);
+    } else {
+        /* the body runs until the server hangs up */
+        resp->keep_alive = FALSE;
+        return xfce_mailwatch_http_conn_read_bytes(http_conn, -1, sink, error);
+    }
+}
+
+static void
+xfce_mailwatch_http_response_clear(XMHTTPResponse *resp)
+{
+    g_free(resp->etag);
+    g_free(resp->last_modified);
+    memset(resp, 0, sizeof(*resp));
+    resp->content_length = -1;
+}
+
+/* GETs |path|, reusing the open connection if there is one.  the body of a
+ * 200 response is handed to |body_func|, and |validators| (which may be NULL)
+ * are both sent with the request and updated from a 200 response.  returns
+ * the HTTP status code, or -1 on failure. */
+gint
+xfce_mailwatch_http_conn_get(XfceMailwatchHTTPConn *http_conn,
+                             const gchar *path,
+                             const gchar *authorization,
+                             XfceMailwatchHTTPValidators *validators,
+                             XMHTTPBodyFunc body_func,
+                             gpointer user_data,
+                             GError **error)
+{
+    XMHTTPResponse resp;
+    XMHTTPBodySink sink;
+    GError *error1 = NULL;
+    gboolean reused, ret;
+    gint status;
+
+    g_return_val_if_fail(http_conn && path && (!error || !*error), -1);
+
+    memset(&resp, 0, sizeof(resp));
+    resp.content_length = -1;
+
+    for(;;) {
+        if(!http_conn->net_conn
+           && !xfce_mailwatch_http_conn_connect(http_conn, error))
+        {
+            return -1;
+        }
+
+        reused = (http_conn->requests++ > 0);
+
+        if(xfce_mailwatch_http_conn_send_request(http_conn, path,
+                                                 authorization, validators,
+                                                 &error1)
+           && xfce_mailwatch_http_conn_read_head(http_conn, &resp, &error1))
+        {
+            break;
+        }
+
+        xfce_mailwatch_http_conn_disconnect(http_conn);
+        xfce_mailwatch_http_response_clear(&resp);
+
+        /* servers drop idle connections whenever they like, and a GET can
+         * safely be repeated, so a reused connection failing gets one more
+         * try on a fresh one */
+        if(!reused || (error1 && error1->code == XFCE_MAILWATCH_ERROR_ABORTED)) {
+            if(error1)
+                g_propagate_error(error, error1);
+            return -1;
+        }
+
+        DBG("reused connection to %s failed (%s), reconnecting",
+            http_conn->hostname, error1 ? error1->message : "?");
+        if(error1) {
+            g_error_free(error1);
+            error1 = NULL;
+        }
+    }
+
+    DBG("HTTP %d from %s (%s%s%s)", resp.status, http_conn->hostname,
+        reused ? "reused connection" : "new connection",
+        resp.chunked ? ", chunked" : "", resp.gzipped ? ", gzipped" : "");
+
+    memset(&sink, 0, sizeof(sink));
+    if(resp.status == 200) {
+        sink.func = body_func;
+        sink.user_data = user_data;
+    }
+#ifdef HAVE_ZLIB
+    if(sink.func && resp.gzipped) {
+        /* 16 + MAX_WBITS asks for a gzip wrapper instead of a zlib one */
+        if(inflateInit2(&sink.inflater, 16 + MAX_WBITS) != Z_OK) {
+            if(error) {
+                g_set_error(error, XFCE_MAILWATCH_ERROR,
+                            XFCE_MAILWATCH_ERROR_FAILED, "%s",
+                            _("Unable to decompress HTTP response"));
+            }
+            xfce_mailwatch_http_conn_disconnect(http_conn);
+            xfce_mailwatch_http_response_clear(&resp);
+            return -1;
+        }
+        sink.gzipped = TRUE;
+    }
+#endif
+
+    ret = xfce_mailwatch_http_conn_read_body(http_conn, &resp, &sink, error);
+
+#ifdef HAVE_ZLIB
+    if(sink.gzipped)
+        inflateEnd(&sink.inflater);
+#endif
+
+    if(!ret) {
+        xfce_mailwatch_http_conn_disconnect(http_conn);
+        xfce_mailwatch_http_response_clear(&resp);
+        return -1;
+    }
+
+    if(resp.status == 200 && validators) {
+        xfce_mailwatch_http_validators_clear(validators);
+        validators->etag = resp.etag;
+        validators->last_modified = resp.last_modified;
+        resp.etag = resp.last_modified = NULL;
+    }
+
+    if(!resp.keep_alive || sink.truncated)
+        xfce_mailwatch_http_conn_disconnect(http_conn);
+
+    status = resp.status;
+    xfce_mailwatch_http_response_clear(&resp);
+
+    return status;
+}
+
+/* copies the counters of the open connection, if there is one.  like
+ * xfce_mailwatch_http_conn_dump_stats(), they cover its whole life. */
+gboolean
+xfce_mailwatch_http_conn_get_stats(XfceMailwatchHTTPConn *http_conn,
+                                   XfceMailwatchNetConnStats *stats)
+{
+    g_return_val_if_fail(http_conn && stats, FALSE);
+
+    if(!http_conn->net_conn)
+        return FALSE;
+
+    xfce_mailwatch_net_conn_get_stats(http_conn->net_conn, stats);
+
+    return TRUE;
+}
+
+void
+xfce_mailwatch_http_conn_dump_stats(XfceMailwatchHTTPConn *http_conn,
+                                    const gchar *what,
+                                    gdouble elapsed)
+{
+    g_return_if_fail(http_conn);
+
+    /* the counters cover the connection's whole life, not just this check */
+    if(http_conn->net_conn)
+        xfce_mailwatch_net_conn_dump_stats(http_conn->net_conn, what, elapsed);
+}
+
+void
+xfce_mailwatch_http_conn_disconnect(XfceMailwatchHTTPConn *http_conn)
+{
+    g_return_if_fail(http_conn);
+
+    if(http_conn->net_conn) {
+        xfce_mailwatch_net_conn_destroy(http_conn->net_conn);
+        http_conn->net_conn = NULL;
+    }
+    http_conn->requests = 0;
+}
+
+void
+xfce_mailwatch_http_conn_destroy(XfceMailwatchHTTPConn *http_conn)
+{
+    g_return_if_fail(http_conn);
+
+    xfce_mailwatch_http_conn_disconnect(http_conn);
+    g_free(http_conn->hostname);
+    g_free(http_conn);
+}
+
+void
+xfce_mailwatch_http_validators_clear(XfceMailwatchHTTPValidators *validators)
+{
+    g_return_if_fail(validators);
+
+    g_free(validators->etag);
+    g_free(validators->last_modified);
+    validators->etag = validators->last_modified = NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __MAILWATCH_HTTP_H__
+#define __MAILWATCH_HTTP_H__
+
+#include <glib.h>
+
+#include "mailwatch-net-conn.h"
+
+G_BEGIN_DECLS
+
+#define XFCE_MAILWATCH_HTTP_NOT_MODIFIED  304
+
+typedef struct _XfceMailwatchHTTPConn  XfceMailwatchHTTPConn;
+
+/* validators from the last 200 response for a resource.  they're sent back
+ * with the next request for it, so an unchanged resource costs a bodiless
+ * 304 Not Modified */
+typedef struct
+{
+    gchar *etag;
+    gchar *last_modified;
+} XfceMailwatchHTTPValidators;
+
+/* gets the decoded body of a 200 response a piece at a time.  returning
+ * FALSE means it doesn't need the rest: a short remainder is skipped over
+ * so the connection can be reused, and otherwise the connection is closed. */
+typedef gboolean (*XMHTTPBodyFunc)(const gchar *data,
+                                   gsize len,
+                                   gpointer user_data);
+
+
+XfceMailwatchHTTPConn *xfce_mailwatch_http_conn_new(const gchar *hostname,
+                                                    guint port,
+                                                    gboolean secure);
+
+void xfce_mailwatch_http_conn_set_should_continue_func(XfceMailwatchHTTPConn *http_conn,
+                                                       XMNCShouldContinueFunc func,
+                                                       gpointer user_data);
+
+gint xfce_mailwatch_http_conn_get(XfceMailwatchHTTPConn *http_conn,
+                                  const gchar *path,
+                                  const gchar *authorization,
+                                  XfceMailwatchHTTPValidators *validators,
+                                  XMHTTPBodyFunc body_func,
+                                  gpointer user_data,
+                                  GError **error);
+
+gboolean xfce_mailwatch_http_conn_get_stats(XfceMailwatchHTTPConn *http_conn,
+                                           XfceMailwatchNetConnStats *stats);
+void xfce_mailwatch_http_conn_dump_stats(XfceMailwatchHTTPConn *http_conn,
+                                         const gchar *what,
+                                         gdouble elapsed);
+
+void xfce_mailwatch_http_conn_disconnect(XfceMailwatchHTTPConn *http_conn);
+void xfce_mailwatch_http_conn_destroy(XfceMailwatchHTTPConn *http_conn);
+
+void xfce_mailwatch_http_validators_clear(XfceMailwatchHTTPValidators *validators);
+
+G_END_DECLS
+
+#endif  /* __MAILWATCH_HTTP_H__ */
@@ -34,6 +34,10 @@
 #include <string.h>
 #endif
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -60,6 +64,7 @@
 #include <libxfce4util/libxfce4util.h>
 #include <libxfce4ui/libxfce4ui.h>
 
+#include "mailwatch-common.h"
 #include "mailwatch-net-conn.h"
 #include "mailwatch-utils.h"
 #include "mailwatch.h"
@@ -75,6 +80,53 @@
 #define IMAP_PORT_S              "143"
 #define IMAPS_PORT_S             "993"
 
+#define IMAP_CRLF_LEN            2
+#define IMAP_LITERAL_MAX         (1024 * 1024)
+
+#define IMAP_NOTIFY_WAKEUP       30  /* seconds */
+#define IMAP_NOTIFY_KEEPALIVE    (25 * 60)  /* seconds */
+
+/* a check only opens another connection for every this many folders, and
+ * never more than this many to one server at once */
+#define IMAP_SHARD_MIN_FOLDERS          32
+#define IMAP_MAX_CONNECTIONS_PER_HOST   8
+
+typedef enum
+{
+    IMAP_CAP_STARTTLS       = 1 << 0,
+    IMAP_CAP_LOGINDISABLED  = 1 << 1,
+    IMAP_CAP_AUTH_CRAM_MD5  = 1 << 2,
+    IMAP_CAP_LIST_EXTENDED  = 1 << 3,
+    IMAP_CAP_SPECIAL_USE    = 1 << 4,
+    IMAP_CAP_LIST_STATUS    = 1 << 5,
+    IMAP_CAP_CONDSTORE      = 1 << 6,
+    IMAP_CAP_NOTIFY         = 1 << 7,
+    IMAP_CAP_COMPRESS       = 1 << 8,
+    IMAP_CAP_SASL_IR        = 1 << 9,
+    IMAP_CAP_AUTH_PLAIN     = 1 << 10,
+    IMAP_CAP_LITERAL_PLUS   = 1 << 11,
+} IMAPCapability;
+
+static const struct
+{
+    const gchar *name;
+    IMAPCapability cap;
+} imap_capabilities[] = {
+    { "STARTTLS", IMAP_CAP_STARTTLS },
+    { "LOGINDISABLED", IMAP_CAP_LOGINDISABLED },
+    { "AUTH=CRAM-MD5", IMAP_CAP_AUTH_CRAM_MD5 },
+    { "LIST-EXTENDED", IMAP_CAP_LIST_EXTENDED },
+    { "SPECIAL-USE", IMAP_CAP_SPECIAL_USE },
+    { "LIST-STATUS", IMAP_CAP_LIST_STATUS },
+    { "CONDSTORE", IMAP_CAP_CONDSTORE },
+    { "QRESYNC", IMAP_CAP_CONDSTORE },  /* implies CONDSTORE */
+    { "NOTIFY", IMAP_CAP_NOTIFY },
+    { "COMPRESS=DEFLATE", IMAP_CAP_COMPRESS },
+    { "SASL-IR", IMAP_CAP_SASL_IR },
+    { "AUTH=PLAIN", IMAP_CAP_AUTH_PLAIN },
+    { "LITERAL+", IMAP_CAP_LITERAL_PLUS },
+};
+
 typedef struct
 {
     XfceMailwatchMailbox mailbox;
@@ -92,12 +144,22 @@ typedef struct
     gboolean use_standard_port;
     gint nonstandard_port;
     XfceMailwatchAuthType auth_type;
+    guint max_connections;  /* per check */
     
     /* current connection stuff */
     gint running;
     gpointer th;  /* really a GThread *, but avoids casts later */
-    guint imap_tag;
     guint check_id;
+    GHashTable *folder_states;  /* folder name -> IMAPFolderState */
+    gboolean reported;  /* check thread only */
+    guint config_serial;  /* bumped whenever the account settings change */
+    guint known_caps;  /* what the server offered after the last login */
+    guint known_caps_serial;  /* |config_serial| when |known_caps| was set */
+
+    /* push connection */
+    gint notify_supported;
+    gpointer notify_th;  /* (GThread *) */
+    gint notify_poke;  /* make sure the push connection is still alive */
     
     /* config dlg */
     gint folder_tree_running;
@@ -106,7 +168,8 @@ typedef struct
     GtkTreeStore *ts;
     GtkCellRenderer *render;
     GtkWidget *refresh_btn;
-    GNode *folder_tree;
+    GHashTable *folder_iters;  /* full path -> (GtkTreeIter *) */
+    gint folder_tree_generation;
 } XfceMailwatchIMAPMailbox;
 
 enum
@@ -115,6 +178,7 @@ enum
     IMAP_FOLDERS_WATCHING,
     IMAP_FOLDERS_HOLDS_MESSAGES,
     IMAP_FOLDERS_FULLPATH,
+    IMAP_FOLDERS_SPECIAL_USE,
     IMAP_FOLDERS_N_COLUMNS
 };
 
@@ -123,8 +187,202 @@ typedef struct
     gchar *folder_name;
     gchar *full_path;
     gboolean holds_messages;
+    gboolean special_use;
+
+    /* the LIST entry, if we've had one, for the cache */
+    guint flags;
+    gchar delimiter;
+    gboolean listed;
+    gboolean seen;  /* during revalidation */
 } IMAPFolderData;
 
+/* folders are handed to the config dialog in batches of this size */
+#define IMAP_FOLDER_BATCH_SIZE   250
+
+#define IMAP_FOLDER_CACHE_VERSION 1
+
+typedef struct
+{
+    gchar *folder_name;
+    gchar *full_path;
+    gchar *parent_path;
+    gboolean holds_messages;
+    gboolean special_use;
+    gboolean removed;
+} IMAPFolderUpdate;
+
+typedef struct
+{
+    XfceMailwatchIMAPMailbox *imailbox;
+    gint generation;
+    gboolean first;
+    GPtrArray *folders;  /* IMAPFolderUpdate */
+} IMAPFolderBatch;
+
+typedef struct
+{
+    XfceMailwatchIMAPMailbox *imailbox;
+    const gchar *server_directory;
+    gint generation;
+    GNode *root;
+    GHashTable *nodes;  /* full path -> GNode */
+    IMAPFolderBatch *batch;
+    gboolean sent_batch;
+} IMAPFolderTreeBuilder;
+
+enum
+{
+    IMAP_LIST_NOSELECT      = 1 << 0,
+    IMAP_LIST_NOINFERIORS   = 1 << 1,
+    IMAP_LIST_HASCHILDREN   = 1 << 2,
+    IMAP_LIST_HASNOCHILDREN = 1 << 3,
+    IMAP_LIST_ALL           = 1 << 4,
+    IMAP_LIST_ARCHIVE       = 1 << 5,
+    IMAP_LIST_DRAFTS        = 1 << 6,
+    IMAP_LIST_FLAGGED       = 1 << 7,
+    IMAP_LIST_JUNK          = 1 << 8,
+    IMAP_LIST_SENT          = 1 << 9,
+    IMAP_LIST_TRASH         = 1 << 10,
+};
+
+#define IMAP_LIST_SPECIAL_USE  (IMAP_LIST_ALL | IMAP_LIST_ARCHIVE \
+                                | IMAP_LIST_DRAFTS | IMAP_LIST_FLAGGED \
+                                | IMAP_LIST_JUNK | IMAP_LIST_SENT \
+                                | IMAP_LIST_TRASH)
+
+static const struct
+{
+    const gchar *name;
+    guint flag;
+} imap_list_flags[] = {
+    { "\\Noselect", IMAP_LIST_NOSELECT },
+    { "\\NonExistent", IMAP_LIST_NOSELECT },
+    { "\\NoInferiors", IMAP_LIST_NOINFERIORS },
+    { "\\HasChildren", IMAP_LIST_HASCHILDREN },
+    { "\\HasNoChildren", IMAP_LIST_HASNOCHILDREN },
+    { "\\All", IMAP_LIST_ALL },
+    { "\\Archive", IMAP_LIST_ARCHIVE },
+    { "\\Drafts", IMAP_LIST_DRAFTS },
+    { "\\Flagged", IMAP_LIST_FLAGGED },
+    { "\\Junk", IMAP_LIST_JUNK },
+    { "\\Sent", IMAP_LIST_SENT },
+    { "\\Trash", IMAP_LIST_TRASH },
+};
+
+typedef struct
+{
+    gchar *name;
+    gchar delimiter;
+    guint flags;
+} IMAPListEntry;
+
+enum
+{
+    IMAP_STATUS_UNSEEN        = 1 << 0,
+    IMAP_STATUS_UIDVALIDITY   = 1 << 1,
+    IMAP_STATUS_UIDNEXT       = 1 << 2,
+    IMAP_STATUS_HIGHESTMODSEQ = 1 << 3,
+};
+
+typedef struct
+{
+    guint64 unseen;
+    guint64 uidvalidity;
+    guint64 uidnext;
+    guint64 highestmodseq;
+    guint items;  /* the IMAP_STATUS_* the server actually sent */
+} IMAPStatus;
+
+#define IMAP_STATUS_CONDSTORE_ITEMS  (IMAP_STATUS_UIDVALIDITY \
+                                      | IMAP_STATUS_UIDNEXT \
+                                      | IMAP_STATUS_HIGHESTMODSEQ)
+
+/* what we last saw of a watched folder on a CONDSTORE server; if none of
+ * it has changed, neither has the folder */
+typedef struct
+{
+    guint64 uidvalidity;
+    guint64 uidnext;
+    guint64 highestmodseq;
+} IMAPFolderState;
+
+static const struct
+{
+    const gchar *name;
+    guint item;
+    glong offset;
+} imap_status_items[] = {
+    { "UNSEEN", IMAP_STATUS_UNSEEN, G_STRUCT_OFFSET(IMAPStatus, unseen) },
+    { "UIDVALIDITY", IMAP_STATUS_UIDVALIDITY,
+      G_STRUCT_OFFSET(IMAPStatus, uidvalidity) },
+    { "UIDNEXT", IMAP_STATUS_UIDNEXT, G_STRUCT_OFFSET(IMAPStatus, uidnext) },
+    { "HIGHESTMODSEQ", IMAP_STATUS_HIGHESTMODSEQ,
+      G_STRUCT_OFFSET(IMAPStatus, highestmodseq) },
+};
+
+typedef enum
+{
+    IMAP_TOKEN_ERROR = -1,
+    IMAP_TOKEN_EOL = 0,
+    IMAP_TOKEN_ATOM,
+    IMAP_TOKEN_STRING,      /* quoted; |str| still contains the escapes */
+    IMAP_TOKEN_LITERAL,
+    IMAP_TOKEN_NIL,
+    IMAP_TOKEN_LIST_START,  /* ( */
+    IMAP_TOKEN_LIST_END,    /* ) */
+    IMAP_TOKEN_CODE_START,  /* [ */
+    IMAP_TOKEN_CODE_END,    /* ] */
+} IMAPTokenType;
+
+typedef struct
+{
+    IMAPTokenType type;
+    const gchar *str;  /* not NUL-terminated */
+    gsize len;
+} IMAPToken;
+
+typedef enum
+{
+    IMAP_RESP_ERROR = -1,  /* the connection is no longer usable */
+    IMAP_RESP_OK = 0,
+    IMAP_RESP_NO,
+    IMAP_RESP_BAD,
+    IMAP_RESP_CONTINUE,
+} IMAPRespStatus;
+
+/* per-connection state */
+typedef struct
+{
+    XfceMailwatchNetConn *net_conn;
+    guint tag;
+    guint caps;
+    gboolean have_caps;
+    gboolean authenticated;
+    guint login_tag;  /* a login whose reply we haven't read yet */
+    GString *corked;  /* commands held back to go out in one write */
+
+    /* response reader; |line| points into the net_conn's buffer and holds
+     * either a response line or literal data */
+    const gchar *line;
+    gsize line_len;
+    gsize text_len;  /* |line_len| minus any trailing literal announcement */
+    gsize pos;
+    gsize literal_len;
+    gboolean have_line;
+    gboolean has_literal;
+    gboolean in_literal;
+    gboolean broken;
+} IMAPConn;
+
+/* connections open to each server (lowercased host -> count) */
+static GStaticMutex host_connections_mx = G_STATIC_MUTEX_INIT;
+static GHashTable *host_connections = NULL;
+
+typedef void (*IMAPUntaggedFunc)(XfceMailwatchIMAPMailbox *imailbox,
+                                 IMAPConn *iconn,
+                                 const IMAPToken *name,
+                                 gpointer user_data);
+
 
 static gboolean
 imap_should_continue(XfceMailwatchNetConn *net_conn,
@@ -142,562 +400,2028 @@ imap_folder_tree_should_continue(XfceMailwatchNetConn *net_conn,
     return (gboolean)g_atomic_int_get(&imailbox->folder_tree_running);
 }
 
+static void
+imap_conn_init(IMAPConn *iconn,
+               XfceMailwatchNetConn *net_conn)
+{
+    memset(iconn, 0, sizeof(*iconn));
+    iconn->net_conn = net_conn;
+}
+
+static void
+imap_log_error(XfceMailwatchIMAPMailbox *imailbox,
+               GError *error)
+{
+    xfce_mailwatch_log_message(imailbox->mailwatch,
+                               XFCE_MAILWATCH_MAILBOX(imailbox),
+                               XFCE_MAILWATCH_LOG_ERROR,
+                               "%s", error->message);
+    g_error_free(error);
+}
+
 static gssize
 imap_send(XfceMailwatchIMAPMailbox *imailbox,
-          XfceMailwatchNetConn *net_conn,
+          IMAPConn *iconn,
           const gchar *buf)
 {
     GError *error = NULL;
     gssize sent;
-    
-    sent = xfce_mailwatch_net_conn_send_data(net_conn,
+
+    if(iconn->corked) {
+        g_string_append(iconn->corked, buf);
+        return strlen(buf);
+    }
+
+    sent = xfce_mailwatch_net_conn_send_data(iconn->net_conn,
                                              (guchar *)buf, strlen(buf),
                                              &error);
-    if(sent < 0) {
-        xfce_mailwatch_log_message(imailbox->mailwatch,
-                                   XFCE_MAILWATCH_MAILBOX(imailbox),
-                                   XFCE_MAILWATCH_LOG_ERROR,
-                                   error->message);
-        g_error_free(error);
-    }
-    
+    if(sent < 0)
+        imap_log_error(imailbox, error);
+
     return sent;
 }
 
-static gssize
-imap_recv(XfceMailwatchIMAPMailbox *imailbox,
-          XfceMailwatchNetConn *net_conn,
-          gchar *buf,
-          gsize len)
+/* holds back everything sent from now on, until the next time we wait for
+ * a reply, so that a batch of commands goes out in as few packets as
+ * possible */
+static void
+imap_cork(IMAPConn *iconn)
 {
-    GError *error = NULL;
-    gssize recvd;
-    
-    recvd = xfce_mailwatch_net_conn_recv_line(net_conn,
-                                              buf, len, &error);
-    
-    if(recvd < 0) {
-        xfce_mailwatch_log_message(imailbox->mailwatch,
-                                   XFCE_MAILWATCH_MAILBOX(imailbox),
-                                   XFCE_MAILWATCH_LOG_ERROR,
-                                   error->message);
-        g_error_free(error);
-    }
-
-    if((gsize)recvd == len)
-        return -1;
-
-    buf[recvd] = '\n';
-    buf[++recvd] = 0;
-    
-    return recvd;
+    if(!iconn->corked)
+        iconn->corked = g_string_sized_new(256);
 }
 
-static inline gboolean
-imap_response_fatal(const gchar *msg)
+static gboolean
+imap_uncork(XfceMailwatchIMAPMailbox *imailbox,
+            IMAPConn *iconn)
 {
-    gchar *p;
-
-    /* here we assume that our tags are always 5 digits long,
-     * plus a space. */
+    GString *corked = iconn->corked;
+    gboolean ret = TRUE;
 
-    /* if NO is untagged, the command can still complete */
-    p = strstr(msg, "NO");
-    if(p && p - msg == 6)
+    if(!corked)
         return TRUE;
 
-    /* BAD can be tagged or untagged, but is always a failure */
-    p = strstr(msg, "BAD");
-    if(p && p - msg <= 6)
-        return TRUE;
+    iconn->corked = NULL;
+    if(corked->len && imap_send(imailbox, iconn,
+                                corked->str) != (gssize)corked->len)
+    {
+        iconn->broken = TRUE;
+        ret = FALSE;
+    }
+    g_string_free(corked, TRUE);
 
-    /* BYE as a reasponse to LOGOUT will wait, otherwise will
-     * disconnect at once */
-    p = strstr(msg, "BYE");
-    if(p && p - msg <= 6)
-        return TRUE;
+    return ret;
+}
 
-    return FALSE;
+static guint
+imap_append_command_valist(IMAPConn *iconn,
+                           GString *cmds,
+                           const gchar *fmt,
+                           va_list args)
+{
+    guint tag = ++iconn->tag;
+
+    g_string_append_printf(cmds, "%05u ", tag);
+    g_string_append_vprintf(cmds, fmt, args);
+    g_string_append(cmds, "\r\n");
+
+    return tag;
 }
 
-static gssize
-imap_recv_command(XfceMailwatchIMAPMailbox *imailbox,
-                  XfceMailwatchNetConn *net_conn,
-                  gchar *buf,
-                  gsize len)
+/* sends a tagged command, adding the tag and line terminator.  returns
+ * the tag, or 0 if the send failed. */
+static guint
+imap_send_command(XfceMailwatchIMAPMailbox *imailbox,
+                  IMAPConn *iconn,
+                  const gchar *fmt,
+                  ...)
 {
-    gssize bin, tot = 0;
-    gchar *p;
+    GString *cmd = g_string_sized_new(64);
+    va_list args;
+    guint tag;
+
+    va_start(args, fmt);
+    tag = imap_append_command_valist(iconn, cmd, fmt, args);
+    va_end(args);
+
+    if(imap_send(imailbox, iconn, cmd->str) != (gssize)cmd->len)
+        tag = 0;
+
+    g_string_free(cmd, TRUE);
 
-    if(len)
-        *buf = 0;
+    return tag;
+}
 
-    while(len - tot > 0) {
-        DBG("trying to get line");
-        bin = imap_recv(imailbox, net_conn, buf+tot, len-tot);
-        DBG("got line: %s", bin > 0 ? buf+tot : "(nada)");
-        if(bin <= 0)
-            return -1;
-        if(imap_response_fatal(buf+tot))
-            return -1;
+/* returns |str| as an IMAP quoted string, for use as a command argument */
+static gchar *
+imap_quote_string(const gchar *str)
+{
+    GString *quoted = g_string_sized_new(strlen(str) + 2);
+    const gchar *p;
+
+    g_string_append_c(quoted, '"');
+    for(p = str; *p; p++) {
+        if(*p == '"' || *p == '\\')
+            g_string_append_c(quoted, '\\');
+        g_string_append_c(quoted, *p);
+    }
+    g_string_append_c(quoted, '"');
 
-        p = strstr(buf+tot, "OK");
-        if(p && p - (buf+tot) <= 6)
-            return tot + bin;
+    return g_string_free(quoted, FALSE);
+}
 
-        tot += bin;
+/* returns |str| as a command argument, using a non-synchronizing literal
+ * (RFC 7888) for anything a quoted string can't carry, if the server
+ * takes them */
+static gchar *
+imap_quote_astring(IMAPConn *iconn,
+                   const gchar *str)
+{
+    const guchar *p;
 
-        if(!xfce_mailwatch_net_conn_should_continue(net_conn))
-            return -1;
+    for(p = (const guchar *)str; *p; p++) {
+        if(*p == '\r' || *p == '\n' || *p >= 0x80)
+            break;
     }
 
-    g_critical("imap_recv_command(): buffer full!");
+    if(!*p || !(iconn->caps & IMAP_CAP_LITERAL_PLUS))
+        return imap_quote_string(str);
 
-    return -1;
+    return g_strdup_printf("{%u+}\r\n%s", (guint)strlen(str), str);
 }
 
+/*
+ * response tokenizer.  responses are parsed in place in the net_conn's
+ * receive buffer, one line (or literal) at a time, so memory use is bounded
+ * by the longest line or literal rather than by the size of the response.
+ * tokens point into that buffer and are only valid until the next call
+ * that reads from the connection.
+ */
+
 static gboolean
-imap_send_login_info(XfceMailwatchIMAPMailbox *imailbox,
-                     XfceMailwatchNetConn *net_conn,
-                     const gchar *username,
-                     const gchar *password)
+imap_response_read_line(XfceMailwatchIMAPMailbox *imailbox,
+                        IMAPConn *iconn)
 {
-#define BUFSIZE 8191
-    gint bin, bout;
-    gchar buf[BUFSIZE+1];
-    
-    TRACE("entering");
-    
-    /* check capabilities */
-    g_snprintf(buf, BUFSIZE, "%05d CAPABILITY\r\n", ++imailbox->imap_tag);
-    bout = imap_send(imailbox, net_conn, buf);
-    DBG("sent CAPABILITY (%d)", bout);
-    if(bout != (gint)strlen(buf))
-        goto cleanuperr;
-    bin = imap_recv_command(imailbox, net_conn, buf, BUFSIZE);
-    DBG("response from CAPABILITY (%d): %s", bin, bin>0?buf:"(nada)");
-    if(bin <= 0)
-        goto cleanuperr;
-    
-    if(strstr(buf, "LOGINDISABLED")) {
+    GError *error = NULL;
+    const gchar *line;
+    gsize i, end;
+
+    line = xfce_mailwatch_net_conn_peek_line(iconn->net_conn,
+                                             &iconn->line_len, &error);
+    if(!line) {
+        imap_log_error(imailbox, error);
+        iconn->broken = TRUE;
+        return FALSE;
+    }
+
+    DBG("< %.*s", (gint)iconn->line_len, line);
+
+    iconn->line = line;
+    iconn->text_len = iconn->line_len;
+    iconn->pos = 0;
+    iconn->have_line = TRUE;
+    iconn->in_literal = FALSE;
+    iconn->has_literal = FALSE;
+
+    /* a line ending in "{n}" announces an n-byte literal that follows
+     * the CRLF; the response continues on the line after it. */
+    i = iconn->line_len;
+    if(i < 3 || line[i-1] != '}')
+        return TRUE;
+    end = --i;
+    if(line[i-1] == '+')
+        end = --i;
+    while(i > 0 && g_ascii_isdigit(line[i-1]))
+        --i;
+    if(i == 0 || i == end || end - i > 9 || line[i-1] != '{')
+        return TRUE;
+
+    iconn->literal_len = strtoul(line + i, NULL, 10);
+    if(iconn->literal_len > IMAP_LITERAL_MAX) {
         xfce_mailwatch_log_message(imailbox->mailwatch,
                                    XFCE_MAILWATCH_MAILBOX(imailbox),
                                    XFCE_MAILWATCH_LOG_ERROR,
-                                   _("Secure IMAP is not available, and the IMAP server does not support plaintext logins."));
-        goto cleanuperr;
+                                   _("The IMAP server sent a response that is too large (%lu bytes)"),
+                                   (gulong)iconn->literal_len);
+        iconn->broken = TRUE;
+        return FALSE;
     }
-    
-#ifdef HAVE_SSL_SUPPORT
-    if(strstr(buf, "AUTH=CRAM-MD5")) {
-        /* the server supports CRAM-MD5; prefer that over LOGIN */
-        g_snprintf(buf, BUFSIZE, "%05d AUTHENTICATE CRAM-MD5\r\n",
-                   ++imailbox->imap_tag);
-        bout = imap_send(imailbox, net_conn, buf);
-        if(bout != strlen(buf))
-            goto cleanuperr;
-        
-        bin = imap_recv(imailbox, net_conn, buf, BUFSIZE);
-        DBG("response from AUTHENTICATE CRAM-MD5 (%d): %s\n", bin, bin>0?buf:"(nada)");
-        if(bin <= 0)
-            goto cleanuperr;
 
-        if(*buf == '+' && *(buf+1) == ' ' && *(buf+2)) {
-            gchar *p, *response_base64;
+    iconn->text_len = i - 1;
+    iconn->has_literal = TRUE;
 
-            /* we got a challenge */
-            p = strstr(buf, "\n");
-            if(!p) {
-                DBG("cram-md5 challenge wasn't a full line?");
-                goto cleanuperr;
-            }
-            *p = 0;
+    return TRUE;
+}
 
-            response_base64 = xfce_mailwatch_cram_md5(username, password,
-                                                      buf + 2);
-            if(!response_base64)
-                goto cleanuperr;
-            g_snprintf(buf, BUFSIZE, "%s\r\n", response_base64);
-            g_free(response_base64);
-            bout = imap_send(imailbox, net_conn, buf);
-            DBG("sent CRAM-MD5 response: %s\n", buf);
-            if(bout != strlen(buf))
-                goto cleanuperr;
-
-            bin = imap_recv_command(imailbox, net_conn, buf, BUFSIZE);
-            DBG("reponse from cram-md5 resp (%d): %s\n", bin, bin>0?buf:"(nada)");
-            if(bin <= 0) {
-                if(bin < 0) {
-                    gchar tmp[16];
-                    g_snprintf(tmp, sizeof(tmp), "%05d NO",
-                               imailbox->imap_tag - 1);
-                    if(strstr(buf, tmp)) {
-                        xfce_mailwatch_log_message(imailbox->mailwatch,
-                                                   XFCE_MAILWATCH_MAILBOX(imailbox),
-                                                   XFCE_MAILWATCH_LOG_ERROR,
-                                                   _("Authentication failed.  Perhaps your username or password is incorrect?"));
-                    }
-                }
-                
-                goto cleanuperr;
-            }
+static IMAPTokenType
+imap_response_next_token(XfceMailwatchIMAPMailbox *imailbox,
+                         IMAPConn *iconn,
+                         IMAPToken *token)
+{
+    const gchar *line;
+    gsize i;
+
+    token->str = NULL;
+    token->len = 0;
+    token->type = IMAP_TOKEN_ERROR;
+
+    if(iconn->broken)
+        return IMAP_TOKEN_ERROR;
+
+    token->type = IMAP_TOKEN_EOL;
+    if(!iconn->have_line)
+        return IMAP_TOKEN_EOL;
+
+    if(iconn->in_literal) {
+        /* the literal has been handed out; the response continues on the
+         * next line */
+        xfce_mailwatch_net_conn_consume(iconn->net_conn, iconn->line_len);
+        iconn->have_line = FALSE;
+        if(!imap_response_read_line(imailbox, iconn))
+            return (token->type = IMAP_TOKEN_ERROR);
+    }
+
+    line = iconn->line;
+    while(iconn->pos < iconn->text_len && line[iconn->pos] == ' ')
+        iconn->pos++;
+
+    if(iconn->pos >= iconn->text_len) {
+        GError *error = NULL;
+
+        if(!iconn->has_literal)
+            return IMAP_TOKEN_EOL;
 
-            /* auth successful */
-            TRACE("leaving (success)");
-            return TRUE;
+        xfce_mailwatch_net_conn_consume(iconn->net_conn,
+                                        iconn->line_len + IMAP_CRLF_LEN);
+        iconn->have_line = FALSE;
+        iconn->has_literal = FALSE;
+
+        line = xfce_mailwatch_net_conn_peek_data(iconn->net_conn,
+                                                 iconn->literal_len,
+                                                 &error);
+        if(!line) {
+            imap_log_error(imailbox, error);
+            iconn->broken = TRUE;
+            return (token->type = IMAP_TOKEN_ERROR);
         }
+
+        iconn->line = line;
+        iconn->line_len = iconn->text_len = iconn->pos = iconn->literal_len;
+        iconn->have_line = TRUE;
+        iconn->in_literal = TRUE;
+
+        token->str = line;
+        token->len = iconn->literal_len;
+        return (token->type = IMAP_TOKEN_LITERAL);
     }
-#endif
 
-    /* no cram-md5 support, send the normal creds */
-    g_snprintf(buf, BUFSIZE, "%05d LOGIN \"%s\" \"%s\"\r\n",
-               ++imailbox->imap_tag, username, password);
-    bout = imap_send(imailbox, net_conn, buf);
-    DBG("sent login (%d)", bout);
-    if(bout != (gint)strlen(buf))
-        goto cleanuperr;
-    
-    /* and see if we actually got auth-ed */
-    bin = imap_recv_command(imailbox, net_conn, buf, BUFSIZE);
-    DBG("response from login (%d): %s", bin, bin>0?buf:"(nada)");
-    if(bin <= 0) {
-        if(bin < 0) {
-            gchar tmp[16];
-            g_snprintf(tmp, sizeof(tmp), "%05d NO", imailbox->imap_tag - 1);
-            if(strstr(buf, tmp)) {
-                xfce_mailwatch_log_message(imailbox->mailwatch,
-                                           XFCE_MAILWATCH_MAILBOX(imailbox),
-                                           XFCE_MAILWATCH_LOG_ERROR,
-                                           _("Authentication failed.  Perhaps your username or password is incorrect?"));
+    token->str = line + iconn->pos;
+    token->len = 1;
+
+    switch(line[iconn->pos]) {
+        case '(':
+            token->type = IMAP_TOKEN_LIST_START;
+            break;
+        case ')':
+            token->type = IMAP_TOKEN_LIST_END;
+            break;
+        case '[':
+            token->type = IMAP_TOKEN_CODE_START;
+            break;
+        case ']':
+            token->type = IMAP_TOKEN_CODE_END;
+            break;
+
+        case '"':
+            for(i = iconn->pos + 1; i < iconn->text_len; i++) {
+                if(line[i] == '\\')
+                    i++;
+                else if(line[i] == '"')
+                    break;
             }
-        }
-        goto cleanuperr;
+            if(i >= iconn->text_len) {
+                DBG("unterminated quoted string");
+                iconn->broken = TRUE;
+                return (token->type = IMAP_TOKEN_ERROR);
+            }
+            token->str = line + iconn->pos + 1;
+            token->len = i - iconn->pos - 1;
+            iconn->pos = i;
+            token->type = IMAP_TOKEN_STRING;
+            break;
+
+        default:
+            for(i = iconn->pos; i < iconn->text_len; i++) {
+                if((guchar)line[i] <= ' ' || line[i] == 0x7f
+                   || strchr("()]\"{", line[i]))
+                {
+                    break;
+                }
+            }
+            if(i == iconn->pos) {
+                DBG("unexpected character '%c' in response", line[i]);
+                iconn->broken = TRUE;
+                return (token->type = IMAP_TOKEN_ERROR);
+            }
+            token->len = i - iconn->pos;
+            iconn->pos = i - 1;
+            if(token->len == 3 && !g_ascii_strncasecmp(token->str, "NIL", 3))
+                token->type = IMAP_TOKEN_NIL;
+            else
+                token->type = IMAP_TOKEN_ATOM;
+            break;
     }
-    
-    TRACE("leaving (success)");
-    
-    return TRUE;
-    
-cleanuperr:
 
-    return FALSE;
-#undef BUFSIZE
+    iconn->pos++;
+
+    return token->type;
 }
 
-static gboolean
-imap_negotiate_ssl(XfceMailwatchIMAPMailbox *imailbox,
-                   XfceMailwatchNetConn *net_conn,
-                   const gchar *host)
+/* returns the rest of the current line as a single token, for human-readable
+ * response text that doesn't follow the usual token rules */
+static void
+imap_response_text(IMAPConn *iconn,
+                   IMAPToken *token)
 {
-    gboolean ret;
-    GError *error = NULL;
-    
-    ret = xfce_mailwatch_net_conn_make_secure(net_conn, &error);
-    if(!ret) {
-        xfce_mailwatch_log_message(imailbox->mailwatch,
-                                   XFCE_MAILWATCH_MAILBOX(imailbox),
-                                   XFCE_MAILWATCH_LOG_ERROR,
-                                   _("TLS handshake failed: %s"),
-                                   error->message);
-        g_error_free(error);
-    }
-    
-    return ret;
+    token->type = IMAP_TOKEN_ATOM;
+    token->str = "";
+    token->len = 0;
+
+    if(!iconn->have_line || iconn->in_literal)
+        return;
+
+    if(iconn->pos < iconn->text_len && iconn->line[iconn->pos] == ' ')
+        iconn->pos++;
+
+    token->str = iconn->line + iconn->pos;
+    token->len = iconn->text_len - iconn->pos;
+    iconn->pos = iconn->text_len;
 }
 
+/* skips whatever is left of the current response, including any literals */
 static gboolean
-imap_do_starttls(XfceMailwatchIMAPMailbox *imailbox,
-                 XfceMailwatchNetConn *net_conn,
-                 const gchar *host,
-                 const gchar *username,
-                 const gchar *password)
+imap_response_finish(XfceMailwatchIMAPMailbox *imailbox,
+                     IMAPConn *iconn)
 {
-#define BUFSIZE 8191
-    gint bin;
-    gchar buf[BUFSIZE+1];
-    
-    TRACE("entering");
-    
-    g_snprintf(buf, BUFSIZE, "%05d CAPABILITY\r\n", ++imailbox->imap_tag);
-    if(imap_send(imailbox, net_conn, buf) != (gint)strlen(buf))
-        return FALSE;
-
-    bin = imap_recv_command(imailbox, net_conn, buf, BUFSIZE);
-    DBG("checking for STARTTLS caps (%d): %s", bin, bin>0?buf:"(nada)");
-    if(bin <= 0)
-        return FALSE;
+    IMAPToken token;
 
-    if(!strstr(buf, "STARTTLS")) {
-        xfce_mailwatch_log_message(imailbox->mailwatch,
-                                   XFCE_MAILWATCH_MAILBOX(imailbox),
-                                   XFCE_MAILWATCH_LOG_WARNING,
-                                   _("STARTTLS security was requested, but this server does not support it."));
-        return FALSE;
+    while(iconn->have_line && !iconn->broken) {
+        if(iconn->in_literal || iconn->has_literal) {
+            iconn->pos = iconn->text_len;
+            if(imap_response_next_token(imailbox, iconn,
+                                        &token) == IMAP_TOKEN_ERROR)
+            {
+                return FALSE;
+            }
+        } else {
+            xfce_mailwatch_net_conn_consume(iconn->net_conn,
+                                            iconn->line_len + IMAP_CRLF_LEN);
+            iconn->have_line = FALSE;
+        }
     }
-    
-    g_snprintf(buf, BUFSIZE, "%05d STARTTLS\r\n", ++imailbox->imap_tag);
-    if(imap_send(imailbox, net_conn, buf) != (gint)strlen(buf))
-        return FALSE;
-    
-    if(imap_recv_command(imailbox, net_conn, buf, BUFSIZE) < 0)
-        return FALSE;
-    DBG("got STARTLS response: %s", bin>0?buf:"(nada)");
-    
-    return TRUE;
-#undef BUFSIZE
+
+    return !iconn->broken;
 }
 
 static gboolean
-imap_connect(XfceMailwatchIMAPMailbox *imailbox,
-             XfceMailwatchNetConn *net_conn,
-             const gchar *host,
-             const gchar *service,
-             gint nonstandard_port)
+imap_response_begin(XfceMailwatchIMAPMailbox *imailbox,
+                    IMAPConn *iconn)
 {
-    GError *error = NULL;
-
-    TRACE("entering (%s)", service);
-    
-    g_return_val_if_fail(net_conn, FALSE);
-    
-    xfce_mailwatch_net_conn_set_service(net_conn, service);
-    if(nonstandard_port > 0)
-        xfce_mailwatch_net_conn_set_port(net_conn, nonstandard_port);
-    
-    if(xfce_mailwatch_net_conn_connect(net_conn, &error))
-        return TRUE;
-    else {
-        xfce_mailwatch_log_message(imailbox->mailwatch,
-                                   XFCE_MAILWATCH_MAILBOX(imailbox),
-                                   XFCE_MAILWATCH_LOG_ERROR,
-                                   "%s", error->message);
-        g_error_free(error);
+    if(!imap_response_finish(imailbox, iconn))
         return FALSE;
-    }
+
+    return imap_response_read_line(imailbox, iconn);
 }
 
 static inline gboolean
-imap_slurp_banner(XfceMailwatchIMAPMailbox *imailbox,
-                  XfceMailwatchNetConn *net_conn)
+imap_token_is(const IMAPToken *token,
+              const gchar *atom)
 {
-    gchar buf[2048];
-    gint bin;
-    
-    bin = imap_recv_command(imailbox, net_conn, buf, sizeof(buf));
-    if(bin < 0) {
-        DBG("failed to get banner");
-    } else {
-        DBG("got banner, discarding: %s\n", buf);
-    }
-    
-    return (bin != -1);
+    return token->type == IMAP_TOKEN_ATOM
+           && token->len == strlen(atom)
+           && !g_ascii_strncasecmp(token->str, atom, token->len);
+}
+
+static gboolean
+imap_token_to_uint64(const IMAPToken *token,
+                     guint64 *value)
+{
+    gsize i;
+
+    if(token->type != IMAP_TOKEN_ATOM || token->len > 20)
+        return FALSE;
+
+    *value = 0;
+    for(i = 0; i < token->len; i++) {
+        if(!g_ascii_isdigit(token->str[i]))
+            return FALSE;
+        *value = *value * 10 + (token->str[i] - '0');
+    }
+
+    return TRUE;
+}
+
+/* returns a newly-allocated copy of a string-ish token, with any quoting
+ * removed, or NULL if the token isn't a string */
+static gchar *
+imap_token_dup(const IMAPToken *token)
+{
+    gchar *str, *q;
+    gsize i;
+
+    switch(token->type) {
+        case IMAP_TOKEN_ATOM:
+        case IMAP_TOKEN_LITERAL:
+            return g_strndup(token->str, token->len);
+
+        case IMAP_TOKEN_STRING:
+            q = str = g_malloc(token->len + 1);
+            for(i = 0; i < token->len; i++) {
+                if(token->str[i] == '\\' && i + 1 < token->len)
+                    i++;
+                *q++ = token->str[i];
+            }
+            *q = 0;
+            return str;
+
+        default:
+            return NULL;
+    }
+}
+
+/* parses a capability list, up to the end of the line or the end of a
+ * [CAPABILITY ...] response code */
+static void
+imap_parse_capabilities(XfceMailwatchIMAPMailbox *imailbox,
+                        IMAPConn *iconn)
+{
+    IMAPToken token;
+    guint i;
+
+    iconn->caps = 0;
+    iconn->have_caps = TRUE;
+
+    while(imap_response_next_token(imailbox, iconn,
+                                   &token) == IMAP_TOKEN_ATOM)
+    {
+        for(i = 0; i < G_N_ELEMENTS(imap_capabilities); i++) {
+            if(imap_token_is(&token, imap_capabilities[i].name)) {
+                iconn->caps |= imap_capabilities[i].cap;
+                break;
+            }
+        }
+    }
+
+    DBG("server capabilities: 0x%x", iconn->caps);
+}
+
+/* parses the rest of an OK/NO/BAD/PREAUTH/BYE response: an optional
+ * response code, and human-readable text */
+static void
+imap_parse_resp_text(XfceMailwatchIMAPMailbox *imailbox,
+                     IMAPConn *iconn,
+                     gchar **text)
+{
+    IMAPToken token;
+    IMAPTokenType type;
+
+    while(iconn->have_line && iconn->pos < iconn->text_len
+          && iconn->line[iconn->pos] == ' ')
+    {
+        iconn->pos++;
+    }
+
+    if(iconn->have_line && iconn->pos < iconn->text_len
+       && iconn->line[iconn->pos] == '[')
+    {
+        imap_response_next_token(imailbox, iconn, &token);
+        type = imap_response_next_token(imailbox, iconn, &token);
+        if(imap_token_is(&token, "CAPABILITY"))
+            imap_parse_capabilities(imailbox, iconn);
+        else {
+            while(type != IMAP_TOKEN_CODE_END && type != IMAP_TOKEN_EOL
+                  && type != IMAP_TOKEN_ERROR)
+            {
+                type = imap_response_next_token(imailbox, iconn, &token);
+            }
+        }
+    }
+
+    if(text) {
+        imap_response_text(iconn, &token);
+        *text = g_strndup(token.str, token.len);
+    }
+}
+
+/* handles the rest of an untagged response, after the "*".  returns FALSE
+ * if the connection can't be used anymore. */
+static gboolean
+imap_handle_untagged(XfceMailwatchIMAPMailbox *imailbox,
+                     IMAPConn *iconn,
+                     IMAPUntaggedFunc func,
+                     gpointer user_data)
+{
+    IMAPToken token;
+
+    if(imap_response_next_token(imailbox, iconn, &token) != IMAP_TOKEN_ATOM)
+        return FALSE;
+
+    if(imap_token_is(&token, "BYE")) {
+        gchar *bye_text = NULL;
+
+        imap_parse_resp_text(imailbox, iconn, &bye_text);
+        xfce_mailwatch_log_message(imailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(imailbox),
+                                   XFCE_MAILWATCH_LOG_WARNING,
+                                   _("The IMAP server closed the connection: %s"),
+                                   bye_text);
+        g_free(bye_text);
+        return FALSE;
+    } else if(imap_token_is(&token, "OK")
+              || imap_token_is(&token, "NO")
+              || imap_token_is(&token, "BAD")
+              || imap_token_is(&token, "PREAUTH"))
+    {
+        imap_parse_resp_text(imailbox, iconn, NULL);
+    } else if(imap_token_is(&token, "CAPABILITY"))
+        imap_parse_capabilities(imailbox, iconn);
+    else if(func)
+        func(imailbox, iconn, &token, user_data);
+
+    return !iconn->broken;
+}
+
+/* reads responses until the tagged completion response for |tag| arrives.
+ * untagged responses are passed to |func| (if not handled here), and the
+ * responses to other tags are skipped.  a continuation request stops the
+ * loop, and the caller can fetch the request text with
+ * imap_response_text(). */
+static IMAPRespStatus
+imap_wait_tagged(XfceMailwatchIMAPMailbox *imailbox,
+                 IMAPConn *iconn,
+                 guint tag,
+                 IMAPUntaggedFunc func,
+                 gpointer user_data,
+                 gchar **text)
+{
+    IMAPToken token;
+    gchar tagstr[16];
+    gsize tag_len;
+
+    tag_len = g_snprintf(tagstr, sizeof(tagstr), "%05u", tag);
+
+    if(!imap_uncork(imailbox, iconn))
+        return IMAP_RESP_ERROR;
+
+    for(;;) {
+        if(!imap_response_begin(imailbox, iconn))
+            return IMAP_RESP_ERROR;
+
+        if(imap_response_next_token(imailbox, iconn,
+                                    &token) != IMAP_TOKEN_ATOM)
+        {
+            DBG("response doesn't start with a tag");
+            return IMAP_RESP_ERROR;
+        }
+
+        if(imap_token_is(&token, "+"))
+            return IMAP_RESP_CONTINUE;
+
+        if(imap_token_is(&token, "*")) {
+            if(!imap_handle_untagged(imailbox, iconn, func, user_data))
+                return IMAP_RESP_ERROR;
+            continue;
+        }
+
+        if(token.len == tag_len && !strncmp(token.str, tagstr, tag_len)) {
+            IMAPRespStatus status;
+
+            imap_response_next_token(imailbox, iconn, &token);
+            if(imap_token_is(&token, "OK"))
+                status = IMAP_RESP_OK;
+            else if(imap_token_is(&token, "NO"))
+                status = IMAP_RESP_NO;
+            else if(imap_token_is(&token, "BAD"))
+                status = IMAP_RESP_BAD;
+            else
+                return IMAP_RESP_ERROR;
+
+            imap_parse_resp_text(imailbox, iconn, text);
+
+            return iconn->broken ? IMAP_RESP_ERROR : status;
+        }
+
+        DBG("skipping response to another command (%.*s)",
+            (gint)token.len, token.str);
+    }
+}
+
+/* asks for the server's capabilities, unless we already know them */
+static gboolean
+imap_ensure_capabilities(XfceMailwatchIMAPMailbox *imailbox,
+                         IMAPConn *iconn)
+{
+    guint tag;
+
+    if(iconn->have_caps)
+        return TRUE;
+
+    tag = imap_send_command(imailbox, iconn, "CAPABILITY");
+    DBG("sent CAPABILITY (%u)", tag);
+    if(!tag || imap_wait_tagged(imailbox, iconn, tag, NULL, NULL,
+                                NULL) != IMAP_RESP_OK)
+    {
+        return FALSE;
+    }
+
+    return iconn->have_caps;
+}
+
+/* reads the reply to the login sent by imap_send_login_info() */
+static gboolean
+imap_finish_login(XfceMailwatchIMAPMailbox *imailbox,
+                  IMAPConn *iconn)
+{
+    IMAPRespStatus status;
+
+    if(!iconn->login_tag)
+        return iconn->authenticated;
+
+    status = imap_wait_tagged(imailbox, iconn, iconn->login_tag, NULL, NULL,
+                              NULL);
+    iconn->login_tag = 0;
+    DBG("response from login (%d)", status);
+    if(status == IMAP_RESP_NO) {
+        xfce_mailwatch_log_message(imailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(imailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   _("Authentication failed.  Perhaps your username or password is incorrect?"));
+    }
+
+    TRACE("leaving (%d)", status);
+
+    iconn->authenticated = (status == IMAP_RESP_OK);
+
+    return iconn->authenticated;
+}
+
+/* logs in.  if |defer| is set and the login can be done in a single
+ * command, the command is only queued: the caller can put more commands
+ * behind it before reading the reply with imap_finish_login(). */
+static gboolean
+imap_send_login_info(XfceMailwatchIMAPMailbox *imailbox,
+                     IMAPConn *iconn,
+                     const gchar *username,
+                     const gchar *password,
+                     gboolean defer)
+{
+    gchar *quoted_username, *quoted_password;
+    guint tag;
+
+    TRACE("entering");
+
+    /* check capabilities; usually the greeting had them already */
+    if(!imap_ensure_capabilities(imailbox, iconn))
+        return FALSE;
+
+    if(iconn->caps & IMAP_CAP_LOGINDISABLED) {
+        xfce_mailwatch_log_message(imailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(imailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   _("Secure IMAP is not available, and the IMAP server does not support plaintext logins."));
+        return FALSE;
+    }
+
+#ifdef HAVE_SSL_SUPPORT
+    /* the server supports CRAM-MD5; prefer that over LOGIN, unless the
+     * connection is already encrypted, in which case the challenge is
+     * just an extra round trip */
+    if((iconn->caps & IMAP_CAP_AUTH_CRAM_MD5)
+       && !xfce_mailwatch_net_conn_is_secure(iconn->net_conn))
+    {
+        IMAPRespStatus status;
+
+        /* the capabilities may change once we're logged in. */
+        iconn->have_caps = FALSE;
+        tag = imap_send_command(imailbox, iconn, "AUTHENTICATE CRAM-MD5");
+        if(!tag)
+            return FALSE;
+
+        status = imap_wait_tagged(imailbox, iconn, tag, NULL, NULL, NULL);
+        DBG("response from AUTHENTICATE CRAM-MD5 (%d)", status);
+        if(status == IMAP_RESP_ERROR)
+            return FALSE;
+
+        if(status == IMAP_RESP_CONTINUE) {
+            IMAPToken challenge;
+            gchar *challenge_str, *response_base64, *buf;
+            gssize bout;
+
+            /* we got a challenge */
+            imap_response_text(iconn, &challenge);
+            challenge_str = g_strndup(challenge.str, challenge.len);
+            response_base64 = xfce_mailwatch_cram_md5(username, password,
+                                                      challenge_str);
+            g_free(challenge_str);
+            if(!response_base64)
+                return FALSE;
+
+            buf = g_strconcat(response_base64, "\r\n", NULL);
+            g_free(response_base64);
+            bout = imap_send(imailbox, iconn, buf);
+            DBG("sent CRAM-MD5 response: %s", buf);
+            if(bout != (gssize)strlen(buf)) {
+                g_free(buf);
+                return FALSE;
+            }
+            g_free(buf);
+
+            /* auth successful? */
+            iconn->login_tag = tag;
+            return imap_finish_login(imailbox, iconn);
+        }
+    }
+#endif
+
+    if(defer)
+        imap_cork(iconn);
+
+    if((iconn->caps & (IMAP_CAP_SASL_IR | IMAP_CAP_AUTH_PLAIN))
+       == (IMAP_CAP_SASL_IR | IMAP_CAP_AUTH_PLAIN))
+    {
+        /* PLAIN with an initial response (RFC 4959) takes no more round
+         * trips than LOGIN, and has no trouble with 8-bit passwords */
+        gsize username_len = strlen(username), password_len = strlen(password);
+        guchar *plain = g_malloc(username_len + password_len + 2);
+        gchar *plain_base64;
+
+        plain[0] = 0;
+        memcpy(plain + 1, username, username_len);
+        plain[username_len + 1] = 0;
+        memcpy(plain + username_len + 2, password, password_len);
+        plain_base64 = g_base64_encode(plain, username_len + password_len + 2);
+        memset(plain, 0, username_len + password_len + 2);
+        g_free(plain);
+
+        iconn->have_caps = FALSE;
+        tag = imap_send_command(imailbox, iconn, "AUTHENTICATE PLAIN %s",
+                                plain_base64);
+        g_free(plain_base64);
+        DBG("sent AUTHENTICATE PLAIN (%u)", tag);
+    } else {
+        /* no cram-md5 support, send the normal creds */
+        quoted_username = imap_quote_astring(iconn, username);
+        quoted_password = imap_quote_astring(iconn, password);
+        iconn->have_caps = FALSE;
+        tag = imap_send_command(imailbox, iconn, "LOGIN %s %s",
+                                quoted_username, quoted_password);
+        g_free(quoted_username);
+        g_free(quoted_password);
+        DBG("sent login (%u)", tag);
+    }
+    if(!tag)
+        return FALSE;
+
+    /* and see if we actually got auth-ed */
+    iconn->login_tag = tag;
+    if(defer)
+        return TRUE;
+
+    return imap_finish_login(imailbox, iconn);
+}
+
+static gboolean
+imap_negotiate_ssl(XfceMailwatchIMAPMailbox *imailbox,
+                   IMAPConn *iconn,
+                   const gchar *host)
+{
+    gboolean ret;
+    GError *error = NULL;
+
+    ret = xfce_mailwatch_net_conn_make_secure(iconn->net_conn, &error);
+    if(!ret) {
+        xfce_mailwatch_log_message(imailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(imailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   _("TLS handshake failed: %s"),
+                                   error->message);
+        g_error_free(error);
+    }
+
+    /* anything we learned before the handshake can't be trusted */
+    iconn->caps = 0;
+    iconn->have_caps = FALSE;
+
+    return ret;
+}
+
+static gboolean
+imap_do_starttls(XfceMailwatchIMAPMailbox *imailbox,
+                 IMAPConn *iconn,
+                 const gchar *host,
+                 const gchar *username,
+                 const gchar *password)
+{
+    guint tag;
+
+    TRACE("entering");
+
+    if(!imap_ensure_capabilities(imailbox, iconn))
+        return FALSE;
+
+    DBG("checking for STARTTLS caps: 0x%x", iconn->caps);
+    if(!(iconn->caps & IMAP_CAP_STARTTLS)) {
+        xfce_mailwatch_log_message(imailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(imailbox),
+                                   XFCE_MAILWATCH_LOG_WARNING,
+                                   _("STARTTLS security was requested, but this server does not support it."));
+        return FALSE;
+    }
+
+    tag = imap_send_command(imailbox, iconn, "STARTTLS");
+    if(!tag || imap_wait_tagged(imailbox, iconn, tag, NULL, NULL,
+                                NULL) != IMAP_RESP_OK)
+    {
+        return FALSE;
+    }
+    DBG("got STARTLS response");
+
+    /* the OK has to be off the buffer before the handshake starts */
+    if(!imap_response_finish(imailbox, iconn))
+        return FALSE;
+
+    return TRUE;
+}
+
+static gboolean
+imap_connect(XfceMailwatchIMAPMailbox *imailbox,
+             IMAPConn *iconn,
+             const gchar *host,
+             const gchar *service,
+             gint nonstandard_port)
+{
+    GError *error = NULL;
+
+    TRACE("entering (%s)", service);
+
+    g_return_val_if_fail(iconn && iconn->net_conn, FALSE);
+
+    xfce_mailwatch_net_conn_set_service(iconn->net_conn, service);
+    if(nonstandard_port > 0)
+        xfce_mailwatch_net_conn_set_port(iconn->net_conn, nonstandard_port);
+
+    if(xfce_mailwatch_net_conn_connect(iconn->net_conn, &error))
+        return TRUE;
+    else {
+        imap_log_error(imailbox, error);
+        return FALSE;
+    }
+}
+
+static gboolean
+imap_slurp_banner(XfceMailwatchIMAPMailbox *imailbox,
+                  IMAPConn *iconn)
+{
+    IMAPToken token;
+
+    if(!imap_response_begin(imailbox, iconn)
+       || imap_response_next_token(imailbox, iconn, &token) != IMAP_TOKEN_ATOM
+       || !imap_token_is(&token, "*")
+       || imap_response_next_token(imailbox, iconn, &token) != IMAP_TOKEN_ATOM)
+    {
+        DBG("failed to get banner");
+        return FALSE;
+    }
+
+    if(imap_token_is(&token, "PREAUTH"))
+        iconn->authenticated = TRUE;
+    else if(!imap_token_is(&token, "OK")) {
+        gchar *text = NULL;
+
+        imap_parse_resp_text(imailbox, iconn, &text);
+        xfce_mailwatch_log_message(imailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(imailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   _("The IMAP server refused the connection: %s"),
+                                   text);
+        g_free(text);
+        return FALSE;
+    }
+
+    imap_parse_resp_text(imailbox, iconn, NULL);
+    DBG("got banner");
+
+    return !iconn->broken;
 }
 
 static gboolean
 imap_authenticate(XfceMailwatchIMAPMailbox *imailbox,
-                  XfceMailwatchNetConn *net_conn,
+                  IMAPConn *iconn,
                   const gchar *host,
                   const gchar *username,
                   const gchar *password,
                   XfceMailwatchAuthType auth_type,
-                  gint nonstandard_port)
+                  gint nonstandard_port,
+                  gboolean defer_login)
+{
+    gboolean ret = FALSE;
+
+    g_return_val_if_fail(iconn && host && username && password, FALSE);
+
+    TRACE("entering, auth_type is %d", auth_type);
+
+    switch(auth_type) {
+        case AUTH_NONE:
+            ret = imap_connect(imailbox, iconn, host, "imap", nonstandard_port);
+            if(ret)
+                ret = imap_slurp_banner(imailbox, iconn);
+            break;
+
+        case AUTH_STARTTLS:
+            ret = imap_connect(imailbox, iconn, host, "imap", nonstandard_port);
+            if(ret)
+                ret = imap_slurp_banner(imailbox, iconn);
+            if(ret)
+                ret = imap_do_starttls(imailbox, iconn, host, username, password);
+            if(ret)
+                ret = imap_negotiate_ssl(imailbox, iconn, host);
+            /* a PREAUTH greeting doesn't carry over into the TLS session */
+            iconn->authenticated = FALSE;
+            break;
+
+        case AUTH_SSL_PORT:
+            ret = imap_connect(imailbox, iconn, host, "imaps", nonstandard_port);
+            if(ret)
+                ret = imap_negotiate_ssl(imailbox, iconn, host);
+            if(ret)
+                ret = imap_slurp_banner(imailbox, iconn);
+            break;
+
+        default:
+            g_critical("XfceMailwatchIMAPMailbox: Unknown auth type (%d)", auth_type);
+            return FALSE;
+    }
+
+    if(ret && !iconn->authenticated)
+       ret = imap_send_login_info(imailbox, iconn, username, password,
+                                  defer_login);
+
+    return ret;
+}
+
+/* turns on COMPRESS=DEFLATE (RFC 4978) if the server offers it.  a refusal
+ * isn't an error: the connection just stays uncompressed.  returns FALSE
+ * only if the connection is no longer usable. */
+static gboolean
+imap_enable_compression(XfceMailwatchIMAPMailbox *imailbox,
+                        IMAPConn *iconn)
+{
+#ifdef HAVE_ZLIB
+    GError *error = NULL;
+    guint tag;
+
+    if(!imap_ensure_capabilities(imailbox, iconn))
+        return FALSE;
+    if(!(iconn->caps & IMAP_CAP_COMPRESS)
+       || xfce_mailwatch_net_conn_is_compressed(iconn->net_conn))
+    {
+        return TRUE;
+    }
+
+    tag = imap_send_command(imailbox, iconn, "COMPRESS DEFLATE");
+    if(!tag)
+        return FALSE;
+    if(imap_wait_tagged(imailbox, iconn, tag, NULL, NULL,
+                        NULL) != IMAP_RESP_OK)
+    {
+        return !iconn->broken;
+    }
+
+    /* everything after the OK is compressed */
+    if(!imap_response_finish(imailbox, iconn))
+        return FALSE;
+
+    if(!xfce_mailwatch_net_conn_start_compression(iconn->net_conn, &error)) {
+        /* the server has already switched, so there's no going back */
+        imap_log_error(imailbox, error);
+        iconn->broken = TRUE;
+        return FALSE;
+    }
+
+    DBG("COMPRESS=DEFLATE enabled");
+#endif
+
+    return TRUE;
+}
+
+/* parses the rest of an untagged STATUS response into |status|, and
+ * optionally returns the mailbox name */
+static gboolean
+imap_parse_status_entry(XfceMailwatchIMAPMailbox *imailbox,
+                        IMAPConn *iconn,
+                        const IMAPToken *name,
+                        gchar **mailbox,
+                        IMAPStatus *status)
+{
+    IMAPToken token;
+    IMAPTokenType type;
+    guint64 value;
+    guint i;
+
+    /* * STATUS <mailbox> (<item> <value> ...) */
+    if(!imap_token_is(name, "STATUS"))
+        return FALSE;
+
+    type = imap_response_next_token(imailbox, iconn, &token);
+    if(type != IMAP_TOKEN_ATOM && type != IMAP_TOKEN_STRING
+       && type != IMAP_TOKEN_LITERAL)
+    {
+        return FALSE;
+    }
+    if(mailbox)
+        *mailbox = imap_token_dup(&token);
+
+    memset(status, 0, sizeof(*status));
+
+    if(imap_response_next_token(imailbox, iconn,
+                                &token) == IMAP_TOKEN_LIST_START)
+    {
+        while(imap_response_next_token(imailbox, iconn,
+                                       &token) == IMAP_TOKEN_ATOM)
+        {
+            for(i = 0; i < G_N_ELEMENTS(imap_status_items); i++) {
+                if(imap_token_is(&token, imap_status_items[i].name))
+                    break;
+            }
+            if(imap_response_next_token(imailbox, iconn,
+                                        &token) != IMAP_TOKEN_ATOM)
+            {
+                break;
+            }
+            if(i < G_N_ELEMENTS(imap_status_items)
+               && imap_token_to_uint64(&token, &value))
+            {
+                G_STRUCT_MEMBER(guint64, status, imap_status_items[i].offset) = value;
+                status->items |= imap_status_items[i].item;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+imap_parse_status_response(XfceMailwatchIMAPMailbox *imailbox,
+                           IMAPConn *iconn,
+                           const IMAPToken *name,
+                           gpointer user_data)
+{
+    IMAPStatus *status = user_data, entry_status;
+
+    if(imap_parse_status_entry(imailbox, iconn, name, NULL, &entry_status))
+        *status = entry_status;
+}
+
+/* the STATUS items to ask for each poll */
+static const gchar *
+imap_status_items_for(guint caps)
+{
+    if(caps & IMAP_CAP_CONDSTORE)
+        return "UNSEEN HIGHESTMODSEQ UIDNEXT UIDVALIDITY";
+    else
+        return "UNSEEN";
+}
+
+/* records the latest |status| of |mailbox_name|, returning FALSE if the
+ * folder provably hasn't changed since the last time we looked */
+static gboolean
+imap_folder_state_update(XfceMailwatchIMAPMailbox *imailbox,
+                         const gchar *mailbox_name,
+                         const IMAPStatus *status)
+{
+    IMAPFolderState *state;
+    gboolean changed = TRUE;
+
+    /* a folder without persistent mod-sequences doesn't send
+     * HIGHESTMODSEQ, so we can never tell */
+    if((status->items & IMAP_STATUS_CONDSTORE_ITEMS) != IMAP_STATUS_CONDSTORE_ITEMS)
+        return TRUE;
+
+    g_mutex_lock(imailbox->config_mx);
+
+    state = g_hash_table_lookup(imailbox->folder_states, mailbox_name);
+    if(!state) {
+        state = g_new0(IMAPFolderState, 1);
+        g_hash_table_insert(imailbox->folder_states, g_strdup(mailbox_name),
+                            state);
+    } else if(state->uidvalidity == status->uidvalidity
+              && state->uidnext == status->uidnext
+              && state->highestmodseq == status->highestmodseq)
+    {
+        changed = FALSE;
+    }
+
+    state->uidvalidity = status->uidvalidity;
+    state->uidnext = status->uidnext;
+    state->highestmodseq = status->highestmodseq;
+
+    g_mutex_unlock(imailbox->config_mx);
+
+    return changed;
+}
+
+/* the server may send INBOX back in any case */
+static const gchar *
+imap_canonical_mailbox_name(const gchar *mailbox_name)
+{
+    return g_ascii_strcasecmp(mailbox_name, "INBOX") ? mailbox_name : "INBOX";
+}
+
+/* the unseen counts of a set of folders, asked for all at once */
+typedef struct
+{
+    GHashTable *pending;  /* watched folders we haven't had a count for */
+    GList *listed;  /* the folders asked for with LIST-STATUS */
+    guint list_tag;
+    guint status_tag;  /* the last of the STATUS commands */
+    guint caps;  /* what the commands were picked for */
+    GHashTable *counts;  /* folder -> GUINT_TO_POINTER(unseen) */
+    guint new_messages;
+    gboolean changed;
+} IMAPStatusBatch;
+
+/* takes the STATUS responses to both LIST-STATUS and plain STATUS; the
+ * LIST responses themselves aren't interesting */
+static void
+imap_parse_status_batch_response(XfceMailwatchIMAPMailbox *imailbox,
+                                 IMAPConn *iconn,
+                                 const IMAPToken *name,
+                                 gpointer user_data)
 {
-    gboolean ret = FALSE;
+    IMAPStatusBatch *batch = user_data;
+    IMAPStatus status;
+    gchar *mailbox_name = NULL;
+    gpointer key;
 
-    g_return_val_if_fail(net_conn && host && username && password, FALSE);
-    
-    TRACE("entering, auth_type is %d", auth_type);
-    
-    switch(auth_type) {
-        case AUTH_NONE:
-            ret = imap_connect(imailbox, net_conn, host, "imap", nonstandard_port);
-            if(ret)
-                ret = imap_slurp_banner(imailbox, net_conn);
-            break;
-        
-        case AUTH_STARTTLS:
-            ret = imap_connect(imailbox, net_conn, host, "imap", nonstandard_port);
-            if(ret)
-                ret = imap_slurp_banner(imailbox, net_conn);
-            if(ret)
-                ret = imap_do_starttls(imailbox, net_conn, host, username, password);
-            if(ret)
-                ret = imap_negotiate_ssl(imailbox, net_conn, host);
-            break;
-        
-        case AUTH_SSL_PORT:
-            ret = imap_connect(imailbox, net_conn, host, "imaps", nonstandard_port);
-            if(ret)
-                ret = imap_negotiate_ssl(imailbox, net_conn, host);
-            if(ret)
-                ret = imap_slurp_banner(imailbox, net_conn);
-            break;
-        
-        default:
-            g_critical("XfceMailwatchIMAPMailbox: Unknown auth type (%d)", auth_type);
+    if(!imap_parse_status_entry(imailbox, iconn, name, &mailbox_name, &status))
+        return;
+
+    if((status.items & IMAP_STATUS_UNSEEN)
+       && g_hash_table_lookup_extended(batch->pending,
+                                       imap_canonical_mailbox_name(mailbox_name),
+                                       &key, NULL))
+    {
+        DBG("new message count in mailbox '%s' is %d", mailbox_name,
+            (gint)status.unseen);
+        g_hash_table_remove(batch->pending, key);
+        batch->new_messages += (guint)status.unseen;
+        g_hash_table_replace(batch->counts, key,
+                             GUINT_TO_POINTER((guint)status.unseen));
+        if(imap_folder_state_update(imailbox, mailbox_name, &status))
+            batch->changed = TRUE;
+        else
+            DBG("mailbox '%s' is unchanged", mailbox_name);
+    }
+
+    g_free(mailbox_name);
+}
+
+static gboolean
+imap_status_batch_send_status(XfceMailwatchIMAPMailbox *imailbox,
+                              IMAPConn *iconn,
+                              IMAPStatusBatch *batch,
+                              GList *mailboxes)
+{
+    GList *l;
+    gchar *quoted_name;
+
+    imap_cork(iconn);
+
+    for(l = mailboxes; l; l = l->next) {
+        quoted_name = imap_quote_string(l->data);
+        batch->status_tag = imap_send_command(imailbox, iconn,
+                                              "STATUS %s (%s)", quoted_name,
+                                              imap_status_items_for(batch->caps));
+        g_free(quoted_name);
+        if(!batch->status_tag)
             return FALSE;
+
+        g_hash_table_insert(batch->pending,
+                            (gpointer)imap_canonical_mailbox_name(l->data),
+                            GINT_TO_POINTER(1));
     }
-    
+
+    return TRUE;
+}
+
+/* sends the commands for the unseen counts of all of |mailboxes|, picked
+ * by |caps|: one LIST-STATUS (RFC 5819) command if the server can do it,
+ * and a STATUS per folder otherwise.  folders whose names contain LIST
+ * wildcards can't be asked for exactly with LIST, so they always get a
+ * STATUS.  nothing is read until imap_status_batch_finish(), so the
+ * commands can go out behind a login that's still in flight. */
+static gboolean
+imap_status_batch_send(XfceMailwatchIMAPMailbox *imailbox,
+                       IMAPConn *iconn,
+                       IMAPStatusBatch *batch,
+                       GList *mailboxes,
+                       guint caps)
+{
+    GList *l, *per_folder = NULL;
+    GString *patterns;
+    gchar *quoted_name;
+    gboolean ret = TRUE;
+
+    TRACE("entering");
+
+    memset(batch, 0, sizeof(*batch));
+    batch->pending = g_hash_table_new(g_str_hash, g_str_equal);
+    batch->counts = g_hash_table_new(g_str_hash, g_str_equal);
+    batch->caps = caps;
+
+    imap_cork(iconn);
+
+    patterns = g_string_new(NULL);
+    for(l = mailboxes; l; l = l->next) {
+        const gchar *mailbox_name = l->data;
+
+        if(!(caps & IMAP_CAP_LIST_STATUS) || strpbrk(mailbox_name, "*%")) {
+            per_folder = g_list_prepend(per_folder, l->data);
+            continue;
+        }
+
+        quoted_name = imap_quote_string(mailbox_name);
+        g_string_append_printf(patterns, "%s%s", patterns->len ? " " : "",
+                               quoted_name);
+        g_free(quoted_name);
+
+        batch->listed = g_list_prepend(batch->listed, l->data);
+        g_hash_table_insert(batch->pending,
+                            (gpointer)imap_canonical_mailbox_name(mailbox_name),
+                            GINT_TO_POINTER(1));
+    }
+
+    if(patterns->len) {
+        batch->list_tag = imap_send_command(imailbox, iconn,
+                                            "LIST \"\" (%s) RETURN (STATUS (%s))",
+                                            patterns->str,
+                                            imap_status_items_for(caps));
+        ret = (batch->list_tag != 0);
+    }
+    g_string_free(patterns, TRUE);
+
+    per_folder = g_list_reverse(per_folder);
     if(ret)
-       ret = imap_send_login_info(imailbox, net_conn, username, password);
+        ret = imap_status_batch_send_status(imailbox, iconn, batch, per_folder);
+    g_list_free(per_folder);
 
     return ret;
 }
 
+/* reads the replies to imap_status_batch_send().  a folder the server
+ * didn't give a count for doesn't exist or can't hold messages, just as a
+ * failed STATUS would have told us; but if the LIST-STATUS failed, or
+ * the commands were picked before the login and the server offers
+ * something different now, those folders get one more try. */
+static gboolean
+imap_status_batch_finish(XfceMailwatchIMAPMailbox *imailbox,
+                         IMAPConn *iconn,
+                         IMAPStatusBatch *batch)
+{
+    IMAPRespStatus status;
+    GList *retry;
+    gboolean list_failed = FALSE, retried = FALSE, ret;
+
+    for(;;) {
+        if(batch->list_tag) {
+            status = imap_wait_tagged(imailbox, iconn, batch->list_tag,
+                                      imap_parse_status_batch_response,
+                                      batch, NULL);
+            DBG("LIST-STATUS finished (%d)", status);
+            batch->list_tag = 0;
+            if(status == IMAP_RESP_ERROR)
+                return FALSE;
+            list_failed = (status != IMAP_RESP_OK);
+        }
+
+        if(batch->status_tag) {
+            status = imap_wait_tagged(imailbox, iconn, batch->status_tag,
+                                      imap_parse_status_batch_response,
+                                      batch, NULL);
+            DBG("STATUS batch finished (%d)", status);
+            batch->status_tag = 0;
+            if(status == IMAP_RESP_ERROR)
+                return FALSE;
+        }
+
+        DBG("%d folders without a count", g_hash_table_size(batch->pending));
+        if(retried || !g_hash_table_size(batch->pending))
+            break;
+        if(!list_failed
+           && (!iconn->have_caps
+               || !((iconn->caps ^ batch->caps)
+                    & (IMAP_CAP_LIST_STATUS | IMAP_CAP_CONDSTORE))))
+        {
+            break;
+        }
+
+        retried = TRUE;
+        if(iconn->have_caps)
+            batch->caps = iconn->caps;
+        retry = g_hash_table_get_keys(batch->pending);
+        g_hash_table_remove_all(batch->pending);
+        ret = imap_status_batch_send_status(imailbox, iconn, batch, retry);
+        g_list_free(retry);
+        if(!ret)
+            return FALSE;
+    }
+
+    if(g_hash_table_size(batch->pending))
+        batch->changed = TRUE;
+
+    return TRUE;
+}
+
+static void
+imap_status_batch_free(IMAPStatusBatch *batch)
+{
+    g_hash_table_destroy(batch->pending);
+    if(batch->counts)
+        g_hash_table_destroy(batch->counts);
+    g_list_free(batch->listed);
+}
+
+/* publishes the unseen count of each of |mailboxes| that one of the
+ * |n_counts| tables (folder -> GUINT_TO_POINTER(unseen)) has */
+static void
+imap_signal_folder_counts(XfceMailwatchIMAPMailbox *imailbox,
+                          GList *mailboxes,
+                          GHashTable **counts,
+                          guint n_counts)
+{
+    guint n = g_list_length(mailboxes), n_folders = 0, i;
+    const gchar **folder_names = g_new(const gchar *, n + 1);
+    guint *new_messages = g_new(guint, n + 1);
+    gpointer value;
+    GList *l;
+
+    for(l = mailboxes; l; l = l->next) {
+        const gchar *mailbox_name = imap_canonical_mailbox_name(l->data);
+
+        for(i = 0; i < n_counts; i++) {
+            if(counts[i] && g_hash_table_lookup_extended(counts[i],
+                                                         mailbox_name,
+                                                         NULL, &value))
+            {
+                folder_names[n_folders] = l->data;
+                new_messages[n_folders++] = GPOINTER_TO_UINT(value);
+                break;
+            }
+        }
+    }
+
+    xfce_mailwatch_signal_new_messages_by_folder(imailbox->mailwatch,
+                                                 XFCE_MAILWATCH_MAILBOX(imailbox),
+                                                 n_folders, folder_names,
+                                                 new_messages);
+
+    g_free(folder_names);
+    g_free(new_messages);
+}
+
+/* one connection's share of a check */
+typedef struct
+{
+    XfceMailwatchIMAPMailbox *imailbox;
+    const gchar *host;
+    const gchar *username;
+    const gchar *password;
+    XfceMailwatchAuthType auth_type;
+    gint nonstandard_port;
+    guint known_caps;
+    GList *mailboxes;
+    GThread *th;
+
+    /* results */
+    gboolean logged_in;
+    gboolean complete;  /* every folder got a reply */
+    gboolean have_caps;
+    guint caps;
+    GHashTable *counts;  /* folder -> GUINT_TO_POINTER(unseen) */
+    gboolean changed;
+} IMAPCheckShard;
+
+static void
+imap_check_shard(IMAPCheckShard *shard)
+{
+    XfceMailwatchIMAPMailbox *imailbox = shard->imailbox;
+    XfceMailwatchNetConn *net_conn;
+    IMAPConn iconn;
+    CHECK_TIMER_INIT;
+
+    CHECK_TIMER_START;
+    net_conn = xfce_mailwatch_net_conn_new(shard->host, NULL);
+    xfce_mailwatch_net_conn_set_should_continue_func(net_conn,
+                                                     imap_should_continue,
+                                                     imailbox);
+    imap_conn_init(&iconn, net_conn);
+    if(imap_authenticate(imailbox, &iconn, shard->host, shard->username,
+                         shard->password, shard->auth_type,
+                         shard->nonstandard_port, TRUE))
+    {
+        IMAPStatusBatch batch;
+        guint caps = 0;
+        /* compression costs a round trip, which a single STATUS reply
+         * won't win back */
+        gboolean compress = (shard->mailboxes && shard->mailboxes->next);
+
+        /* if the login is still on its way, the counts are asked for right
+         * behind it, going by what the server offered last time.  COMPRESS
+         * can't be, so a server that offers it gets the login's reply
+         * read first. */
+        if(iconn.login_tag) {
+            caps = shard->known_caps;
+            if(compress && (caps & IMAP_CAP_COMPRESS)
+               && imap_finish_login(imailbox, &iconn))
+            {
+                imap_enable_compression(imailbox, &iconn);
+            }
+        } else if(imap_ensure_capabilities(imailbox, &iconn)) {
+            caps = iconn.caps;
+            if(compress)
+                imap_enable_compression(imailbox, &iconn);
+        }
+
+        if(imap_status_batch_send(imailbox, &iconn, &batch,
+                                  shard->mailboxes, caps)
+           && imap_finish_login(imailbox, &iconn))
+        {
+            shard->logged_in = TRUE;
+            shard->complete = imap_status_batch_finish(imailbox, &iconn,
+                                                       &batch);
+            shard->counts = batch.counts;
+            batch.counts = NULL;
+            shard->changed = batch.changed;
+
+            /* the first time round, find out what to use next time */
+            if(!iconn.have_caps && !caps && !iconn.broken)
+                imap_ensure_capabilities(imailbox, &iconn);
+            shard->have_caps = iconn.have_caps;
+            shard->caps = iconn.caps;
+        }
+
+        imap_status_batch_free(&batch);
+    }
+
+    if(xfce_mailwatch_net_conn_is_connected(net_conn) && !iconn.broken) {
+        imap_send_command(imailbox, &iconn, "LOGOUT");
+        imap_uncork(imailbox, &iconn);
+    }
+
+    xfce_mailwatch_net_conn_dump_stats(net_conn, "IMAP check",
+                                       CHECK_TIMER_ELAPSED);
+    CHECK_TIMER_FREE;
+
+    xfce_mailwatch_net_conn_destroy(net_conn);
+}
+
+static gpointer
+imap_check_shard_th(gpointer user_data)
+{
+    imap_check_shard(user_data);
+    return NULL;
+}
+
+/* takes up to |wanted| of |host|'s connection slots, which are shared by
+ * every IMAP mailbox.  there's always at least one. */
 static guint
-imap_check_mailbox(XfceMailwatchIMAPMailbox *imailbox,
-                   XfceMailwatchNetConn *net_conn,
-                   const gchar *mailbox_name)
+imap_host_connections_acquire(const gchar *host,
+                              guint wanted)
+{
+    gchar *key = g_ascii_strdown(host, -1);
+    guint in_use, granted;
+
+    g_static_mutex_lock(&host_connections_mx);
+
+    if(!host_connections)
+        host_connections = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 g_free, NULL);
+
+    in_use = GPOINTER_TO_UINT(g_hash_table_lookup(host_connections, key));
+    if(in_use + wanted <= IMAP_MAX_CONNECTIONS_PER_HOST)
+        granted = wanted;
+    else if(in_use < IMAP_MAX_CONNECTIONS_PER_HOST)
+        granted = IMAP_MAX_CONNECTIONS_PER_HOST - in_use;
+    else
+        granted = 1;
+    g_hash_table_replace(host_connections, key,
+                         GUINT_TO_POINTER(in_use + granted));
+
+    g_static_mutex_unlock(&host_connections_mx);
+
+    return granted;
+}
+
+static void
+imap_host_connections_release(const gchar *host,
+                              guint count)
+{
+    gchar *key = g_ascii_strdown(host, -1);
+    guint in_use;
+
+    g_static_mutex_lock(&host_connections_mx);
+
+    in_use = GPOINTER_TO_UINT(g_hash_table_lookup(host_connections, key));
+    if(in_use > count)
+        g_hash_table_replace(host_connections, key,
+                             GUINT_TO_POINTER(in_use - count));
+    else {
+        g_hash_table_remove(host_connections, key);
+        g_free(key);
+    }
+
+    g_static_mutex_unlock(&host_connections_mx);
+}
+
+static gpointer
+imap_check_mail_th(gpointer user_data)
 {
-    gint new_messages = 0, bin;
-    gchar buf[4096], *p, *q;
+#define BUFSIZE 1024
+    XfceMailwatchIMAPMailbox *imailbox = user_data;
+    gchar host[BUFSIZE], username[BUFSIZE], password[BUFSIZE];
+    guint config_serial, known_caps = 0, max_connections, n_shards, i;
+    gboolean logged_in = FALSE, complete = TRUE, changed = FALSE;
+    GList *mailboxes_to_check = NULL, *l;
+    XfceMailwatchAuthType auth_type;
+    gint nonstandard_port = -1;
+    IMAPCheckShard *shards;
+    GHashTable **counts;
+
+    /* wait for the main thread to set the thread pointer.  this is
+     * not the most elegant way to do this, but it works. */
+    while(!g_atomic_pointer_get(&imailbox->th)
+          && g_atomic_int_get(&imailbox->running))
+    {
+        g_thread_yield();
+    }
+
+    if(!g_atomic_int_get(&imailbox->running)) {
+        g_atomic_pointer_set(&imailbox->th, NULL);
+        return NULL;
+    }
+
+    g_mutex_lock(imailbox->config_mx);
+    
+    if(!imailbox->host || !imailbox->username || !imailbox->password) {
+        g_mutex_unlock(imailbox->config_mx);
+        g_atomic_pointer_set(&imailbox->th, NULL);
+        return NULL;
+    }
     
-    TRACE("entering, folder %s", mailbox_name);
+    g_strlcpy(host, imailbox->host, BUFSIZE);
+    g_strlcpy(username, imailbox->username, BUFSIZE);
+    g_strlcpy(password, imailbox->password, BUFSIZE);
+    auth_type = imailbox->auth_type;
+    if(!imailbox->use_standard_port)
+        nonstandard_port = imailbox->nonstandard_port;
+    max_connections = imailbox->max_connections;
     
-    /* ask the server to look at the mailbox */
-    g_snprintf(buf, sizeof(buf), "%05d STATUS %s (UNSEEN)\r\n",
-               ++imailbox->imap_tag, mailbox_name);
+    /* make a deep copy of the mailbox list */
+    for(l = imailbox->mailboxes_to_check; l; l = l->next)
+        mailboxes_to_check = g_list_prepend(mailboxes_to_check, g_strdup(l->data));
+    mailboxes_to_check = g_list_reverse(mailboxes_to_check);
 
-    if(imap_send(imailbox, net_conn, buf) != (gint)strlen(buf))
-        return 0;
-    DBG("  successfully sent cmd '%s'", buf);
+    config_serial = imailbox->config_serial;
+    if(imailbox->known_caps_serial == config_serial)
+        known_caps = imailbox->known_caps;
     
-    /* grab the response */
-    bin = imap_recv_command(imailbox, net_conn, buf, sizeof(buf));
-    if(bin <= 0) {
-        g_warning("Mailwatch: Bad response to STATUS UNSEEN; possibly just a folder that doesn't exist");
-        return 0;
+    g_mutex_unlock(imailbox->config_mx);
+
+    /* a connection only pays for itself with enough folders to check */
+    n_shards = (g_list_length(mailboxes_to_check) + IMAP_SHARD_MIN_FOLDERS - 1)
+               / IMAP_SHARD_MIN_FOLDERS;
+    n_shards = CLAMP(n_shards, 1, MAX(max_connections, 1));
+    n_shards = imap_host_connections_acquire(host, n_shards);
+    DBG("checking %d folders over %d connection(s)",
+        g_list_length(mailboxes_to_check), n_shards);
+
+    shards = g_new0(IMAPCheckShard, n_shards);
+    counts = g_new0(GHashTable *, n_shards);
+    for(i = 0; i < n_shards; i++) {
+        shards[i].imailbox = imailbox;
+        shards[i].host = host;
+        shards[i].username = username;
+        shards[i].password = password;
+        shards[i].auth_type = auth_type;
+        shards[i].nonstandard_port = nonstandard_port;
+        shards[i].known_caps = known_caps;
+    }
+    for(l = mailboxes_to_check, i = 0; l; l = l->next, i = (i + 1) % n_shards)
+        shards[i].mailboxes = g_list_prepend(shards[i].mailboxes, l->data);
+
+    /* this thread takes the first share itself */
+    for(i = 1; i < n_shards; i++) {
+        shards[i].mailboxes = g_list_reverse(shards[i].mailboxes);
+        shards[i].th = g_thread_create(imap_check_shard_th, &shards[i],
+                                       TRUE, NULL);
     }
-    DBG("response to STATUS UNSEEN: %s", buf);
+    shards[0].mailboxes = g_list_reverse(shards[0].mailboxes);
+    imap_check_shard(&shards[0]);
+
+    for(i = 0; i < n_shards; i++) {
+        if(i > 0) {
+            if(shards[i].th)
+                g_thread_join(shards[i].th);
+            else
+                imap_check_shard(&shards[i]);
+        }
 
-    p = strstr(buf, "(UNSEEN ");
-    if(p) {
-        q = strchr(p, ')');
-        if(q) {
-            *q = 0;
-            new_messages = atoi(p+8);
-            *q = ')';
+        if(shards[i].logged_in) {
+            logged_in = TRUE;
+            if(shards[i].changed)
+                changed = TRUE;
         }
+        counts[i] = shards[i].counts;
+        /* folders we couldn't ask about have to be asked about next time */
+        if(!shards[i].logged_in || !shards[i].complete)
+            complete = FALSE;
+
+        if(shards[i].have_caps) {
+            /* the timeout can switch to a push connection */
+            g_atomic_int_set(&imailbox->notify_supported,
+                             !!(shards[i].caps & IMAP_CAP_NOTIFY));
+
+            g_mutex_lock(imailbox->config_mx);
+            if(imailbox->config_serial == config_serial) {
+                imailbox->known_caps = shards[i].caps;
+                imailbox->known_caps_serial = config_serial;
+            }
+            g_mutex_unlock(imailbox->config_mx);
+        }
+
+        g_list_free(shards[i].mailboxes);
+    }
+    g_free(shards);
+
+    imap_host_connections_release(host, n_shards);
+
+    /* on a CONDSTORE server, nothing we've already reported needs
+     * reporting again if no folder has changed */
+    if(logged_in && (changed || !complete || !imailbox->reported)) {
+        imap_signal_folder_counts(imailbox, mailboxes_to_check, counts,
+                                  n_shards);
+        /* a partial count has to be corrected next time */
+        imailbox->reported = complete;
+    } else if(logged_in)
+        DBG("no watched folder has changed");
+
+    for(i = 0; i < n_shards; i++) {
+        if(counts[i])
+            g_hash_table_destroy(counts[i]);
     }
+    g_free(counts);
     
-    DBG("new message count in mailbox '%s' is %d", mailbox_name, new_messages);
+    if(mailboxes_to_check) {
+        g_list_foreach(mailboxes_to_check, (GFunc)g_free, NULL);
+        g_list_free(mailboxes_to_check);
+    }
     
-    return (guint)new_messages;
+    g_atomic_pointer_set(&imailbox->th, NULL);
+
+    return NULL;
+#undef BUFSIZE
 }
 
+typedef struct
+{
+    GHashTable *counts;  /* watched folder -> GUINT_TO_POINTER(unseen) */
+    GHashTable *stale;   /* watched folders whose counts need refetching */
+    gboolean changed;
+} IMAPNotifyData;
+
+/* keeps the per-folder counts up to date from the STATUS responses the
+ * server pushes for watched folders */
 static void
-__backfill(gchar *str)
+imap_notify_status_cb(XfceMailwatchIMAPMailbox *imailbox,
+                      IMAPConn *iconn,
+                      const IMAPToken *name,
+                      gpointer user_data)
 {
-    gchar *p;
-    
-    p = str + strlen(str);
-    *(p+1) = 0;
-    
-    while(p != str) {
-        *p = *(p-1);
-        p--;
+    IMAPNotifyData *ndata = user_data;
+    IMAPStatus status;
+    gchar *mailbox_name = NULL;
+    gpointer key, value;
+
+    if(!imap_parse_status_entry(imailbox, iconn, name, &mailbox_name, &status))
+        return;
+
+    if(g_hash_table_lookup_extended(ndata->counts,
+                                    imap_canonical_mailbox_name(mailbox_name),
+                                    &key, &value))
+    {
+        if(!(status.items & IMAP_STATUS_UNSEEN)) {
+            /* new or expunged messages; the server doesn't have to tell
+             * us the new unseen count */
+            g_hash_table_insert(ndata->stale, key, key);
+        } else if(GPOINTER_TO_UINT(value) != (guint)status.unseen) {
+            DBG("new message count in mailbox '%s' is now %d", mailbox_name,
+                (gint)status.unseen);
+            g_hash_table_insert(ndata->counts, key,
+                                GUINT_TO_POINTER((guint)status.unseen));
+            ndata->changed = TRUE;
+        }
     }
+
+    g_free(mailbox_name);
 }
 
 static void
-imap_escape_string(gchar *buf, gssize buflen)
+imap_notify_collect_stale(gpointer key,
+                          gpointer value,
+                          gpointer user_data)
 {
-    gssize room_left;
-    gchar *p;
-    
-    g_return_if_fail(buf);
-    
-    room_left = buflen - strlen(buf);
-    
-    for(p = (gchar *)buf; *p; p++) {
-        if(!room_left)
+    GList **stale = user_data;
+    *stale = g_list_prepend(*stale, key);
+}
+
+/* pipelines a STATUS (UNSEEN) for each folder in |mailboxes|; the answers
+ * come in through imap_notify_status_cb() */
+static gboolean
+imap_notify_refresh_counts(XfceMailwatchIMAPMailbox *imailbox,
+                           IMAPConn *iconn,
+                           IMAPNotifyData *ndata,
+                           GList *mailboxes)
+{
+    GList *l;
+    guint *tags, i, n = g_list_length(mailboxes);
+    gchar *quoted_name;
+    gboolean ret = TRUE;
+
+    if(!n)
+        return TRUE;
+
+    tags = g_new0(guint, n);
+    for(l = mailboxes, i = 0; l; l = l->next, i++) {
+        /* the server hasn't necessarily told us anything new for a folder
+         * it already has fresh counts queued for */
+        g_hash_table_remove(ndata->stale, l->data);
+
+        quoted_name = imap_quote_string(l->data);
+        tags[i] = imap_send_command(imailbox, iconn, "STATUS %s (UNSEEN)",
+                                    quoted_name);
+        g_free(quoted_name);
+        if(!tags[i]) {
+            ret = FALSE;
             break;
-        
-        if(*p == '\\') {
-            DBG("backfilling '%s'", p);
-            __backfill(p+1);
-            *(p+1) = '\\';
-            p++;
-            room_left--;
         }
     }
+
+    /* a folder that fails here just keeps its old count */
+    for(i = 0; i < n && ret && tags[i]; i++) {
+        if(imap_wait_tagged(imailbox, iconn, tags[i], imap_notify_status_cb,
+                            ndata, NULL) == IMAP_RESP_ERROR)
+        {
+            ret = FALSE;
+        }
+    }
+
+    g_free(tags);
+
+    return ret;
+}
+
+/* reads one response the server sent on its own accord */
+static gboolean
+imap_read_unsolicited(XfceMailwatchIMAPMailbox *imailbox,
+                      IMAPConn *iconn,
+                      IMAPUntaggedFunc func,
+                      gpointer user_data)
+{
+    IMAPToken token;
+
+    if(!imap_response_begin(imailbox, iconn))
+        return FALSE;
+
+    if(imap_response_next_token(imailbox, iconn, &token) != IMAP_TOKEN_ATOM)
+        return FALSE;
+
+    if(imap_token_is(&token, "*"))
+        return imap_handle_untagged(imailbox, iconn, func, user_data);
+
+    DBG("skipping unexpected response (%.*s)", (gint)token.len, token.str);
+
+    return TRUE;
+}
+
+static gboolean
+imap_notify_config_changed(XfceMailwatchIMAPMailbox *imailbox,
+                           guint config_serial)
+{
+    gboolean changed;
+
+    g_mutex_lock(imailbox->config_mx);
+    changed = (imailbox->config_serial != config_serial);
+    g_mutex_unlock(imailbox->config_mx);
+
+    return changed;
 }
 
+/* holds a connection open and asks the server (RFC 5465) to push STATUS
+ * updates for all the watched folders, instead of polling them.  the
+ * thread exits when the mailbox is deactivated, the config changes, or
+ * the connection drops; the regular timeout then starts a new one. */
 static gpointer
-imap_check_mail_th(gpointer user_data)
+imap_notify_th(gpointer user_data)
 {
 #define BUFSIZE 1024
     XfceMailwatchIMAPMailbox *imailbox = user_data;
     gchar host[BUFSIZE], username[BUFSIZE], password[BUFSIZE];
-    guint new_messages = 0;
-    GList *mailboxes_to_check = NULL, *l;
+    GList *mailboxes_to_check = NULL, *stale, *l;
     XfceMailwatchAuthType auth_type;
     gint nonstandard_port = -1;
+    guint config_serial, tag;
     XfceMailwatchNetConn *net_conn;
+    IMAPConn iconn;
+    IMAPNotifyData ndata;
+    IMAPRespStatus status;
+    GString *mailboxes;
+    gchar *quoted_name;
+    GError *error = NULL;
+    time_t last_command, keepalive;
+    gint ret;
 
-    /* wait for the main thread to set the thread pointer.  this is
-     * not the most elegant way to do this, but it works. */
-    while(!g_atomic_pointer_get(&imailbox->th)
+    while(!g_atomic_pointer_get(&imailbox->notify_th)
           && g_atomic_int_get(&imailbox->running))
     {
         g_thread_yield();
     }
 
     if(!g_atomic_int_get(&imailbox->running)) {
-        g_atomic_pointer_set(&imailbox->th, NULL);
+        g_atomic_pointer_set(&imailbox->notify_th, NULL);
         return NULL;
     }
 
     g_mutex_lock(imailbox->config_mx);
-    
-    if(!imailbox->host || !imailbox->username || !imailbox->password) {
+
+    if(!imailbox->host || !imailbox->username || !imailbox->password
+       || !imailbox->mailboxes_to_check)
+    {
         g_mutex_unlock(imailbox->config_mx);
-        g_atomic_pointer_set(&imailbox->th, NULL);
+        g_atomic_pointer_set(&imailbox->notify_th, NULL);
         return NULL;
     }
-    
+
     g_strlcpy(host, imailbox->host, BUFSIZE);
     g_strlcpy(username, imailbox->username, BUFSIZE);
     g_strlcpy(password, imailbox->password, BUFSIZE);
     auth_type = imailbox->auth_type;
     if(!imailbox->use_standard_port)
         nonstandard_port = imailbox->nonstandard_port;
-    
-    /* make a deep copy of the mailbox list */
     for(l = imailbox->mailboxes_to_check; l; l = l->next)
         mailboxes_to_check = g_list_prepend(mailboxes_to_check, g_strdup(l->data));
-    
+    mailboxes_to_check = g_list_reverse(mailboxes_to_check);
+    config_serial = imailbox->config_serial;
+    /* a push connection that silently died would leave the counts stale
+     * for good, so don't go longer than a poll would without hearing from
+     * the server */
+    keepalive = MIN(imailbox->timeout, IMAP_NOTIFY_KEEPALIVE);
+
     g_mutex_unlock(imailbox->config_mx);
-    
-    /* escape stuff */
-    imap_escape_string(username, BUFSIZE);
-    imap_escape_string(password, BUFSIZE);
-    
+
+    g_atomic_int_set(&imailbox->notify_poke, FALSE);
+
+    ndata.counts = g_hash_table_new(g_str_hash, g_str_equal);
+    ndata.stale = g_hash_table_new(g_str_hash, g_str_equal);
+    ndata.changed = TRUE;
+    mailboxes = g_string_new(NULL);
+    for(l = mailboxes_to_check; l; l = l->next) {
+        g_hash_table_insert(ndata.counts,
+                            (gpointer)imap_canonical_mailbox_name(l->data),
+                            GUINT_TO_POINTER(0));
+        quoted_name = imap_quote_string(l->data);
+        if(mailboxes->len)
+            g_string_append_c(mailboxes, ' ');
+        g_string_append(mailboxes, quoted_name);
+        g_free(quoted_name);
+    }
+
     net_conn = xfce_mailwatch_net_conn_new(host, NULL);
     xfce_mailwatch_net_conn_set_should_continue_func(net_conn,
                                                      imap_should_continue,
                                                      imailbox);
-    if(imap_authenticate(imailbox, net_conn, host, username, password,
-                          auth_type, nonstandard_port))
+    imap_conn_init(&iconn, net_conn);
+    if(!imap_authenticate(imailbox, &iconn, host, username, password,
+                          auth_type, nonstandard_port, FALSE)
+       || !imap_ensure_capabilities(imailbox, &iconn)
+       || !imap_enable_compression(imailbox, &iconn))
     {
-        for(l = mailboxes_to_check; l; l = l->next) {
-            new_messages += imap_check_mailbox(imailbox, net_conn, l->data);
-            DBG("checked mail folder %s, total is now %d new messages", (gchar *)l->data, new_messages);
+        goto out;
+    }
+
+    if(!(iconn.caps & IMAP_CAP_NOTIFY)) {
+        g_atomic_int_set(&imailbox->notify_supported, FALSE);
+        goto out;
+    }
+
+    /* ask for the events first, so nothing that happens while we're
+     * fetching the initial counts is missed.  the STATUS indicator
+     * wouldn't help there: it doesn't include UNSEEN. */
+    tag = imap_send_command(imailbox, &iconn,
+                            "NOTIFY SET (mailboxes (%s) (MessageNew MessageExpunge FlagChange))",
+                            mailboxes->str);
+    if(!tag)
+        goto out;
+    status = imap_wait_tagged(imailbox, &iconn, tag, imap_notify_status_cb,
+                              &ndata, NULL);
+    if(status != IMAP_RESP_OK) {
+        if(status != IMAP_RESP_ERROR) {
+            DBG("server refused NOTIFY SET; going back to polling");
+            g_atomic_int_set(&imailbox->notify_supported, FALSE);
         }
-        
-        xfce_mailwatch_signal_new_messages(imailbox->mailwatch,
-                XFCE_MAILWATCH_MAILBOX(imailbox), new_messages);
+        goto out;
     }
 
-    if(xfce_mailwatch_net_conn_is_connected(net_conn))
-        imap_send(imailbox, net_conn, "ABCD LOGOUT\r\n");
-    
-    if(mailboxes_to_check) {
-        g_list_foreach(mailboxes_to_check, (GFunc)g_free, NULL);
-        g_list_free(mailboxes_to_check);
+    if(!imap_notify_refresh_counts(imailbox, &iconn, &ndata,
+                                   mailboxes_to_check))
+    {
+        goto out;
     }
-    
+    last_command = time(NULL);
+
+    DBG("NOTIFY is active for %d folders on %s",
+        g_list_length(mailboxes_to_check), host);
+
+    for(;;) {
+        if(ndata.changed) {
+            imap_signal_folder_counts(imailbox, mailboxes_to_check,
+                                      &ndata.counts, 1);
+            ndata.changed = FALSE;
+        }
+
+        if(imap_notify_config_changed(imailbox, config_serial)) {
+            DBG("config changed, restarting NOTIFY connection");
+            break;
+        }
+
+        ret = xfce_mailwatch_net_conn_wait_readable(net_conn,
+                                                    IMAP_NOTIFY_WAKEUP,
+                                                    &error);
+        if(ret < 0) {
+            if(error->code != XFCE_MAILWATCH_ERROR_ABORTED)
+                imap_log_error(imailbox, error);
+            else
+                g_error_free(error);
+            break;
+        } else if(!ret) {
+            /* keep the server (and any NAT in between) from deciding the
+             * connection is dead, and find out if it already is */
+            if(g_atomic_int_compare_and_exchange(&imailbox->notify_poke,
+                                                 TRUE, FALSE)
+               || time(NULL) - last_command >= keepalive)
+            {
+                tag = imap_send_command(imailbox, &iconn, "NOOP");
+                if(!tag || imap_wait_tagged(imailbox, &iconn, tag,
+                                            imap_notify_status_cb, &ndata,
+                                            NULL) == IMAP_RESP_ERROR)
+                {
+                    break;
+                }
+                last_command = time(NULL);
+            }
+            continue;
+        }
+
+        if(!imap_read_unsolicited(imailbox, &iconn, imap_notify_status_cb,
+                                  &ndata))
+        {
+            break;
+        }
+
+        if(g_hash_table_size(ndata.stale)) {
+            stale = NULL;
+            g_hash_table_foreach(ndata.stale, imap_notify_collect_stale,
+                                 &stale);
+            ret = imap_notify_refresh_counts(imailbox, &iconn, &ndata, stale);
+            g_list_free(stale);
+            if(!ret)
+                break;
+            last_command = time(NULL);
+        }
+    }
+
+out:
+    if(xfce_mailwatch_net_conn_is_connected(net_conn) && !iconn.broken)
+        imap_send_command(imailbox, &iconn, "LOGOUT");
+
     xfce_mailwatch_net_conn_destroy(net_conn);
-    g_atomic_pointer_set(&imailbox->th, NULL);
+
+    g_string_free(mailboxes, TRUE);
+    g_hash_table_destroy(ndata.counts);
+    g_hash_table_destroy(ndata.stale);
+    g_list_foreach(mailboxes_to_check, (GFunc)g_free, NULL);
+    g_list_free(mailboxes_to_check);
+
+    g_atomic_pointer_set(&imailbox->notify_th, NULL);
 
     return NULL;
 #undef BUFSIZE
@@ -711,7 +2435,10 @@ imap_mailbox_new(XfceMailwatch *mailwatch, XfceMailwatchMailboxType *type)
     imailbox->mailwatch = mailwatch;
     imailbox->timeout = XFCE_MAILWATCH_DEFAULT_TIMEOUT;
     imailbox->use_standard_port = TRUE;
+    imailbox->max_connections = 1;
     imailbox->config_mx = g_mutex_new();
+    imailbox->folder_states = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                    g_free, g_free);
 
     /* this is a bit of a hack; should really fetch the folder list and
      * try to find the inbox, as the inbox might not be named "INBOX" */
@@ -736,6 +2463,16 @@ imap_check_mail_timeout(gpointer data)
         return TRUE;
     }
 
+    /* nothing to poll while the server is pushing updates */
+    if(g_atomic_pointer_get(&imailbox->notify_th))
+        return TRUE;
+
+    if(g_atomic_int_get(&imailbox->notify_supported)) {
+        th = g_thread_create(imap_notify_th, imailbox, FALSE, NULL);
+        g_atomic_pointer_set(&imailbox->notify_th, th);
+        return TRUE;
+    }
+
     th = g_thread_create(imap_check_mail_th, imailbox, FALSE, NULL);
     g_atomic_pointer_set(&imailbox->th, th);
 
@@ -769,13 +2506,21 @@ imap_force_update_cb(XfceMailwatchMailbox *mailbox)
     
     if(!g_atomic_pointer_get(&imailbox->th)) {
         gboolean restart = FALSE;
+        GThread *th;
 
         if(imailbox->check_id) {
             g_source_remove(imailbox->check_id);
             restart = TRUE;
         }
 
-        imap_check_mail_timeout(imailbox);
+        if(g_atomic_pointer_get(&imailbox->notify_th)) {
+            /* the push connection may have gone quiet without noticing;
+             * poll anyway, and have it check the server is still there */
+            g_atomic_int_set(&imailbox->notify_poke, TRUE);
+            th = g_thread_create(imap_check_mail_th, imailbox, FALSE, NULL);
+            g_atomic_pointer_set(&imailbox->th, th);
+        } else
+            imap_check_mail_timeout(imailbox);
 
         if(restart) {
             imailbox->check_id = g_timeout_add(imailbox->timeout * 1000,
@@ -796,6 +2541,10 @@ imap_host_entry_focus_out_cb(GtkWidget *w, GdkEventFocus *evt,
     
     g_mutex_lock(imailbox->config_mx);
     
+    /* another server's mod-sequences mean nothing */
+    if(g_strcmp0(imailbox->host, str && *str ? str : NULL))
+        g_hash_table_remove_all(imailbox->folder_states);
+
     g_free(imailbox->host);
     if(!str || !*str) {
         imailbox->host = NULL;
@@ -803,6 +2552,7 @@ imap_host_entry_focus_out_cb(GtkWidget *w, GdkEventFocus *evt,
     } else
         imailbox->host = str;
     
+    imailbox->config_serial++;
     g_mutex_unlock(imailbox->config_mx);
     
     return FALSE;
@@ -819,6 +2569,9 @@ imap_username_entry_focus_out_cb(GtkWidget *w, GdkEventFocus *evt,
     
     g_mutex_lock(imailbox->config_mx);
     
+    if(g_strcmp0(imailbox->username, str && *str ? str : NULL))
+        g_hash_table_remove_all(imailbox->folder_states);
+
     g_free(imailbox->username);
     if(!str || !*str) {
         imailbox->username = NULL;
@@ -826,6 +2579,7 @@ imap_username_entry_focus_out_cb(GtkWidget *w, GdkEventFocus *evt,
     } else
         imailbox->username = str;
     
+    imailbox->config_serial++;
     g_mutex_unlock(imailbox->config_mx);
     
     return FALSE;
@@ -849,280 +2603,673 @@ imap_password_entry_focus_out_cb(GtkWidget *w, GdkEventFocus *evt,
     } else
         imailbox->password = str;
     
+    imailbox->config_serial++;
     g_mutex_unlock(imailbox->config_mx);
     
     return FALSE;
 }
 
-static void
-imap_config_timeout_spinbutton_changed_cb(GtkSpinButton *sb,
-                                          gpointer user_data)
+static void
+imap_config_timeout_spinbutton_changed_cb(GtkSpinButton *sb,
+                                          gpointer user_data)
+{
+    XfceMailwatchIMAPMailbox *imailbox = user_data;
+    guint value = gtk_spin_button_get_value_as_int(sb) * 60;
+    
+    if(imailbox->timeout == value)
+        return;
+
+    imailbox->timeout = value;
+
+    if(g_atomic_int_get(&imailbox->running)) {
+        /* probably shouldn't do this so frequently */
+        if(imailbox->check_id)
+            g_source_remove(imailbox->check_id);
+        imailbox->check_id = g_timeout_add(imailbox->timeout * 1000,
+                                           imap_check_mail_timeout,
+                                           imailbox);
+    }
+}
+
+static gboolean
+imap_parse_list_entry(XfceMailwatchIMAPMailbox *imailbox,
+                      IMAPConn *iconn,
+                      const IMAPToken *name,
+                      IMAPListEntry *entry)
+{
+    IMAPToken token;
+    IMAPTokenType type;
+    guint i;
+    gchar *str;
+
+    /* * LIST (<flags>) <delimiter> <mailbox> */
+    if(!imap_token_is(name, "LIST"))
+        return FALSE;
+
+    memset(entry, 0, sizeof(*entry));
+
+    if(imap_response_next_token(imailbox, iconn,
+                                &token) != IMAP_TOKEN_LIST_START)
+    {
+        return FALSE;
+    }
+
+    while((type = imap_response_next_token(imailbox, iconn,
+                                           &token)) == IMAP_TOKEN_ATOM)
+    {
+        for(i = 0; i < G_N_ELEMENTS(imap_list_flags); i++) {
+            if(imap_token_is(&token, imap_list_flags[i].name)) {
+                entry->flags |= imap_list_flags[i].flag;
+                break;
+            }
+        }
+    }
+    if(type != IMAP_TOKEN_LIST_END)
+        return FALSE;
+
+    type = imap_response_next_token(imailbox, iconn, &token);
+    if(type == IMAP_TOKEN_STRING) {
+        str = imap_token_dup(&token);
+        entry->delimiter = *str;
+        g_free(str);
+    } else if(type != IMAP_TOKEN_NIL)
+        return FALSE;
+
+    type = imap_response_next_token(imailbox, iconn, &token);
+    if(type != IMAP_TOKEN_ATOM && type != IMAP_TOKEN_STRING
+       && type != IMAP_TOKEN_LITERAL)
+    {
+        return FALSE;
+    }
+
+    entry->name = imap_token_dup(&token);
+
+    return TRUE;
+}
+
+static void
+imap_folder_update_free(IMAPFolderUpdate *update)
+{
+    g_free(update->folder_name);
+    g_free(update->full_path);
+    g_free(update->parent_path);
+    g_free(update);
+}
+
+static void
+imap_folder_batch_free(IMAPFolderBatch *batch)
+{
+    g_ptr_array_foreach(batch->folders, (GFunc)imap_folder_update_free, NULL);
+    g_ptr_array_free(batch->folders, TRUE);
+    g_free(batch);
+}
+
+static void
+imap_folder_tree_clear(XfceMailwatchIMAPMailbox *imailbox)
+{
+    gtk_tree_store_clear(imailbox->ts);
+    g_hash_table_remove_all(imailbox->folder_iters);
+}
+
+static gint
+imap_folder_tree_compare(GtkTreeModel *model,
+                         GtkTreeIter *a,
+                         GtkTreeIter *b,
+                         gpointer user_data)
+{
+    gchar *name_a = NULL, *name_b = NULL;
+    gboolean special_a = FALSE, special_b = FALSE;
+    gint ret;
+
+    gtk_tree_model_get(model, a,
+                       IMAP_FOLDERS_NAME, &name_a,
+                       IMAP_FOLDERS_SPECIAL_USE, &special_a,
+                       -1);
+    gtk_tree_model_get(model, b,
+                       IMAP_FOLDERS_NAME, &name_b,
+                       IMAP_FOLDERS_SPECIAL_USE, &special_b,
+                       -1);
+
+    /* the inbox goes first, then drafts/sent/trash and friends, then
+     * everything else */
+    if(!name_a || !name_b)
+        ret = (name_a ? 1 : 0) - (name_b ? 1 : 0);
+    else if(!g_ascii_strcasecmp(name_a, "inbox"))
+        ret = -1;
+    else if(!g_ascii_strcasecmp(name_b, "inbox"))
+        ret = 1;
+    else if(special_a != special_b)
+        ret = special_a ? -1 : 1;
+    else
+        ret = g_ascii_strcasecmp(name_a, name_b);
+
+    g_free(name_a);
+    g_free(name_b);
+
+    return ret;
+}
+
+/* adds a batch of newly discovered (or changed) folders to the tree store.
+ * runs in the main thread. */
+static gboolean
+imap_folder_batch_idled(gpointer user_data)
+{
+    IMAPFolderBatch *batch = user_data;
+    XfceMailwatchIMAPMailbox *imailbox = batch->imailbox;
+    GHashTable *mailboxes_to_check;
+    GList *l;
+    guint i;
+
+    if(!imailbox->folder_tree_dialog
+       || batch->generation != imailbox->folder_tree_generation)
+    {
+        imap_folder_batch_free(batch);
+        return FALSE;
+    }
+
+    if(batch->first) {
+        imap_folder_tree_clear(imailbox);
+        g_object_set(G_OBJECT(imailbox->render), "foreground-set", FALSE,
+                     "style-set", FALSE, NULL);
+    }
+
+    g_mutex_lock(imailbox->config_mx);
+    mailboxes_to_check = g_hash_table_new(g_str_hash, g_str_equal);
+    for(l = imailbox->mailboxes_to_check; l; l = l->next)
+        g_hash_table_insert(mailboxes_to_check, l->data, GINT_TO_POINTER(1));
+
+    for(i = 0; i < batch->folders->len; i++) {
+        IMAPFolderUpdate *update = g_ptr_array_index(batch->folders, i);
+        GtkTreeIter *itr, *parent = NULL;
+
+        itr = g_hash_table_lookup(imailbox->folder_iters, update->full_path);
+        if(update->removed) {
+            /* children always come before their parents here */
+            if(itr) {
+                gtk_tree_store_remove(imailbox->ts, itr);
+                g_hash_table_remove(imailbox->folder_iters, update->full_path);
+            }
+            continue;
+        }
+
+        if(itr) {
+            /* setting the name again makes the store re-sort the row */
+            gtk_tree_store_set(imailbox->ts, itr,
+                               IMAP_FOLDERS_NAME, update->folder_name,
+                               IMAP_FOLDERS_HOLDS_MESSAGES, update->holds_messages,
+                               IMAP_FOLDERS_SPECIAL_USE, update->special_use,
+                               -1);
+            continue;
+        }
+
+        if(update->parent_path)
+            parent = g_hash_table_lookup(imailbox->folder_iters,
+                                         update->parent_path);
+
+        itr = g_new(GtkTreeIter, 1);
+        gtk_tree_store_insert_with_values(imailbox->ts, itr, parent, -1,
+                IMAP_FOLDERS_NAME, update->folder_name,
+                IMAP_FOLDERS_WATCHING, g_hash_table_lookup(mailboxes_to_check, update->full_path) != NULL,
+                IMAP_FOLDERS_HOLDS_MESSAGES, update->holds_messages,
+                IMAP_FOLDERS_FULLPATH, update->full_path,
+                IMAP_FOLDERS_SPECIAL_USE, update->special_use,
+                -1);
+        g_hash_table_insert(imailbox->folder_iters,
+                            g_strdup(update->full_path), itr);
+    }
+
+    g_mutex_unlock(imailbox->config_mx);
+    g_hash_table_destroy(mailboxes_to_check);
+
+    imap_folder_batch_free(batch);
+
+    return FALSE;
+}
+
+static void
+imap_folder_tree_flush(IMAPFolderTreeBuilder *builder,
+                       gboolean force)
+{
+    if(!builder->batch && force && !builder->sent_batch) {
+        /* send an empty batch so the "please wait" row goes away */
+        builder->batch = g_new0(IMAPFolderBatch, 1);
+        builder->batch->imailbox = builder->imailbox;
+        builder->batch->generation = builder->generation;
+        builder->batch->folders = g_ptr_array_new();
+    }
+
+    if(!builder->batch)
+        return;
+
+    builder->batch->first = !builder->sent_batch;
+    g_idle_add(imap_folder_batch_idled, builder->batch);
+    builder->batch = NULL;
+    builder->sent_batch = TRUE;
+}
+
+static void
+imap_folder_tree_queue_node(IMAPFolderTreeBuilder *builder,
+                            GNode *node,
+                            gboolean removed)
+{
+    IMAPFolderData *fdata = node->data, *parent_fdata = node->parent->data;
+    IMAPFolderUpdate *update = g_new0(IMAPFolderUpdate, 1);
+
+    update->folder_name = g_strdup(fdata->folder_name);
+    update->full_path = g_strdup(fdata->full_path);
+    update->parent_path = parent_fdata ? g_strdup(parent_fdata->full_path) : NULL;
+    update->holds_messages = fdata->holds_messages;
+    update->special_use = fdata->special_use;
+    update->removed = removed;
+
+    if(!builder->batch) {
+        builder->batch = g_new0(IMAPFolderBatch, 1);
+        builder->batch->imailbox = builder->imailbox;
+        builder->batch->generation = builder->generation;
+        builder->batch->folders = g_ptr_array_sized_new(IMAP_FOLDER_BATCH_SIZE);
+    }
+    g_ptr_array_add(builder->batch->folders, update);
+
+    if(builder->batch->folders->len >= IMAP_FOLDER_BATCH_SIZE)
+        imap_folder_tree_flush(builder, FALSE);
+}
+
+/* adds a LIST entry to the folder tree, creating placeholder nodes for any
+ * parent folders the server hasn't told us about yet */
+static void
+imap_folder_tree_add_entry(IMAPFolderTreeBuilder *builder,
+                           const IMAPListEntry *entry)
+{
+    GNode *parent = builder->root, *node;
+    IMAPFolderData *fdata;
+    GString *path;
+    gchar **components, delimiter[2] = { 0, 0 };
+    gboolean changed;
+    guint i, n;
+
+    if(builder->server_directory
+       && !g_str_has_prefix(entry->name, builder->server_directory))
+    {
+        return;
+    }
+
+    /* some IMAP servers return the entire content of the home directory
+     * in the toplevel listing */
+    if(!*entry->name || *entry->name == '.')
+        return;
+
+    /* a folder that can't hold messages or have subfolders isn't useful */
+    if((entry->flags & IMAP_LIST_NOSELECT)
+       && (entry->flags & (IMAP_LIST_NOINFERIORS | IMAP_LIST_HASNOCHILDREN)))
+    {
+        return;
+    }
+
+    if(entry->delimiter) {
+        *delimiter = entry->delimiter;
+        components = g_strsplit(entry->name, delimiter, -1);
+    } else {
+        /* a NIL delimiter means a flat namespace */
+        components = g_new0(gchar *, 2);
+        components[0] = g_strdup(entry->name);
+    }
+
+    n = g_strv_length(components);
+    if(!n || !*components[n-1]) {
+        g_strfreev(components);
+        return;
+    }
+
+    path = g_string_sized_new(strlen(entry->name));
+    for(i = 0; i < n; i++) {
+        if(i > 0)
+            g_string_append_c(path, entry->delimiter);
+        g_string_append(path, components[i]);
+
+        changed = FALSE;
+        node = g_hash_table_lookup(builder->nodes, path->str);
+        if(!node) {
+            /* until its own LIST response shows up, a parent we haven't
+             * seen yet is just a placeholder */
+            fdata = g_new0(IMAPFolderData, 1);
+            fdata->folder_name = g_strdup(components[i]);
+            fdata->full_path = g_strdup(path->str);
+            node = g_node_append_data(parent, fdata);
+            g_hash_table_insert(builder->nodes, fdata->full_path, node);
+            changed = TRUE;
+        }
+
+        fdata = node->data;
+        fdata->seen = TRUE;
+
+        if(i == n - 1) {
+            gboolean holds_messages = !(entry->flags & IMAP_LIST_NOSELECT);
+            gboolean special_use = !!(entry->flags & IMAP_LIST_SPECIAL_USE);
+
+            fdata->flags = entry->flags;
+            fdata->delimiter = entry->delimiter;
+            fdata->listed = TRUE;
+            if(fdata->holds_messages != holds_messages
+               || fdata->special_use != special_use)
+            {
+                fdata->holds_messages = holds_messages;
+                fdata->special_use = special_use;
+                changed = TRUE;
+            }
+        }
+
+        if(changed)
+            imap_folder_tree_queue_node(builder, node, FALSE);
+
+        parent = node;
+    }
+
+    g_string_free(path, TRUE);
+    g_strfreev(components);
+}
+
+static void
+imap_folder_tree_list_cb(XfceMailwatchIMAPMailbox *imailbox,
+                         IMAPConn *iconn,
+                         const IMAPToken *name,
+                         gpointer user_data)
+{
+    IMAPFolderTreeBuilder *builder = user_data;
+    IMAPListEntry entry;
+
+    if(imap_parse_list_entry(imailbox, iconn, name, &entry)) {
+        imap_folder_tree_add_entry(builder, &entry);
+        g_free(entry.name);
+    }
+}
+
+static gboolean
+imap_free_folder_data(GNode *node, gpointer data)
+{
+    IMAPFolderData *fdata = node->data;
+
+    if(!fdata)
+        return FALSE;
+
+    g_free(fdata->folder_name);
+    g_free(fdata->full_path);
+    g_free(fdata);
+
+    return FALSE;
+}
+
+static void
+imap_folder_tree_builder_init(IMAPFolderTreeBuilder *builder,
+                              XfceMailwatchIMAPMailbox *imailbox,
+                              const gchar *server_directory,
+                              gint generation)
+{
+    memset(builder, 0, sizeof(*builder));
+    builder->imailbox = imailbox;
+    builder->server_directory = server_directory;
+    builder->generation = generation;
+    builder->root = g_node_new(NULL);
+    builder->nodes = g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+static void
+imap_folder_tree_builder_free(IMAPFolderTreeBuilder *builder)
+{
+    if(builder->batch)
+        imap_folder_batch_free(builder->batch);
+    g_hash_table_destroy(builder->nodes);
+    g_node_traverse(builder->root, G_IN_ORDER, G_TRAVERSE_ALL, -1,
+                    imap_free_folder_data, NULL);
+    g_node_destroy(builder->root);
+}
+
+/* throws away everything we know; the next batch replaces the whole tree */
+static void
+imap_folder_tree_builder_reset(IMAPFolderTreeBuilder *builder)
+{
+    IMAPFolderTreeBuilder fresh;
+
+    imap_folder_tree_builder_init(&fresh, builder->imailbox,
+                                  builder->server_directory,
+                                  builder->generation);
+    imap_folder_tree_builder_free(builder);
+    *builder = fresh;
+}
+
+static gboolean
+imap_folder_tree_mark_unseen(GNode *node, gpointer data)
+{
+    IMAPFolderData *fdata = node->data;
+
+    if(fdata)
+        fdata->seen = fdata->listed = FALSE;
+
+    return FALSE;
+}
+
+static gboolean
+imap_folder_tree_collect_stale(GNode *node, gpointer data)
 {
-    XfceMailwatchIMAPMailbox *imailbox = user_data;
-    guint value = gtk_spin_button_get_value_as_int(sb) * 60;
-    
-    if(imailbox->timeout == value)
-        return;
+    IMAPFolderTreeBuilder *builder = data;
+    IMAPFolderData *fdata = node->data;
 
-    imailbox->timeout = value;
+    if(!fdata)
+        return FALSE;
 
-    if(g_atomic_int_get(&imailbox->running)) {
-        /* probably shouldn't do this so frequently */
-        if(imailbox->check_id)
-            g_source_remove(imailbox->check_id);
-        imailbox->check_id = g_timeout_add(imailbox->timeout * 1000,
-                                           imap_check_mail_timeout,
-                                           imailbox);
+    if(!fdata->seen) {
+        /* gone from the server */
+        imap_folder_tree_queue_node(builder, node, TRUE);
+    } else if(!fdata->listed
+              && (fdata->holds_messages || fdata->special_use))
+    {
+        /* only its children are still around */
+        fdata->holds_messages = fdata->special_use = FALSE;
+        fdata->flags = 0;
+        imap_folder_tree_queue_node(builder, node, FALSE);
     }
+
+    return FALSE;
 }
 
-static GNode *
-my_g_node_insert_data_sorted(GNode *parent, gpointer data)
+/* the folder cache lives in $XDG_CACHE_HOME/xfce4/mailwatch, one file per
+ * account */
+static gchar *
+imap_folder_cache_filename(const gchar *account)
 {
-    IMAPFolderData *fdata = data;
-    GNode *new_node = NULL, *n;
-    
-    g_return_val_if_fail(parent && data, NULL);
-    
-    for(n = parent->children; n; n = n->next) {
-        IMAPFolderData *a_fdata = n->data;
-        if(g_ascii_strcasecmp(fdata->folder_name, a_fdata->folder_name) <= 0) {
-            new_node = g_node_insert_data_before(parent, n, data);
-            break;
-        }
-    }
-    
-    if(!new_node)
-        new_node = g_node_append_data(parent, data);
-    
-    return new_node;
+    gchar *checksum, *basename, *filename;
+
+    checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, account, -1);
+    basename = g_strconcat("imap-folders-", checksum, NULL);
+    filename = g_build_filename(g_get_user_cache_dir(), "xfce4", "mailwatch",
+                                basename, NULL);
+    g_free(basename);
+    g_free(checksum);
+
+    return filename;
 }
 
-static gboolean
-imap_populate_folder_tree(XfceMailwatchIMAPMailbox *imailbox,
-                          XfceMailwatchNetConn *net_conn,
-                          const gchar *cur_folder,
-                          GNode *parent)
+/* replays the cached LIST entries into |builder|.  returns the INBOX
+ * UIDVALIDITY the cache was written with, or 0 if there's no usable cache */
+static guint64
+imap_folder_cache_load(IMAPFolderTreeBuilder *builder,
+                       const gchar *filename,
+                       const gchar *account)
 {
-#define BUFSIZE 16383
-    gboolean ret = TRUE;
-    gchar buf[BUFSIZE+1], fullpath[(BUFSIZE+1)/8] = "", separator[2] = { 0, 0 };
-    gchar *p, *q, **resp_lines;
-    gint bin, i;
-    gboolean holds_messages = TRUE, has_children = TRUE;
-    IMAPFolderData *fdata;
-    GNode *node;
-    
-    g_return_val_if_fail(cur_folder, TRUE);
-    
-    TRACE("entering (%p, %s, %p)", imailbox, cur_folder, parent);
-    
-    g_snprintf(buf, BUFSIZE, "%05d LIST \"%s\" \"%%\"\r\n",
-            ++imailbox->imap_tag, cur_folder);
-    if(imap_send(imailbox, net_conn, buf) != (gint)strlen(buf))
-        return FALSE;
-    DBG("sent LIST: '%s'", buf);
-    
-    bin = imap_recv_command(imailbox, net_conn, buf, BUFSIZE);
-    if(bin <= 0) {
-        DBG("LIST failed");
-        return FALSE;
+    gchar *contents = NULL, **lines, *p, *end;
+    guint64 uidvalidity = 0;
+    IMAPListEntry entry;
+    guint i;
+
+    if(!g_file_get_contents(filename, &contents, NULL, NULL))
+        return 0;
+
+    lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    /* version <n>
+     * account <account>
+     * uidvalidity <n>
+     * <flags> <delimiter> <name>... */
+    if(g_strv_length(lines) < 3
+       || !g_str_has_prefix(lines[0], "version ")
+       || strtoul(lines[0] + strlen("version "), NULL, 10) != IMAP_FOLDER_CACHE_VERSION
+       || !g_str_has_prefix(lines[1], "account ")
+       || strcmp(lines[1] + strlen("account "), account)
+       || !g_str_has_prefix(lines[2], "uidvalidity "))
+    {
+        DBG("ignoring stale or corrupt folder cache %s", filename);
+        g_strfreev(lines);
+        return 0;
     }
-    
-    if(strstr(buf, "\r"))
-        resp_lines = g_strsplit(buf, "\r\n", -1);
-    else
-        resp_lines = g_strsplit(buf, "\n", -1);
-    
-    for(i = 0; resp_lines[i]; i++) {
-        if(!imap_folder_tree_should_continue(net_conn, imailbox)) {
-            ret = FALSE;
-            break;
-        }
 
-        if(*resp_lines[i] != '*')
-            continue;
-        
-        /* special case: NIL for a separator */
-        p = strstr(resp_lines[i], "NIL");
-        if(p) {
-            p += 4;
-            if(!*p)
-                continue;
-            else if(*p == '"') {
-                p++;
-                p[strlen(p)-1] = 0;
-            }
-            
-            /* since the separator is NIL, it can't have subfolders.  if it
-             * doesn't hold any messages, there's no point in adding it. */
-            if(strstr(resp_lines[i], "\\NoSelect"))
-                continue;
-            
-            fdata = g_new0(IMAPFolderData, 1);
-            fdata->folder_name = g_strdup(p);
-            fdata->full_path = g_strdup(p);
-            fdata->holds_messages = TRUE;
-            
-            my_g_node_insert_data_sorted(parent, fdata);
-            
-            continue;
-        }
-        
-        /* first quote before separator */
-        p = strstr(resp_lines[i], "\"");
-        if(!p)
-            continue;
-        *separator = *(p+1);
-        
-        /* quote after separator */
-        p = strstr(p+1, "\"");
-        if(!p)
-            continue;
-        
-        /* space before folder name */
-        p = strstr(p+1, " ");
-        if(!p)
-            continue;
-        /* this is stupid */
-        p++;
-        if(*p == '"') {
-            p++;
-            p[strlen(p)-1] = 0;
-        }
-        
-        /* sometimes the first entry is just the name of the current folder
-         * itself. */
-        if(!strcmp(p, cur_folder))
+    uidvalidity = g_ascii_strtoull(lines[2] + strlen("uidvalidity "), NULL, 10);
+
+    for(i = 3; lines[i]; i++) {
+        p = lines[i];
+        entry.flags = strtoul(p, &end, 16);
+        if(end == p || *end != ' ')
             continue;
-        
-        if(G_NODE_IS_ROOT(parent)) {
-            /* if there's no parent, we need to be especially careful about what
-             * we list here, as some IMAP servers return the entire content of
-             * the home directory in the toplevel listing */
-            
-            if(imailbox->server_directory && *imailbox->server_directory
-                    && strstr(p, imailbox->server_directory) != p)
-            {
-                continue;
-            }
-            
-            if(*p == '.')
-                continue;
-            
-            if((strstr(resp_lines[i], "\\NoInferiors") || strstr(resp_lines[i], "\\HasNoChildren"))
-                    && strstr(resp_lines[i], "\\NoSelect"))
-            {
-                continue;
-            }
-        }
-        
-        has_children = (!strstr(resp_lines[i], "\\HasNoChildren")
-                && !strstr(resp_lines[i], "\\NoInferiors"));
-        holds_messages = !strstr(resp_lines[i], "\\NoSelect");
-        
-        /* we only want the folder name, not the entire hierarchy */
-        q = g_strrstr(p, separator);
-        if(q)
-            p = q + 1;
-        
-        /* i'm not sure why this happens sometimes.  my code is probably buggy */
-        if(!*p)
+        p = end + 1;
+        entry.delimiter = (gchar)strtoul(p, &end, 16);
+        if(end == p || *end != ' ')
             continue;
-        
-        g_snprintf(fullpath, (BUFSIZE+1)/8, "%s%s", cur_folder, p);
-        
-        fdata = g_new0(IMAPFolderData, 1);
-        fdata->folder_name = g_strdup(p);
-        fdata->full_path = g_strdup(fullpath);
-        fdata->holds_messages = holds_messages;
-        
-        node = my_g_node_insert_data_sorted(parent, fdata);
-        
-        if(has_children) {
-            g_strlcat(fullpath, separator, (BUFSIZE+1)/8);
-            if(!imap_populate_folder_tree(imailbox, net_conn, fullpath, node)) {
-                ret = FALSE;
-                break;
-            }
-        }
+        entry.name = end + 1;
+
+        imap_folder_tree_add_entry(builder, &entry);
     }
-    
-    g_strfreev(resp_lines);
-    
-    return ret;
-#undef BUFSIZE
+
+    g_strfreev(lines);
+
+    DBG("loaded %d folders from %s", g_hash_table_size(builder->nodes),
+        filename);
+
+    return uidvalidity;
 }
 
-static void
-imap_populate_folder_tree_nodes_rec(XfceMailwatchIMAPMailbox *imailbox,
-        GHashTable *mailboxes_to_check, GNode *node, GtkTreeIter *parent)
+static gboolean
+imap_folder_cache_write_node(GNode *node, gpointer data)
 {
-    GtkTreeIter itr;
-    GNode *n;
+    GString *contents = data;
     IMAPFolderData *fdata = node->data;
-    
-    if(!g_ascii_strcasecmp(fdata->folder_name, "inbox"))
-        gtk_tree_store_prepend(imailbox->ts, &itr, parent);
-    else
-        gtk_tree_store_append(imailbox->ts, &itr, parent);
-    
-    gtk_tree_store_set(imailbox->ts, &itr,
-            IMAP_FOLDERS_NAME, fdata->folder_name,
-            IMAP_FOLDERS_WATCHING, g_hash_table_lookup(mailboxes_to_check, fdata->full_path),
-            IMAP_FOLDERS_HOLDS_MESSAGES, fdata->holds_messages,
-            IMAP_FOLDERS_FULLPATH, fdata->full_path,
-            -1);
-    
-    node->data = NULL;
-    g_free(fdata->folder_name);
-    g_free(fdata->full_path);
-    g_free(fdata);
-    
-    for(n = node->children; n; n = n->next)
-        imap_populate_folder_tree_nodes_rec(imailbox, mailboxes_to_check, n, &itr);
+
+    if(fdata && fdata->listed) {
+        g_string_append_printf(contents, "%x %x %s\n", fdata->flags,
+                               (guchar)fdata->delimiter, fdata->full_path);
+    }
+
+    return FALSE;
+}
+
+static void
+imap_folder_cache_save(IMAPFolderTreeBuilder *builder,
+                       const gchar *filename,
+                       const gchar *account,
+                       guint64 uidvalidity)
+{
+    GString *contents;
+    gchar *dirname;
+    GError *error = NULL;
+
+    dirname = g_path_get_dirname(filename);
+    g_mkdir_with_parents(dirname, 0700);
+    g_free(dirname);
+
+    contents = g_string_sized_new(64 * g_hash_table_size(builder->nodes));
+    g_string_append_printf(contents, "version %d\naccount %s\n"
+                           "uidvalidity %" G_GUINT64_FORMAT "\n",
+                           IMAP_FOLDER_CACHE_VERSION, account, uidvalidity);
+    /* parents before children, so loading doesn't create placeholders */
+    g_node_traverse(builder->root, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
+                    imap_folder_cache_write_node, contents);
+
+    if(!g_file_set_contents(filename, contents->str, contents->len, &error)) {
+        g_warning("Mailwatch: Unable to write IMAP folder cache: %s",
+                  error->message);
+        g_error_free(error);
+    }
+
+    g_string_free(contents, TRUE);
 }
 
+/* fetches the whole folder hierarchy with a single LIST command, updating
+ * |builder| (which may already hold the cached tree) as the responses
+ * stream in and handing changes to the main thread in batches.  the
+ * INBOX's UIDVALIDITY is checked first, since a changed value means the
+ * account was recreated and nothing in the cache can be trusted. */
 static gboolean
-imap_populate_folder_tree_nodes(gpointer user_data)
+imap_populate_folder_tree(XfceMailwatchIMAPMailbox *imailbox,
+                          IMAPConn *iconn,
+                          IMAPFolderTreeBuilder *builder,
+                          guint64 *uidvalidity)
 {
-    XfceMailwatchIMAPMailbox *imailbox = user_data;
-    GHashTable *mailboxes_to_check;
-    GList *l;
-    GNode *n;
-    
-    g_atomic_int_set(&imailbox->folder_tree_running, FALSE);
-    while(g_atomic_pointer_get(&imailbox->folder_tree_th))
-        g_thread_yield();
-    
-    if(!imailbox->folder_tree_dialog)
+    IMAPRespStatus status;
+    IMAPStatus inbox_status;
+    gchar *pattern, *quoted_pattern;
+    guint status_tag, tag;
+
+    TRACE("entering (%s)", builder->server_directory ? builder->server_directory : "");
+
+    /* a big LIST is the one response here that's worth compressing */
+    if(!imap_ensure_capabilities(imailbox, iconn)
+       || !imap_enable_compression(imailbox, iconn))
+    {
         return FALSE;
-    
-    g_mutex_lock(imailbox->config_mx);
-    
-    /* make a deep copy of the mailbox list */
-    mailboxes_to_check = g_hash_table_new_full(g_str_hash, g_str_equal,
-            (GDestroyNotify)g_free, NULL);
-    for(l = imailbox->mailboxes_to_check; l; l = l->next)
-        g_hash_table_insert(mailboxes_to_check, g_strdup(l->data), GINT_TO_POINTER(1));
-    
-    g_mutex_unlock(imailbox->config_mx);
-    
-    gtk_tree_store_clear(imailbox->ts);
-    g_object_set(G_OBJECT(imailbox->render), "foreground-set", FALSE,
-            "style-set", FALSE, NULL);
-    
-    for(n = imailbox->folder_tree->children; n; n = n->next)
-        imap_populate_folder_tree_nodes_rec(imailbox, mailboxes_to_check, n, NULL);
-    
-    g_node_destroy(imailbox->folder_tree);
-    imailbox->folder_tree = NULL;
-    
-    g_hash_table_destroy(mailboxes_to_check);
-    
-    gtk_widget_set_sensitive(imailbox->refresh_btn, TRUE);
-    
-    return FALSE;
+    }
+
+    /* both commands go out at once; the STATUS reply comes back first */
+    status_tag = imap_send_command(imailbox, iconn,
+                                   "STATUS \"INBOX\" (UIDVALIDITY)");
+    if(!status_tag)
+        return FALSE;
+
+    pattern = g_strconcat(builder->server_directory ? builder->server_directory : "",
+                          "*", NULL);
+    quoted_pattern = imap_quote_string(pattern);
+    if((iconn->caps & IMAP_CAP_LIST_EXTENDED)
+       && (iconn->caps & IMAP_CAP_SPECIAL_USE))
+    {
+        tag = imap_send_command(imailbox, iconn,
+                                "LIST \"\" %s RETURN (SPECIAL-USE)",
+                                quoted_pattern);
+    } else
+        tag = imap_send_command(imailbox, iconn, "LIST \"\" %s", quoted_pattern);
+    g_free(quoted_pattern);
+    g_free(pattern);
+    if(!tag)
+        return FALSE;
+
+    memset(&inbox_status, 0, sizeof(inbox_status));
+    status = imap_wait_tagged(imailbox, iconn, status_tag,
+                              imap_parse_status_response, &inbox_status,
+                              NULL);
+    if(status == IMAP_RESP_ERROR)
+        return FALSE;
+
+    if(inbox_status.items & IMAP_STATUS_UIDVALIDITY) {
+        if(*uidvalidity && *uidvalidity != inbox_status.uidvalidity) {
+            DBG("UIDVALIDITY changed (%" G_GUINT64_FORMAT " -> %" G_GUINT64_FORMAT "), dropping cached folders",
+                *uidvalidity, inbox_status.uidvalidity);
+            imap_folder_tree_builder_reset(builder);
+        }
+        *uidvalidity = inbox_status.uidvalidity;
+    }
+
+    g_node_traverse(builder->root, G_IN_ORDER, G_TRAVERSE_ALL, -1,
+                    imap_folder_tree_mark_unseen, NULL);
+
+    status = imap_wait_tagged(imailbox, iconn, tag,
+                              imap_folder_tree_list_cb, builder, NULL);
+    DBG("LIST finished (%d), %d folders", status,
+        g_hash_table_size(builder->nodes));
+    if(status != IMAP_RESP_OK)
+        return FALSE;
+
+    /* post-order, so children are removed before their parents */
+    g_node_traverse(builder->root, G_POST_ORDER, G_TRAVERSE_ALL, -1,
+                    imap_folder_tree_collect_stale, builder);
+    imap_folder_tree_flush(builder, TRUE);
+
+    return TRUE;
 }
 
 static gboolean
@@ -1130,23 +3277,23 @@ imap_populate_folder_tree_failed(gpointer user_data)
 {
     XfceMailwatchIMAPMailbox *imailbox = user_data;
     GtkTreeIter itr;
-    
+
     g_atomic_int_set(&imailbox->folder_tree_running, FALSE);
     while(g_atomic_pointer_get(&imailbox->folder_tree_th))
         g_thread_yield();
 
     if(!imailbox->folder_tree_dialog)
         return FALSE;
-    
-    gtk_tree_store_clear(imailbox->ts);
+
+    imap_folder_tree_clear(imailbox);
     gtk_tree_store_append(imailbox->ts, &itr, NULL);
     gtk_tree_store_set(imailbox->ts, &itr,
                        IMAP_FOLDERS_NAME, _("Failed to get folder list"),
                        IMAP_FOLDERS_HOLDS_MESSAGES, FALSE,
                        -1);
-    
+
     gtk_widget_set_sensitive(imailbox->refresh_btn, TRUE);
-    
+
     return FALSE;
 }
 
@@ -1154,7 +3301,7 @@ static gboolean
 imap_folder_tree_th_join(gpointer user_data)
 {
     XfceMailwatchIMAPMailbox *imailbox = user_data;
-    
+
     /* this should never really end up spinning even once */
     g_atomic_int_set(&imailbox->folder_tree_running, FALSE);
     while(g_atomic_pointer_get(&imailbox->folder_tree_th))
@@ -1162,22 +3309,7 @@ imap_folder_tree_th_join(gpointer user_data)
 
     if(imailbox->folder_tree_dialog)
         gtk_widget_set_sensitive(imailbox->refresh_btn, TRUE);
-    
-    return FALSE;
-}
 
-static gboolean
-imap_free_folder_data(GNode *node, gpointer data)
-{
-    IMAPFolderData *fdata = node->data;
-    
-    if(fdata == (gpointer)0xdeadbeef)
-        return FALSE;
-    
-    g_free(fdata->folder_name);
-    g_free(fdata->full_path);
-    g_free(fdata);
-    
     return FALSE;
 }
 
@@ -1187,10 +3319,16 @@ imap_populate_folder_tree_th(gpointer data)
 #define BUFSIZE 1024
     XfceMailwatchIMAPMailbox *imailbox = data;
     gchar host[BUFSIZE], username[BUFSIZE], password[BUFSIZE];
+    gchar *server_directory = NULL;
     XfceMailwatchAuthType auth_type;
     gint nonstandard_port = -1;
+    gint generation;
+    gchar *account, *cache_file;
+    guint64 uidvalidity;
+    IMAPFolderTreeBuilder builder;
     XfceMailwatchNetConn *net_conn;
-    
+    IMAPConn iconn;
+
     TRACE("entering");
 
     /* wait for caller to set thread pointer */
@@ -1204,55 +3342,77 @@ imap_populate_folder_tree_th(gpointer data)
         g_atomic_pointer_set(&imailbox->folder_tree_th, NULL);
         return NULL;
     }
-    
+
     g_mutex_lock(imailbox->config_mx);
-    
+
     if(!imailbox->host || !imailbox->username || !imailbox->password) {
         g_mutex_unlock(imailbox->config_mx);
         g_idle_add(imap_folder_tree_th_join, imailbox);
         g_atomic_pointer_set(&imailbox->folder_tree_th, NULL);
         return NULL;
     }
-    
+
     g_strlcpy(host, imailbox->host, BUFSIZE);
     g_strlcpy(username, imailbox->username, BUFSIZE);
     g_strlcpy(password, imailbox->password, BUFSIZE);
     auth_type = imailbox->auth_type;
     if(!imailbox->use_standard_port)
         nonstandard_port = imailbox->nonstandard_port;
-    
+    if(imailbox->server_directory && *imailbox->server_directory)
+        server_directory = g_strdup(imailbox->server_directory);
+    generation = g_atomic_int_get(&imailbox->folder_tree_generation);
+
     g_mutex_unlock(imailbox->config_mx);
-    
-    imap_escape_string(username, BUFSIZE);
-    imap_escape_string(password, BUFSIZE);
-    
+
+    /* show whatever we saw last time right away, then revalidate it */
+    account = g_strdup_printf("%s@%s:%d/%s", username, host, nonstandard_port,
+                              server_directory ? server_directory : "");
+    cache_file = imap_folder_cache_filename(account);
+    imap_folder_tree_builder_init(&builder, imailbox, server_directory,
+                                  generation);
+    uidvalidity = imap_folder_cache_load(&builder, cache_file, account);
+    imap_folder_tree_flush(&builder, FALSE);
+
     net_conn = xfce_mailwatch_net_conn_new(host, NULL);
     xfce_mailwatch_net_conn_set_should_continue_func(net_conn,
                                                      imap_folder_tree_should_continue,
                                                      imailbox);
-    if(imap_authenticate(imailbox, net_conn, host, username,
-                         password, auth_type, nonstandard_port))
+    imap_conn_init(&iconn, net_conn);
+    if(imap_authenticate(imailbox, &iconn, host, username,
+                         password, auth_type, nonstandard_port, FALSE))
     {
-       if(g_atomic_int_get(&imailbox->folder_tree_running)) {
-           imailbox->folder_tree = g_node_new((gpointer)0xdeadbeef);
-           if(imap_populate_folder_tree(imailbox, net_conn, "", imailbox->folder_tree))
-               g_idle_add(imap_populate_folder_tree_nodes, imailbox);
-           else {
-               g_node_traverse(imailbox->folder_tree, G_IN_ORDER,
-                               G_TRAVERSE_ALL, -1, imap_free_folder_data, NULL);
-               g_node_destroy(imailbox->folder_tree);
-               g_idle_add(imap_folder_tree_th_join, imailbox);
-           }
+       if(!g_atomic_int_get(&imailbox->folder_tree_running))
+           g_idle_add(imap_folder_tree_th_join, imailbox);
+       else if(imap_populate_folder_tree(imailbox, &iconn, &builder,
+                                         &uidvalidity))
+       {
+           imap_folder_cache_save(&builder, cache_file, account, uidvalidity);
+           g_idle_add(imap_folder_tree_th_join, imailbox);
+       } else if(g_atomic_int_get(&imailbox->folder_tree_running)
+                 && !builder.sent_batch)
+       {
+           g_idle_add(imap_populate_folder_tree_failed, imailbox);
        } else
            g_idle_add(imap_folder_tree_th_join, imailbox);
-    } else {
+    } else if(!builder.sent_batch) {
         DBG("failed to connect to imap server to probe folders");
         g_idle_add(imap_populate_folder_tree_failed, imailbox);
+    } else {
+        /* leave the cached folders up */
+        DBG("failed to connect to imap server to revalidate folders");
+        g_idle_add(imap_folder_tree_th_join, imailbox);
     }
 
+    if(xfce_mailwatch_net_conn_is_connected(net_conn) && !iconn.broken)
+        imap_send_command(imailbox, &iconn, "LOGOUT");
+
     xfce_mailwatch_net_conn_destroy(net_conn);
+    imap_folder_tree_builder_free(&builder);
+    g_free(cache_file);
+    g_free(account);
+    g_free(server_directory);
     g_atomic_pointer_set(&imailbox->folder_tree_th, NULL);
-    
+
     return NULL;
 #undef BUFSIZE
 }
@@ -1264,6 +3424,10 @@ imap_config_newmailfolders_destroy_cb(GtkWidget *w, gpointer user_data)
     
     imailbox->folder_tree_dialog = NULL;
     g_atomic_int_set(&imailbox->folder_tree_running, FALSE);
+    g_atomic_int_inc(&imailbox->folder_tree_generation);
+
+    g_hash_table_destroy(imailbox->folder_iters);
+    imailbox->folder_iters = NULL;
 }
 
 static void
@@ -1283,7 +3447,9 @@ imap_config_refresh_btn_clicked_cb(GtkWidget *w, gpointer user_data)
     
     gtk_widget_set_sensitive(imailbox->refresh_btn, FALSE);
     
-    gtk_tree_store_clear(imailbox->ts);
+    /* drop anything still queued from the last fetch */
+    g_atomic_int_inc(&imailbox->folder_tree_generation);
+    imap_folder_tree_clear(imailbox);
     gtk_tree_store_append(imailbox->ts, &itr, NULL);
     gtk_tree_store_set(imailbox->ts, &itr, IMAP_FOLDERS_NAME,
             _("Please wait..."), -1);
@@ -1344,6 +3510,7 @@ imap_config_treeview_btnpress_cb(GtkWidget *w, GdkEventButton *evt,
                                     folder_path);
                     DBG("IMAP: adding %s to the new mail folder list (not saved yet)", folder_path);
                 }
+                imailbox->config_serial++;
                 g_mutex_unlock(imailbox->config_mx);
             } else
                 g_free(folder_path);
@@ -1432,7 +3599,15 @@ imap_config_newmailfolders_btn_clicked_cb(GtkWidget *w, gpointer user_data)
     
     imailbox->ts = ts = gtk_tree_store_new(IMAP_FOLDERS_N_COLUMNS,
                                            G_TYPE_STRING, G_TYPE_BOOLEAN,
-                                           G_TYPE_BOOLEAN, G_TYPE_STRING);
+                                           G_TYPE_BOOLEAN, G_TYPE_STRING,
+                                           G_TYPE_BOOLEAN);
+    gtk_tree_sortable_set_sort_func(GTK_TREE_SORTABLE(ts), IMAP_FOLDERS_NAME,
+                                    imap_folder_tree_compare, NULL, NULL);
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(ts),
+                                         IMAP_FOLDERS_NAME,
+                                         GTK_SORT_ASCENDING);
+    imailbox->folder_iters = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                   g_free, g_free);
     
     treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(ts));
     gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(treeview), FALSE);
@@ -1499,6 +3674,7 @@ imap_config_newmailfolders_btn_clicked_cb(GtkWidget *w, gpointer user_data)
     gtk_tree_store_set(ts, &itr, IMAP_FOLDERS_NAME, _("Please wait..."), -1);
     gtk_widget_set_sensitive(btn, FALSE);
 
+    g_atomic_int_inc(&imailbox->folder_tree_generation);
     g_atomic_int_set(&imailbox->folder_tree_running, TRUE);
     th = g_thread_create(imap_populate_folder_tree_th,
                          imailbox, FALSE, NULL);
@@ -1519,6 +3695,7 @@ imap_config_nonstandard_chk_cb(GtkToggleButton *tb, gpointer user_data)
     imailbox->use_standard_port = !gtk_toggle_button_get_active(tb);
     gtk_widget_set_sensitive(entry, !imailbox->use_standard_port);
     
+    imailbox->config_serial++;
     g_mutex_unlock(imailbox->config_mx);
 }
 
@@ -1532,6 +3709,7 @@ imap_config_nonstandard_focusout_cb(GtkWidget *w, GdkEventFocus *evt,
     
     imailbox->nonstandard_port = atoi(gtk_editable_get_chars(GTK_EDITABLE(w), 0, -1));
     
+    imailbox->config_serial++;
     g_mutex_unlock(imailbox->config_mx);
     
     return FALSE;
@@ -1554,6 +3732,7 @@ imap_config_security_combo_changed_cb(GtkWidget *w, gpointer user_data)
             gtk_entry_set_text(GTK_ENTRY(entry), IMAP_PORT_S);
     }
     
+    imailbox->config_serial++;
     g_mutex_unlock(imailbox->config_mx);
 }
 
@@ -1573,12 +3752,23 @@ imap_config_serverdir_focusout_cb(GtkWidget *w, GdkEventFocus *evt,
     return FALSE;
 }
 
+static void
+imap_config_max_connections_changed_cb(GtkSpinButton *sb,
+                                       gpointer user_data)
+{
+    XfceMailwatchIMAPMailbox *imailbox = user_data;
+
+    g_mutex_lock(imailbox->config_mx);
+    imailbox->max_connections = gtk_spin_button_get_value_as_int(sb);
+    g_mutex_unlock(imailbox->config_mx);
+}
+
 static void
 imap_config_advanced_btn_clicked_cb(GtkWidget *w, gpointer user_data)
 {
     XfceMailwatchIMAPMailbox *imailbox = user_data;
     GtkWidget *dlg, *topvbox, *vbox, *hbox, *lbl, *entry, *frame, *frame_bin,
-              *chk, *combo;
+              *chk, *combo, *sbtn;
     
     dlg = gtk_dialog_new_with_buttons(_("Advanced IMAP Options"),
             GTK_WINDOW(gtk_widget_get_toplevel(w)),
@@ -1648,6 +3838,25 @@ imap_config_advanced_btn_clicked_cb(GtkWidget *w, gpointer user_data)
     g_object_set_data(G_OBJECT(chk), "xfmw-entry", entry);
     g_object_set_data(G_OBJECT(combo), "xfmw-entry", entry);
     
+    hbox = gtk_hbox_new(FALSE, BORDER/2);
+    gtk_widget_show(hbox);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+    
+    lbl = gtk_label_new_with_mnemonic(_("_Maximum connections per check:"));
+    gtk_widget_show(lbl);
+    gtk_box_pack_start(GTK_BOX(hbox), lbl, FALSE, FALSE, 0);
+    
+    sbtn = gtk_spin_button_new_with_range(1.0, IMAP_MAX_CONNECTIONS_PER_HOST,
+                                          1.0);
+    gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(sbtn), TRUE);
+    gtk_spin_button_set_wrap(GTK_SPIN_BUTTON(sbtn), FALSE);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(sbtn), imailbox->max_connections);
+    gtk_widget_show(sbtn);
+    gtk_box_pack_start(GTK_BOX(hbox), sbtn, FALSE, FALSE, 0);
+    g_signal_connect(G_OBJECT(sbtn), "value-changed",
+            G_CALLBACK(imap_config_max_connections_changed_cb), imailbox);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(lbl), sbtn);
+    
     frame = xfce_gtk_frame_box_new(_("Folders"), &frame_bin);
     gtk_widget_show(frame);
     gtk_box_pack_start(GTK_BOX(topvbox), frame, FALSE, FALSE, 0);
@@ -1828,6 +4037,9 @@ imap_restore_param_list(XfceMailwatchMailbox *mailbox, GList *params)
             imailbox->nonstandard_port = atoi(param->value);
         else if(!strcmp(param->key, "timeout"))
             imailbox->timeout = atoi(param->value);
+        else if(!strcmp(param->key, "max_connections"))
+            imailbox->max_connections = CLAMP(atoi(param->value), 1,
+                                              IMAP_MAX_CONNECTIONS_PER_HOST);
         else if(!strcmp(param->key, "n_newmail_boxes"))
             n_newmail_boxes = atoi(param->value);
     }
@@ -1913,6 +4125,11 @@ imap_save_param_list(XfceMailwatchMailbox *mailbox)
     param->value = g_strdup_printf("%d", imailbox->timeout);
     params = g_list_prepend(params, param);
     
+    param = g_new(XfceMailwatchParam, 1);
+    param->key = g_strdup("max_connections");
+    param->value = g_strdup_printf("%u", imailbox->max_connections);
+    params = g_list_prepend(params, param);
+    
     param = g_new(XfceMailwatchParam, 1);
     param->key = g_strdup("n_newmail_boxes");
     param->value = g_strdup_printf("%d", g_list_length(imailbox->mailboxes_to_check));
@@ -1926,7 +4143,7 @@ imap_save_param_list(XfceMailwatchMailbox *mailbox)
         DBG("IMAP: sending back new mail folder param (%s, %s)", param->key,
             param->value);
     }
-    
+
     g_mutex_unlock(imailbox->config_mx);
     
     return g_list_reverse(params);
@@ -1945,12 +4162,16 @@ imap_mailbox_free(XfceMailwatchMailbox *mailbox)
 
     while(g_atomic_pointer_get(&imailbox->th))
         g_thread_yield();
+
+    while(g_atomic_pointer_get(&imailbox->notify_th))
+        g_thread_yield();
     
     g_mutex_free(imailbox->config_mx);
     
     g_free(imailbox->host);
     g_free(imailbox->username);
     g_free(imailbox->password);
+    g_hash_table_destroy(imailbox->folder_states);
     
     g_free(imailbox);
 }
@@ -1966,5 +4187,6 @@ XfceMailwatchMailboxType builtin_mailbox_type_imap = {
     imap_get_setup_page,
     imap_restore_param_list,
     imap_save_param_list,
-    imap_mailbox_free
+    imap_mailbox_free,
+    NULL
 };
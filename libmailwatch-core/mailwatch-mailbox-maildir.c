@@ -25,6 +25,10 @@
 #include <string.h>
 #endif
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -51,6 +55,7 @@
 #include <libxfce4ui/libxfce4ui.h>
 
 #include "mailwatch.h"
+#include "mailwatch-watch.h"
 
 #define XFCE_MAILWATCH_MAILDIR_MAILBOX( p ) ( (XfceMailwatchMaildirMailbox *) p )
 #define BORDER                              ( 8 )
@@ -70,6 +75,7 @@ typedef struct {
     gboolean                running;
     gpointer                thread;  /* (GThread *) */
     guint                   check_id;
+    XfceMailwatchWatch      *watch;
 } XfceMailwatchMaildirMailbox;
 
 static void
@@ -139,6 +145,11 @@ maildir_check_mail( XfceMailwatchMaildirMailbox *maildir )
             g_error_free( error );
         }
         maildir->mtime = st.st_mtime;
+        if ( st.st_mtime >= time( NULL ) ) {
+            /* another delivery this second wouldn't move mtime, so
+             * look again next time */
+            maildir->mtime--;
+        }
     }
 
 out:
@@ -268,6 +279,23 @@ maildir_restore_param_list( XfceMailwatchMailbox *mailbox, GList *params )
     DBG( "<<--" );
 }
 
+static gboolean maildir_watch_cb( gpointer data );
+
+/* must be called with the mutex held */
+static void
+maildir_watch_path( XfceMailwatchMaildirMailbox *maildir )
+{
+    xfce_mailwatch_watch_remove( maildir->watch );
+    maildir->watch = NULL;
+
+    if ( maildir->path && *(maildir->path) ) {
+        gchar   *path = g_build_filename( maildir->path, "new", NULL );
+
+        maildir->watch = xfce_mailwatch_watch_add( path, maildir_watch_cb, maildir );
+        g_free( path );
+    }
+}
+
 static void
 maildir_folder_set_cb( GtkWidget *button,
         XfceMailwatchMaildirMailbox *maildir )
@@ -284,6 +312,10 @@ maildir_folder_set_cb( GtkWidget *button,
     } else {
         maildir->path = g_strdup( "" );
     }
+    if( g_atomic_int_get( &maildir->running ) ) {
+        /* the old watch is still on the previous folder */
+        maildir_watch_path( maildir );
+    }
     g_mutex_unlock( maildir->mutex );
 
     DBG( "<<--" );
@@ -404,6 +436,22 @@ maildir_force_update_cb( XfceMailwatchMailbox *mailbox ) {
     DBG( "<<--" );
 }
 
+static gboolean
+maildir_watch_cb( gpointer data )
+{
+    XfceMailwatchMaildirMailbox     *maildir = XFCE_MAILWATCH_MAILDIR_MAILBOX( data );
+
+    if( g_atomic_pointer_get( &maildir->thread ) ) {
+        /* look again once it's done */
+        return FALSE;
+    }
+
+    if( g_atomic_int_get( &maildir->running ) )
+        maildir_force_update_cb( XFCE_MAILWATCH_MAILBOX( maildir ) );
+
+    return TRUE;
+}
+
 static void
 maildir_set_activated( XfceMailwatchMailbox *mailbox, gboolean activated )
 {
@@ -417,10 +465,18 @@ maildir_set_activated( XfceMailwatchMailbox *mailbox, gboolean activated )
     if( activated ) {
         g_atomic_int_set( &maildir->running, TRUE );
         maildir->check_id = g_timeout_add( maildir->interval * 1000, maildir_check_mail_timeout, maildir );
+
+        /* only new/ matters; the timeout stays for NFS */
+        g_mutex_lock( maildir->mutex );
+        maildir_watch_path( maildir );
+        g_mutex_unlock( maildir->mutex );
     } else {
         g_atomic_int_set( &maildir->running, FALSE );
         g_source_remove( maildir->check_id );
         maildir->check_id = 0;
+
+        xfce_mailwatch_watch_remove( maildir->watch );
+        maildir->watch = NULL;
     }
 
     DBG( "<<--" );
@@ -455,5 +511,6 @@ XfceMailwatchMailboxType    builtin_mailbox_type_maildir = {
     maildir_get_setup_page,
     maildir_restore_param_list,
     maildir_save_param_list,
-    maildir_free
+    maildir_free,
+    NULL
 };
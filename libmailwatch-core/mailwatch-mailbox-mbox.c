@@ -25,6 +25,10 @@
 #include <string.h>
 #endif
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -45,46 +49,874 @@
 #include <errno.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #include <gtk/gtk.h>
 
 #include <libxfce4util/libxfce4util.h>
 #include <libxfce4ui/libxfce4ui.h>
 
 #include "mailwatch.h"
+#include "mailwatch-common.h"
+#include "mailwatch-watch.h"
 
 #define XFCE_MAILWATCH_MBOX_MAILBOX( p )    ( (XfceMailwatchMboxMailbox *) p )
 #define BORDER                              ( 8 )
+/* big enough that the syscalls don't matter, small enough to stay in cache */
+#define MBOX_READ_SIZE                      ( 1024 * 1024 )
+/* reads start small, since an incremental scan usually doesn't go far */
+#define MBOX_FIRST_READ_SIZE                ( 64 * 1024 )
+/* headers bigger than this aren't worth reading again to check them */
+#define MBOX_MAX_HEADER_LEN                 ( 256 * 1024 )
+/* what reading a header again costs on top of its length, in bytes of
+ * scanning */
+#define MBOX_REREAD_COST                    ( 4 * 1024 )
+/* how far past a changed message to look for one that only moved */
+#define MBOX_RESYNC_WINDOW                  ( 64 )
+#define MBOX_MAX_RESYNCS                    ( 4 )
+#define MBOX_HASH_INIT                      G_GUINT64_CONSTANT( 14695981039346656037 )
+/* how long to wait for a delivery to finish before scanning anyway, and
+ * how often (in ms) to look again meanwhile */
+#define MBOX_WRITE_WAIT                     ( 5 )
+#define MBOX_WRITE_RETRY_DELAY              ( 500 )
+/* dotlocks older than this were left behind by something that died */
+#define MBOX_DOTLOCK_STALE                  ( 5 * 60 )
+/* the newline before a body's end, and maybe a blank line and "From " */
+#define MBOX_BODY_END_LEN                   ( 7 )
+
+#define MBOX_INDEX_MAGIC                    "XMWMBOXI"
+#define MBOX_INDEX_VERSION                  ( 1 )
+#define MBOX_INDEX_HEADER_LEN               ( 24 )
+#define MBOX_INDEX_RECORD_LEN               ( 20 )
+#define MBOX_INDEX_FLAG_NEW                 ( 1 << 0 )
 
 typedef struct {
     XfceMailwatchMailbox    xfce_mailwatch_mailbox;
     XfceMailwatch           *mailwatch;
 
-    gchar                   *fn;
-    time_t                  ctime;
-    size_t                  size;
-    guint                   new_messages;
+    gchar                   *fn;        /* a file, a directory or a pattern */
     guint                   interval;
+    gboolean                fast;       /* only say if there's new mail */
+    gint                    count_requested;
     
     gint                    running;
     gpointer                thread;  /* (GThread *) */
     guint                   check_id;
+    guint                   retry_id;   /* under settings_mutex */
+    XfceMailwatchWatch      *watch;
     GMutex                  *settings_mutex;
+
+    /* only the check thread touches this */
+    GList                   *files;     /* of MboxFile */
 } XfceMailwatchMboxMailbox;
 
+/* One of the spools a mailbox covers */
+typedef struct {
+    gchar                   *fn;
+    time_t                  ctime;
+    size_t                  size;
+    time_t                  mtime;      /* and size, when last counted */
+    guint                   new_messages;
+    guint                   num_new;    /* what was last reported */
+    struct _MboxIndex       *index;
+    time_t                  busy_since; /* when it was first found being written */
+    guint64                 busy_size;  /* still being written, even after waiting */
+} MboxFile;
+
+typedef struct {
+    guint64     offset;         /* of the From line */
+    guint32     header_len;     /* From line through the blank line */
+    guint32     header_hash;
+    gboolean    is_new;
+} MboxMessage;
+
+/* What we know about the spool from the last scan, so that the next one
+ * only has to look at what changed.  It's kept next to the other caches,
+ * in $XDG_CACHE_HOME/xfce4/mailwatch. */
+typedef struct _MboxIndex {
+    GArray      *messages;      /* of MboxMessage, in file order */
+    guint64     scan_end;       /* where the next scan picks up */
+
+    /* what the saved index holds, so that saving it only has to write
+     * what changed */
+    guint       saved_len;
+    guint       saved_unchanged;    /* how many of those still hold */
+    guint64     saved_scan_end;
+} MboxIndex;
+
+/* where the scanner is in the file, kept between reads */
+typedef struct {
+    guint       num_new;
+    gboolean    in_header;
+    gboolean    cur_new;
+    gboolean    skip_line;      /* in the middle of a line we don't care about */
+    guint64     pos;            /* file offset of the next byte to scan */
+    guint64     msg_offset;     /* where the current message starts */
+    guint64     hash;           /* of its headers so far */
+    gboolean    has_length;     /* it has a Content-Length header */
+    guint64     length;
+    guint64     body_end;       /* where the length says the body ends,
+                                 * if that's past the buffer; 0 if not */
+    GArray      *messages;      /* messages found are added here, if set */
+
+    /* The messages that came after the first changed one.  If one of them
+     * turns up again further along, the rest of the file probably just
+     * moved, and the scan can stop there. */
+    gint        fd;
+    guint64     size;
+    GArray      *old_tail;
+    guint       old_next;
+    guint64     old_scan_end;
+    gboolean    resynced;
+    guint       resync_len;     /* messages found before resyncing */
+    guint64     resume;         /* where to pick up after resyncing */
+} MboxScan;
+
+static gboolean mbox_message_reread( gint fd, const MboxMessage *msg,
+                                     gint64 delta, guint64 size,
+                                     MboxMessage *fresh );
+static gboolean mbox_watch_cb( gpointer data );
+static gboolean mbox_retry_cb( gpointer data );
+
+static inline guint64
+mbox_hash_update( guint64 hash, const gchar *data, gsize len )
+{
+    gsize           i;
+
+    /* 64-bit FNV-1a */
+    for ( i = 0; i < len; i++ ) {
+        hash ^= (guchar)data[i];
+        hash *= G_GUINT64_CONSTANT( 1099511628211 );
+    }
+
+    return ( hash );
+}
+
 static void
-mbox_check_mail( XfceMailwatchMboxMailbox *mbox )
+mbox_scan_header_line( MboxScan *scan, const gchar *line, gsize len )
+{
+    if ( len == 0 ) {
+        scan->in_header = FALSE;
+
+        if ( scan->cur_new ) {
+            scan->num_new++;
+        }
+    }
+    else if ( len >= 8 && !memcmp( line, "Status: ", 8 ) ) {
+        if ( memchr( line + 8, 'R', len - 8 ) || memchr( line + 8, 'O', len - 8 ) ) {
+            scan->cur_new = FALSE;
+        }
+    }
+    else if ( len >= 18 && !memcmp( line, "X-Mozilla-Status: ", 18 ) ) {
+        if ( len < 22 || memcmp( line + 18, "0000", 4 ) ) {
+            scan->cur_new = FALSE;
+        }
+    }
+    else if ( len >= 15 && !g_ascii_strncasecmp( line, "Content-Length:", 15 ) ) {
+        gsize       i = 15;
+        guint64     length = 0;
+
+        while ( i < len && ( line[i] == ' ' || line[i] == '\t' ) ) {
+            i++;
+        }
+        scan->has_length = ( i < len && g_ascii_isdigit( line[i] ) );
+        for ( ; i < len && g_ascii_isdigit( line[i] ) && length < ( G_GUINT64_CONSTANT( 1 ) << 48 ); i++ ) {
+            length = length * 10 + ( line[i] - '0' );
+        }
+        scan->length = length;
+    }
+}
+
+/* Checks where a Content-Length says a body ends, given what's in the file
+ * from just before there: it has to end a line, and be followed by the end
+ * of the file or a From line, maybe after a blank line.  Less than
+ * MBOX_BODY_END_LEN bytes means the file ends there.  Returns where the
+ * next message starts, or 0 if the length is wrong. */
+static guint64
+mbox_body_end_check( const gchar *data, gsize len, guint64 end )
+{
+    if ( len == 0 || data[0] != '\n' ) {
+        return ( 0 );
+    }
+    if ( len == 1 || ( len >= 6 && !memcmp( data + 1, "From ", 5 ) ) ) {
+        return ( end );
+    }
+    if ( data[1] == '\n' && ( len == 2 || ( len >= 7 && !memcmp( data + 2, "From ", 5 ) ) ) ) {
+        return ( end + 1 );
+    }
+
+    return ( 0 );
+}
+
+static void
+mbox_scan_try_resync( MboxScan *scan, const MboxMessage *msg )
+{
+    GArray          *tail = scan->old_tail;
+    const MboxMessage *old = NULL, *last;
+    MboxMessage     moved, fresh;
+    gint64          delta;
+    guint           i;
+
+    for ( i = scan->old_next; i < tail->len && i < scan->old_next + MBOX_RESYNC_WINDOW; i++ ) {
+        old = &g_array_index( tail, MboxMessage, i );
+        if ( old->header_hash == msg->header_hash && old->header_len == msg->header_len ) {
+            break;
+        }
+    }
+    if ( i >= tail->len || i >= scan->old_next + MBOX_RESYNC_WINDOW ) {
+        return;
+    }
+
+    /* make sure the end of the file moved by as much */
+    delta = (gint64)msg->offset - (gint64)old->offset;
+    last = &g_array_index( tail, MboxMessage, tail->len - 1 );
+    if ( (gint64)scan->old_scan_end + delta > (gint64)scan->size
+         || !mbox_message_reread( scan->fd, last, delta, scan->size, &fresh )
+         || fresh.header_hash != last->header_hash )
+    {
+        scan->old_next = i + 1;
+        return;
+    }
+
+    scan->resync_len = scan->messages->len;
+    for ( i++; i < tail->len; i++ ) {
+        moved = g_array_index( tail, MboxMessage, i );
+        moved.offset += delta;
+        g_array_append_val( scan->messages, moved );
+    }
+
+    DBG( "the rest of the file moved by %" G_GINT64_FORMAT " bytes", delta );
+    scan->resynced = TRUE;
+    scan->resume = scan->old_scan_end + delta;
+}
+
+static void
+mbox_scan_end_header( MboxScan *scan, guint64 end )
+{
+    MboxMessage     msg;
+
+    if ( !scan->messages ) {
+        return;
+    }
+
+    msg.offset = scan->msg_offset;
+    msg.header_len = (guint32)MIN( end - scan->msg_offset, G_MAXUINT32 );
+    msg.header_hash = (guint32)( scan->hash ^ ( scan->hash >> 32 ) );
+    msg.is_new = scan->cur_new;
+    g_array_append_val( scan->messages, msg );
+
+    if ( scan->old_tail && scan->old_tail->len ) {
+        mbox_scan_try_resync( scan, &msg );
+    }
+}
+
+/* Scans as much of buf as it can, and returns how much that was.  Whatever
+ * is left over is the start of a line that continues past the end of buf,
+ * and has to be passed in again with what comes after it.  Only header
+ * lines are looked at; bodies are skipped a line at a time with memchr(),
+ * stopping only to see if the next line starts with "From ". */
+static gsize
+mbox_scan_block( MboxScan *scan, const gchar *buf, gsize len, gboolean eof )
+{
+    const gchar     *p = buf, *end = buf + len, *nl, *next;
+    gsize           consumed = len;
+
+    while ( p < end && !scan->resynced ) {
+        if ( scan->skip_line ) {
+            nl = memchr( p, '\n', end - p );
+            next = nl ? nl + 1 : end;
+            if ( scan->in_header ) {
+                scan->hash = mbox_hash_update( scan->hash, p, next - p );
+            }
+            scan->skip_line = ( nl == NULL );
+            p = next;
+            continue;
+        }
+
+        if ( !scan->in_header ) {
+            if ( end - p < 5 ) {
+                /* can't tell yet if it's a From line */
+                if ( !eof ) {
+                    consumed = p - buf;
+                }
+                break;
+            }
+            if ( !memcmp( p, "From ", 5 ) ) {
+                scan->in_header = TRUE;
+                scan->cur_new = TRUE;
+                scan->has_length = FALSE;
+                scan->msg_offset = scan->pos + ( p - buf );
+                scan->hash = MBOX_HASH_INIT;
+            }
+            scan->skip_line = TRUE;
+            continue;
+        }
+
+        nl = memchr( p, '\n', end - p );
+        if ( !nl ) {
+            if ( eof ) {
+                mbox_scan_header_line( scan, p, end - p );
+            }
+            else if ( p == buf ) {
+                /* a header line longer than the buffer can't be one we
+                 * care about */
+                scan->skip_line = TRUE;
+                continue;
+            }
+            else {
+                consumed = p - buf;
+            }
+            break;
+        }
+
+        scan->hash = mbox_hash_update( scan->hash, p, nl + 1 - p );
+        mbox_scan_header_line( scan, p, nl - p );
+        p = nl + 1;
+
+        if ( !scan->in_header ) {
+            mbox_scan_end_header( scan, scan->pos + ( p - buf ) );
+
+            if ( scan->has_length && !scan->resynced ) {
+                /* Skip the body, if the length looks right */
+                guint64     end = scan->pos + ( p - buf ) + scan->length;
+                gint64      avail = (gint64)( scan->pos + len ) - (gint64)( end - 1 );
+                guint64     next;
+
+                scan->has_length = FALSE;
+                if ( avail >= MBOX_BODY_END_LEN || ( eof && avail >= 0 ) ) {
+                    next = mbox_body_end_check( buf + ( end - 1 - scan->pos ),
+                                                MIN( avail, MBOX_BODY_END_LEN ), end );
+                    if ( next ) {
+                        p = buf + ( next - scan->pos );
+                    }
+                }
+                else if ( !eof ) {
+                    /* It's past the buffer; let the caller look */
+                    scan->body_end = end;
+                    consumed = p - buf;
+                    break;
+                }
+            }
+        }
+    }
+
+    scan->pos += consumed;
+
+    return ( consumed );
+}
+
+/* Scans from scan->pos to the end of the file.  Returns FALSE if the scan
+ * was cut short, either by an error (which is logged) or because the
+ * mailbox was deactivated. */
+static gboolean
+mbox_scan_file( XfceMailwatchMboxMailbox *mbox, const gchar *mailbox,
+                gint fd, MboxScan *scan )
+{
+    gchar           *buf;
+    gsize           filled = 0, consumed, chunk = MBOX_FIRST_READ_SIZE;
+    gssize          n;
+    gboolean        ret = TRUE;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise( fd, scan->pos, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+
+    buf = g_malloc( MBOX_READ_SIZE );
+
+    for ( ;; ) {
+        n = pread( fd, buf + filled, MIN( chunk, MBOX_READ_SIZE - filled ),
+                   scan->pos + filled );
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            xfce_mailwatch_log_message( mbox->mailwatch,
+                                        XFCE_MAILWATCH_MAILBOX( mbox ),
+                                        XFCE_MAILWATCH_LOG_ERROR,
+                                        _( "Failed to read from file %s: %s" ),
+                                        mailbox, g_strerror( errno ) );
+            ret = FALSE;
+            break;
+        }
+        filled += n;
+
+        consumed = mbox_scan_block( scan, buf, filled, n == 0 );
+        if ( scan->body_end ) {
+            gchar       tail[MBOX_BODY_END_LEN];
+            gssize      got;
+            guint64     next;
+
+            got = pread( fd, tail, sizeof( tail ), scan->body_end - 1 );
+            next = got > 0 ? mbox_body_end_check( tail, got, scan->body_end ) : 0;
+            scan->body_end = 0;
+            if ( next ) {
+                /* Whatever's in the buffer is part of the body */
+                scan->pos = next;
+                filled = 0;
+                continue;
+            }
+        }
+        else if ( n == 0 || scan->resynced ) {
+            break;
+        }
+        memmove( buf, buf + consumed, filled - consumed );
+        filled -= consumed;
+        chunk = MIN( chunk * 2, MBOX_READ_SIZE );
+
+        if( !g_atomic_int_get( &mbox->running ) ) {
+            ret = FALSE;
+            break;
+        }
+    }
+
+    g_free( buf );
+
+    return ( ret );
+}
+
+/* Reads the header block msg describes again, moved by delta bytes, and
+ * parses it into fresh.  Returns FALSE if there isn't a header block of the
+ * same length there any more. */
+static gboolean
+mbox_message_reread( gint fd, const MboxMessage *msg, gint64 delta,
+                     guint64 size, MboxMessage *fresh )
+{
+    guint64         offset = msg->offset + delta;
+    gchar           *buf;
+    MboxScan        scan;
+    GArray          *found;
+    gboolean        ret = FALSE;
+
+    if ( msg->header_len > MBOX_MAX_HEADER_LEN || offset + msg->header_len > size ) {
+        return ( FALSE );
+    }
+
+    buf = g_malloc( msg->header_len );
+    if ( pread( fd, buf, msg->header_len, offset ) == (gssize)msg->header_len ) {
+        found = g_array_new( FALSE, FALSE, sizeof( MboxMessage ) );
+        memset( &scan, 0, sizeof( scan ) );
+        scan.pos = offset;
+        scan.messages = found;
+        mbox_scan_block( &scan, buf, msg->header_len, TRUE );
+
+        if ( found->len == 1
+             && g_array_index( found, MboxMessage, 0 ).offset == offset
+             && g_array_index( found, MboxMessage, 0 ).header_len == msg->header_len )
+        {
+            *fresh = g_array_index( found, MboxMessage, 0 );
+            ret = TRUE;
+        }
+        g_array_free( found, TRUE );
+    }
+    g_free( buf );
+
+    return ( ret );
+}
+
+/* A "From " at the start of a line is where a message starts, whatever was
+ * there before. */
+static gboolean
+mbox_is_message_start( gint fd, guint64 offset, guint64 size )
+{
+    gchar           buf[6];
+
+    if ( offset == 0 ) {
+        return ( size >= 5 && pread( fd, buf, 5, 0 ) == 5 && !memcmp( buf, "From ", 5 ) );
+    }
+
+    return ( offset + 5 <= size && pread( fd, buf, 6, offset - 1 ) == 6
+             && !memcmp( buf, "\nFrom ", 6 ) );
+}
+
+/* Finds the first message that isn't where the index says it is, assuming
+ * that a rewrite changes everything from the first message it touches on.
+ * Marking a message read is often done by rewriting its Status header in
+ * place, so the new messages before it are read again, but only while
+ * that's cheaper than scanning on from one of them.  The index is cut off
+ * where scanning has to start, and the messages from the first changed one
+ * on are put into old_tail.  The first n_scanned messages were just
+ * scanned, and are taken as they are.  Returns where scanning has to pick
+ * up again. */
+static guint64
+mbox_index_validate( MboxIndex *index, gint fd, guint64 size, guint n_scanned,
+                     GArray **old_tail )
 {
-    gchar           *mailbox;
+    GArray          *messages = index->messages;
+    MboxMessage     *msg, fresh;
+    guint           lo = n_scanned, hi = messages->len, mid, i, cut;
+    guint64         resume, end, cost, best;
+
+    while ( lo < hi ) {
+        mid = lo + ( hi - lo ) / 2;
+        msg = &g_array_index( messages, MboxMessage, mid );
+        if ( mbox_message_reread( fd, msg, 0, size, &fresh )
+             && fresh.header_hash == msg->header_hash )
+        {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    /* Cutting the index at a new message costs reading the new ones
+     * before it again, and scanning from it to where scanning starts
+     * anyway */
+    end = ( lo < messages->len ? g_array_index( messages, MboxMessage, lo ).offset
+                               : index->scan_end );
+    for ( i = n_scanned, best = 0; i < lo; i++ ) {
+        msg = &g_array_index( messages, MboxMessage, i );
+        if ( msg->is_new ) {
+            best += msg->header_len + MBOX_REREAD_COST;
+        }
+    }
+    for ( i = n_scanned, cost = 0, cut = lo; i < lo; i++ ) {
+        msg = &g_array_index( messages, MboxMessage, i );
+        if ( msg->is_new ) {
+            if ( cost + ( end - msg->offset ) < best ) {
+                best = cost + ( end - msg->offset );
+                cut = i;
+            }
+            cost += msg->header_len + MBOX_REREAD_COST;
+        }
+    }
+
+    for ( i = n_scanned; i < cut; i++ ) {
+        msg = &g_array_index( messages, MboxMessage, i );
+        if ( msg->is_new ) {
+            if ( !mbox_message_reread( fd, msg, 0, size, &fresh ) ) {
+                cut = i;
+                break;
+            }
+            if ( fresh.header_hash != msg->header_hash || !fresh.is_new ) {
+                index->saved_unchanged = MIN( index->saved_unchanged, i );
+            }
+            *msg = fresh;
+        }
+    }
+    if ( cut < lo ) {
+        DBG( "scanning again from message %u of %u", cut, messages->len );
+    }
+
+    *old_tail = g_array_new( FALSE, FALSE, sizeof( MboxMessage ) );
+    if ( lo < messages->len ) {
+        g_array_append_vals( *old_tail, &g_array_index( messages, MboxMessage, lo ),
+                             messages->len - lo );
+    }
+    if ( cut < messages->len ) {
+        resume = g_array_index( messages, MboxMessage, cut ).offset;
+        g_array_set_size( messages, cut );
+        index->saved_unchanged = MIN( index->saved_unchanged, cut );
+    }
+    else {
+        resume = index->scan_end;
+    }
+
+    if ( resume == size || mbox_is_message_start( fd, resume, size ) ) {
+        return ( resume );
+    }
+
+    /* the body before it changed too; start over from the end of the last
+     * good header */
+    if ( messages->len ) {
+        msg = &g_array_index( messages, MboxMessage, messages->len - 1 );
+        return ( msg->offset + msg->header_len );
+    }
+
+    return ( 0 );
+}
+
+/* Whether something, most likely the MDA, is in the middle of writing to
+ * the spool: it holds a dotlock or an fcntl() lock on it, or the file
+ * doesn't end at the end of a line. */
+static gboolean
+mbox_is_being_written( const gchar *mailbox, gint fd, guint64 size )
+{
+    gchar           *lock_fn, last;
     struct stat     st;
-    guint           num_new = 0;
+    struct flock    fl;
+    gboolean        locked;
+
+    lock_fn = g_strconcat( mailbox, ".lock", NULL );
+    locked = ( stat( lock_fn, &st ) == 0 && st.st_mtime + MBOX_DOTLOCK_STALE > time( NULL ) );
+    g_free( lock_fn );
+    if ( locked ) {
+        DBG( "%s is dotlocked", mailbox );
+        return ( TRUE );
+    }
+
+    /* A reader is only kept out by a write lock */
+    memset( &fl, 0, sizeof( fl ) );
+    fl.l_type = F_RDLCK;
+    fl.l_whence = SEEK_SET;
+    if ( fcntl( fd, F_GETLK, &fl ) == 0 && fl.l_type != F_UNLCK ) {
+        DBG( "%s is locked by process %d", mailbox, (gint)fl.l_pid );
+        return ( TRUE );
+    }
+
+    if ( size > 0
+         && ( pread( fd, &last, 1, size - 1 ) != 1 || last != '\n' ) )
+    {
+        DBG( "%s ends in the middle of a line", mailbox );
+        return ( TRUE );
+    }
+
+    return ( FALSE );
+}
+
+static MboxIndex *
+mbox_index_new( void )
+{
+    MboxIndex       *index = g_new0( MboxIndex, 1 );
+
+    index->messages = g_array_new( FALSE, FALSE, sizeof( MboxMessage ) );
+
+    return ( index );
+}
+
+static void
+mbox_index_free( MboxIndex *index )
+{
+    g_array_free( index->messages, TRUE );
+    g_free( index );
+}
+
+static gchar *
+mbox_index_filename( const gchar *mailbox )
+{
+    gchar           *checksum, *basename, *filename;
+
+    checksum = g_compute_checksum_for_string( G_CHECKSUM_MD5, mailbox, -1 );
+    basename = g_strconcat( "mbox-index-", checksum, NULL );
+    filename = g_build_filename( g_get_user_cache_dir(), "xfce4", "mailwatch",
+                                 basename, NULL );
+    g_free( basename );
+    g_free( checksum );
+
+    return ( filename );
+}
+
+/* The file is the magic, the version and the number of messages (32-bit)
+ * and where the next scan picks up (64-bit), followed by a record for each
+ * message: its offset (64-bit), header length, header hash and flags
+ * (32-bit), all little-endian.  Returns an empty index if there's no
+ * usable one. */
+static MboxIndex *
+mbox_index_load( const gchar *filename )
+{
+    MboxIndex       *index = mbox_index_new();
+    gchar           *contents = NULL, *p;
+    gsize           len = 0;
+    guint32         version, n_messages, u32;
+    guint64         u64;
+    MboxMessage     msg;
+    guint           i;
+
+    if ( !g_file_get_contents( filename, &contents, &len, NULL ) ) {
+        return ( index );
+    }
+
+    if ( len < MBOX_INDEX_HEADER_LEN || memcmp( contents, MBOX_INDEX_MAGIC, 8 ) ) {
+        DBG( "ignoring corrupt mbox index %s", filename );
+        g_free( contents );
+        return ( index );
+    }
+
+    memcpy( &version, contents + 8, 4 );
+    memcpy( &n_messages, contents + 12, 4 );
+    n_messages = GUINT32_FROM_LE( n_messages );
+    if ( GUINT32_FROM_LE( version ) != MBOX_INDEX_VERSION
+         || len != MBOX_INDEX_HEADER_LEN + (gsize)n_messages * MBOX_INDEX_RECORD_LEN )
+    {
+        DBG( "ignoring stale or corrupt mbox index %s", filename );
+        g_free( contents );
+        return ( index );
+    }
+
+    memcpy( &u64, contents + 16, 8 );
+    index->scan_end = GUINT64_FROM_LE( u64 );
+
+    g_array_set_size( index->messages, n_messages );
+    g_array_set_size( index->messages, 0 );
+    for ( i = 0, p = contents + MBOX_INDEX_HEADER_LEN; i < n_messages; i++ ) {
+        memcpy( &u64, p, 8 );
+        msg.offset = GUINT64_FROM_LE( u64 );
+        memcpy( &u32, p + 8, 4 );
+        msg.header_len = GUINT32_FROM_LE( u32 );
+        memcpy( &u32, p + 12, 4 );
+        msg.header_hash = GUINT32_FROM_LE( u32 );
+        memcpy( &u32, p + 16, 4 );
+        msg.is_new = ( GUINT32_FROM_LE( u32 ) & MBOX_INDEX_FLAG_NEW ) != 0;
+        g_array_append_val( index->messages, msg );
+        p += MBOX_INDEX_RECORD_LEN;
+    }
+    g_free( contents );
+
+    index->saved_len = index->saved_unchanged = n_messages;
+    index->saved_scan_end = index->scan_end;
+
+    DBG( "loaded %u messages from %s", n_messages, filename );
+
+    return ( index );
+}
+
+static void
+mbox_index_encode( MboxIndex *index, guint first, gchar *p )
+{
+    guint32         u32;
+    guint64         u64;
+    MboxMessage     *msg;
+    guint           i;
+
+    for ( i = first; i < index->messages->len; i++ ) {
+        msg = &g_array_index( index->messages, MboxMessage, i );
+        u64 = GUINT64_TO_LE( msg->offset );
+        memcpy( p, &u64, 8 );
+        u32 = GUINT32_TO_LE( msg->header_len );
+        memcpy( p + 8, &u32, 4 );
+        u32 = GUINT32_TO_LE( msg->header_hash );
+        memcpy( p + 12, &u32, 4 );
+        u32 = GUINT32_TO_LE( msg->is_new ? MBOX_INDEX_FLAG_NEW : 0 );
+        memcpy( p + 16, &u32, 4 );
+        p += MBOX_INDEX_RECORD_LEN;
+    }
+}
+
+/* Adds the messages found since the index was saved to the end of the
+ * file, and then the new count and scan_end, so that the file only looks
+ * right once it's all there.  Returns FALSE if it has to be written
+ * anew. */
+static gboolean
+mbox_index_append( MboxIndex *index, const gchar *filename )
+{
+    gchar           *contents, head[12];
+    gsize           len;
+    guint32         u32;
+    guint64         u64;
+    struct stat     st;
+    gint            fd;
+    gboolean        ret;
+
+    fd = open( filename, O_WRONLY );
+    if ( fd < 0 ) {
+        return ( FALSE );
+    }
+    if ( fstat( fd, &st ) != 0
+         || (guint64)st.st_size != MBOX_INDEX_HEADER_LEN + (guint64)index->saved_len * MBOX_INDEX_RECORD_LEN )
+    {
+        close( fd );
+        return ( FALSE );
+    }
+
+    len = (gsize)( index->messages->len - index->saved_len ) * MBOX_INDEX_RECORD_LEN;
+    contents = g_malloc( len + 1 );
+    mbox_index_encode( index, index->saved_len, contents );
+
+    u32 = GUINT32_TO_LE( index->messages->len );
+    memcpy( head, &u32, 4 );
+    u64 = GUINT64_TO_LE( index->scan_end );
+    memcpy( head + 4, &u64, 8 );
+
+    ret = ( pwrite( fd, contents, len, st.st_size ) == (gssize)len
+            && pwrite( fd, head, sizeof( head ), 12 ) == sizeof( head ) );
+    g_free( contents );
+
+    if ( close( fd ) != 0 ) {
+        ret = FALSE;
+    }
+
+    return ( ret );
+}
+
+/* Most checks only find a few more messages, so only those are written
+ * out, unless something before them changed */
+static void
+mbox_index_save( MboxIndex *index, const gchar *filename )
+{
+    gchar           *contents, *dirname;
+    gsize           len;
+    guint32         u32;
+    guint64         u64;
+    GError          *error = NULL;
+
+    if ( index->saved_unchanged == index->saved_len
+         && index->saved_len <= index->messages->len )
+    {
+        if ( index->saved_len == index->messages->len
+             && index->saved_scan_end == index->scan_end )
+        {
+            return;
+        }
+        if ( mbox_index_append( index, filename ) ) {
+            index->saved_len = index->saved_unchanged = index->messages->len;
+            index->saved_scan_end = index->scan_end;
+            return;
+        }
+    }
+
+    dirname = g_path_get_dirname( filename );
+    g_mkdir_with_parents( dirname, 0700 );
+    g_free( dirname );
+
+    len = MBOX_INDEX_HEADER_LEN + (gsize)index->messages->len * MBOX_INDEX_RECORD_LEN;
+    contents = g_malloc( len );
+    memcpy( contents, MBOX_INDEX_MAGIC, 8 );
+    u32 = GUINT32_TO_LE( MBOX_INDEX_VERSION );
+    memcpy( contents + 8, &u32, 4 );
+    u32 = GUINT32_TO_LE( index->messages->len );
+    memcpy( contents + 12, &u32, 4 );
+    u64 = GUINT64_TO_LE( index->scan_end );
+    memcpy( contents + 16, &u64, 8 );
+    mbox_index_encode( index, 0, contents + MBOX_INDEX_HEADER_LEN );
+
+    if ( g_file_set_contents( filename, contents, len, &error ) ) {
+        index->saved_len = index->saved_unchanged = index->messages->len;
+        index->saved_scan_end = index->scan_end;
+    }
+    else {
+        g_warning( "Mailwatch: Unable to write mbox index: %s", error->message );
+        g_error_free( error );
+        index->saved_len = index->saved_unchanged = 0;
+    }
 
+    g_free( contents );
+}
+
+/* Looks at the spools again soon, for one that was being written to */
+static void
+mbox_retry_later( XfceMailwatchMboxMailbox *mbox )
+{
     g_mutex_lock( mbox->settings_mutex );
-    if ( !mbox->fn ) {
-        g_mutex_unlock( mbox->settings_mutex );
-        return;
+    if ( !mbox->retry_id && g_atomic_int_get( &mbox->running ) ) {
+        DBG( "looking again in %dms", MBOX_WRITE_RETRY_DELAY );
+        mbox->retry_id = g_timeout_add( MBOX_WRITE_RETRY_DELAY, mbox_retry_cb, mbox );
+    }
+    g_mutex_unlock( mbox->settings_mutex );
+}
+
+/* Drops a retry mbox_retry_later() set up */
+static void
+mbox_retry_cancel( XfceMailwatchMboxMailbox *mbox )
+{
+    g_mutex_lock( mbox->settings_mutex );
+    if ( mbox->retry_id ) {
+        g_source_remove( mbox->retry_id );
+        mbox->retry_id = 0;
     }
-    mailbox = g_strdup( mbox->fn );
     g_mutex_unlock( mbox->settings_mutex );
+}
+
+/* Brings file->num_new up to date.  In fast mode only stat() is used,
+ * unless a count was asked for. */
+static void
+mbox_check_file( XfceMailwatchMboxMailbox *mbox, MboxFile *file,
+                 gboolean fast, gboolean count )
+{
+    const gchar     *mailbox = file->fn;
+    struct stat     st;
+    guint           num_new = 0;
 
     /* For some reason g_stat() doesn't update
      * ctime */
@@ -94,107 +926,367 @@ mbox_check_mail( XfceMailwatchMboxMailbox *mbox )
                                     XFCE_MAILWATCH_LOG_ERROR,
                                     _( "Failed to get status of file %s: %s" ),
                                     mailbox, g_strerror( errno ) );
-        g_free( mailbox );
         return;
     }
 
-    if ( st.st_ctime > mbox->ctime ) {
-        gboolean        in_header = FALSE;
-        gboolean        cur_new = FALSE;
-        gchar           *p;
-        GIOChannel      *ioc;
-        gsize           nl;
-        GError          *error = NULL;
-
-        num_new = 0;
+    if ( fast && !count ) {
+        /* Like a shell's "You have new mail": there's new mail if the
+         * spool was written after it was last read.  A count made since
+         * it was last written still holds. */
+        if ( st.st_size == 0 || st.st_mtime <= st.st_atime ) {
+            file->num_new = 0;
+        }
+        else if ( st.st_mtime == file->mtime && (size_t)st.st_size == file->size ) {
+            file->num_new = file->new_messages;
+        }
+        else {
+            file->num_new = 1;
+        }
+        return;
+    }
 
-        ioc = g_io_channel_new_file( mailbox, "r", &error );
-        if ( !ioc ) {
+    if ( st.st_ctime > file->ctime || (size_t)st.st_size != file->size
+         || st.st_mtime != file->mtime || !file->index )
+    {
+        MboxIndex       *index;
+        MboxScan        scan;
+        GArray          *old_tail;
+        gchar           *index_filename;
+        gint            fd, pass;
+        gboolean        ok = TRUE;
+        guint64         resume, scanned = 0;
+        guint           i, n_scanned = 0;
+        time_t          atime, touched_ctime = 0;
+        CHECK_TIMER_INIT;
+
+        atime = st.st_atime;
+        fd = open( mailbox, O_RDONLY );
+        if ( fd < 0 ) {
             xfce_mailwatch_log_message( mbox->mailwatch,
                                         XFCE_MAILWATCH_MAILBOX( mbox ),
                                         XFCE_MAILWATCH_LOG_ERROR,
-                                        error->message );
-            g_free( mailbox );
-            g_error_free( error );
+                                        _( "Failed to open file %s: %s" ),
+                                        mailbox, g_strerror( errno ) );
             return;
         }
-        if ( g_io_channel_set_encoding( ioc, NULL, &error ) != G_IO_STATUS_NORMAL ) {
-            xfce_mailwatch_log_message( mbox->mailwatch,
-                                        XFCE_MAILWATCH_MAILBOX( mbox ),
-                                        XFCE_MAILWATCH_LOG_WARNING,
-                                        error->message );
-            g_error_free( error );
-            error = NULL;
-        }
-       
-        if ( mbox->size && st.st_size > (guint)mbox->size ) {
-            /* G_SEEK_CUR is same as G_SEEK_SET in this context. */
-            if ( g_io_channel_seek_position( ioc, mbox->size, G_SEEK_CUR, &error ) !=  G_IO_STATUS_NORMAL ) {
-                xfce_mailwatch_log_message( mbox->mailwatch,
-                                            XFCE_MAILWATCH_MAILBOX( mbox ),
-                                            XFCE_MAILWATCH_LOG_ERROR,
-                                            error->message );
-                g_io_channel_unref( ioc );
-                g_free( mailbox );
-                g_error_free( error );
+
+        /* Scanning a message that's still being delivered would count it
+         * half written, and the next check would have to look at it again.
+         * Rather than hold up the other spools, keep the last count and
+         * look again shortly. */
+        if ( (guint64)st.st_size != file->busy_size
+             && mbox_is_being_written( mailbox, fd, st.st_size ) )
+        {
+            if ( !file->busy_since ) {
+                file->busy_since = time( NULL );
+            }
+            if ( time( NULL ) - file->busy_since < MBOX_WRITE_WAIT ) {
+                close( fd );
+                mbox_retry_later( mbox );
+                file->num_new = file->new_messages;
                 return;
             }
-            num_new += mbox->new_messages;
+            /* Don't wait for the same lock or unfinished line again */
+            DBG( "gave up waiting for %s to be written", mailbox );
+            file->busy_size = st.st_size;
         }
+        file->busy_since = 0;
 
-        while ( g_io_channel_read_line( ioc, &p, NULL, &nl, NULL ) == G_IO_STATUS_NORMAL ) {
-            p[nl] = 0;
-            
-            if ( !in_header ) {
-                if ( !strncmp( p, "From ", 5 ) ) {
-                    in_header = TRUE;
-                    cur_new = TRUE;
-                }
+        index_filename = mbox_index_filename( mailbox );
+        if ( !file->index ) {
+            file->index = mbox_index_load( index_filename );
+        }
+        index = file->index;
+
+        CHECK_TIMER_START;
+        for ( pass = 0; ; pass++ ) {
+            resume = mbox_index_validate( index, fd, st.st_size, n_scanned, &old_tail );
+
+            memset( &scan, 0, sizeof( scan ) );
+            scan.pos = resume;
+            scan.messages = index->messages;
+            if ( pass < MBOX_MAX_RESYNCS ) {
+                scan.fd = fd;
+                scan.size = st.st_size;
+                scan.old_tail = old_tail;
+                scan.old_scan_end = index->scan_end;
             }
-            else {
-                if ( *p == 0 ) {
-                    in_header = FALSE;
 
-                    if ( cur_new ) {
-                        num_new++;
-                    }
-                }
-                else if ( !strncmp( p, "Status: ", 8 ) ) {
-                    gchar       *q = p + 8;
-                    if ( strchr( q, 'R' ) || strchr( q, 'O' ) ) {
-                        cur_new = FALSE;
-                    }
-                }
-                else if ( !strncmp( p, "X-Mozilla-Status: ", 18 ) ) {
-                    if ( strncmp( p + 18, "0000", 4 ) ) {
-                        cur_new = FALSE;
-                    }
+            ok = mbox_scan_file( mbox, mailbox, fd, &scan );
+            g_array_free( old_tail, TRUE );
+            if ( !ok ) {
+                break;
+            }
+            scanned += scan.pos - resume;
+
+            if ( !scan.resynced ) {
+                index->scan_end = scan.in_header ? scan.msg_offset : scan.pos;
+                break;
+            }
+            index->scan_end = scan.resume;
+            n_scanned = scan.resync_len;
+        }
+        DBG( "scanned %" G_GUINT64_FORMAT " of %lu bytes of %s in %.3fs",
+             scanned, (gulong)st.st_size, mailbox, CHECK_TIMER_ELAPSED );
+        CHECK_TIMER_FREE;
+#ifdef UTIME_OMIT
+        if ( fast ) {
+            /* Reading the spool mustn't look like the user read it, or
+             * the fast check would stop seeing the new mail */
+            struct timespec     times[2];
+
+            times[0].tv_sec = atime;
+            times[0].tv_nsec = 0;
+            times[1].tv_sec = 0;
+            times[1].tv_nsec = UTIME_OMIT;
+            if ( futimens( fd, times ) == 0 ) {
+                struct stat     touched;
+
+                /* Setting atime moves ctime too; remember where it
+                 * went, or the next check would scan all over again */
+                if ( fstat( fd, &touched ) == 0 ) {
+                    touched_ctime = touched.st_ctime;
                 }
             }
-            g_free( p );
+        }
+#endif
+        close( fd );
+
+        if ( !ok ) {
+            /* the index is only half updated; start again from the saved
+             * one next time */
+            mbox_index_free( file->index );
+            file->index = NULL;
+            g_free( index_filename );
+            return;
+        }
 
-            if( !g_atomic_int_get( &mbox->running ) ) {
-                g_io_channel_unref( ioc );
-                g_free( mailbox );
-                return;
+        mbox_index_save( index, index_filename );
+        g_free( index_filename );
+
+        for ( i = 0; i < index->messages->len; i++ ) {
+            if ( g_array_index( index->messages, MboxMessage, i ).is_new ) {
+                num_new++;
             }
         }
-        g_io_channel_unref( ioc );
-        
-        if ( st.st_size > (guint)mbox->size && num_new <= mbox->new_messages ) {
-            /* Assume mailbox opened and some headers added by client */
-            num_new = mbox->new_messages = 0;
+        file->new_messages = num_new;
+
+        file->ctime = st.st_ctime;
+        file->size = st.st_size;
+        file->mtime = st.st_mtime;
+        if ( st.st_ctime >= time( NULL ) ) {
+            /* Another change this second wouldn't move ctime, so look
+             * again next time */
+            file->ctime--;
         }
-        else {
-            mbox->new_messages = num_new;
+        else if ( touched_ctime ) {
+            /* A write after the scan but in the same second as the
+             * atime reset still changes the size or mtime */
+            file->ctime = touched_ctime;
         }
+    }
+    file->num_new = file->new_messages;
+}
+
+static gboolean
+mbox_is_pattern( const gchar *path )
+{
+    const gchar     *base = strrchr( path, G_DIR_SEPARATOR );
+
+    base = base ? base + 1 : path;
+
+    return ( strchr( base, '*' ) || strchr( base, '?' ) );
+}
+
+static gint
+mbox_path_compare( gconstpointer a, gconstpointer b )
+{
+    return ( strcmp( *(const gchar **) a, *(const gchar **) b ) );
+}
+
+/* Lists the spools a source names: the file itself, every file in a
+ * directory, or the files matching a pattern in the last component.  The
+ * names come back sorted, and *multi says whether the source can name
+ * more than one. */
+static GPtrArray *
+mbox_list_files( XfceMailwatchMboxMailbox *mbox, const gchar *source,
+                 gboolean *multi )
+{
+    GPtrArray       *paths = g_ptr_array_new();
+    GPatternSpec    *pattern = NULL;
+    gchar           *dirname;
+    GDir            *dir;
+    GError          *error = NULL;
+    const gchar     *entry;
+
+    if ( mbox_is_pattern( source ) ) {
+        gchar   *base = g_path_get_basename( source );
+
+        pattern = g_pattern_spec_new( base );
+        dirname = g_path_get_dirname( source );
+        g_free( base );
+    }
+    else if ( g_file_test( source, G_FILE_TEST_IS_DIR ) ) {
+        dirname = g_strdup( source );
+    }
+    else {
+        *multi = FALSE;
+        g_ptr_array_add( paths, g_strdup( source ) );
+        return ( paths );
+    }
+    *multi = TRUE;
+
+    dir = g_dir_open( dirname, 0, &error );
+    if ( !dir ) {
+        xfce_mailwatch_log_message( mbox->mailwatch,
+                                    XFCE_MAILWATCH_MAILBOX( mbox ),
+                                    XFCE_MAILWATCH_LOG_ERROR,
+                                    "%s", error->message );
+        g_error_free( error );
+    }
+    else {
+        while ( ( entry = g_dir_read_name( dir ) ) ) {
+            gchar   *path;
+
+            /* Dotfiles and lock files are never spools */
+            if ( *entry == '.' || g_str_has_suffix( entry, ".lock" ) ) {
+                continue;
+            }
+            if ( pattern && !g_pattern_match_string( pattern, entry ) ) {
+                continue;
+            }
+            path = g_build_filename( dirname, entry, NULL );
+            if ( g_file_test( path, G_FILE_TEST_IS_REGULAR ) ) {
+                g_ptr_array_add( paths, path );
+            }
+            else {
+                g_free( path );
+            }
+        }
+        g_dir_close( dir );
+    }
+
+    if ( pattern ) {
+        g_pattern_spec_free( pattern );
+    }
+    g_free( dirname );
+
+    g_ptr_array_sort( paths, mbox_path_compare );
+
+    return ( paths );
+}
+
+static void
+mbox_file_free( MboxFile *file )
+{
+    if ( file->index ) {
+        mbox_index_free( file->index );
+    }
+    g_free( file->fn );
+    g_free( file );
+}
+
+/* Makes mbox->files match paths, keeping what's known about the spools
+ * that are still there */
+static void
+mbox_sync_files( XfceMailwatchMboxMailbox *mbox, GPtrArray *paths )
+{
+    GList       *files = NULL, *l;
+    guint       i;
+
+    for ( i = 0; i < paths->len; i++ ) {
+        const gchar *path = g_ptr_array_index( paths, i );
+        MboxFile    *file = NULL;
+
+        for ( l = mbox->files; l; l = l->next ) {
+            if ( !strcmp( ( (MboxFile *) l->data )->fn, path ) ) {
+                file = l->data;
+                mbox->files = g_list_delete_link( mbox->files, l );
+                break;
+            }
+        }
+        if ( !file ) {
+            file = g_new0( MboxFile, 1 );
+            file->fn = g_strdup( path );
+        }
+        files = g_list_prepend( files, file );
+    }
+
+    for ( l = mbox->files; l; l = l->next ) {
+        MboxFile    *file = l->data;
+
+        if ( !g_file_test( file->fn, G_FILE_TEST_EXISTS ) ) {
+            /* The spool is gone for good, so its index is of no use */
+            gchar   *index_filename = mbox_index_filename( file->fn );
+
+            unlink( index_filename );
+            g_free( index_filename );
+        }
+        mbox_file_free( file );
+    }
+    g_list_free( mbox->files );
+
+    mbox->files = g_list_reverse( files );
+}
+
+static void
+mbox_check_mail( XfceMailwatchMboxMailbox *mbox )
+{
+    gchar           *source;
+    GPtrArray       *paths;
+    GList           *l;
+    gboolean        fast, count, multi;
+    guint           i, n_files, total = 0;
+
+    g_mutex_lock( mbox->settings_mutex );
+    if ( !mbox->fn || !*mbox->fn ) {
+        g_mutex_unlock( mbox->settings_mutex );
+        return;
+    }
+    source = g_strdup( mbox->fn );
+    fast = mbox->fast;
+    g_mutex_unlock( mbox->settings_mutex );
 
-        xfce_mailwatch_signal_new_messages( mbox->mailwatch, (XfceMailwatchMailbox *) mbox, num_new );
+    count = g_atomic_int_compare_and_exchange( &mbox->count_requested, TRUE, FALSE );
+
+    paths = mbox_list_files( mbox, source, &multi );
+    mbox_sync_files( mbox, paths );
+    g_ptr_array_foreach( paths, (GFunc) g_free, NULL );
+    g_ptr_array_free( paths, TRUE );
+    g_free( source );
+
+    for ( l = mbox->files; l; l = l->next ) {
+        if ( !g_atomic_int_get( &mbox->running ) ) {
+            return;
+        }
+        mbox_check_file( mbox, l->data, fast, count );
+        total += ( (MboxFile *) l->data )->num_new;
+    }
 
-        mbox->ctime = st.st_ctime;
-        mbox->size = st.st_size;
+    if ( !multi ) {
+        xfce_mailwatch_signal_new_messages( mbox->mailwatch, (XfceMailwatchMailbox *) mbox, total );
+    }
+    else {
+        const gchar     **names;
+        guint           *counts;
+
+        /* Each spool is reported on its own, like an IMAP folder */
+        n_files = g_list_length( mbox->files );
+        names = g_new( const gchar *, n_files + 1 );
+        counts = g_new( guint, n_files + 1 );
+        for ( l = mbox->files, i = 0; l; l = l->next, i++ ) {
+            MboxFile    *file = l->data;
+            const gchar *base = strrchr( file->fn, G_DIR_SEPARATOR );
+
+            names[i] = base ? base + 1 : file->fn;
+            counts[i] = file->num_new;
+        }
+        xfce_mailwatch_signal_new_messages_by_folder( mbox->mailwatch,
+                                                      (XfceMailwatchMailbox *) mbox,
+                                                      n_files, names, counts );
+        g_free( names );
+        g_free( counts );
     }
-    g_free( mailbox );
 }
 
 static gpointer
@@ -262,18 +1354,13 @@ mbox_save_settings( XfceMailwatchMailbox *mailbox )
     settings = g_list_append( settings, param );
 
     param = g_new( XfceMailwatchParam, 1 );
-    param->key      = g_strdup( "ctime" );
-    param->value    = g_strdup_printf( "%ld", (glong)mbox->ctime );
-    settings = g_list_append( settings, param );
-
-    param = g_new( XfceMailwatchParam, 1 );
-    param->key      = g_strdup( "size" );
-    param->value    = g_strdup_printf( "%lu", (gulong)mbox->size );
+    param->key      = g_strdup( "interval" );
+    param->value    = g_strdup_printf( "%u", mbox->interval );
     settings = g_list_append( settings, param );
 
     param = g_new( XfceMailwatchParam, 1 );
-    param->key      = g_strdup( "interval" );
-    param->value    = g_strdup_printf( "%u", mbox->interval );
+    param->key      = g_strdup( "fast" );
+    param->value    = g_strdup( mbox->fast ? "1" : "0" );
     settings = g_list_append( settings, param );
 
     g_mutex_unlock( mbox->settings_mutex );
@@ -298,42 +1385,84 @@ mbox_restore_settings( XfceMailwatchMailbox *mailbox, GList *settings )
             }
             mbox->fn = g_strdup( p->value );
         }
-        else if ( !strcmp( p->key, "ctime" ) ) {
-            mbox->ctime = atol( p->value );
-        }
-        else if ( !strcmp( p->key, "size" ) ) {
-            mbox->size = (size_t) atol( p->value );
-        }
         else if ( !strcmp( p->key, "interval" ) ) {
             mbox->interval = (guint) atol( p->value );
         }
+        else if ( !strcmp( p->key, "fast" ) ) {
+            mbox->fast = ( *( p->value ) == '1' );
+        }
     }
 
     g_mutex_unlock( mbox->settings_mutex );
 }
 
+/* Must be called with the settings mutex held */
 static void
-mbox_file_set_cb( GtkWidget *button,
-        XfceMailwatchMboxMailbox *mbox )
+mbox_watch_spool( XfceMailwatchMboxMailbox *mbox )
 {
-    gchar *text;
+    xfce_mailwatch_watch_remove( mbox->watch );
+    mbox->watch = NULL;
 
-    text = gtk_file_chooser_get_filename( GTK_FILE_CHOOSER( button ) );
+    if ( mbox->fn && *mbox->fn ) {
+        if ( mbox_is_pattern( mbox->fn ) ) {
+            gchar   *dirname = g_path_get_dirname( mbox->fn );
+
+            mbox->watch = xfce_mailwatch_watch_add( dirname, mbox_watch_cb, mbox );
+            g_free( dirname );
+        }
+        else {
+            mbox->watch = xfce_mailwatch_watch_add( mbox->fn, mbox_watch_cb, mbox );
+        }
+    }
+}
 
+static void
+mbox_set_filename( XfceMailwatchMboxMailbox *mbox, const gchar *text )
+{
     g_mutex_lock( mbox->settings_mutex );
     if ( mbox->fn ) {
         g_free( mbox->fn );
     }
 
-    if ( text ) {
-        mbox->fn = text;
+    if ( text && !strncmp( text, "~" G_DIR_SEPARATOR_S, 2 ) ) {
+        mbox->fn = g_build_filename( g_get_home_dir(), text + 2, NULL );
+    }
+    else if ( text ) {
+        mbox->fn = g_strdup( text );
     }
     else {
         mbox->fn = g_strdup( "" );
     }
+
+    if ( g_atomic_int_get( &mbox->running ) ) {
+        /* The old watch is on the wrong file or directory now */
+        mbox_watch_spool( mbox );
+    }
     g_mutex_unlock( mbox->settings_mutex );
 }
 
+static gboolean
+mbox_entry_focus_out_cb( GtkWidget *entry, GdkEventFocus *evt,
+        XfceMailwatchMboxMailbox *mbox )
+{
+    mbox_set_filename( mbox, gtk_entry_get_text( GTK_ENTRY( entry ) ) );
+
+    return ( FALSE );
+}
+
+static void
+mbox_file_set_cb( GtkWidget *button,
+        XfceMailwatchMboxMailbox *mbox )
+{
+    GtkWidget *entry = g_object_get_data( G_OBJECT( button ), "mbox-entry" );
+    gchar *text;
+
+    text = gtk_file_chooser_get_filename( GTK_FILE_CHOOSER( button ) );
+    gtk_entry_set_text( GTK_ENTRY( entry ), text ? text : "" );
+    mbox_set_filename( mbox, text );
+    g_free( text );
+}
+
 static void
 mbox_interval_changed_cb( GtkWidget *spinner, XfceMailwatchMboxMailbox *mbox ) {
     guint val = gtk_spin_button_get_value_as_int( GTK_SPIN_BUTTON( spinner ) ) * 60;
@@ -349,6 +1478,14 @@ mbox_interval_changed_cb( GtkWidget *spinner, XfceMailwatchMboxMailbox *mbox ) {
     }
     mbox->interval = val;
 }
+
+static void
+mbox_fast_toggled_cb( GtkToggleButton *tb, XfceMailwatchMboxMailbox *mbox )
+{
+    g_mutex_lock( mbox->settings_mutex );
+    mbox->fast = gtk_toggle_button_get_active( tb );
+    g_mutex_unlock( mbox->settings_mutex );
+}
     
 static GtkContainer *
 mbox_get_setup_page( XfceMailwatchMailbox *mailbox )
@@ -356,7 +1493,7 @@ mbox_get_setup_page( XfceMailwatchMailbox *mailbox )
     XfceMailwatchMboxMailbox    *mbox = XFCE_MAILWATCH_MBOX_MAILBOX( mailbox );
     GtkWidget                   *vbox, *hbox;
     GtkWidget                   *label;
-    GtkWidget                   *button, *spinner;
+    GtkWidget                   *entry, *button, *spinner, *chk;
     GtkSizeGroup                *sg;
 
     vbox = gtk_vbox_new( FALSE, BORDER / 2 );
@@ -374,19 +1511,34 @@ mbox_get_setup_page( XfceMailwatchMailbox *mailbox )
 
     gtk_size_group_add_widget( GTK_SIZE_GROUP( sg ), label );
 
+    /* A directory, or a pattern for the names in one, watches several
+     * spools at once, so it's typed rather than picked */
+    entry = gtk_entry_new();
+    gtk_entry_set_activates_default( GTK_ENTRY( entry ), TRUE );
+    gtk_widget_set_tooltip_text( entry, _( "A mbox file, a directory of them, "
+                                           "or a pattern such as ~/Mail/*.mbox" ) );
     button = gtk_file_chooser_button_new( _("Select mbox file"),
                                           GTK_FILE_CHOOSER_ACTION_OPEN );
     g_mutex_lock( mbox->settings_mutex );
     if ( mbox->fn ) {
-        gtk_file_chooser_set_filename( GTK_FILE_CHOOSER( button ), mbox->fn );
+        gtk_entry_set_text( GTK_ENTRY( entry ), mbox->fn );
+        if ( !mbox_is_pattern( mbox->fn ) ) {
+            gtk_file_chooser_set_filename( GTK_FILE_CHOOSER( button ), mbox->fn );
+        }
     }
     g_mutex_unlock( mbox->settings_mutex );
+    gtk_widget_show( entry );
+    gtk_box_pack_start( GTK_BOX( hbox ), entry, TRUE, TRUE, 0 );
+    g_signal_connect( G_OBJECT( entry ), "focus-out-event",
+            G_CALLBACK( mbox_entry_focus_out_cb ), mbox );
+
+    g_object_set_data( G_OBJECT( button ), "mbox-entry", entry );
     gtk_widget_show( button );
-    gtk_box_pack_start( GTK_BOX( hbox ), button, TRUE, TRUE, 0 );
+    gtk_box_pack_start( GTK_BOX( hbox ), button, FALSE, FALSE, 0 );
     g_signal_connect( G_OBJECT( button ), "file-set",
             G_CALLBACK( mbox_file_set_cb ), mbox );
 
-    gtk_label_set_mnemonic_widget( GTK_LABEL( label ), button );
+    gtk_label_set_mnemonic_widget( GTK_LABEL( label ), entry );
 
     hbox = gtk_hbox_new( FALSE, BORDER );
     gtk_widget_show( hbox );
@@ -413,6 +1565,15 @@ mbox_get_setup_page( XfceMailwatchMailbox *mailbox )
     gtk_widget_show( label );
     gtk_box_pack_start( GTK_BOX( hbox ), label, FALSE, FALSE, 0 );
 
+    chk = gtk_check_button_new_with_mnemonic( _( "Only check _whether there is new mail (count on Update Now)" ) );
+    g_mutex_lock( mbox->settings_mutex );
+    gtk_toggle_button_set_active( GTK_TOGGLE_BUTTON( chk ), mbox->fast );
+    g_mutex_unlock( mbox->settings_mutex );
+    gtk_widget_show( chk );
+    gtk_box_pack_start( GTK_BOX( vbox ), chk, FALSE, FALSE, 0 );
+    g_signal_connect( G_OBJECT( chk ), "toggled",
+            G_CALLBACK( mbox_fast_toggled_cb ), mbox );
+
     return ( GTK_CONTAINER( vbox ) );
 }
 
@@ -427,18 +1588,27 @@ mbox_activate( XfceMailwatchMailbox *mailbox, gboolean activated )
     if( activated ) {
         g_atomic_int_set( &mbox->running, TRUE );
         mbox->check_id = g_timeout_add( mbox->interval * 1000, mbox_check_mail_timeout, mbox );
+
+        /* The timeout is still needed for NFS, where other machines'
+         * changes can't be watched.  A pattern's spools all live in one
+         * directory, so watching that covers them all. */
+        g_mutex_lock( mbox->settings_mutex );
+        mbox_watch_spool( mbox );
+        g_mutex_unlock( mbox->settings_mutex );
     } else {
         g_atomic_int_set( &mbox->running, FALSE );
         g_source_remove( mbox->check_id );
         mbox->check_id = 0;
+        mbox_retry_cancel( mbox );
+
+        xfce_mailwatch_watch_remove( mbox->watch );
+        mbox->watch = NULL;
     }
 }
 
 static void
-mbox_force_update( XfceMailwatchMailbox *mailbox )
+mbox_check_now( XfceMailwatchMboxMailbox *mbox )
 {
-    XfceMailwatchMboxMailbox    *mbox = XFCE_MAILWATCH_MBOX_MAILBOX( mailbox );
-
     if( !g_atomic_pointer_get( &mbox->thread ) ) {
         gboolean restart = FALSE;
 
@@ -454,6 +1624,54 @@ mbox_force_update( XfceMailwatchMailbox *mailbox )
     }
 }
 
+static void
+mbox_force_update( XfceMailwatchMailbox *mailbox )
+{
+    XfceMailwatchMboxMailbox    *mbox = XFCE_MAILWATCH_MBOX_MAILBOX( mailbox );
+
+    /* The user wants to know how many, even in fast mode */
+    g_atomic_int_set( &mbox->count_requested, TRUE );
+    mbox_check_now( mbox );
+}
+
+static gboolean
+mbox_watch_cb( gpointer data )
+{
+    XfceMailwatchMboxMailbox    *mbox = XFCE_MAILWATCH_MBOX_MAILBOX( data );
+
+    if( g_atomic_pointer_get( &mbox->thread ) ) {
+        /* Look again once it's done */
+        return ( FALSE );
+    }
+
+    if( g_atomic_int_get( &mbox->running ) ) {
+        mbox_check_now( mbox );
+    }
+
+    return ( TRUE );
+}
+
+static gboolean
+mbox_retry_cb( gpointer data )
+{
+    XfceMailwatchMboxMailbox    *mbox = XFCE_MAILWATCH_MBOX_MAILBOX( data );
+
+    if( g_atomic_pointer_get( &mbox->thread ) ) {
+        /* Look again once it's done */
+        return ( TRUE );
+    }
+
+    g_mutex_lock( mbox->settings_mutex );
+    mbox->retry_id = 0;
+    g_mutex_unlock( mbox->settings_mutex );
+
+    if( g_atomic_int_get( &mbox->running ) ) {
+        mbox_check_now( mbox );
+    }
+
+    return ( FALSE );
+}
+
 static void
 mbox_free( XfceMailwatchMailbox *mailbox )
 {
@@ -462,12 +1680,15 @@ mbox_free( XfceMailwatchMailbox *mailbox )
     mbox_activate( mailbox, FALSE );
     while( g_atomic_pointer_get( &mbox->thread ) )
         g_thread_yield();
+    mbox_retry_cancel( mbox );
     
     g_mutex_free( mbox->settings_mutex );
 
     if ( mbox->fn ) {
         g_free( mbox->fn );
     }
+    g_list_foreach( mbox->files, (GFunc) mbox_file_free, NULL );
+    g_list_free( mbox->files );
     g_free( mbox );
 }
 
@@ -481,5 +1702,6 @@ XfceMailwatchMailboxType    builtin_mailbox_type_mbox = {
     mbox_get_setup_page,
     mbox_restore_settings,
     mbox_save_settings,
-    mbox_free
+    mbox_free,
+    NULL
 };
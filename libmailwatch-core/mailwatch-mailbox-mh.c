@@ -25,6 +25,10 @@
 #include <string.h>
 #endif
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -51,6 +55,7 @@
 #include <libxfce4ui/libxfce4ui.h>
 
 #include "mailwatch.h"
+#include "mailwatch-watch.h"
 
 #define XFCE_MAILWATCH_MH_MAILBOX( p )      ( (XfceMailwatchMHMailbox *) p )
 #define BORDER          ( 8 )
@@ -78,6 +83,11 @@ typedef struct {
     gint                    running;
     gpointer                thread;  /* (GThread *) */
     guint                   check_id;
+
+    /* Only the check thread touches these, since it's the one that finds
+     * out where the files are.  They're kept while the mailbox is paused. */
+    XfceMailwatchWatch      *profile_watch;
+    XfceMailwatchWatch      *sequences_watch;
 } XfceMailwatchMHMailbox;
 
 typedef struct {
@@ -369,6 +379,8 @@ mh_read_config( XfceMailwatchMHMailbox *mh )
     mh_profile_free( profile );
 }
 
+static gboolean mh_watch_cb( gpointer data );
+
 static void
 mh_check_mail( XfceMailwatchMHMailbox *mh )
 {
@@ -379,11 +391,22 @@ mh_check_mail( XfceMailwatchMHMailbox *mh )
     if ( !mh->mh_profile_fn ) {
         mh->mh_profile_fn = mh_get_profile_filename();
     }
+    if ( !mh->profile_watch ) {
+        mh->profile_watch = xfce_mailwatch_watch_add( mh->mh_profile_fn, mh_watch_cb, mh );
+    }
     
     if ( stat( mh->mh_profile_fn, &st ) == 0 ) {
         if ( st.st_ctime != mh->mh_profile_ctime ) {
+            /* The sequences file might be somewhere else now */
+            xfce_mailwatch_watch_remove( mh->sequences_watch );
+            mh->sequences_watch = NULL;
+
             mh_read_config( mh );
             mh->mh_profile_ctime = st.st_ctime;
+            if ( st.st_ctime >= time( NULL ) ) {
+                /* Another change this second wouldn't move ctime */
+                mh->mh_profile_ctime--;
+            }
         }
     }
     else {
@@ -396,6 +419,9 @@ mh_check_mail( XfceMailwatchMHMailbox *mh )
     if ( !mh->mh_sequences_fn ) {
         return;
     }
+    if ( !mh->sequences_watch ) {
+        mh->sequences_watch = xfce_mailwatch_watch_add( mh->mh_sequences_fn, mh_watch_cb, mh );
+    }
 
     if ( stat( mh->mh_sequences_fn, &st ) < 0 ) {
         xfce_mailwatch_log_message( mh->mailwatch, XFCE_MAILWATCH_MAILBOX( mh ),
@@ -410,6 +436,9 @@ mh_check_mail( XfceMailwatchMHMailbox *mh )
             gulong          num_new = 0;
 
             mh->mh_sequences_ctime = st.st_ctime;
+            if ( st.st_ctime >= time( NULL ) ) {
+                mh->mh_sequences_ctime--;
+            }
 
             seqlist = mh_profile_read( mh, mh->mh_sequences_fn );
 
@@ -634,6 +663,22 @@ mh_force_update_cb( XfceMailwatchMailbox *mailbox )
     }
 }
 
+static gboolean
+mh_watch_cb( gpointer data )
+{
+    XfceMailwatchMHMailbox  *mh = XFCE_MAILWATCH_MH_MAILBOX( data );
+
+    if( g_atomic_pointer_get( &mh->thread ) ) {
+        /* Look again once it's done */
+        return FALSE;
+    }
+
+    if( g_atomic_int_get( &mh->running ) )
+        mh_force_update_cb( XFCE_MAILWATCH_MAILBOX( mh ) );
+
+    return TRUE;
+}
+
 static void
 mh_set_activated_cb( XfceMailwatchMailbox *mailbox, gboolean activate )
 {
@@ -665,6 +710,9 @@ mh_free( XfceMailwatchMailbox *mailbox )
     while( g_atomic_pointer_get( &mh->thread ) )
         g_thread_yield();
 
+    xfce_mailwatch_watch_remove( mh->profile_watch );
+    xfce_mailwatch_watch_remove( mh->sequences_watch );
+
     if ( mh->mh_profile_fn ) {
         g_free( mh->mh_profile_fn );
     }
@@ -688,6 +736,7 @@ XfceMailwatchMailboxType builtin_mailbox_type_mh = {
     mh_get_setup_page,
     mh_restore_param_list,
     mh_save_param_list,
-    mh_free
+    mh_free,
+    NULL
 };
 
@@ -44,6 +44,7 @@
 #include <libxfce4util/libxfce4util.h>
 #include <libxfce4ui/libxfce4ui.h>
 
+#include "mailwatch-common.h"
 #include "mailwatch-utils.h"
 #include "mailwatch.h"
 #include "mailwatch-net-conn.h"
@@ -53,8 +54,30 @@
 #define POP3_PORT_S              "110"
 #define POP3S_PORT_S             "995"
 
+#define POP3_CRLF_LEN            2
+
+#define POP3_CAP_STLS            (1 << 0)
+#define POP3_CAP_PIPELINING      (1 << 1)
+#define POP3_CAP_CRAM_MD5        (1 << 2)
+
+#define POP3_SEEN_SET_MAGIC      "XMWPOP3S"
+#define POP3_SEEN_SET_VERSION    2
+#define POP3_SEEN_SET_HEADER_LEN 28
+
+/* past this many new messages, one UIDL listing beats probing each */
+#define POP3_MAX_TAIL_PROBES     64
+
 #define XFCE_MAILWATCH_POP3_MAILBOX(ptr) ((XfceMailwatchPOP3Mailbox *)ptr)
 
+typedef struct
+{
+    gchar *account;
+    GArray *seen;       /* sorted hashes of UIDs the user has been told about */
+    GArray *unseen;     /* sorted hashes of UIDs still reported as new */
+    guint last_count;   /* maildrop size at the end of the last check */
+    guint32 last_hash;  /* hash of the UID of message |last_count| */
+} POP3SeenSet;
+
 typedef struct
 {
     XfceMailwatchMailbox mailbox;
@@ -78,8 +101,18 @@ typedef struct
     
     /* state related to the current connection (if any) */
     XfceMailwatchNetConn *net_conn;
+    guint caps;
+    
+    /* only the check thread touches the seen-set */
+    POP3SeenSet *seen_set;
+    gint mark_seen;
 } XfceMailwatchPOP3Mailbox;
 
+/* CAPA results, shared by every POP3 mailbox and keyed by host, port,
+ * auth type and whether the connection was secured yet */
+static GStaticMutex caps_cache_mx = G_STATIC_MUTEX_INIT;
+static GHashTable *caps_cache = NULL;
+
 
 static gboolean
 pop3_should_continue(XfceMailwatchNetConn *net_conn,
@@ -124,6 +157,7 @@ pop3_recv(XfceMailwatchPOP3Mailbox *pmailbox, gchar *buf, gsize len)
                                    XFCE_MAILWATCH_LOG_ERROR,
                                    error->message);
         g_error_free(error);
+        return -1;
     }
 
     if((gsize)recvd == len)
@@ -183,24 +217,16 @@ pop3_send_login_info(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *username,
 #define BUFSIZE 8191
     gint bin, bout;
     gchar buf[BUFSIZE+1];
+    gboolean pipelining = (pmailbox->caps & POP3_CAP_PIPELINING);
     
 #ifdef HAVE_SSL_SUPPORT
-    gchar *p, *q;
+    gchar *p;
     
-    /* see if CRAM-MD5 is supported */
-    g_strlcpy(buf, "CAPA\r\n", BUFSIZE);
-    bout = pop3_send(pmailbox, buf);
-    if(bout != strlen(buf))
-        return FALSE;
-
-    bin = pop3_recv_command(pmailbox, buf, BUFSIZE, TRUE);
-    if(bin < 0)
-        return FALSE;
-
-    if((p = strstr(buf, "SASL ")) && (q = strstr(p, "\n"))
-       && (p = strstr(p, "CRAM-MD5")) && p < q)
+    /* CRAM-MD5 costs an extra round trip, and TLS already keeps the password
+     * safe, so only use it in the clear */
+    if((pmailbox->caps & POP3_CAP_CRAM_MD5)
+       && !xfce_mailwatch_net_conn_is_secure(pmailbox->net_conn))
     {
-        /* server supports CRAM-MD5 */
         g_strlcpy(buf, "AUTH CRAM-MD5\r\n", BUFSIZE);
         bout = pop3_send(pmailbox, buf);
         if(bout != strlen(buf))
@@ -252,8 +278,13 @@ pop3_send_login_info(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *username,
     }
 #endif
 
-    /* send the username */
+    /* send the username, and the password right behind it if the server
+     * lets us pipeline */
     g_snprintf(buf, BUFSIZE, "USER %s\r\n", username);
+    if(pipelining) {
+        gsize len = strlen(buf);
+        g_snprintf(buf + len, BUFSIZE - len, "PASS %s\r\n", password);
+    }
     bout = pop3_send(pmailbox, buf);
     DBG("sent user (%d)", bout);
     if(bout != (gint)strlen(buf))
@@ -265,12 +296,14 @@ pop3_send_login_info(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *username,
     if(bin <= 0)
         return FALSE;
     
-    /* send the password */
-    g_snprintf(buf, BUFSIZE, "PASS %s\r\n", password);
-    bout = pop3_send(pmailbox, buf);
-    DBG("sent password (%d)", bout);
-    if(bout != (gint)strlen(buf))
-        return FALSE;
+    if(!pipelining) {
+        /* send the password */
+        g_snprintf(buf, BUFSIZE, "PASS %s\r\n", password);
+        bout = pop3_send(pmailbox, buf);
+        DBG("sent password (%d)", bout);
+        if(bout != (gint)strlen(buf))
+            return FALSE;
+    }
     
     /* check for OK response */
     bin = pop3_recv_command(pmailbox, buf, BUFSIZE, FALSE);
@@ -313,34 +346,107 @@ pop3_negotiate_ssl(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *host)
     return ret;
 }
 
+static gchar *
+pop3_caps_key(const gchar *host, gint nonstandard_port,
+        XfceMailwatchAuthType auth_type, gboolean secure)
+{
+    gchar *lhost = g_ascii_strdown(host, -1);
+    gchar *key = g_strdup_printf("%s:%d:%d:%s", lhost, nonstandard_port,
+                                 auth_type, secure ? "secure" : "plain");
+    
+    g_free(lhost);
+    
+    return key;
+}
+
+static void
+pop3_caps_forget(const gchar *key)
+{
+    g_static_mutex_lock(&caps_cache_mx);
+    if(caps_cache)
+        g_hash_table_remove(caps_cache, key);
+    g_static_mutex_unlock(&caps_cache_mx);
+}
+
+/* fills in pmailbox->caps, only asking the server the first time we talk
+ * to it in this state */
 static gboolean
-pop3_do_stls(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *host,
-        const gchar *username, const gchar *password)
+pop3_get_caps(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *key)
 {
 #define BUFSIZE 8191
     gint bin;
-    gchar buf[BUFSIZE+1];
-    
-    TRACE("entering");
+    gchar buf[BUFSIZE+1], **lines;
+    gpointer cached = NULL;
+    gboolean found;
+    guint caps = 0, i;
+    
+    g_static_mutex_lock(&caps_cache_mx);
+    found = caps_cache && g_hash_table_lookup_extended(caps_cache, key, NULL,
+                                                       &cached);
+    g_static_mutex_unlock(&caps_cache_mx);
+    
+    if(found) {
+        DBG("using cached caps for %s: 0x%x", key, GPOINTER_TO_UINT(cached));
+        pmailbox->caps = GPOINTER_TO_UINT(cached);
+        return TRUE;
+    }
     
     if(pop3_send(pmailbox, "CAPA\r\n") != 6)
         return FALSE;
     
     bin = pop3_recv_command(pmailbox, buf, BUFSIZE, TRUE);
-    DBG("checking for STLS caps (%d): %s", bin, bin>0?buf:"(nada)");
-    if(bin <= 0)
-        return FALSE;
-    if(!strstr(buf, "\nSTLS\n"))
+    DBG("got caps (%d): %s", bin, bin>0?buf:"(nada)");
+    if(bin <= 0) {
+        /* CAPA is optional; a server without it just has no extensions */
+        if(strncmp(buf, "-ERR", 4))
+            return FALSE;
+    } else {
+        lines = g_strsplit(buf, "\n", -1);
+        for(i = 1; lines[i]; i++) {
+            if(!strcmp(lines[i], "STLS"))
+                caps |= POP3_CAP_STLS;
+            else if(!strcmp(lines[i], "PIPELINING"))
+                caps |= POP3_CAP_PIPELINING;
+            else if(g_str_has_prefix(lines[i], "SASL ")
+                    && strstr(lines[i], " CRAM-MD5"))
+            {
+                caps |= POP3_CAP_CRAM_MD5;
+            }
+        }
+        g_strfreev(lines);
+    }
+    
+    g_static_mutex_lock(&caps_cache_mx);
+    if(!caps_cache)
+        caps_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, NULL);
+    g_hash_table_replace(caps_cache, g_strdup(key), GUINT_TO_POINTER(caps));
+    g_static_mutex_unlock(&caps_cache_mx);
+    
+    pmailbox->caps = caps;
+    
+    return TRUE;
+#undef BUFSIZE
+}
+
+static gboolean
+pop3_do_stls(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *host,
+        const gchar *username, const gchar *password)
+{
+    gchar buf[1024];
+    
+    TRACE("entering");
+    
+    if(!(pmailbox->caps & POP3_CAP_STLS))
         return FALSE;
     
     if(pop3_send(pmailbox, "STLS\r\n") != 6)
         return FALSE;
     
-    if(pop3_recv_command(pmailbox, buf, BUFSIZE, FALSE) < 0)
+    if(pop3_recv_command(pmailbox, buf, sizeof(buf) - 1, FALSE) < 0)
         return FALSE;
     
     return TRUE;
-#undef BUFSIZE
 }
 
 static gboolean
@@ -389,6 +495,7 @@ pop3_authenticate(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *host,
         XfceMailwatchAuthType auth_type, gint nonstandard_port)
 {
     gboolean ret = FALSE;
+    gchar *key;
     
     TRACE("entering, auth_type is %d", auth_type);
     
@@ -403,8 +510,15 @@ pop3_authenticate(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *host,
             ret = pop3_connect(pmailbox, host, "pop3", nonstandard_port);
             if(ret)
                 ret = pop3_slurp_banner(pmailbox);
-            if(ret)
-                ret = pop3_do_stls(pmailbox, host, username, password);
+            if(ret) {
+                key = pop3_caps_key(host, nonstandard_port, auth_type, FALSE);
+                ret = pop3_get_caps(pmailbox, key);
+                if(ret)
+                    ret = pop3_do_stls(pmailbox, host, username, password);
+                if(!ret)
+                    pop3_caps_forget(key);
+                g_free(key);
+            }
             if(ret)
                 ret = pop3_negotiate_ssl(pmailbox, host);
             break;
@@ -422,37 +536,645 @@ pop3_authenticate(XfceMailwatchPOP3Mailbox *pmailbox, const gchar *host,
             return FALSE;
     }
     
+    if(!ret)
+        return FALSE;
+    
+    /* the caps can change once the connection is secured */
+    key = pop3_caps_key(host, nonstandard_port, auth_type,
+                        xfce_mailwatch_net_conn_is_secure(pmailbox->net_conn));
+    ret = pop3_get_caps(pmailbox, key);
     if(ret)
         ret = pop3_send_login_info(pmailbox, username, password);
+    if(!ret) {
+        /* maybe the server isn't what it used to be */
+        pop3_caps_forget(key);
+    }
+    g_free(key);
 
     return ret;
 }
 
-static guint
-pop3_check_inbox(XfceMailwatchPOP3Mailbox *pmailbox)
+/* reads the response to a STAT that has already been sent */
+static gboolean
+pop3_read_stat(XfceMailwatchPOP3Mailbox *pmailbox, guint *n_messages)
 {
     gchar buf[1024], *p;
     gint bin;
-    gint new_messages;
-    
-    if(pop3_send(pmailbox, "STAT\r\n") != 6)
-        return 0;
+    gint count;
     
     bin = pop3_recv_command(pmailbox, buf, 1023, FALSE);
     if(bin <= 0)
-        return 0;
+        return FALSE;
     DBG("got response from STAT (%d): %s", bin, buf);
     
     p = strstr(buf, "\n");
     if(!p)
-        return 0;
+        return FALSE;
     *p = 0;
     
-    new_messages = atoi(buf+4);
-    if(new_messages < 0)
-       return 0;
+    count = atoi(buf+4);
+    if(count < 0)
+       return FALSE;
+    
+    *n_messages = count;
+    
+    return TRUE;
+}
+
+static gboolean
+pop3_stat(XfceMailwatchPOP3Mailbox *pmailbox, guint *n_messages)
+{
+    if(pop3_send(pmailbox, "STAT\r\n") != 6)
+        return FALSE;
+    
+    return pop3_read_stat(pmailbox, n_messages);
+}
+
+/* UIDs are kept as 32-bit hashes so that even a 100k-message maildrop only
+ * needs a few hundred KB.  a new message whose hash collides with a seen one
+ * goes uncounted, which at that size happens about once in 40000 arrivals */
+static inline guint32
+pop3_uid_hash(const gchar *uid, gsize len)
+{
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    gsize i;
+    
+    /* 64-bit FNV-1a, folded */
+    for(i = 0; i < len; i++) {
+        hash ^= (guchar)uid[i];
+        hash *= G_GUINT64_CONSTANT(1099511628211);
+    }
+    
+    return (guint32)(hash ^ (hash >> 32));
+}
+
+static gint
+pop3_uid_hash_compare(gconstpointer a, gconstpointer b)
+{
+    guint32 ha = *(const guint32 *)a, hb = *(const guint32 *)b;
+    
+    return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+/* binary search in a sorted hash array.  returns the index of |hash|, or
+ * the index it would have to be inserted at if it isn't there */
+static guint
+pop3_uid_hashes_find(GArray *hashes, guint32 hash, gboolean *found)
+{
+    guint lo = 0, hi = hashes->len, mid;
+    
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(g_array_index(hashes, guint32, mid) < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    *found = (lo < hashes->len && g_array_index(hashes, guint32, lo) == hash);
+    
+    return lo;
+}
+
+static void
+pop3_uid_hashes_insert(GArray *hashes, guint32 hash)
+{
+    gboolean found;
+    guint idx = pop3_uid_hashes_find(hashes, hash, &found);
+    
+    if(!found)
+        g_array_insert_val(hashes, idx, hash);
+}
+
+static void
+pop3_uid_hashes_from_le(GArray *hashes, const gchar *data, guint count)
+{
+    g_array_set_size(hashes, count);
+    memcpy(hashes->data, data, (gsize)count * 4);
+    
+#if G_BYTE_ORDER != G_LITTLE_ENDIAN
+    {
+        guint i;
+        for(i = 0; i < count; i++) {
+            g_array_index(hashes, guint32, i) =
+                    GUINT32_FROM_LE(g_array_index(hashes, guint32, i));
+        }
+    }
+#endif
+}
+
+static gchar *
+pop3_uid_hashes_to_le(gchar *dest, GArray *hashes)
+{
+    guint32 val;
+    guint i;
+    
+    for(i = 0; i < hashes->len; i++, dest += 4) {
+        val = GUINT32_TO_LE(g_array_index(hashes, guint32, i));
+        memcpy(dest, &val, 4);
+    }
+    
+    return dest;
+}
+
+static POP3SeenSet *
+pop3_seen_set_new(const gchar *account)
+{
+    POP3SeenSet *set = g_new0(POP3SeenSet, 1);
+    
+    set->account = g_strdup(account);
+    set->seen = g_array_new(FALSE, FALSE, sizeof(guint32));
+    set->unseen = g_array_new(FALSE, FALSE, sizeof(guint32));
+    
+    return set;
+}
+
+static void
+pop3_seen_set_free(POP3SeenSet *set)
+{
+    g_free(set->account);
+    g_array_free(set->seen, TRUE);
+    g_array_free(set->unseen, TRUE);
+    g_free(set);
+}
+
+static gboolean
+pop3_seen_set_is_known(POP3SeenSet *set, guint32 hash)
+{
+    gboolean found;
+    
+    pop3_uid_hashes_find(set->seen, hash, &found);
+    if(!found)
+        pop3_uid_hashes_find(set->unseen, hash, &found);
+    
+    return found;
+}
+
+/* the seen-set lives in $XDG_CACHE_HOME/xfce4/mailwatch, one file per
+ * account */
+static gchar *
+pop3_seen_set_filename(const gchar *account)
+{
+    gchar *checksum, *basename, *filename;
+    
+    checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, account, -1);
+    basename = g_strconcat("pop3-seen-", checksum, NULL);
+    filename = g_build_filename(g_get_user_cache_dir(), "xfce4", "mailwatch",
+                                basename, NULL);
+    g_free(basename);
+    g_free(checksum);
+    
+    return filename;
+}
+
+/* the file is the magic, then the version, the seen and unseen counts, the
+ * maildrop size and the hash of its last UID (all little-endian 32-bit),
+ * followed by the sorted seen and unseen hashes in the same format.
+ * returns NULL if there's no usable seen-set */
+static POP3SeenSet *
+pop3_seen_set_load(const gchar *filename, const gchar *account)
+{
+    gchar *contents = NULL;
+    gsize len = 0;
+    guint32 header[5];
+    POP3SeenSet *set;
+    gint i;
+    
+    if(!g_file_get_contents(filename, &contents, &len, NULL))
+        return NULL;
+    
+    if(len < POP3_SEEN_SET_HEADER_LEN
+       || memcmp(contents, POP3_SEEN_SET_MAGIC, 8))
+    {
+        DBG("ignoring corrupt seen-set %s", filename);
+        g_free(contents);
+        return NULL;
+    }
+    
+    memcpy(header, contents + 8, sizeof(header));
+    for(i = 0; i < 5; i++)
+        header[i] = GUINT32_FROM_LE(header[i]);
+    
+    if(header[0] != POP3_SEEN_SET_VERSION
+       || len != POP3_SEEN_SET_HEADER_LEN
+                 + ((gsize)header[1] + header[2]) * 4)
+    {
+        DBG("ignoring stale or corrupt seen-set %s", filename);
+        g_free(contents);
+        return NULL;
+    }
+    
+    set = pop3_seen_set_new(account);
+    pop3_uid_hashes_from_le(set->seen, contents + POP3_SEEN_SET_HEADER_LEN,
+                            header[1]);
+    pop3_uid_hashes_from_le(set->unseen,
+                            contents + POP3_SEEN_SET_HEADER_LEN
+                            + (gsize)header[1] * 4,
+                            header[2]);
+    set->last_count = header[3];
+    set->last_hash = header[4];
+    g_free(contents);
+    
+    DBG("loaded %u seen and %u unseen UIDs from %s", set->seen->len,
+        set->unseen->len, filename);
+    
+    return set;
+}
+
+static void
+pop3_seen_set_save(POP3SeenSet *set, const gchar *filename)
+{
+    gchar *contents, *dirname, *p;
+    gsize len;
+    guint32 header[5];
+    gint i;
+    GError *error = NULL;
+    
+    dirname = g_path_get_dirname(filename);
+    g_mkdir_with_parents(dirname, 0700);
+    g_free(dirname);
+    
+    header[0] = POP3_SEEN_SET_VERSION;
+    header[1] = set->seen->len;
+    header[2] = set->unseen->len;
+    header[3] = set->last_count;
+    header[4] = set->last_hash;
+    for(i = 0; i < 5; i++)
+        header[i] = GUINT32_TO_LE(header[i]);
+    
+    len = POP3_SEEN_SET_HEADER_LEN
+          + ((gsize)set->seen->len + set->unseen->len) * 4;
+    contents = g_malloc(len);
+    memcpy(contents, POP3_SEEN_SET_MAGIC, 8);
+    memcpy(contents + 8, header, sizeof(header));
+    p = pop3_uid_hashes_to_le(contents + POP3_SEEN_SET_HEADER_LEN, set->seen);
+    pop3_uid_hashes_to_le(p, set->unseen);
+    
+    if(!g_file_set_contents(filename, contents, len, &error)) {
+        g_warning("Mailwatch: Unable to write POP3 seen-set: %s",
+                  error->message);
+        g_error_free(error);
+    }
+    
+    g_free(contents);
+}
+
+/* streams the UIDL listing straight out of the connection's buffer, hashing
+ * each UID as it goes by.  returns the sorted hashes and sets |last_hash| to
+ * the hash of the last message's UID, or returns NULL if the server doesn't
+ * do UIDL or the connection failed; |unsupported| tells the two apart */
+static GArray *
+pop3_fetch_uid_hashes(XfceMailwatchPOP3Mailbox *pmailbox,
+                      guint32 *last_hash,
+                      gboolean *unsupported)
+{
+    gchar buf[1024];
+    const gchar *line, *p, *end;
+    gsize line_len;
+    guint32 hash;
+    GArray *hashes;
+    GError *error = NULL;
+    
+    *unsupported = FALSE;
+    *last_hash = 0;
+    
+    if(pop3_send(pmailbox, "UIDL\r\n") != 6)
+        return NULL;
+    
+    if(pop3_recv(pmailbox, buf, sizeof(buf) - 1) <= 0)
+        return NULL;
+    if(strncmp(buf, "+OK", 3)) {
+        DBG("server doesn't support UIDL: %s", buf);
+        *unsupported = TRUE;
+        return NULL;
+    }
+    
+    hashes = g_array_sized_new(FALSE, FALSE, sizeof(guint32), 1024);
+    
+    /* "<msgno> <uid>" per message, then "." */
+    while((line = xfce_mailwatch_net_conn_peek_line(pmailbox->net_conn,
+                                                    &line_len, &error)))
+    {
+        if(line_len == 1 && *line == '.') {
+            xfce_mailwatch_net_conn_consume(pmailbox->net_conn,
+                                            line_len + POP3_CRLF_LEN);
+            g_array_sort(hashes, pop3_uid_hash_compare);
+            return hashes;
+        }
+        
+        end = line + line_len;
+        p = memchr(line, ' ', line_len);
+        if(p && ++p < end) {
+            hash = pop3_uid_hash(p, end - p);
+            g_array_append_val(hashes, hash);
+            *last_hash = hash;
+        }
+        
+        xfce_mailwatch_net_conn_consume(pmailbox->net_conn,
+                                        line_len + POP3_CRLF_LEN);
+    }
+    
+    xfce_mailwatch_log_message(pmailbox->mailwatch,
+                               XFCE_MAILWATCH_MAILBOX(pmailbox),
+                               XFCE_MAILWATCH_LOG_ERROR,
+                               "%s", error->message);
+    g_error_free(error);
+    g_array_free(hashes, TRUE);
+    
+    return NULL;
+}
+
+/* reads the response to a "UIDL <msgno>" that has already been sent.
+ * returns 1 and fills in |hash| if there is such a message, 0 if there
+ * isn't, and -1 on error */
+static gint
+pop3_read_uid_hash(XfceMailwatchPOP3Mailbox *pmailbox,
+                   guint msgno,
+                   guint32 *hash)
+{
+    gchar buf[1024], *p, *end;
+    
+    if(pop3_recv(pmailbox, buf, sizeof(buf) - 1) <= 0)
+        return -1;
+    if(!strncmp(buf, "-ERR", 4))
+        return 0;
+    
+    /* "+OK <msgno> <uid>" */
+    end = strchr(buf, '\n');
+    if(strncmp(buf, "+OK ", 4) || !end || !(p = strchr(buf + 4, ' '))
+       || ++p >= end)
+    {
+        DBG("bad response to UIDL %u: %s", msgno, buf);
+        return -1;
+    }
+    
+    *hash = pop3_uid_hash(p, end - p);
+    
+    return 1;
+}
+
+/* asks for the UID of message |msgno| alone */
+static gint
+pop3_probe_uid_hash(XfceMailwatchPOP3Mailbox *pmailbox,
+                    guint msgno,
+                    guint32 *hash)
+{
+    gchar buf[64];
+    
+    g_snprintf(buf, sizeof(buf), "UIDL %u\r\n", msgno);
+    if(pop3_send(pmailbox, buf) != (gssize)strlen(buf))
+        return -1;
     
-    return new_messages;
+    return pop3_read_uid_hash(pmailbox, msgno, hash);
+}
+
+/* rebuilds |set| from a full UIDL listing: UIDs that have left the server
+ * are dropped from the seen-set, and whatever is left over is unseen.  for
+ * a |baseline|, everything on the server is taken as seen instead */
+static gboolean
+pop3_seen_set_full_update(XfceMailwatchPOP3Mailbox *pmailbox,
+                          POP3SeenSet *set,
+                          gboolean baseline,
+                          gboolean *unsupported)
+{
+    GArray *current, *seen = set->seen;
+    guint32 last_hash;
+    guint i, j, k;
+    
+    current = pop3_fetch_uid_hashes(pmailbox, &last_hash, unsupported);
+    if(!current)
+        return FALSE;
+    
+    set->last_count = current->len;
+    set->last_hash = last_hash;
+    g_array_set_size(set->unseen, 0);
+    
+    if(baseline) {
+        g_array_free(set->seen, TRUE);
+        set->seen = current;
+        return TRUE;
+    }
+    
+    /* both lists are sorted, so one merge pass finds the unseen UIDs and
+     * compacts the seen-set down to what's still on the server */
+    for(i = 0, j = 0, k = 0; i < current->len; i++) {
+        guint32 hash = g_array_index(current, guint32, i);
+        
+        while(j < seen->len && g_array_index(seen, guint32, j) < hash)
+            j++;
+        
+        if(j < seen->len && g_array_index(seen, guint32, j) == hash) {
+            if(!k || g_array_index(seen, guint32, k - 1) != hash)
+                g_array_index(seen, guint32, k++) = hash;
+        } else
+            g_array_append_val(set->unseen, hash);
+    }
+    
+    if(k != seen->len) {
+        DBG("dropping %u UIDs no longer on the server", seen->len - k);
+        g_array_set_size(seen, k);
+    }
+    
+    g_array_free(current, TRUE);
+    
+    return TRUE;
+}
+
+/* brings |set| up to date by asking about single messages instead of
+ * listing the whole maildrop.  if message |last_count| still has the UID it
+ * had last time, nothing before it has moved and only the messages after it
+ * need looking at.  otherwise something was deleted; POP3 keeps messages in
+ * arrival order, so the messages we know about are still a prefix of the
+ * maildrop, and a binary search finds where that prefix now ends.  returns
+ * FALSE with |failed| unset when a full listing would be the better deal */
+static gboolean
+pop3_seen_set_tail_update(XfceMailwatchPOP3Mailbox *pmailbox,
+                          POP3SeenSet *set,
+                          gboolean *failed)
+{
+    gboolean pipelining = (pmailbox->caps & POP3_CAP_PIPELINING);
+    guint count, known = 0, lo, hi, mid, i;
+    guint32 hash, known_hash = 0;
+    gint ret = 0;
+    
+    *failed = FALSE;
+    
+    if(pipelining && set->last_count) {
+        /* no need to wait for STAT: if the maildrop shrank, the probe will
+         * just come back with -ERR */
+        gchar buf[64];
+        
+        g_snprintf(buf, sizeof(buf), "STAT\r\nUIDL %u\r\n", set->last_count);
+        if(pop3_send(pmailbox, buf) != (gssize)strlen(buf)
+           || !pop3_read_stat(pmailbox, &count))
+        {
+            *failed = TRUE;
+            return FALSE;
+        }
+        ret = pop3_read_uid_hash(pmailbox, set->last_count, &hash);
+    } else {
+        if(!pop3_stat(pmailbox, &count)) {
+            *failed = TRUE;
+            return FALSE;
+        }
+        if(set->last_count && set->last_count <= count)
+            ret = pop3_probe_uid_hash(pmailbox, set->last_count, &hash);
+    }
+    
+    if(set->last_count) {
+        if(ret < 0) {
+            *failed = TRUE;
+            return FALSE;
+        }
+        if(ret > 0 && hash == set->last_hash) {
+            known = set->last_count;
+            known_hash = hash;
+        }
+    }
+    
+    if(set->last_count && !known) {
+        /* deletions may have taken unseen messages with them, and only a
+         * full listing can say which */
+        if(set->unseen->len)
+            return FALSE;
+        
+        lo = 0;
+        hi = MIN(set->last_count - 1, count);
+        while(lo < hi) {
+            mid = lo + (hi - lo + 1) / 2;
+            ret = pop3_probe_uid_hash(pmailbox, mid, &hash);
+            if(ret < 0) {
+                *failed = TRUE;
+                return FALSE;
+            }
+            if(ret > 0 && pop3_seen_set_is_known(set, hash)) {
+                lo = mid;
+                known_hash = hash;
+            } else
+                hi = mid - 1;
+        }
+        known = lo;
+        if(!known)
+            known_hash = 0;
+        
+        DBG("maildrop was compacted, %u of %u messages left", known,
+            set->last_count);
+        
+        /* the seen-set can't shed deleted UIDs without a full listing, so
+         * get one once enough of them pile up */
+        if(set->seen->len > known + known / 8 + 64)
+            return FALSE;
+    }
+    
+    if(count - known > POP3_MAX_TAIL_PROBES)
+        return FALSE;
+    
+    if(pipelining && count > known) {
+        GString *cmds = g_string_sized_new(16 * (count - known));
+        gboolean sent;
+        
+        for(i = known + 1; i <= count; i++)
+            g_string_append_printf(cmds, "UIDL %u\r\n", i);
+        sent = (pop3_send(pmailbox, cmds->str) == (gssize)cmds->len);
+        g_string_free(cmds, TRUE);
+        
+        if(!sent) {
+            *failed = TRUE;
+            return FALSE;
+        }
+    }
+    
+    for(i = known + 1; i <= count; i++) {
+        if(pipelining)
+            ret = pop3_read_uid_hash(pmailbox, i, &hash);
+        else
+            ret = pop3_probe_uid_hash(pmailbox, i, &hash);
+        if(ret <= 0) {
+            *failed = TRUE;
+            return FALSE;
+        }
+        if(!pop3_seen_set_is_known(set, hash))
+            pop3_uid_hashes_insert(set->unseen, hash);
+        known_hash = hash;
+    }
+    
+    set->last_count = count;
+    set->last_hash = known_hash;
+    
+    return TRUE;
+}
+
+/* counts the messages on the server whose UIDs aren't in the seen-set.  the
+ * first time an account is checked, everything already on the server is
+ * taken as seen; after that, messages count as new until the user goes to
+ * read their mail.  returns -1 on failure, setting |unsupported| if that
+ * was because the server doesn't do UIDL */
+static gint
+pop3_check_inbox_uids(XfceMailwatchPOP3Mailbox *pmailbox,
+                      const gchar *account,
+                      gboolean *unsupported)
+{
+    POP3SeenSet *set = pmailbox->seen_set;
+    gboolean failed = FALSE, dirty = TRUE;
+    gchar *filename;
+    guint last_count, n_seen, n_unseen;
+    guint32 last_hash;
+    
+    *unsupported = FALSE;
+    
+    filename = pop3_seen_set_filename(account);
+    
+    if(!set || strcmp(set->account, account)) {
+        if(set)
+            pop3_seen_set_free(set);
+        set = pmailbox->seen_set = pop3_seen_set_load(filename, account);
+    }
+    
+    if(!set) {
+        set = pop3_seen_set_new(account);
+        if(!pop3_seen_set_full_update(pmailbox, set, TRUE, unsupported)) {
+            pop3_seen_set_free(set);
+            g_free(filename);
+            return -1;
+        }
+        pmailbox->seen_set = set;
+    } else {
+        last_count = set->last_count;
+        last_hash = set->last_hash;
+        n_seen = set->seen->len;
+        n_unseen = set->unseen->len;
+        
+        if(pop3_seen_set_tail_update(pmailbox, set, &failed)) {
+            dirty = (set->last_count != last_count
+                     || set->last_hash != last_hash
+                     || set->seen->len != n_seen
+                     || set->unseen->len != n_unseen);
+        } else if(failed
+                  || !pop3_seen_set_full_update(pmailbox, set, FALSE,
+                                                unsupported))
+        {
+            g_free(filename);
+            return -1;
+        }
+    }
+    
+    if(g_atomic_int_compare_and_exchange(&pmailbox->mark_seen, TRUE, FALSE)
+       && set->unseen->len)
+    {
+        guint i;
+        
+        for(i = 0; i < set->unseen->len; i++)
+            pop3_uid_hashes_insert(set->seen,
+                                   g_array_index(set->unseen, guint32, i));
+        g_array_set_size(set->unseen, 0);
+        dirty = TRUE;
+    }
+    
+    if(dirty)
+        pop3_seen_set_save(set, filename);
+    g_free(filename);
+    
+    return set->unseen->len;
 }
 
 static gpointer
@@ -464,6 +1186,7 @@ pop3_check_mail_th(gpointer user_data)
     guint new_messages = 0;
     XfceMailwatchAuthType auth_type;
     gint nonstandard_port = -1;
+    CHECK_TIMER_INIT;
 
     while(!g_atomic_pointer_get(&pmailbox->th)
           && g_atomic_int_get(&pmailbox->running))
@@ -493,6 +1216,7 @@ pop3_check_mail_th(gpointer user_data)
     
     g_mutex_unlock(pmailbox->config_mx);
     
+    CHECK_TIMER_START;
     pmailbox->net_conn = xfce_mailwatch_net_conn_new(host, NULL);
     xfce_mailwatch_net_conn_set_should_continue_func(pmailbox->net_conn,
                                                      pop3_should_continue,
@@ -500,20 +1224,35 @@ pop3_check_mail_th(gpointer user_data)
     if(pop3_authenticate(pmailbox, host, username, password, auth_type,
                          nonstandard_port))
     {
-        new_messages = pop3_check_inbox(pmailbox);
-        DBG("checked inbox, %d new messages", new_messages);
+        gchar *account = g_strdup_printf("%s@%s:%d", username, host,
+                                         nonstandard_port);
+        gboolean unsupported = FALSE;
+        gint unseen = pop3_check_inbox_uids(pmailbox, account, &unsupported);
         
-        xfce_mailwatch_signal_new_messages(pmailbox->mailwatch,
-                XFCE_MAILWATCH_MAILBOX(pmailbox), new_messages);
+        g_free(account);
+        
+        if(unseen >= 0
+           || (unsupported && pop3_stat(pmailbox, &new_messages)))
+        {
+            if(unseen >= 0)
+                new_messages = unseen;
+            DBG("checked inbox, %d new messages", new_messages);
+            
+            xfce_mailwatch_signal_new_messages(pmailbox->mailwatch,
+                    XFCE_MAILWATCH_MAILBOX(pmailbox), new_messages);
+        }
     }
     
     if(xfce_mailwatch_net_conn_is_connected(pmailbox->net_conn))
         pop3_send(pmailbox, "QUIT\r\n");
     
     if(pmailbox->net_conn) {
+        xfce_mailwatch_net_conn_dump_stats(pmailbox->net_conn, "POP3 check",
+                                           CHECK_TIMER_ELAPSED);
         xfce_mailwatch_net_conn_destroy(pmailbox->net_conn);
         pmailbox->net_conn = NULL;
     }
+    CHECK_TIMER_FREE;
 
     g_atomic_pointer_set(&pmailbox->th, NULL);
     return NULL;
@@ -598,6 +1337,15 @@ pop3_force_update_cb(XfceMailwatchMailbox *mailbox)
     }
 }
 
+static void
+pop3_mark_seen_cb(XfceMailwatchMailbox *mailbox)
+{
+    XfceMailwatchPOP3Mailbox *pmailbox = XFCE_MAILWATCH_POP3_MAILBOX(mailbox);
+    
+    g_atomic_int_set(&pmailbox->mark_seen, TRUE);
+    pop3_force_update_cb(mailbox);
+}
+
 static gboolean
 pop3_host_entry_focus_out_cb(GtkWidget *w, GdkEventFocus *evt,
         gpointer user_data)
@@ -1029,6 +1777,9 @@ pop3_mailbox_free(XfceMailwatchMailbox *mailbox)
     g_free(pmailbox->username);
     g_free(pmailbox->password);
     
+    if(pmailbox->seen_set)
+        pop3_seen_set_free(pmailbox->seen_set);
+    
     g_free(pmailbox);
 }
 
@@ -1043,5 +1794,6 @@ XfceMailwatchMailboxType builtin_mailbox_type_pop3 = {
     pop3_get_setup_page,
     pop3_restore_param_list,
     pop3_save_param_list,
-    pop3_mailbox_free
+    pop3_mailbox_free,
+    pop3_mark_seen_cb
 };
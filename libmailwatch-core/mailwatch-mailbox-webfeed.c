@@ -0,0 +1,1166 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2005-2008 Brian Tarricone <bjt23@cornell.edu>
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* watches any web page that knows how many new messages there are: an Atom
+ * or RSS feed, a JSON API, or anything a regex can pick a number out of.
+ * the GMail mailbox is one of these with the feed filled in. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include <libxfce4util/libxfce4util.h>
+#include <libxfce4ui/libxfce4ui.h>
+
+#include "mailwatch-common.h"
+#include "mailwatch-utils.h"
+#include "mailwatch.h"
+#include "mailwatch-net-conn.h"
+#include "mailwatch-http.h"
+#include "mailwatch-feed.h"
+
+#define BORDER                  8
+#define WEBFEED_MAX_BODY_SIZE   (1024 * 1024)
+#define WEBFEED_JSON_MAX_DEPTH  64
+#define XFCE_MAILWATCH_WEBFEED_MAILBOX(ptr)  ((XfceMailwatchWebFeedMailbox *)ptr)
+
+#ifdef HAVE_SSL_SUPPORT
+#define GMAIL_FEED_URL          "https://mail.google.com/mail/feed/atom"
+#define GMAIL_FEED_RULE         "fullcount"
+#endif
+
+/* how the new message count is found.  these are saved in the config, so
+ * only add to the end. */
+typedef enum
+{
+    RULE_XML_ELEMENT = 0,
+    RULE_JSON_POINTER,
+    RULE_REGEX,
+} XfceMailwatchWebFeedRuleType;
+
+typedef struct
+{
+    XfceMailwatchMailbox mailbox;
+
+    GMutex *config_mx;
+
+    gchar *url;
+    gchar *username;
+    gchar *password;
+    XfceMailwatchWebFeedRuleType rule_type;
+    gchar *rule;
+    guint timeout;
+    gboolean fixed;  /* the URL and rule come with the mailbox type */
+
+    XfceMailwatch *mailwatch;
+
+    /* current connection state */
+    gint running;
+    gpointer th;
+    guint check_id;
+
+    /* kept between checks; only the check thread touches these */
+    XfceMailwatchHTTPConn *http_conn;
+    gchar *conn_host;
+    guint conn_port;
+    gboolean conn_secure;
+    XfceMailwatchHTTPValidators validators;
+    gchar *feed_key;
+    guint last_count;
+} XfceMailwatchWebFeedMailbox;
+
+typedef struct
+{
+    gchar *host;
+    guint port;
+    gboolean secure;
+    gchar *path;
+    gchar *username;
+    gchar *password;
+} XfceMailwatchWebFeedURL;
+
+typedef struct
+{
+    GString *data;
+    gboolean too_large;
+} XfceMailwatchWebFeedBody;
+
+#ifdef HAVE_SSL_SUPPORT
+extern XfceMailwatchMailboxType builtin_mailbox_type_gmail;
+#endif
+
+
+static gboolean
+webfeed_should_continue(XfceMailwatchNetConn *net_conn,
+                        gpointer user_data)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = user_data;
+    return g_atomic_int_get(&wfmailbox->running);
+}
+
+static void
+webfeed_url_clear(XfceMailwatchWebFeedURL *url)
+{
+    g_free(url->host);
+    g_free(url->path);
+    g_free(url->username);
+    g_free(url->password);
+    memset(url, 0, sizeof(*url));
+}
+
+/* splits up an http:// or https:// URL.  credentials in the URL are only
+ * used if none are configured. */
+static gboolean
+webfeed_url_parse(const gchar *str,
+                  XfceMailwatchWebFeedURL *url)
+{
+    const gchar *p, *authority, *authority_end, *host, *host_end, *port;
+    gchar *userinfo, *colon, *end = NULL;
+    gulong port_num;
+
+    memset(url, 0, sizeof(*url));
+
+    if(!g_ascii_strncasecmp(str, "http://", 7))
+        authority = str + 7;
+    else if(!g_ascii_strncasecmp(str, "https://", 8)) {
+        authority = str + 8;
+        url->secure = TRUE;
+    } else
+        return FALSE;
+
+    authority_end = authority + strcspn(authority, "/?#");
+
+    host = authority;
+    for(p = authority; p < authority_end; p++) {
+        if(*p == '@')
+            host = p + 1;
+    }
+    if(host != authority) {
+        userinfo = g_strndup(authority, host - 1 - authority);
+        colon = strchr(userinfo, ':');
+        if(colon) {
+            *colon = 0;
+            url->password = g_uri_unescape_string(colon + 1, NULL);
+        }
+        url->username = g_uri_unescape_string(userinfo, NULL);
+        g_free(userinfo);
+    }
+
+    /* IPv6 addresses are in brackets, so their colons aren't a port */
+    if(*host == '[') {
+        host_end = memchr(host, ']', authority_end - host);
+        if(!host_end)
+            goto fail;
+        url->host = g_strndup(host + 1, host_end - host - 1);
+        port = host_end + 1;
+        if(port < authority_end && *port != ':')
+            goto fail;
+    } else {
+        for(p = host, port = authority_end; p < authority_end; p++) {
+            if(*p == ':')
+                port = p;
+        }
+        url->host = g_strndup(host, port - host);
+    }
+
+    if(port < authority_end && port + 1 < authority_end) {
+        port_num = strtoul(port + 1, &end, 10);
+        if(end != authority_end || !port_num || port_num > 65535)
+            goto fail;
+        url->port = port_num;
+    }
+
+    if(!*url->host)
+        goto fail;
+
+    /* the fragment is never sent */
+    if(*authority_end == '/')
+        url->path = g_strndup(authority_end, strcspn(authority_end, "#"));
+    else {
+        url->path = g_strconcat("/", authority_end, NULL);
+        url->path[1 + strcspn(authority_end, "#")] = 0;
+    }
+
+    return TRUE;
+
+fail:
+    webfeed_url_clear(url);
+    return FALSE;
+}
+
+/* the body of a JSON response or one we run a regex over is collected
+ * whole; these are small */
+static gboolean
+webfeed_collect_body(const gchar *data,
+                     gsize len,
+                     gpointer user_data)
+{
+    XfceMailwatchWebFeedBody *body = user_data;
+
+    if(body->data->len + len > WEBFEED_MAX_BODY_SIZE) {
+        body->too_large = TRUE;
+        return FALSE;
+    }
+
+    g_string_append_len(body->data, data, len);
+
+    return TRUE;
+}
+
+static gboolean
+webfeed_scan_feed(const gchar *data,
+                  gsize len,
+                  gpointer user_data)
+{
+    return xfce_mailwatch_feed_scanner_feed(user_data, data, len);
+}
+
+static const gchar *
+webfeed_json_skip_ws(const gchar *p,
+                     const gchar *end)
+{
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+    return p;
+}
+
+/* |p| is at the opening quote.  returns what follows the closing one. */
+static const gchar *
+webfeed_json_skip_string(const gchar *p,
+                         const gchar *end)
+{
+    for(p++; p < end; p++) {
+        if(*p == '\\')
+            p++;
+        else if(*p == '"')
+            return p + 1;
+    }
+
+    return NULL;
+}
+
+static const gchar *
+webfeed_json_skip_value(const gchar *p,
+                        const gchar *end,
+                        guint depth)
+{
+    gchar close;
+
+    p = webfeed_json_skip_ws(p, end);
+    if(p >= end)
+        return NULL;
+
+    if(*p == '"')
+        return webfeed_json_skip_string(p, end);
+
+    if(*p != '{' && *p != '[') {
+        /* a number, true, false or null */
+        while(p < end && !strchr(",}] \t\r\n", *p))
+            p++;
+        return p;
+    }
+
+    if(depth > WEBFEED_JSON_MAX_DEPTH)
+        return NULL;
+
+    close = (*p == '{' ? '}' : ']');
+    p = webfeed_json_skip_ws(p + 1, end);
+    if(p < end && *p == close)
+        return p + 1;
+
+    while(p < end) {
+        if(close == '}') {
+            if(*p != '"' || !(p = webfeed_json_skip_string(p, end)))
+                return NULL;
+            p = webfeed_json_skip_ws(p, end);
+            if(p >= end || *p != ':')
+                return NULL;
+            p++;
+        }
+
+        if(!(p = webfeed_json_skip_value(p, end, depth + 1)))
+            return NULL;
+
+        p = webfeed_json_skip_ws(p, end);
+        if(p >= end)
+            return NULL;
+        if(*p == close)
+            return p + 1;
+        if(*p != ',')
+            return NULL;
+        p = webfeed_json_skip_ws(p + 1, end);
+    }
+
+    return NULL;
+}
+
+/* compares the JSON string between the quotes at |p| and |end| with |str| */
+static gboolean
+webfeed_json_string_equal(const gchar *p,
+                          const gchar *end,
+                          const gchar *str)
+{
+    gchar utf8[8];
+    gunichar ch;
+    gint len, i, digit;
+
+    for(p++; p < end; p++) {
+        if(*p != '\\') {
+            if(*p != *str++)
+                return FALSE;
+            continue;
+        }
+
+        if(++p >= end)
+            return FALSE;
+        switch(*p) {
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'n': ch = '\n'; break;
+            case 'r': ch = '\r'; break;
+            case 't': ch = '\t'; break;
+            case 'u':
+                if(end - p < 5)
+                    return FALSE;
+                for(i = 1, ch = 0; i <= 4; i++) {
+                    if((digit = g_ascii_xdigit_value(p[i])) < 0)
+                        return FALSE;
+                    ch = (ch << 4) | digit;
+                }
+                p += 4;
+                break;
+            default:
+                ch = *p;
+                break;
+        }
+
+        len = g_unichar_to_utf8(ch, utf8);
+        if(strncmp(str, utf8, len))
+            return FALSE;
+        str += len;
+    }
+
+    return !*str;
+}
+
+/* finds the value |pointer| (RFC 6901) refers to in |json|.  a number, or a
+ * string holding one, is the count itself; an array counts its elements. */
+static gboolean
+webfeed_json_pointer_count(const gchar *json,
+                           gsize len,
+                           const gchar *pointer,
+                           guint *count)
+{
+#define BUFSIZE 255
+    const gchar *p = json, *end = json + len, *key, *key_end;
+    gchar token[BUFSIZE+1], *q;
+    gboolean found;
+    guint n = 0;
+    gulong index;
+    gint64 value;
+
+    if(*pointer && *pointer != '/')
+        return FALSE;
+
+    while(*pointer) {
+        /* the next reference token, with ~1 and ~0 unescaped */
+        for(pointer++, n = 0; *pointer && *pointer != '/'; pointer++) {
+            if(n == BUFSIZE)
+                return FALSE;
+            if(*pointer == '~' && (pointer[1] == '1' || pointer[1] == '0'))
+                token[n++] = (*++pointer == '1' ? '/' : '~');
+            else
+                token[n++] = *pointer;
+        }
+        token[n] = 0;
+
+        p = webfeed_json_skip_ws(p, end);
+        if(p >= end)
+            return FALSE;
+
+        found = FALSE;
+        if(*p == '{') {
+            p = webfeed_json_skip_ws(p + 1, end);
+            while(p < end && *p == '"') {
+                key = p;
+                if(!(p = webfeed_json_skip_string(p, end)))
+                    return FALSE;
+                key_end = p - 1;
+                p = webfeed_json_skip_ws(p, end);
+                if(p >= end || *p != ':')
+                    return FALSE;
+                p++;
+
+                if(webfeed_json_string_equal(key, key_end, token)) {
+                    found = TRUE;
+                    break;
+                }
+
+                if(!(p = webfeed_json_skip_value(p, end, 0)))
+                    return FALSE;
+                p = webfeed_json_skip_ws(p, end);
+                if(p < end && *p == ',')
+                    p = webfeed_json_skip_ws(p + 1, end);
+            }
+        } else if(*p == '[') {
+            if(!g_ascii_isdigit(*token) || (*token == '0' && token[1]))
+                return FALSE;
+            index = strtoul(token, &q, 10);
+            if(*q)
+                return FALSE;
+
+            p = webfeed_json_skip_ws(p + 1, end);
+            while(p < end && *p != ']') {
+                if(!index--) {
+                    found = TRUE;
+                    break;
+                }
+                if(!(p = webfeed_json_skip_value(p, end, 0)))
+                    return FALSE;
+                p = webfeed_json_skip_ws(p, end);
+                if(p < end && *p == ',')
+                    p = webfeed_json_skip_ws(p + 1, end);
+            }
+        }
+
+        if(!found)
+            return FALSE;
+    }
+
+    p = webfeed_json_skip_ws(p, end);
+    if(p >= end)
+        return FALSE;
+
+    if(*p == '[') {
+        p = webfeed_json_skip_ws(p + 1, end);
+        for(n = 0; p < end && *p != ']'; n++) {
+            if(!(p = webfeed_json_skip_value(p, end, 0)))
+                return FALSE;
+            p = webfeed_json_skip_ws(p, end);
+            if(p < end && *p == ',')
+                p = webfeed_json_skip_ws(p + 1, end);
+        }
+        *count = n;
+        return TRUE;
+    }
+
+    if(*p == '"')
+        p++;
+    if(!g_ascii_isdigit(*p))
+        return FALSE;
+
+    /* the body is nul-terminated, so this can't run off the end */
+    value = g_ascii_strtoll(p, NULL, 10);
+    if(value < 0 || value > G_MAXUINT)
+        return FALSE;
+    *count = value;
+
+    return TRUE;
+#undef BUFSIZE
+}
+
+/* with a capture group, the first match's group holds the count.
+ * otherwise, each match is a new message. */
+static gboolean
+webfeed_regex_count(XfceMailwatchWebFeedMailbox *wfmailbox,
+                    const gchar *pattern,
+                    const gchar *body,
+                    gsize len,
+                    guint *count)
+{
+    GRegex *regex;
+    GMatchInfo *match_info = NULL;
+    GError *error = NULL;
+    gchar *group;
+    gboolean ret = FALSE;
+    guint n = 0;
+
+    regex = g_regex_new(pattern, G_REGEX_RAW | G_REGEX_MULTILINE, 0, &error);
+    if(!regex) {
+        xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   _("Invalid regular expression: %s"),
+                                   error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    g_regex_match_full(regex, body, len, 0, 0, &match_info, NULL);
+
+    if(g_regex_get_capture_count(regex) > 0) {
+        if(g_match_info_matches(match_info)) {
+            group = g_match_info_fetch(match_info, 1);
+            if(group && g_ascii_isdigit(*group)) {
+                *count = atoi(group);
+                ret = TRUE;
+            }
+            g_free(group);
+        }
+    } else {
+        while(g_match_info_matches(match_info)) {
+            n++;
+            g_match_info_next(match_info, NULL);
+        }
+        *count = n;
+        ret = TRUE;
+    }
+
+    g_match_info_free(match_info);
+    g_regex_unref(regex);
+
+    return ret;
+}
+
+static gboolean
+webfeed_check_feed(XfceMailwatchWebFeedMailbox *wfmailbox,
+                   const gchar *url_str,
+                   const gchar *username,
+                   const gchar *password,
+                   XfceMailwatchWebFeedRuleType rule_type,
+                   const gchar *rule,
+                   guint *new_messages)
+{
+#define BUFSIZE 8191
+    gboolean ret = FALSE;
+    GError *error = NULL;
+    gchar buf[BUFSIZE+1], *base64_creds, *authorization = NULL, *feed_key;
+    gint respcode, tmp;
+    guint count = 0;
+    XfceMailwatchWebFeedURL url;
+    XfceMailwatchFeedScanner scanner;
+    XfceMailwatchWebFeedBody body = { NULL, FALSE };
+    CHECK_TIMER_INIT;
+
+    if(!webfeed_url_parse(url_str, &url)) {
+        xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   _("\"%s\" is not an http:// or https:// URL."),
+                                   url_str);
+        return FALSE;
+    }
+
+    if(!*username && url.username) {
+        username = url.username;
+        password = url.password ? url.password : "";
+    }
+
+    if(*username) {
+        g_snprintf(buf, BUFSIZE, "%s:%s", username, password);
+        if(xfce_mailwatch_base64_encode((guchar *)buf, strlen(buf), &base64_creds) <= 0) {
+            DBG("failed to base64 enc credentials");
+            webfeed_url_clear(&url);
+            return FALSE;
+        }
+        authorization = g_strconcat("Basic ", base64_creds, NULL);
+        g_free(base64_creds);
+    }
+
+    /* a 304 only means the count didn't change if it's the same feed,
+     * fetched as the same user, and read the same way */
+    feed_key = g_strdup_printf("%s\n%s\n%d\n%s", url_str, username,
+                               rule_type, rule);
+    if(!wfmailbox->feed_key || strcmp(wfmailbox->feed_key, feed_key)) {
+        xfce_mailwatch_http_validators_clear(&wfmailbox->validators);
+        g_free(wfmailbox->feed_key);
+        wfmailbox->feed_key = feed_key;
+    } else
+        g_free(feed_key);
+
+    if(wfmailbox->http_conn
+       && (strcmp(wfmailbox->conn_host, url.host)
+           || wfmailbox->conn_port != url.port
+           || wfmailbox->conn_secure != url.secure))
+    {
+        xfce_mailwatch_http_conn_destroy(wfmailbox->http_conn);
+        wfmailbox->http_conn = NULL;
+    }
+
+    if(!wfmailbox->http_conn) {
+        wfmailbox->http_conn = xfce_mailwatch_http_conn_new(url.host, url.port,
+                                                            url.secure);
+        xfce_mailwatch_http_conn_set_should_continue_func(wfmailbox->http_conn,
+                                                          webfeed_should_continue,
+                                                          wfmailbox);
+        g_free(wfmailbox->conn_host);
+        wfmailbox->conn_host = g_strdup(url.host);
+        wfmailbox->conn_port = url.port;
+        wfmailbox->conn_secure = url.secure;
+    }
+
+    CHECK_TIMER_START;
+
+    if(rule_type == RULE_XML_ELEMENT) {
+        /* without a count element, each entry is a new message */
+        xfce_mailwatch_feed_scanner_init(&scanner, *rule ? rule : NULL,
+                                         NULL, NULL);
+        respcode = xfce_mailwatch_http_conn_get(wfmailbox->http_conn, url.path,
+                                                authorization,
+                                                &wfmailbox->validators,
+                                                webfeed_scan_feed, &scanner,
+                                                &error);
+    } else {
+        body.data = g_string_sized_new(4096);
+        respcode = xfce_mailwatch_http_conn_get(wfmailbox->http_conn, url.path,
+                                                authorization,
+                                                &wfmailbox->validators,
+                                                webfeed_collect_body, &body,
+                                                &error);
+    }
+    g_free(authorization);
+    DBG("response code is %d", respcode);
+
+    if(respcode < 0) {
+        xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   "%s", error->message);
+        g_error_free(error);
+    } else if(respcode == XFCE_MAILWATCH_HTTP_NOT_MODIFIED) {
+        DBG("feed hasn't changed");
+        *new_messages = wfmailbox->last_count;
+        ret = TRUE;
+    } else if(respcode != 200) {
+        if(respcode == 403 || respcode == 401) {
+            xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                       XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                       XFCE_MAILWATCH_LOG_ERROR,
+                                       _("Received HTTP response code %d.  The most likely reason for this is that your username or password is incorrect."),
+                                       respcode);
+        } else {
+            xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                       XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                       XFCE_MAILWATCH_LOG_ERROR,
+                                       _("Received HTTP response code %d, which should be 200."),
+                                       respcode);
+        }
+    } else if(body.too_large) {
+        xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                   XFCE_MAILWATCH_LOG_ERROR,
+                                   _("The response from %s is too large (over %d KiB) to look for the new message count in."),
+                                   url.host, WEBFEED_MAX_BODY_SIZE / 1024);
+    } else {
+        switch(rule_type) {
+            case RULE_XML_ELEMENT:
+                if(!*rule) {
+                    count = xfce_mailwatch_feed_scanner_get_n_entries(&scanner);
+                    ret = TRUE;
+                } else if((tmp = xfce_mailwatch_feed_scanner_get_count(&scanner)) >= 0) {
+                    count = tmp;
+                    ret = TRUE;
+                }
+                break;
+
+            case RULE_JSON_POINTER:
+                ret = webfeed_json_pointer_count(body.data->str,
+                                                 body.data->len, rule, &count);
+                break;
+
+            case RULE_REGEX:
+                ret = webfeed_regex_count(wfmailbox, rule, body.data->str,
+                                          body.data->len, &count);
+                break;
+        }
+
+        if(ret)
+            *new_messages = wfmailbox->last_count = count;
+        else {
+            xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                       XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                       XFCE_MAILWATCH_LOG_ERROR,
+                                       _("Couldn't find the new message count in the response from %s."),
+                                       url.host);
+        }
+    }
+
+    if(!ret) {
+        /* don't let a 304 vouch for a count we never got */
+        xfce_mailwatch_http_validators_clear(&wfmailbox->validators);
+    }
+
+    if(body.data)
+        g_string_free(body.data, TRUE);
+
+    xfce_mailwatch_http_conn_dump_stats(wfmailbox->http_conn, "web feed check",
+                                        CHECK_TIMER_ELAPSED);
+    CHECK_TIMER_FREE;
+    webfeed_url_clear(&url);
+
+    return ret;
+#undef BUFSIZE
+}
+
+static void
+webfeed_check_mail(XfceMailwatchWebFeedMailbox *wfmailbox)
+{
+    gchar *url, *username, *password, *rule;
+    XfceMailwatchWebFeedRuleType rule_type;
+    guint new_messages = 0;
+
+    g_mutex_lock(wfmailbox->config_mx);
+
+    if(!wfmailbox->url || !*wfmailbox->url) {
+        g_mutex_unlock(wfmailbox->config_mx);
+        return;
+    }
+
+    url = g_strdup(wfmailbox->url);
+    username = g_strdup(wfmailbox->username ? wfmailbox->username : "");
+    password = g_strdup(wfmailbox->password ? wfmailbox->password : "");
+    rule_type = wfmailbox->rule_type;
+    rule = g_strdup(wfmailbox->rule ? wfmailbox->rule : "");
+
+    g_mutex_unlock(wfmailbox->config_mx);
+
+    if(webfeed_check_feed(wfmailbox, url, username, password, rule_type,
+                          rule, &new_messages))
+    {
+        DBG("checked web feed, %u new messages", new_messages);
+        xfce_mailwatch_signal_new_messages(wfmailbox->mailwatch,
+                                           XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                           new_messages);
+    } else {
+        DBG("failed to check web feed");
+    }
+
+    g_free(url);
+    g_free(username);
+    g_free(password);
+    g_free(rule);
+}
+
+static gpointer
+webfeed_check_mail_th(gpointer data)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(data);
+
+    while(!g_atomic_pointer_get(&wfmailbox->th)
+          && g_atomic_int_get(&wfmailbox->running))
+    {
+        g_thread_yield();
+    }
+
+    if(!g_atomic_int_get(&wfmailbox->running)) {
+        g_atomic_pointer_set(&wfmailbox->th, NULL);
+        return NULL;
+    }
+
+    webfeed_check_mail(wfmailbox);
+
+    g_atomic_pointer_set(&wfmailbox->th, NULL);
+    return NULL;
+}
+
+static gboolean
+webfeed_check_mail_timeout(gpointer data)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(data);
+
+    GThread *th;
+
+    if(g_atomic_pointer_get(&wfmailbox->th)) {
+        xfce_mailwatch_log_message(wfmailbox->mailwatch,
+                                   XFCE_MAILWATCH_MAILBOX(wfmailbox),
+                                   XFCE_MAILWATCH_LOG_WARNING,
+                                   _("Previous thread hasn't exited yet, not checking mail this time."));
+        return TRUE;
+    }
+
+    th = g_thread_create(webfeed_check_mail_th, wfmailbox, FALSE, NULL);
+    g_atomic_pointer_set(&wfmailbox->th, th);
+
+    return TRUE;
+}
+
+static XfceMailwatchMailbox *
+webfeed_mailbox_new(XfceMailwatch *mailwatch, XfceMailwatchMailboxType *type)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = g_new0(XfceMailwatchWebFeedMailbox, 1);
+    wfmailbox->mailbox.type = type;
+    wfmailbox->mailwatch = mailwatch;
+    wfmailbox->timeout = XFCE_MAILWATCH_DEFAULT_TIMEOUT;
+    wfmailbox->rule_type = RULE_XML_ELEMENT;
+    wfmailbox->config_mx = g_mutex_new();
+
+#ifdef HAVE_SSL_SUPPORT
+    if(type == &builtin_mailbox_type_gmail) {
+        wfmailbox->url = g_strdup(GMAIL_FEED_URL);
+        wfmailbox->rule = g_strdup(GMAIL_FEED_RULE);
+        wfmailbox->fixed = TRUE;
+    }
+#endif
+
+    xfce_mailwatch_net_conn_init();
+
+    return (XfceMailwatchMailbox *)wfmailbox;
+}
+
+static void
+webfeed_set_activated(XfceMailwatchMailbox *mailbox, gboolean activated)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(mailbox);
+
+    if(activated == g_atomic_int_get(&wfmailbox->running))
+        return;
+
+    if(activated) {
+        g_atomic_int_set(&wfmailbox->running, TRUE);
+        wfmailbox->check_id = g_timeout_add(wfmailbox->timeout * 1000,
+                                            webfeed_check_mail_timeout,
+                                            wfmailbox);
+    } else {
+        g_atomic_int_set(&wfmailbox->running, FALSE);
+        g_source_remove(wfmailbox->check_id);
+        wfmailbox->check_id = 0;
+    }
+}
+
+static void
+webfeed_force_update_cb(XfceMailwatchMailbox *mailbox)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(mailbox);
+
+    if(!g_atomic_pointer_get(&wfmailbox->th)) {
+        gboolean restart = FALSE;
+
+        if(wfmailbox->check_id) {
+            g_source_remove(wfmailbox->check_id);
+            restart = TRUE;
+        }
+
+        webfeed_check_mail_timeout(wfmailbox);
+
+        if(restart) {
+            wfmailbox->check_id = g_timeout_add(wfmailbox->timeout * 1000,
+                                                webfeed_check_mail_timeout,
+                                                wfmailbox);
+        }
+    }
+}
+
+static gboolean
+webfeed_config_entry_focus_out_cb(GtkWidget *w,
+                                  GdkEventFocus *evt,
+                                  gpointer user_data)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(user_data);
+    gchar **setting = g_object_get_data(G_OBJECT(w), "xfmw-setting");
+
+    g_mutex_lock(wfmailbox->config_mx);
+
+    g_free(*setting);
+    *setting = gtk_editable_get_chars(GTK_EDITABLE(w), 0, -1);
+
+    g_mutex_unlock(wfmailbox->config_mx);
+
+    return FALSE;
+}
+
+static void
+webfeed_config_rule_combo_changed_cb(GtkWidget *w,
+                                     gpointer user_data)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(user_data);
+
+    g_mutex_lock(wfmailbox->config_mx);
+    wfmailbox->rule_type = gtk_combo_box_get_active(GTK_COMBO_BOX(w));
+    g_mutex_unlock(wfmailbox->config_mx);
+}
+
+static gboolean
+webfeed_config_timeout_spinbutton_changed_cb(GtkSpinButton *sb,
+                                             gpointer user_data)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(user_data);
+    guint value = (guint) gtk_spin_button_get_value_as_int(sb) * 60;
+
+    if(value == wfmailbox->timeout)
+        return FALSE;
+
+    wfmailbox->timeout = value;
+
+    if(g_atomic_int_get(&wfmailbox->running)) {
+        /* probably shouldn't do this so frequently */
+        if(wfmailbox->check_id)
+            g_source_remove(wfmailbox->check_id);
+        wfmailbox->check_id = g_timeout_add(wfmailbox->timeout * 1000,
+                                            webfeed_check_mail_timeout,
+                                            wfmailbox);
+    }
+
+    return FALSE;
+}
+
+static GtkWidget *
+webfeed_config_add_entry(XfceMailwatchWebFeedMailbox *wfmailbox,
+                         GtkWidget *vbox,
+                         GtkSizeGroup *sg,
+                         const gchar *label,
+                         gchar **setting,
+                         gboolean visible)
+{
+    GtkWidget *hbox, *lbl, *entry;
+
+    hbox = gtk_hbox_new(FALSE, BORDER/2);
+    gtk_widget_show(hbox);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+    lbl = gtk_label_new_with_mnemonic(label);
+    gtk_misc_set_alignment(GTK_MISC(lbl), 0.0, 0.5);
+    gtk_widget_show(lbl);
+    gtk_box_pack_start(GTK_BOX(hbox), lbl, FALSE, FALSE, 0);
+    gtk_size_group_add_widget(sg, lbl);
+
+    entry = gtk_entry_new();
+    gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+    gtk_entry_set_visibility(GTK_ENTRY(entry), visible);
+    if(*setting)
+        gtk_entry_set_text(GTK_ENTRY(entry), *setting);
+    gtk_widget_show(entry);
+    gtk_box_pack_start(GTK_BOX(hbox), entry, TRUE, TRUE, 0);
+    g_object_set_data(G_OBJECT(entry), "xfmw-setting", setting);
+    g_signal_connect(G_OBJECT(entry), "focus-out-event",
+                     G_CALLBACK(webfeed_config_entry_focus_out_cb), wfmailbox);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(lbl), entry);
+
+    return hbox;
+}
+
+static GtkContainer *
+webfeed_get_setup_page(XfceMailwatchMailbox *mailbox)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(mailbox);
+    GtkWidget *vbox, *hbox, *lbl, *combo, *sbtn;
+    GtkSizeGroup *sg;
+
+    vbox = gtk_vbox_new(FALSE, BORDER/2);
+    gtk_widget_show(vbox);
+
+    sg = gtk_size_group_new(GTK_SIZE_GROUP_HORIZONTAL);
+
+    if(!wfmailbox->fixed) {
+        webfeed_config_add_entry(wfmailbox, vbox, sg, _("_URL:"),
+                                 &wfmailbox->url, TRUE);
+    }
+    webfeed_config_add_entry(wfmailbox, vbox, sg, _("_Username:"),
+                             &wfmailbox->username, TRUE);
+    webfeed_config_add_entry(wfmailbox, vbox, sg, _("_Password:"),
+                             &wfmailbox->password, FALSE);
+
+    if(!wfmailbox->fixed) {
+        hbox = gtk_hbox_new(FALSE, BORDER/2);
+        gtk_widget_show(hbox);
+        gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+        lbl = gtk_label_new_with_mnemonic(_("_Count using:"));
+        gtk_misc_set_alignment(GTK_MISC(lbl), 0.0, 0.5);
+        gtk_widget_show(lbl);
+        gtk_box_pack_start(GTK_BOX(hbox), lbl, FALSE, FALSE, 0);
+        gtk_size_group_add_widget(sg, lbl);
+
+        combo = gtk_combo_box_new_text();
+        gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("Atom/RSS element (empty counts entries)"));
+        gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("JSON pointer"));
+        gtk_combo_box_append_text(GTK_COMBO_BOX(combo), _("Regular expression"));
+        gtk_combo_box_set_active(GTK_COMBO_BOX(combo), wfmailbox->rule_type);
+        gtk_widget_show(combo);
+        gtk_box_pack_start(GTK_BOX(hbox), combo, TRUE, TRUE, 0);
+        g_signal_connect(G_OBJECT(combo), "changed",
+                         G_CALLBACK(webfeed_config_rule_combo_changed_cb),
+                         wfmailbox);
+        gtk_label_set_mnemonic_widget(GTK_LABEL(lbl), combo);
+
+        webfeed_config_add_entry(wfmailbox, vbox, sg, _("_Rule:"),
+                                 &wfmailbox->rule, TRUE);
+    }
+
+    hbox = gtk_hbox_new(FALSE, BORDER/2);
+    gtk_widget_show(hbox);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+    lbl = gtk_label_new_with_mnemonic(_("Check for _new messages every"));
+    gtk_widget_show(lbl);
+    gtk_box_pack_start(GTK_BOX(hbox), lbl, FALSE, FALSE, 0);
+
+    sbtn = gtk_spin_button_new_with_range(1.0, 1440.0, 1.0);
+    gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(sbtn), TRUE);
+    gtk_spin_button_set_wrap(GTK_SPIN_BUTTON(sbtn), FALSE);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(sbtn), wfmailbox->timeout/60);
+    gtk_widget_show(sbtn);
+    gtk_box_pack_start(GTK_BOX(hbox), sbtn, FALSE, FALSE, 0);
+    g_signal_connect(G_OBJECT(sbtn), "value-changed",
+                     G_CALLBACK(webfeed_config_timeout_spinbutton_changed_cb),
+                     wfmailbox);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(lbl), sbtn);
+
+    lbl = gtk_label_new(_("minute(s)."));
+    gtk_widget_show(lbl);
+    gtk_box_pack_start(GTK_BOX(hbox), lbl, FALSE, FALSE, 0);
+
+    return GTK_CONTAINER(vbox);
+}
+
+static void
+webfeed_restore_param_list(XfceMailwatchMailbox *mailbox, GList *params)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(mailbox);
+    GList *l;
+
+    g_mutex_lock(wfmailbox->config_mx);
+
+    for(l = params; l; l = l->next) {
+        XfceMailwatchParam *param = l->data;
+
+        if(!strcmp(param->key, "url") && !wfmailbox->fixed)
+            wfmailbox->url = g_strdup(param->value);
+        else if(!strcmp(param->key, "username"))
+            wfmailbox->username = g_strdup(param->value);
+        else if(!strcmp(param->key, "password"))
+            wfmailbox->password = g_strdup(param->value);
+        else if(!strcmp(param->key, "rule_type") && !wfmailbox->fixed) {
+            wfmailbox->rule_type = atoi(param->value);
+            if(wfmailbox->rule_type > RULE_REGEX)
+                wfmailbox->rule_type = RULE_XML_ELEMENT;
+        } else if(!strcmp(param->key, "rule") && !wfmailbox->fixed)
+            wfmailbox->rule = g_strdup(param->value);
+        else if(!strcmp(param->key, "timeout"))
+            wfmailbox->timeout = atoi(param->value);
+    }
+
+    g_mutex_unlock(wfmailbox->config_mx);
+}
+
+static GList *
+webfeed_save_param_list(XfceMailwatchMailbox *mailbox)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(mailbox);
+    GList *params = NULL;
+    XfceMailwatchParam *param;
+
+    g_mutex_lock(wfmailbox->config_mx);
+
+    /* the GMail mailbox saves what it always did */
+    if(!wfmailbox->fixed) {
+        param = g_new(XfceMailwatchParam, 1);
+        param->key = g_strdup("url");
+        param->value = g_strdup(wfmailbox->url);
+        params = g_list_prepend(params, param);
+    }
+
+    param = g_new(XfceMailwatchParam, 1);
+    param->key = g_strdup("username");
+    param->value = g_strdup(wfmailbox->username);
+    params = g_list_prepend(params, param);
+
+    param = g_new(XfceMailwatchParam, 1);
+    param->key = g_strdup("password");
+    param->value = g_strdup(wfmailbox->password);
+    params = g_list_prepend(params, param);
+
+    if(!wfmailbox->fixed) {
+        param = g_new(XfceMailwatchParam, 1);
+        param->key = g_strdup("rule_type");
+        param->value = g_strdup_printf("%d", wfmailbox->rule_type);
+        params = g_list_prepend(params, param);
+
+        param = g_new(XfceMailwatchParam, 1);
+        param->key = g_strdup("rule");
+        param->value = g_strdup(wfmailbox->rule);
+        params = g_list_prepend(params, param);
+    }
+
+    param = g_new(XfceMailwatchParam, 1);
+    param->key = g_strdup("timeout");
+    param->value = g_strdup_printf("%u", wfmailbox->timeout);
+    params = g_list_prepend(params, param);
+
+    g_mutex_unlock(wfmailbox->config_mx);
+
+    return g_list_reverse(params);
+}
+
+static void
+webfeed_mailbox_free(XfceMailwatchMailbox *mailbox)
+{
+    XfceMailwatchWebFeedMailbox *wfmailbox = XFCE_MAILWATCH_WEBFEED_MAILBOX(mailbox);
+
+    webfeed_set_activated(mailbox, FALSE);
+    while(g_atomic_pointer_get(&wfmailbox->th))
+        g_thread_yield();
+
+    g_mutex_free(wfmailbox->config_mx);
+
+    g_free(wfmailbox->url);
+    g_free(wfmailbox->username);
+    g_free(wfmailbox->password);
+    g_free(wfmailbox->rule);
+
+    if(wfmailbox->http_conn)
+        xfce_mailwatch_http_conn_destroy(wfmailbox->http_conn);
+    g_free(wfmailbox->conn_host);
+    xfce_mailwatch_http_validators_clear(&wfmailbox->validators);
+    g_free(wfmailbox->feed_key);
+
+    g_free(wfmailbox);
+}
+
+XfceMailwatchMailboxType builtin_mailbox_type_webfeed = {
+    "webfeed",
+    N_("Remote Web Feed"),
+    N_("The Web Feed plugin can watch an Atom, RSS or JSON feed on a web server and find the number of new messages in it."),
+
+    webfeed_mailbox_new,
+    webfeed_set_activated,
+    webfeed_force_update_cb,
+    webfeed_get_setup_page,
+    webfeed_restore_param_list,
+    webfeed_save_param_list,
+    webfeed_mailbox_free,
+    NULL
+};
+
+#ifdef HAVE_SSL_SUPPORT
+XfceMailwatchMailboxType builtin_mailbox_type_gmail = {
+    "gmail",
+    N_("Remote GMail Mailbox"),
+    N_("The GMail plugin can connect to Google's mail service and securely retrieve the number of new messages."),
+
+    webfeed_mailbox_new,
+    webfeed_set_activated,
+    webfeed_force_update_cb,
+    webfeed_get_setup_page,
+    webfeed_restore_param_list,
+    webfeed_save_param_list,
+    webfeed_mailbox_free,
+    NULL
+};
+#endif
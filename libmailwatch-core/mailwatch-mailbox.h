@@ -147,6 +147,18 @@ typedef GList *(*SaveParamListFunc)(XfceMailwatchMailbox *mailbox);
  **/
 typedef void (*FreeMailboxFunc)(XfceMailwatchMailbox *mailbox);
 
+/**
+ * MarkSeenCallback:
+ * @mailbox: The #XfceMailwatchMailbox instance.
+ *
+ * A callback that the #XfceMailwatch instance can call when the user has gone
+ * to read their mail, so @mailbox can stop counting the messages it currently
+ * reports as new.  Like #ForceUpdateCallback, this is called in the main (UI)
+ * thread.  Mailbox types that can tell read mail from unread mail on their own
+ * can leave this %NULL.
+ **/
+typedef void (*MarkSeenCallback)(XfceMailwatchMailbox *mailbox);
+
 /**
  * XfceMailwatchMailboxType:
  * @id: A short string ID to identify the mailbox type in config files.
@@ -172,6 +184,7 @@ struct _XfceMailwatchMailboxType
     RestoreParamListFunc restore_param_list_func;
     SaveParamListFunc save_param_list_func;
     FreeMailboxFunc free_mailbox_func;
+    MarkSeenCallback mark_seen_callback;
 };
 
 G_END_DECLS
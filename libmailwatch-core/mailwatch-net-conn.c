@@ -65,6 +65,10 @@
 #include <gnutls/gnutls.h>
 #endif
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "mailwatch-net-conn.h"
 #include "mailwatch-common.h"
 
@@ -88,6 +92,8 @@
 #define TIMER_START             __timer_start = time(NULL)
 #define TIMER_EXPIRED(endtime)  (time(NULL) - __timer_start >= (endtime))
 
+#define ZBUF_SIZE               4096
+
 struct _XfceMailwatchNetConn
 {
     gchar *hostname;
@@ -98,7 +104,11 @@ struct _XfceMailwatchNetConn
     gint fd;
     gint actual_port;
 
+    /* unconsumed received data lives at buffer[buffer_pos] through
+     * buffer[buffer_pos + buffer_len - 1], and is always NUL-terminated */
     guchar *buffer;
+    gsize buffer_size;
+    gsize buffer_pos;
     gsize buffer_len;
     
     gboolean is_secure;
@@ -107,8 +117,23 @@ struct _XfceMailwatchNetConn
     gnutls_certificate_credentials_t gt_creds;
 #endif
 
+    /* RFC 4978-style compression sits between the socket (or TLS) and the
+     * buffer; |zbuf| holds compressed data the inflater hasn't used yet,
+     * and |zpending| is set while the inflater may still hold output it
+     * had no room for */
+    gboolean is_compressed;
+#ifdef HAVE_ZLIB
+    z_stream deflater;
+    z_stream inflater;
+    guchar *zbuf;
+    gboolean zpending;
+#endif
+
     XMNCShouldContinueFunc should_continue;
     gpointer should_continue_user_data;
+
+    XfceMailwatchNetConnStats stats;
+    gboolean awaiting_reply;
 };
 
 typedef enum
@@ -199,12 +224,23 @@ my_g_mutex_unlock(void **priv)
 
 
 
+static gdouble
+xfce_mailwatch_net_conn_now(void)
+{
+    GTimeVal tv;
+
+    g_get_current_time(&tv);
+
+    return tv.tv_sec + (gdouble)tv.tv_usec / G_USEC_PER_SEC;
+}
+
 #ifdef HAVE_SSL_SUPPORT
 static gboolean
 xfce_mailwatch_net_conn_tls_handshake(XfceMailwatchNetConn *net_conn,
                                       GError **error)
 {
     gint ret;
+    gdouble start = xfce_mailwatch_net_conn_now();
     TIMER_INIT;
 
     TIMER_START;
@@ -213,6 +249,8 @@ xfce_mailwatch_net_conn_tls_handshake(XfceMailwatchNetConn *net_conn,
     } while((ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED)
             && !TIMER_EXPIRED(RECV_TIMEOUT) && SHOULD_CONTINUE(net_conn));
 
+    net_conn->stats.connect_time += xfce_mailwatch_net_conn_now() - start;
+
     if(ret != GNUTLS_E_SUCCESS) {
         gint code = XFCE_MAILWATCH_ERROR_FAILED;
         const gchar *reason;
@@ -293,6 +331,7 @@ xfce_mailwatch_net_conn_get_connect_status(XfceMailwatchNetConn *net_conn,
         DBG("checking for a connection...");
 
         /* wait until the connect attempt finishes */
+        net_conn->stats.select_calls++;
         if(select(FD_SETSIZE, NULL, &wfd, NULL, &tv) < 0) {
             if(errno == EINTR)
                 continue;
@@ -511,11 +550,13 @@ xfce_mailwatch_net_conn_connect(XfceMailwatchNetConn *net_conn,
                                 GError **error)
 {
     struct addrinfo *addresses = NULL, *ai;
+    gdouble start;
     
     g_return_val_if_fail(net_conn && (!error || !*error), FALSE);
     g_return_val_if_fail(net_conn->fd == -1, TRUE);
 
     net_conn->actual_port = -1;
+    start = xfce_mailwatch_net_conn_now();
 
     if(!xfce_mailwatch_net_conn_get_addrinfo(net_conn, &addresses, error)) {
         DBG("failed to get sockaddr");
@@ -566,6 +607,8 @@ xfce_mailwatch_net_conn_connect(XfceMailwatchNetConn *net_conn,
                 }
 #endif
                 freeaddrinfo(addresses);
+                net_conn->stats.connect_time += xfce_mailwatch_net_conn_now()
+                                                - start;
                 return TRUE;
         }
     }
@@ -586,6 +629,8 @@ out_err:
     if(addresses)
         freeaddrinfo(addresses);
 
+    net_conn->stats.connect_time += xfce_mailwatch_net_conn_now() - start;
+
     return FALSE;
 }
 
@@ -605,6 +650,13 @@ xfce_mailwatch_net_conn_make_secure(XfceMailwatchNetConn *net_conn,
     g_return_val_if_fail(!net_conn->is_secure, TRUE);
 
 #ifdef HAVE_SSL_SUPPORT
+    /* anything still buffered arrived before the handshake, and must not
+     * be mistaken for data sent over the secure channel */
+    if(net_conn->buffer_len) {
+        DBG("discarding %d bytes of unencrypted data", (gint)net_conn->buffer_len);
+        xfce_mailwatch_net_conn_consume(net_conn, net_conn->buffer_len);
+    }
+
     /* init the x509 cert */
     gnutls_certificate_allocate_credentials(&net_conn->gt_creds);
     gnutls_certificate_set_x509_trust_file(net_conn->gt_creds,
@@ -647,21 +699,15 @@ xfce_mailwatch_net_conn_make_secure(XfceMailwatchNetConn *net_conn,
 #endif
 }
 
-gint
-xfce_mailwatch_net_conn_send_data(XfceMailwatchNetConn *net_conn,
-                                  const guchar *buf,
-                                  gssize buf_len,
-                                  GError **error)
+static gint
+xfce_mailwatch_net_conn_send_internal(XfceMailwatchNetConn *net_conn,
+                                      const guchar *buf,
+                                      gsize buf_len,
+                                      GError **error)
 {
     gint bout = 0;
     TIMER_INIT;
 
-    g_return_val_if_fail(net_conn && (!error || !*error), -1);
-    g_return_val_if_fail(net_conn->fd != -1, -1);
-
-    if(buf_len < 0)
-        buf_len = strlen((const gchar *)buf);
-
 #ifdef HAVE_SSL_SUPPORT
     if(net_conn->is_secure) {
         gint ret = 0, totallen = buf_len;
@@ -670,6 +716,7 @@ xfce_mailwatch_net_conn_send_data(XfceMailwatchNetConn *net_conn,
         while(bytesleft > 0) {
             TIMER_START;
             do {
+                net_conn->stats.send_calls++;
                 ret = gnutls_record_send(net_conn->gt_session,
                                          buf + totallen - bytesleft,
                                          bytesleft);
@@ -710,6 +757,7 @@ xfce_mailwatch_net_conn_send_data(XfceMailwatchNetConn *net_conn,
     {
         TIMER_START;
         do {
+            net_conn->stats.send_calls++;
             bout = send(net_conn->fd, buf, buf_len, MSG_NOSIGNAL);
         } while(bout < 0 && (errno == EINTR || errno == EAGAIN)
                 && !TIMER_EXPIRED(RECV_TIMEOUT) && SHOULD_CONTINUE(net_conn));
@@ -731,6 +779,82 @@ xfce_mailwatch_net_conn_send_data(XfceMailwatchNetConn *net_conn,
                     _("Failed to send data: %s"), reason);
     }
 
+    if(bout > 0) {
+        net_conn->stats.bytes_sent += bout;
+        net_conn->awaiting_reply = TRUE;
+    }
+
+    return bout;
+}
+
+#ifdef HAVE_ZLIB
+static gint
+xfce_mailwatch_net_conn_send_compressed(XfceMailwatchNetConn *net_conn,
+                                        const guchar *buf,
+                                        gsize buf_len,
+                                        GError **error)
+{
+    guchar out[ZBUF_SIZE];
+    gsize out_len, sent;
+    gint ret, bout;
+
+    net_conn->deflater.next_in = (Bytef *)buf;
+    net_conn->deflater.avail_in = buf_len;
+
+    /* flush after every write, since the server has to be able to act on
+     * each command as soon as it arrives */
+    do {
+        net_conn->deflater.next_out = out;
+        net_conn->deflater.avail_out = sizeof(out);
+        ret = deflate(&net_conn->deflater, Z_SYNC_FLUSH);
+        if(ret != Z_OK && ret != Z_BUF_ERROR) {
+            g_set_error(error, XFCE_MAILWATCH_ERROR,
+                        XFCE_MAILWATCH_ERROR_FAILED,
+                        _("Failed to compress data: %s"),
+                        net_conn->deflater.msg ? net_conn->deflater.msg : "");
+            return -1;
+        }
+
+        out_len = sizeof(out) - net_conn->deflater.avail_out;
+        for(sent = 0; sent < out_len; sent += bout) {
+            bout = xfce_mailwatch_net_conn_send_internal(net_conn, out + sent,
+                                                         out_len - sent,
+                                                         error);
+            if(bout <= 0)
+                return -1;
+        }
+    } while(net_conn->deflater.avail_out == 0);
+
+    return buf_len;
+}
+#endif
+
+gint
+xfce_mailwatch_net_conn_send_data(XfceMailwatchNetConn *net_conn,
+                                  const guchar *buf,
+                                  gssize buf_len,
+                                  GError **error)
+{
+    gint bout;
+
+    g_return_val_if_fail(net_conn && (!error || !*error), -1);
+    g_return_val_if_fail(net_conn->fd != -1, -1);
+
+    if(buf_len < 0)
+        buf_len = strlen((const gchar *)buf);
+
+#ifdef HAVE_ZLIB
+    if(net_conn->is_compressed)
+        bout = xfce_mailwatch_net_conn_send_compressed(net_conn, buf, buf_len,
+                                                       error);
+    else
+#endif
+        bout = xfce_mailwatch_net_conn_send_internal(net_conn, buf, buf_len,
+                                                     error);
+
+    if(bout > 0)
+        net_conn->stats.plain_bytes_sent += bout;
+
     return bout;
 }
 
@@ -745,6 +869,10 @@ xfce_mailwatch_net_conn_recv_internal(XfceMailwatchNetConn *net_conn,
     const gchar *reason;
     TIMER_INIT;
 
+    if(block && net_conn->awaiting_reply)
+        net_conn->stats.round_trips++;
+    net_conn->awaiting_reply = FALSE;
+
     TIMER_START;
     do {
         fd_set rfd;
@@ -762,6 +890,7 @@ xfce_mailwatch_net_conn_recv_internal(XfceMailwatchNetConn *net_conn,
             break;
         }
 #endif
+        net_conn->stats.select_calls++;
         ret = select(FD_SETSIZE, &rfd, NULL, NULL, &tv);
         if(ret > 0 && FD_ISSET(net_conn->fd, &rfd))
             break;
@@ -803,6 +932,7 @@ xfce_mailwatch_net_conn_recv_internal(XfceMailwatchNetConn *net_conn,
 
         TIMER_START;
         do {
+            net_conn->stats.recv_calls++;
             gret = gnutls_record_recv(net_conn->gt_session, buf, buf_len);
 
             if(gret == GNUTLS_E_REHANDSHAKE) {
@@ -839,6 +969,7 @@ xfce_mailwatch_net_conn_recv_internal(XfceMailwatchNetConn *net_conn,
 
         TIMER_START;
         do {
+            net_conn->stats.recv_calls++;
             pret = recv(net_conn->fd, buf, buf_len, MSG_NOSIGNAL);
         } while(pret < 0 && (errno == EINTR || errno == EAGAIN)
                 && !TIMER_EXPIRED(RECV_TIMEOUT) && SHOULD_CONTINUE(net_conn));
@@ -861,9 +992,146 @@ xfce_mailwatch_net_conn_recv_internal(XfceMailwatchNetConn *net_conn,
             bin = pret;
     }
 
+    if(bin > 0)
+        net_conn->stats.bytes_received += bin;
+
     return bin;
 }
 
+/* reads whatever is available (or, if |block|, waits for something) into
+ * |buf|, decompressing it if needed.  returns the number of bytes read, 0
+ * on EOF (or if nothing was available when not blocking), or -1 on
+ * error. */
+static gint
+xfce_mailwatch_net_conn_read(XfceMailwatchNetConn *net_conn,
+                             guchar *buf,
+                             gsize buf_len,
+                             gboolean block,
+                             GError **error)
+{
+    gint bin;
+
+#ifdef HAVE_ZLIB
+    if(net_conn->is_compressed) {
+        z_stream *zs = &net_conn->inflater;
+        gint ret;
+
+        for(;;) {
+            if(!zs->avail_in && !net_conn->zpending) {
+                bin = xfce_mailwatch_net_conn_recv_internal(net_conn,
+                                                            net_conn->zbuf,
+                                                            ZBUF_SIZE,
+                                                            block, error);
+                if(bin <= 0)
+                    return bin;
+                zs->next_in = net_conn->zbuf;
+                zs->avail_in = bin;
+            }
+
+            zs->next_out = buf;
+            zs->avail_out = buf_len;
+            ret = inflate(zs, Z_SYNC_FLUSH);
+            if(ret != Z_OK && ret != Z_BUF_ERROR) {
+                g_set_error(error, XFCE_MAILWATCH_ERROR,
+                            XFCE_MAILWATCH_ERROR_FAILED,
+                            _("Failed to decompress data: %s"),
+                            zs->msg ? zs->msg : "");
+                return -1;
+            }
+            /* zlib can keep output back even with no input left */
+            net_conn->zpending = (zs->avail_out == 0);
+
+            /* a flush marker on its own doesn't produce anything */
+            bin = buf_len - zs->avail_out;
+            if(bin > 0)
+                break;
+        }
+    } else
+#endif
+        bin = xfce_mailwatch_net_conn_recv_internal(net_conn, buf, buf_len,
+                                                    block, error);
+
+    if(bin > 0)
+        net_conn->stats.plain_bytes_received += bin;
+
+    return bin;
+}
+
+/* reads one more chunk from the network onto the end of the buffered data,
+ * first moving any unconsumed data to the front of the buffer.  returns
+ * the number of bytes read, 0 on EOF, or -1 on error. */
+static gint
+xfce_mailwatch_net_conn_fill_buffer(XfceMailwatchNetConn *net_conn,
+                                    GError **error)
+{
+#define BUFSTEP  4096
+    gint bin;
+
+    if(net_conn->buffer_pos > 0) {
+        memmove(net_conn->buffer, net_conn->buffer + net_conn->buffer_pos,
+                net_conn->buffer_len);
+        net_conn->buffer_pos = 0;
+    }
+
+    if(net_conn->buffer_size < net_conn->buffer_len + BUFSTEP + 1) {
+        gsize new_size = MAX(net_conn->buffer_size, BUFSTEP + 1);
+
+        while(new_size < net_conn->buffer_len + BUFSTEP + 1)
+            new_size *= 2;
+        net_conn->buffer = g_realloc(net_conn->buffer, new_size);
+        net_conn->buffer_size = new_size;
+    }
+
+    bin = xfce_mailwatch_net_conn_read(net_conn,
+                                       net_conn->buffer + net_conn->buffer_len,
+                                       BUFSTEP, TRUE, error);
+    if(bin > 0)
+        net_conn->buffer_len += bin;
+    net_conn->buffer[net_conn->buffer_len] = 0;
+
+    return bin;
+#undef BUFSTEP
+}
+
+/* finds the next full line in the buffer, reading more data as needed.
+ * returns 1 and sets |line_len| (not including the terminator) if found,
+ * 0 on EOF, or -1 on error. */
+static gint
+xfce_mailwatch_net_conn_find_line(XfceMailwatchNetConn *net_conn,
+                                  gsize *line_len,
+                                  GError **error)
+{
+    gsize term_len = strlen(net_conn->line_terminator), scanned = 0;
+    gchar *data, *p;
+    gint bin;
+
+    for(;;) {
+        data = (gchar *)net_conn->buffer + net_conn->buffer_pos;
+        if(net_conn->buffer_len >= term_len) {
+            p = g_strstr_len(data + scanned, net_conn->buffer_len - scanned,
+                             net_conn->line_terminator);
+            if(p) {
+                *line_len = p - data;
+                return 1;
+            }
+            scanned = net_conn->buffer_len - term_len + 1;
+        }
+
+        /* XXX: keep this from going too crazy */
+        if(net_conn->buffer_len > (512 * 1024)) {
+            if(error) {
+                g_set_error(error, XFCE_MAILWATCH_ERROR, 0,
+                            _("Canceling read: read too many bytes without a newline"));
+            }
+            return -1;
+        }
+
+        bin = xfce_mailwatch_net_conn_fill_buffer(net_conn, error);
+        if(bin <= 0)
+            return bin;
+    }
+}
+
 gint
 xfce_mailwatch_net_conn_recv_data(XfceMailwatchNetConn *net_conn,
                                   guchar *buf,
@@ -876,36 +1144,19 @@ xfce_mailwatch_net_conn_recv_data(XfceMailwatchNetConn *net_conn,
     g_return_val_if_fail(net_conn->fd != -1, -1);
 
     if(net_conn->buffer_len) {
-        if(net_conn->buffer_len <= buf_len) {
-            bin = net_conn->buffer_len;
-            memcpy(buf, net_conn->buffer, bin);
-            g_free(net_conn->buffer);
-            net_conn->buffer = NULL;
-            net_conn->buffer_len = 0;
-
-            if(bin == (gint)buf_len)
-                return bin;
-            else {
-                buf += bin;
-                buf_len -= bin;
-            }
-        } else {
-            bin = buf_len;
-            net_conn->buffer_len -= bin;
-            memcpy(buf, net_conn->buffer, bin);
-            memmove(net_conn->buffer, net_conn->buffer + bin,
-                    net_conn->buffer_len);
-            net_conn->buffer = g_realloc(net_conn->buffer,
-                                         net_conn->buffer_len + 1);
-            net_conn->buffer[net_conn->buffer_len] = 0;
+        bin = MIN(net_conn->buffer_len, buf_len);
+        memcpy(buf, net_conn->buffer + net_conn->buffer_pos, bin);
+        xfce_mailwatch_net_conn_consume(net_conn, bin);
 
+        if(bin == (gint)buf_len)
             return bin;
-        }
+
+        buf += bin;
+        buf_len -= bin;
     }
 
-    ret = xfce_mailwatch_net_conn_recv_internal(net_conn, buf, buf_len,
-                                                bin > 0 ? FALSE : TRUE,
-                                                error);
+    ret = xfce_mailwatch_net_conn_read(net_conn, buf, buf_len,
+                                       bin > 0 ? FALSE : TRUE, error);
     if(ret > 0)
         bin += ret;
 
@@ -918,69 +1169,279 @@ xfce_mailwatch_net_conn_recv_line(XfceMailwatchNetConn *net_conn,
                                   gsize buf_len,
                                   GError **error)
 {
-#define BUFSTEP  1024
-    gint bin;
-    gchar *p = NULL;
+    gsize line_len = 0;
+    gint ret;
 
     g_return_val_if_fail(net_conn && (!error || !*error), -1);
     g_return_val_if_fail(net_conn->fd != -1, -1);
 
-    do {
-        p = NULL;
-        if(net_conn->buffer_len > 0)
-            p = strstr((char *)net_conn->buffer, net_conn->line_terminator);
-
-        if(!p) {
-            net_conn->buffer = g_realloc(net_conn->buffer,
-                                         net_conn->buffer_len + BUFSTEP + 1);
-            bin = xfce_mailwatch_net_conn_recv_internal(net_conn,
-                                                        net_conn->buffer
-                                                        + net_conn->buffer_len,
-                                                        BUFSTEP, TRUE, error);
-            if(bin <= 0) {
-                net_conn->buffer = g_realloc(net_conn->buffer,
-                                             net_conn->buffer_len + 1);
-                net_conn->buffer[net_conn->buffer_len] = 0;
-                return bin;
-            }
-
-            net_conn->buffer_len += bin;
-            net_conn->buffer[net_conn->buffer_len] = 0;
-        }
-
-        /* XXX: keep this from going too crazy */
-        if(net_conn->buffer_len > (512 * 1024)) {
-            if(error) {
-                g_set_error(error, XFCE_MAILWATCH_ERROR, 0,
-                            _("Canceling read: read too many bytes without a newline"));
-            }
-            return -1;
+    /* an empty line reads as 0, so EOF has to be an error */
+    ret = xfce_mailwatch_net_conn_find_line(net_conn, &line_len, error);
+    if(ret <= 0) {
+        if(!ret && error) {
+            g_set_error(error, XFCE_MAILWATCH_ERROR,
+                        XFCE_MAILWATCH_ERROR_FAILED, "%s",
+                        _("Connection closed by server"));
         }
-    } while(!p);
+        return -1;
+    }
 
-    if((gint)buf_len < p - (gchar *)net_conn->buffer) {
+    if(buf_len < line_len) {
         if(error) {
             gchar *bl = g_strdup_printf("%" G_GSIZE_FORMAT, buf_len);
             g_set_error(error, XFCE_MAILWATCH_ERROR, 0,
                         _("Buffer is not large enough to hold a full line (%s < %d)"),
-                        bl, (gint)(p - (gchar *)net_conn->buffer));
+                        bl, (gint)line_len);
             g_free(bl);
         }
         return -1;
     }
 
-    bin = p - (gchar *)net_conn->buffer;
-    memcpy(buf, net_conn->buffer, bin);
-    buf[bin] = 0;
+    memcpy(buf, net_conn->buffer + net_conn->buffer_pos, line_len);
+    buf[line_len] = 0;
 
-    net_conn->buffer_len -= bin + strlen(net_conn->line_terminator);
-    memmove(net_conn->buffer, p + strlen(net_conn->line_terminator),
-            net_conn->buffer_len);
-    net_conn->buffer = g_realloc(net_conn->buffer,
-                                 net_conn->buffer_len + 1);
-    net_conn->buffer[net_conn->buffer_len] = 0;
+    xfce_mailwatch_net_conn_consume(net_conn,
+                                    line_len
+                                    + strlen(net_conn->line_terminator));
 
-    return bin;
+    return line_len;
+}
+
+/* returns a pointer to the next full line in the connection's buffer,
+ * reading from the network as needed, without copying it.  |line_len| is
+ * set to the length of the line, not including the line terminator.  the
+ * line is not NUL-terminated, and stays valid until the next read or
+ * consume call; call xfce_mailwatch_net_conn_consume() with the line
+ * length plus the terminator length when done with it. */
+const gchar *
+xfce_mailwatch_net_conn_peek_line(XfceMailwatchNetConn *net_conn,
+                                  gsize *line_len,
+                                  GError **error)
+{
+    gint ret;
+
+    g_return_val_if_fail(net_conn && line_len && (!error || !*error), NULL);
+    g_return_val_if_fail(net_conn->fd != -1, NULL);
+
+    ret = xfce_mailwatch_net_conn_find_line(net_conn, line_len, error);
+    if(ret <= 0) {
+        if(!ret && error) {
+            g_set_error(error, XFCE_MAILWATCH_ERROR,
+                        XFCE_MAILWATCH_ERROR_FAILED, "%s",
+                        _("Connection closed by server"));
+        }
+        return NULL;
+    }
+
+    return (const gchar *)net_conn->buffer + net_conn->buffer_pos;
+}
+
+/* like xfce_mailwatch_net_conn_peek_line(), but waits for at least
+ * |min_len| bytes of raw data to be buffered. */
+const gchar *
+xfce_mailwatch_net_conn_peek_data(XfceMailwatchNetConn *net_conn,
+                                  gsize min_len,
+                                  GError **error)
+{
+    gint bin;
+
+    g_return_val_if_fail(net_conn && (!error || !*error), NULL);
+    g_return_val_if_fail(net_conn->fd != -1, NULL);
+
+    while(net_conn->buffer_len < min_len) {
+        bin = xfce_mailwatch_net_conn_fill_buffer(net_conn, error);
+        if(bin <= 0) {
+            if(!bin && error) {
+                g_set_error(error, XFCE_MAILWATCH_ERROR,
+                            XFCE_MAILWATCH_ERROR_FAILED, "%s",
+                            _("Connection closed by server"));
+            }
+            return NULL;
+        }
+    }
+
+    return (const gchar *)net_conn->buffer + net_conn->buffer_pos;
+}
+
+void
+xfce_mailwatch_net_conn_consume(XfceMailwatchNetConn *net_conn,
+                                gsize len)
+{
+    g_return_if_fail(net_conn && len <= net_conn->buffer_len);
+
+    net_conn->buffer_pos += len;
+    net_conn->buffer_len -= len;
+
+    if(!net_conn->buffer_len) {
+        net_conn->buffer_pos = 0;
+        /* don't hang on to the memory after an unusually large read */
+        if(net_conn->buffer_size > (64 * 1024)) {
+            g_free(net_conn->buffer);
+            net_conn->buffer = NULL;
+            net_conn->buffer_size = 0;
+        }
+    }
+}
+
+/* waits up to |timeout| seconds for the server to send something, for
+ * connections that sit idle waiting for the server to push data.  returns
+ * 1 if data is available, 0 if the timeout expired, or -1 on error or if
+ * the operation was aborted. */
+gint
+xfce_mailwatch_net_conn_wait_readable(XfceMailwatchNetConn *net_conn,
+                                      guint timeout,
+                                      GError **error)
+{
+    gint ret;
+    TIMER_INIT;
+
+    g_return_val_if_fail(net_conn && (!error || !*error), -1);
+    g_return_val_if_fail(net_conn->fd != -1, -1);
+
+    if(net_conn->buffer_len > 0)
+        return 1;
+#ifdef HAVE_ZLIB
+    /* the inflater only leaves input or output behind when it ran out of
+     * room */
+    if(net_conn->is_compressed
+       && (net_conn->inflater.avail_in > 0 || net_conn->zpending))
+    {
+        return 1;
+    }
+#endif
+
+    TIMER_START;
+    do {
+        fd_set rfd;
+        struct timeval tv = { 1, 0 };
+
+#ifdef HAVE_SSL_SUPPORT
+        if(net_conn->is_secure
+           && gnutls_record_check_pending(net_conn->gt_session) > 0)
+        {
+            return 1;
+        }
+#endif
+
+        FD_ZERO(&rfd);
+        FD_SET(net_conn->fd, &rfd);
+
+        net_conn->stats.select_calls++;
+        ret = select(FD_SETSIZE, &rfd, NULL, NULL, &tv);
+        if(ret > 0 && FD_ISSET(net_conn->fd, &rfd))
+            return 1;
+        else if(ret < 0 && errno != EINTR) {
+            g_set_error(error, XFCE_MAILWATCH_ERROR,
+                        XFCE_MAILWATCH_ERROR_FAILED, "%s", strerror(errno));
+            return -1;
+        }
+    } while(!TIMER_EXPIRED(timeout) && SHOULD_CONTINUE(net_conn));
+
+    if(!SHOULD_CONTINUE(net_conn)) {
+        g_set_error(error, XFCE_MAILWATCH_ERROR,
+                    XFCE_MAILWATCH_ERROR_ABORTED, "%s",
+                    _("Operation aborted"));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* turns on raw DEFLATE compression (RFC 1951, as used by RFC 4978) in both
+ * directions.  call this right after the server has agreed to it; any
+ * data already buffered is taken to be compressed. */
+gboolean
+xfce_mailwatch_net_conn_start_compression(XfceMailwatchNetConn *net_conn,
+                                          GError **error)
+{
+    g_return_val_if_fail(net_conn && (!error || !*error), FALSE);
+    g_return_val_if_fail(net_conn->fd != -1, FALSE);
+    g_return_val_if_fail(!net_conn->is_compressed, TRUE);
+
+#ifdef HAVE_ZLIB
+    memset(&net_conn->deflater, 0, sizeof(net_conn->deflater));
+    memset(&net_conn->inflater, 0, sizeof(net_conn->inflater));
+
+    if(deflateInit2(&net_conn->deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                    -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        g_set_error(error, XFCE_MAILWATCH_ERROR, XFCE_MAILWATCH_ERROR_FAILED,
+                    "%s", _("Failed to initialize compression"));
+        return FALSE;
+    }
+    if(inflateInit2(&net_conn->inflater, -MAX_WBITS) != Z_OK) {
+        deflateEnd(&net_conn->deflater);
+        g_set_error(error, XFCE_MAILWATCH_ERROR, XFCE_MAILWATCH_ERROR_FAILED,
+                    "%s", _("Failed to initialize compression"));
+        return FALSE;
+    }
+
+    net_conn->zbuf = g_malloc(MAX(ZBUF_SIZE, net_conn->buffer_len));
+    net_conn->zpending = FALSE;
+    if(net_conn->buffer_len) {
+        memcpy(net_conn->zbuf, net_conn->buffer + net_conn->buffer_pos,
+               net_conn->buffer_len);
+        net_conn->inflater.next_in = net_conn->zbuf;
+        net_conn->inflater.avail_in = net_conn->buffer_len;
+        xfce_mailwatch_net_conn_consume(net_conn, net_conn->buffer_len);
+    }
+
+    net_conn->is_compressed = TRUE;
+
+    return TRUE;
+#else
+    if(error) {
+        g_set_error(error, XFCE_MAILWATCH_ERROR, 0,
+                    _("Not compiled with compression support"));
+    }
+
+    return FALSE;
+#endif
+}
+
+gboolean
+xfce_mailwatch_net_conn_is_compressed(XfceMailwatchNetConn *net_conn)
+{
+    g_return_val_if_fail(net_conn, FALSE);
+    return net_conn->is_compressed;
+}
+
+void
+xfce_mailwatch_net_conn_get_stats(XfceMailwatchNetConn *net_conn,
+                                  XfceMailwatchNetConnStats *stats)
+{
+    g_return_if_fail(net_conn && stats);
+    *stats = net_conn->stats;
+}
+
+/* prints the counters for a finished operation in debug builds.  |elapsed|
+ * is the wall-clock time the caller measured for the whole operation. */
+void
+xfce_mailwatch_net_conn_dump_stats(XfceMailwatchNetConn *net_conn,
+                                   const gchar *what,
+                                   gdouble elapsed)
+{
+    g_return_if_fail(net_conn);
+
+    if(net_conn->is_compressed && net_conn->stats.bytes_received
+       && net_conn->stats.bytes_sent)
+    {
+        DBG("%s (%s): compression ratio %.2f in, %.2f out",
+            what ? what : "net_conn", net_conn->hostname,
+            (gdouble)net_conn->stats.plain_bytes_received
+            / net_conn->stats.bytes_received,
+            (gdouble)net_conn->stats.plain_bytes_sent
+            / net_conn->stats.bytes_sent);
+    }
+
+    DBG("%s (%s): %.3fs total, %.3fs connecting, %u round trips, "
+        "%" G_GUINT64_FORMAT " bytes out in %u sends, "
+        "%" G_GUINT64_FORMAT " bytes in in %u recvs, %u selects",
+        what ? what : "net_conn", net_conn->hostname, elapsed,
+        net_conn->stats.connect_time, net_conn->stats.round_trips,
+        net_conn->stats.bytes_sent, net_conn->stats.send_calls,
+        net_conn->stats.bytes_received, net_conn->stats.recv_calls,
+        net_conn->stats.select_calls);
 }
 
 void
@@ -1000,8 +1461,21 @@ xfce_mailwatch_net_conn_disconnect(XfceMailwatchNetConn *net_conn)
     }
 #endif
 
+#ifdef HAVE_ZLIB
+    if(net_conn->is_compressed) {
+        deflateEnd(&net_conn->deflater);
+        inflateEnd(&net_conn->inflater);
+        g_free(net_conn->zbuf);
+        net_conn->zbuf = NULL;
+        net_conn->zpending = FALSE;
+        net_conn->is_compressed = FALSE;
+    }
+#endif
+
     g_free(net_conn->buffer);
     net_conn->buffer = NULL;
+    net_conn->buffer_size = 0;
+    net_conn->buffer_pos = 0;
     net_conn->buffer_len = 0;
 
     shutdown(net_conn->fd, SHUT_RDWR);
@@ -25,6 +25,19 @@ G_BEGIN_DECLS
 
 typedef struct _XfceMailwatchNetConn  XfceMailwatchNetConn;
 
+typedef struct
+{
+    guint64 bytes_sent;
+    guint64 bytes_received;
+    guint send_calls;    /* send() or gnutls_record_send() */
+    guint recv_calls;    /* recv() or gnutls_record_recv() */
+    guint select_calls;
+    guint round_trips;   /* times we blocked waiting on a reply to a send */
+    guint64 plain_bytes_sent;      /* before compression */
+    guint64 plain_bytes_received;  /* after decompression */
+    gdouble connect_time;  /* seconds spent in connect() and TLS handshakes */
+} XfceMailwatchNetConnStats;
+
 typedef gboolean (*XMNCShouldContinueFunc)(XfceMailwatchNetConn *net_conn,
                                            gpointer user_data);
 
@@ -61,6 +74,10 @@ gboolean xfce_mailwatch_net_conn_is_connected(XfceMailwatchNetConn *net_conn);
 gboolean xfce_mailwatch_net_conn_make_secure(XfceMailwatchNetConn *net_conn,
                                              GError **error);
 
+gboolean xfce_mailwatch_net_conn_start_compression(XfceMailwatchNetConn *net_conn,
+                                                   GError **error);
+gboolean xfce_mailwatch_net_conn_is_compressed(XfceMailwatchNetConn *net_conn);
+
 gint xfce_mailwatch_net_conn_send_data(XfceMailwatchNetConn *net_conn,
                                        const guchar *buf,
                                        gssize buf_len,
@@ -75,6 +92,25 @@ gint xfce_mailwatch_net_conn_recv_line(XfceMailwatchNetConn *net_conn,
                                        gsize buf_len,
                                        GError **error);
 
+const gchar *xfce_mailwatch_net_conn_peek_line(XfceMailwatchNetConn *net_conn,
+                                               gsize *line_len,
+                                               GError **error);
+const gchar *xfce_mailwatch_net_conn_peek_data(XfceMailwatchNetConn *net_conn,
+                                               gsize min_len,
+                                               GError **error);
+void xfce_mailwatch_net_conn_consume(XfceMailwatchNetConn *net_conn,
+                                     gsize len);
+
+gint xfce_mailwatch_net_conn_wait_readable(XfceMailwatchNetConn *net_conn,
+                                           guint timeout,
+                                           GError **error);
+
+void xfce_mailwatch_net_conn_get_stats(XfceMailwatchNetConn *net_conn,
+                                       XfceMailwatchNetConnStats *stats);
+void xfce_mailwatch_net_conn_dump_stats(XfceMailwatchNetConn *net_conn,
+                                        const gchar *what,
+                                        gdouble elapsed);
+
 void xfce_mailwatch_net_conn_disconnect(XfceMailwatchNetConn *net_conn);
 void xfce_mailwatch_net_conn_destroy(XfceMailwatchNetConn *net_conn);
 
@@ -0,0 +1,349 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* one inotify descriptor shared by all the local mailboxes, so that they
+ * hear about new mail as soon as it's delivered instead of at the next
+ * poll.  the polling stays, since inotify doesn't see changes made by
+ * other machines on NFS, and isn't there at all on some systems. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "mailwatch-watch.h"
+
+/* changes are reported once there's been a tick without any, or after
+ * WATCH_MAX_TICKS if they keep coming (a big delivery, say) */
+#define WATCH_TICK_MS    200
+#define WATCH_MAX_TICKS  10
+
+struct _XfceMailwatchWatch
+{
+    gint wd;
+    gchar *name;  /* the file in the watched directory, or NULL for any */
+    XMWatchFunc func;
+    gpointer user_data;
+    gboolean pending;
+};
+
+typedef struct
+{
+    XMWatchFunc func;
+    gpointer user_data;
+} WatchCall;
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/* a write, or a file coming or going.  not IN_ACCESS or IN_ATTRIB, since
+ * checking the mail would set those off itself. */
+#define WATCH_EVENTS  (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE \
+                       | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF \
+                       | IN_MOVE_SELF)
+
+static GStaticMutex watch_mx = G_STATIC_MUTEX_INIT;
+static GList *watches = NULL;
+static gint watch_fd = -1;
+static guint watch_io_id = 0;
+static guint watch_tick_id = 0;
+static guint watch_ticks = 0;
+static gboolean watch_dirty = FALSE;
+
+static gboolean watch_tick(gpointer data);
+
+/* must be called with watch_mx held */
+static void
+watch_mark_pending(XfceMailwatchWatch *watch)
+{
+    watch->pending = TRUE;
+    watch_dirty = TRUE;
+    if(!watch_tick_id) {
+        watch_dirty = FALSE;
+        watch_ticks = 0;
+        watch_tick_id = g_timeout_add(WATCH_TICK_MS, watch_tick, NULL);
+    }
+}
+
+static gboolean
+watch_tick(gpointer data)
+{
+    GArray *calls;
+    GList *l;
+    WatchCall call;
+    guint i;
+
+    g_static_mutex_lock(&watch_mx);
+
+    if(watch_dirty && ++watch_ticks < WATCH_MAX_TICKS) {
+        /* still going */
+        watch_dirty = FALSE;
+        g_static_mutex_unlock(&watch_mx);
+        return TRUE;
+    }
+
+    /* the functions might add or remove watches, so they're called
+     * without the lock */
+    calls = g_array_new(FALSE, FALSE, sizeof(WatchCall));
+    for(l = watches; l; l = l->next) {
+        XfceMailwatchWatch *watch = l->data;
+
+        if(watch->pending) {
+            watch->pending = FALSE;
+            call.func = watch->func;
+            call.user_data = watch->user_data;
+            g_array_append_val(calls, call);
+        }
+    }
+    watch_tick_id = 0;
+
+    g_static_mutex_unlock(&watch_mx);
+
+    for(i = 0; i < calls->len; i++) {
+        call = g_array_index(calls, WatchCall, i);
+        if(call.func(call.user_data))
+            continue;
+
+        /* ask again later, if it's still being watched */
+        g_static_mutex_lock(&watch_mx);
+        for(l = watches; l; l = l->next) {
+            XfceMailwatchWatch *watch = l->data;
+
+            if(watch->func == call.func && watch->user_data == call.user_data)
+                watch_mark_pending(watch);
+        }
+        g_static_mutex_unlock(&watch_mx);
+    }
+    g_array_free(calls, TRUE);
+
+    return FALSE;
+}
+
+static void
+watch_handle_event(const struct inotify_event *ev)
+{
+    GList *l;
+
+    for(l = watches; l; l = l->next) {
+        XfceMailwatchWatch *watch = l->data;
+
+        if(ev->mask & IN_Q_OVERFLOW) {
+            /* events were lost, so anything might have changed */
+            watch_mark_pending(watch);
+        } else if(watch->wd == ev->wd) {
+            if(ev->mask & IN_IGNORED) {
+                /* the directory is gone; only polling will notice it
+                 * coming back */
+                watch->wd = -1;
+                watch_mark_pending(watch);
+            } else if(!watch->name
+                      || (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                      || (ev->len && !strcmp(ev->name, watch->name)))
+            {
+                watch_mark_pending(watch);
+            }
+        }
+    }
+}
+
+static gboolean
+watch_io_cb(GIOChannel *source,
+            GIOCondition condition,
+            gpointer data)
+{
+    union
+    {
+        struct inotify_event ev;
+        gchar buf[4096];
+    } u;
+    gssize n, off;
+
+    g_static_mutex_lock(&watch_mx);
+
+    if(watch_fd < 0) {
+        /* the last watch was removed in the meantime */
+        g_static_mutex_unlock(&watch_mx);
+        return FALSE;
+    }
+
+    while((n = read(watch_fd, u.buf, sizeof(u.buf))) > 0) {
+        for(off = 0; off + (gssize)sizeof(struct inotify_event) <= n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)(u.buf + off);
+
+            watch_handle_event(ev);
+            off += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    if(n < 0 && errno != EAGAIN && errno != EINTR)
+        g_warning("Failed to read file change events: %s", g_strerror(errno));
+
+    g_static_mutex_unlock(&watch_mx);
+
+    return TRUE;
+}
+
+/* must be called with watch_mx held */
+static gboolean
+watch_ensure_fd(void)
+{
+    GIOChannel *ioc;
+
+    if(watch_fd >= 0)
+        return TRUE;
+
+    watch_fd = inotify_init();
+    if(watch_fd < 0) {
+        DBG("inotify unavailable: %s", g_strerror(errno));
+        return FALSE;
+    }
+    fcntl(watch_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(watch_fd, F_SETFL, fcntl(watch_fd, F_GETFL) | O_NONBLOCK);
+
+    ioc = g_io_channel_unix_new(watch_fd);
+    watch_io_id = g_io_add_watch(ioc, G_IO_IN, watch_io_cb, NULL);
+    g_io_channel_unref(ioc);
+
+    return TRUE;
+}
+
+XfceMailwatchWatch *
+xfce_mailwatch_watch_add(const gchar *path,
+                         XMWatchFunc func,
+                         gpointer user_data)
+{
+    XfceMailwatchWatch *watch;
+    struct stat st;
+    gchar *dir = NULL;
+    gint wd;
+
+    g_return_val_if_fail(path && func, NULL);
+
+    g_static_mutex_lock(&watch_mx);
+
+    if(!watch_ensure_fd()) {
+        g_static_mutex_unlock(&watch_mx);
+        return NULL;
+    }
+
+    watch = g_new0(XfceMailwatchWatch, 1);
+    watch->func = func;
+    watch->user_data = user_data;
+
+    /* a file is watched through its directory, so that it's still watched
+     * after it's been replaced, or if it isn't there yet */
+    if(stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        dir = g_path_get_dirname(path);
+        watch->name = g_path_get_basename(path);
+    }
+
+    wd = inotify_add_watch(watch_fd, dir ? dir : path, WATCH_EVENTS);
+    if(wd < 0) {
+        DBG("can't watch %s: %s", dir ? dir : path, g_strerror(errno));
+        g_free(watch->name);
+        g_free(watch);
+        watch = NULL;
+    } else {
+        watch->wd = wd;
+        watches = g_list_prepend(watches, watch);
+    }
+
+    g_static_mutex_unlock(&watch_mx);
+
+    g_free(dir);
+
+    return watch;
+}
+
+void
+xfce_mailwatch_watch_remove(XfceMailwatchWatch *watch)
+{
+    GList *l;
+    gboolean shared = FALSE;
+
+    if(!watch)
+        return;
+
+    g_static_mutex_lock(&watch_mx);
+
+    watches = g_list_remove(watches, watch);
+
+    /* watching the same directory twice gives the same descriptor */
+    for(l = watches; l; l = l->next) {
+        if(((XfceMailwatchWatch *)l->data)->wd == watch->wd)
+            shared = TRUE;
+    }
+    if(!shared && watch->wd >= 0)
+        inotify_rm_watch(watch_fd, watch->wd);
+
+    if(!watches) {
+        g_source_remove(watch_io_id);
+        watch_io_id = 0;
+        if(watch_tick_id) {
+            g_source_remove(watch_tick_id);
+            watch_tick_id = 0;
+        }
+        close(watch_fd);
+        watch_fd = -1;
+    }
+
+    g_static_mutex_unlock(&watch_mx);
+
+    g_free(watch->name);
+    g_free(watch);
+}
+
+#else  /* !HAVE_SYS_INOTIFY_H */
+
+XfceMailwatchWatch *
+xfce_mailwatch_watch_add(const gchar *path,
+                         XMWatchFunc func,
+                         gpointer user_data)
+{
+    return NULL;
+}
+
+void
+xfce_mailwatch_watch_remove(XfceMailwatchWatch *watch)
+{
+}
+
+#endif  /* HAVE_SYS_INOTIFY_H */
@@ -0,0 +1,48 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __MAILWATCH_WATCH_H__
+#define __MAILWATCH_WATCH_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _XfceMailwatchWatch  XfceMailwatchWatch;
+
+/* called from the main loop once a burst of changes to the path is over.
+ * return FALSE if the change can't be looked at right now (say, a check is
+ * already running), and it'll be reported again shortly. */
+typedef gboolean (*XMWatchFunc)(gpointer user_data);
+
+
+/* watches a directory for changes to its entries, or a file for changes
+ * to it, including it being replaced, created or removed.  returns NULL if
+ * the path can't be watched (no inotify, or too many watches), in which
+ * case polling is all there is.  these can be called from any thread, but
+ * func can still be called once after a watch is removed from anywhere
+ * but the main thread. */
+XfceMailwatchWatch *xfce_mailwatch_watch_add(const gchar *path,
+                                             XMWatchFunc func,
+                                             gpointer user_data);
+
+void xfce_mailwatch_watch_remove(XfceMailwatchWatch *watch);
+
+G_END_DECLS
+
+#endif  /* __MAILWATCH_WATCH_H__ */
@@ -54,6 +54,8 @@ typedef struct
     XfceMailwatchMailbox *mailbox;
     gchar *mailbox_name;
     guint num_new_messages;
+    XfceMailwatchFolderCount *folders;  /* if the mailbox breaks them down */
+    guint n_folders;
 } XfceMailwatchMailboxData;
 
 struct _XfceMailwatch
@@ -79,6 +81,7 @@ extern XfceMailwatchMailboxType builtin_mailbox_type_pop3;
 extern XfceMailwatchMailboxType builtin_mailbox_type_maildir;
 extern XfceMailwatchMailboxType builtin_mailbox_type_mbox;
 extern XfceMailwatchMailboxType builtin_mailbox_type_mh;
+extern XfceMailwatchMailboxType builtin_mailbox_type_webfeed;
 #ifdef HAVE_SSL_SUPPORT
 extern XfceMailwatchMailboxType builtin_mailbox_type_gmail;
 #endif
@@ -89,6 +92,7 @@ XfceMailwatchMailboxType *builtin_mailbox_types[] = {
 #ifdef HAVE_SSL_SUPPORT
     &builtin_mailbox_type_gmail,
 #endif
+    &builtin_mailbox_type_webfeed,
     &builtin_mailbox_type_maildir,
     &builtin_mailbox_type_mbox,
     &builtin_mailbox_type_mh,
@@ -96,6 +100,25 @@ XfceMailwatchMailboxType *builtin_mailbox_types[] = {
 };
 #define N_BUILTIN_MAILBOX_TYPES (sizeof(builtin_mailbox_types)/sizeof(builtin_mailbox_types[0]))
 
+static void
+mailwatch_folder_counts_free(XfceMailwatchFolderCount *folders,
+                             guint n_folders)
+{
+    guint i;
+
+    for(i = 0; i < n_folders; i++)
+        g_free(folders[i].folder_name);
+    g_free(folders);
+}
+
+static void
+mailwatch_mailbox_data_free(XfceMailwatchMailboxData *mdata)
+{
+    mailwatch_folder_counts_free(mdata->folders, mdata->n_folders);
+    g_free(mdata->mailbox_name);
+    g_free(mdata);
+}
+
 static GList *
 mailwatch_load_mailbox_types(void)
 {
@@ -153,8 +176,7 @@ xfce_mailwatch_destroy(XfceMailwatch *mailwatch)
         XfceMailwatchMailboxData *mdata = l->data;
         
         mdata->mailbox->type->free_mailbox_func(mdata->mailbox);
-        g_free(mdata->mailbox_name);
-        g_free(mdata);
+        mailwatch_mailbox_data_free(mdata);
     }
     if(stuff_to_free)
         g_list_free(stuff_to_free);
@@ -433,33 +455,67 @@ xfce_mailwatch_get_new_messages(XfceMailwatch *mailwatch)
 }
 
 /**
- * The caller should free @mailbox_names with g_strfreev(), and
- * @new_message_counts with g_free().
+ * Returns a snapshot of the new message counts of every mailbox, and of
+ * the folders in mailboxes that publish them.  The caller should free it
+ * with xfce_mailwatch_breakdown_free().
  **/
-void
-xfce_mailwatch_get_new_message_breakdown(XfceMailwatch *mailwatch,
-        gchar ***mailbox_names, guint **new_message_counts)
+XfceMailwatchBreakdown *
+xfce_mailwatch_get_new_message_breakdown(XfceMailwatch *mailwatch)
 {
+    XfceMailwatchBreakdown *breakdown;
     GList *l;
-    gint i;
+    guint i, j;
     
-    g_return_if_fail(mailbox_names && new_message_counts);
+    g_return_val_if_fail(mailwatch, NULL);
+    
+    breakdown = g_new0(XfceMailwatchBreakdown, 1);
     
     /* fire! */
     g_mutex_lock(mailwatch->mailboxes_mx);
     
-    *mailbox_names = g_new0(gchar *, g_list_length(mailwatch->mailboxes)+1);
-    *new_message_counts = g_new0(guint, g_list_length(mailwatch->mailboxes)+1);
+    breakdown->n_mailboxes = g_list_length(mailwatch->mailboxes);
+    breakdown->mailboxes = g_new0(XfceMailwatchMailboxCount,
+                                  breakdown->n_mailboxes);
     
     for(l = mailwatch->mailboxes, i = 0; l; l = l->next, i++) {
         XfceMailwatchMailboxData *mdata = l->data;
+        XfceMailwatchMailboxCount *mcount = &breakdown->mailboxes[i];
+        
+        mcount->mailbox_name = g_strdup(mdata->mailbox_name);
+        mcount->num_new_messages = mdata->num_new_messages;
+        breakdown->num_new_messages += mdata->num_new_messages;
         
-        (*mailbox_names)[i] = g_strdup(mdata->mailbox_name);
-        (*new_message_counts)[i] = mdata->num_new_messages;
+        if(mdata->folders) {
+            mcount->n_folders = mdata->n_folders;
+            mcount->folders = g_new(XfceMailwatchFolderCount, mdata->n_folders);
+            for(j = 0; j < mdata->n_folders; j++) {
+                mcount->folders[j].folder_name = g_strdup(mdata->folders[j].folder_name);
+                mcount->folders[j].num_new_messages = mdata->folders[j].num_new_messages;
+            }
+        }
     }
     
     /* direct hit, captain */
     g_mutex_unlock(mailwatch->mailboxes_mx);
+    
+    return breakdown;
+}
+
+void
+xfce_mailwatch_breakdown_free(XfceMailwatchBreakdown *breakdown)
+{
+    guint i;
+    
+    if(!breakdown)
+        return;
+    
+    for(i = 0; i < breakdown->n_mailboxes; i++) {
+        g_free(breakdown->mailboxes[i].mailbox_name);
+        mailwatch_folder_counts_free(breakdown->mailboxes[i].folders,
+                                     breakdown->mailboxes[i].n_folders);
+    }
+    g_free(breakdown->mailboxes);
+    g_free(breakdown);
 }
 
 void
@@ -479,6 +535,22 @@ xfce_mailwatch_force_update(XfceMailwatch *mailwatch)
     g_mutex_unlock(mailwatch->mailboxes_mx);
 }
 
+void
+xfce_mailwatch_mark_seen(XfceMailwatch *mailwatch)
+{
+    GList *l;
+    
+    g_mutex_lock(mailwatch->mailboxes_mx);
+    
+    for(l = mailwatch->mailboxes; l; l = l->next) {
+        XfceMailwatchMailboxData *mdata = l->data;
+        if(mdata->mailbox->type->mark_seen_callback)
+            mdata->mailbox->type->mark_seen_callback(mdata->mailbox);
+    }
+    
+    g_mutex_unlock(mailwatch->mailboxes_mx);
+}
+
 static gboolean
 mailwatch_signal_new_messages_idled(gpointer data)
 {
@@ -522,6 +594,13 @@ xfce_mailwatch_signal_new_messages(XfceMailwatch *mailwatch,
                 mdata->num_new_messages = num_new_messages;
                 do_signal = TRUE;
             }
+            /* a lone total means there's no breakdown anymore */
+            if(mdata->folders) {
+                mailwatch_folder_counts_free(mdata->folders, mdata->n_folders);
+                mdata->folders = NULL;
+                mdata->n_folders = 0;
+                do_signal = TRUE;
+            }
             break;
         }
     }
@@ -533,6 +612,65 @@ xfce_mailwatch_signal_new_messages(XfceMailwatch *mailwatch,
         g_idle_add(mailwatch_signal_new_messages_idled, mailwatch);
 }
 
+/* like xfce_mailwatch_signal_new_messages(), for mailboxes made up of
+ * several folders: the mailbox's count is the sum of the folders' */
+void
+xfce_mailwatch_signal_new_messages_by_folder(XfceMailwatch *mailwatch,
+        XfceMailwatchMailbox *mailbox, guint n_folders,
+        const gchar * const *folder_names, const guint *num_new_messages)
+{
+    GList *l;
+    guint i, total = 0;
+    gboolean do_signal = FALSE;
+    
+    g_return_if_fail(mailwatch && mailbox);
+    g_return_if_fail(!n_folders || (folder_names && num_new_messages));
+    
+    for(i = 0; i < n_folders; i++)
+        total += num_new_messages[i];
+    
+    g_mutex_lock(mailwatch->mailboxes_mx);
+    
+    for(l = mailwatch->mailboxes; l; l = l->next) {
+        XfceMailwatchMailboxData *mdata = l->data;
+        
+        if(mdata->mailbox != mailbox)
+            continue;
+        
+        if(mdata->num_new_messages != total || !mdata->folders
+           || mdata->n_folders != n_folders)
+        {
+            do_signal = TRUE;
+        } else {
+            for(i = 0; i < n_folders && !do_signal; i++) {
+                if(mdata->folders[i].num_new_messages != num_new_messages[i]
+                   || strcmp(mdata->folders[i].folder_name, folder_names[i]))
+                {
+                    do_signal = TRUE;
+                }
+            }
+        }
+        
+        if(do_signal) {
+            mailwatch_folder_counts_free(mdata->folders, mdata->n_folders);
+            /* always non-NULL, even with no folders */
+            mdata->folders = g_new(XfceMailwatchFolderCount, n_folders + 1);
+            mdata->n_folders = n_folders;
+            for(i = 0; i < n_folders; i++) {
+                mdata->folders[i].folder_name = g_strdup(folder_names[i]);
+                mdata->folders[i].num_new_messages = num_new_messages[i];
+            }
+            mdata->num_new_messages = total;
+        }
+        break;
+    }
+    
+    g_mutex_unlock(mailwatch->mailboxes_mx);
+    
+    if(do_signal)
+        g_idle_add(mailwatch_signal_new_messages_idled, mailwatch);
+}
+
 static gboolean
 xfce_mailwatch_signal_log_message( gpointer data )
 {
@@ -835,7 +973,7 @@ config_add_btn_clicked_cb(GtkWidget *w, XfceMailwatch *mailwatch)
     if(config_run_addedit_window(_("Add New Mailbox"), parent, NULL,
                 new_mailbox, &new_mailbox_name))
     {
-        XfceMailwatchMailboxData *mdata = g_new(XfceMailwatchMailboxData, 1);
+        XfceMailwatchMailboxData *mdata = g_new0(XfceMailwatchMailboxData, 1);
         GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(mailwatch->config_treeview));
         GtkTreeIter itr;
         
@@ -910,8 +1048,7 @@ config_remove_btn_clicked_cb(GtkWidget *w, XfceMailwatch *mailwatch)
         
         if(mdata->mailbox == mailbox) {
             mailwatch->mailboxes = g_list_remove(mailwatch->mailboxes, mdata);
-            g_free(mdata->mailbox_name);
-            g_free(mdata);
+            mailwatch_mailbox_data_free(mdata);
             break;
         }
     }
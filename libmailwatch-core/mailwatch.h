@@ -59,6 +59,25 @@ typedef struct {
     gchar                   *message;
 } XfceMailwatchLogEntry;
 
+typedef struct {
+    gchar                   *folder_name;
+    guint                   num_new_messages;
+} XfceMailwatchFolderCount;
+
+typedef struct {
+    gchar                   *mailbox_name;
+    guint                   num_new_messages;
+    /* only set for mailboxes that publish per-folder counts */
+    XfceMailwatchFolderCount *folders;
+    guint                   n_folders;
+} XfceMailwatchMailboxCount;
+
+typedef struct {
+    guint                   num_new_messages;
+    XfceMailwatchMailboxCount *mailboxes;
+    guint                   n_mailboxes;
+} XfceMailwatchBreakdown;
+
 XfceMailwatch *xfce_mailwatch_new      ();
 void xfce_mailwatch_destroy            (XfceMailwatch *mailwatch);
 
@@ -72,12 +91,12 @@ gboolean xfce_mailwatch_save_config    (XfceMailwatch *mailwatch);
 
 guint xfce_mailwatch_get_new_messages  (XfceMailwatch *mailwatch);
 
-void xfce_mailwatch_get_new_message_breakdown
-                                       (XfceMailwatch *mailwatch,
-                                        gchar ***mailbox_names,
-                                        guint **new_message_counts);
+XfceMailwatchBreakdown *xfce_mailwatch_get_new_message_breakdown
+                                       (XfceMailwatch *mailwatch);
+void xfce_mailwatch_breakdown_free     (XfceMailwatchBreakdown *breakdown);
 
 void xfce_mailwatch_force_update       (XfceMailwatch *mailwatch);
+void xfce_mailwatch_mark_seen          (XfceMailwatch *mailwatch);
 
 GtkContainer *xfce_mailwatch_get_configuration_page
                                        (XfceMailwatch *mailwatch);
@@ -95,6 +114,12 @@ void xfce_mailwatch_signal_disconnect  (XfceMailwatch *mailwatch,
 void xfce_mailwatch_signal_new_messages(XfceMailwatch *mailwatch,
                                         XfceMailwatchMailbox *mailbox,
                                         guint num_new_messages);
+void xfce_mailwatch_signal_new_messages_by_folder
+                                       (XfceMailwatch *mailwatch,
+                                        XfceMailwatchMailbox *mailbox,
+                                        guint n_folders,
+                                        const gchar * const *folder_names,
+                                        const guint *num_new_messages);
 void xfce_mailwatch_log_message        (XfceMailwatch *mailwatch,
                                         XfceMailwatchMailbox *mailbox,
                                         XfceMailwatchLogLevel level,
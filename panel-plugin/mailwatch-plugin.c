@@ -134,6 +134,53 @@ mailwatch_set_default_config(XfceMailwatchPlugin *mwp)
     mwp->show_log_status = TRUE;
 }
         
+static void
+mailwatch_set_new_messages_tooltip(XfceMailwatchPlugin *mwp,
+                                   guint                new_messages)
+{
+    GString                *ttip_str = g_string_sized_new(64);
+    XfceMailwatchBreakdown *breakdown;
+    guint                   i, j;
+    
+    g_string_append_printf(ttip_str,
+                           ngettext("You have %d new message:",
+                                    "You have %d new messages:",
+                                    new_messages), new_messages);
+    
+    breakdown = xfce_mailwatch_get_new_message_breakdown(mwp->mailwatch);
+    for (i = 0; i < breakdown->n_mailboxes; i++) {
+        XfceMailwatchMailboxCount *mcount = &breakdown->mailboxes[i];
+        
+        if (mcount->num_new_messages == 0)
+            continue;
+        
+        g_string_append_c(ttip_str, '\n');
+        g_string_append_printf(ttip_str,
+                               Q_("tells how many new messages in each mailbox|    %d in %s"),
+                               mcount->num_new_messages,
+                               mcount->mailbox_name);
+        
+        /* a single folder would just repeat the mailbox's line */
+        if (mcount->n_folders < 2)
+            continue;
+        for (j = 0; j < mcount->n_folders; j++) {
+            if (mcount->folders[j].num_new_messages > 0) {
+                g_string_append_c(ttip_str, '\n');
+                g_string_append_printf(ttip_str,
+                                       Q_("tells how many new messages in each folder of a mailbox|        %d in %s"),
+                                       mcount->folders[j].num_new_messages,
+                                       mcount->folders[j].folder_name);
+            }
+        }
+    }
+    
+    xfce_mailwatch_breakdown_free(breakdown);
+    
+    gtk_widget_set_tooltip_text(mwp->button, ttip_str->str);
+    gtk_widget_trigger_tooltip_query(mwp->button);
+    g_string_free(ttip_str, TRUE);
+}
+
 static void
 mailwatch_new_messages_changed_cb(XfceMailwatch *mailwatch,
                                   gpointer       new_message_count,
@@ -162,35 +209,10 @@ mailwatch_new_messages_changed_cb(XfceMailwatch *mailwatch,
                                xfce_panel_plugin_get_size(mwp->plugin),
                                mwp);
         }
+        /* the folders can change even if the total doesn't */
+        mailwatch_set_new_messages_tooltip(mwp, new_messages);
+        
         if (new_messages != mwp->new_messages) {
-            GString *ttip_str = g_string_sized_new(64);
-            gchar **mailbox_names = NULL;
-            guint *new_message_counts = NULL;
-            gint i;
-            
-            g_string_append_printf(ttip_str,
-                                   ngettext("You have %d new message:",
-                                            "You have %d new messages:",
-                                            new_messages), new_messages);
-            
-            xfce_mailwatch_get_new_message_breakdown(mwp->mailwatch,
-                    &mailbox_names, &new_message_counts);
-            for (i = 0; mailbox_names[i]; i++) {
-                if (new_message_counts[i] > 0) {
-                    g_string_append_c(ttip_str, '\n');
-                    g_string_append_printf(ttip_str,
-                                           Q_("tells how many new messages in each mailbox|    %d in %s"),
-                                           new_message_counts[i],
-                                           mailbox_names[i]);
-                }
-            }
-            
-            g_strfreev(mailbox_names);
-            g_free(new_message_counts);
-            
-            gtk_widget_set_tooltip_text(mwp->button, ttip_str->str);
-            gtk_widget_trigger_tooltip_query(mwp->button);
-            g_string_free(ttip_str, TRUE);
             /* Run command when count of new messages changes from
              * zero to non-zero. */
             if (mwp->new_messages == 0 && mwp->new_messages_command)
@@ -237,6 +259,7 @@ mailwatch_button_release_cb(GtkWidget      *w,
                     xfce_spawn_command_line_on_screen(gdk_screen_get_default(),
                                                       mwp->click_command,
                                                       FALSE, FALSE, NULL);
+                xfce_mailwatch_mark_seen(mwp->mailwatch);
                 break;
         
             case MOUSE_BUTTON_MIDDLE:
@@ -0,0 +1,134 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * compares a check that asks for every folder's count with one LIST-STATUS
+ * command against one that sends a STATUS per folder, on the mock IMAP
+ * server.  the STATUS commands are pipelined, so both take the same round
+ * trips; what differs is the bytes each way and the work of building and
+ * parsing them.  neither server offers CONDSTORE, so every check gets
+ * every count.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test-common.h"
+
+#define xfce_mailwatch_net_conn_dump_stats(net_conn, what, elapsed) \
+    test_collect_net_stats(net_conn)
+#include "mailwatch-mailbox-imap.c"
+
+#define UNSEEN  2
+
+/* a link to a server some way off */
+static TestOptions options = { 20, 20, 0, 0, FALSE };
+
+static const guint default_folders[] = { 10, 100, 1000 };
+
+static void
+bench_imap_run(const gchar *name,
+               guint imap_caps,
+               guint n_folders,
+               TestCheckStats *stats)
+{
+    MockServerConfig config;
+    MockServer *server;
+    XfceMailwatchIMAPMailbox *imailbox;
+    GList *params;
+    guint i;
+
+    test_server_config_init(&config, MOCK_SERVER_IMAP, &options);
+    config.n_folders = n_folders;
+    config.imap_caps = imap_caps;
+    config.unseen = UNSEEN;
+    server = mock_server_new(&config);
+
+    params = test_folder_params(test_server_params(server), n_folders);
+    imailbox = XFCE_MAILWATCH_IMAP_MAILBOX(test_mailbox_new(&builtin_mailbox_type_imap,
+                                                            params));
+
+    /* the first check finds out what the server offers */
+    memset(stats, 0, sizeof(*stats));
+    for(i = 0; i <= (guint)options.iterations; i++) {
+        if(i == 1)
+            memset(stats, 0, sizeof(*stats));
+        stats->name = name;
+
+        test_check_run(stats, server, &imailbox->running, &imailbox->th,
+                       imap_check_mail_th, imailbox);
+
+        test_expect_new(name, n_folders, n_folders * UNSEEN);
+    }
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(imailbox));
+    mock_server_destroy(server);
+}
+
+static void
+bench_imap_compare(guint n_folders)
+{
+    TestCheckStats status, list_status;
+    gchar *status_name, *list_status_name;
+
+    status_name = g_strdup_printf("STATUS, %u folders", n_folders);
+    list_status_name = g_strdup_printf("LIST-STATUS, %u folders", n_folders);
+
+    bench_imap_run(status_name, 0, n_folders, &status);
+    bench_imap_run(list_status_name, MOCK_IMAP_LIST_STATUS, n_folders,
+                   &list_status);
+
+    test_stats_print(&status);
+    test_stats_print(&list_status);
+
+    printf("  LIST-STATUS: %.0f%% of the time, %.0f%% of the bytes sent, "
+           "%.0f%% of the bytes received, %.0f%% of the allocations\n\n",
+           100 * list_status.elapsed / MAX(status.elapsed, 1e-9),
+           100.0 * list_status.net.bytes_sent / MAX(status.net.bytes_sent, 1),
+           100.0 * list_status.net.bytes_received
+           / MAX(status.net.bytes_received, 1),
+           100.0 * list_status.allocs / MAX(status.allocs, 1));
+    fflush(stdout);
+
+    g_free(status_name);
+    g_free(list_status_name);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+    guint i;
+
+    test_init(&argc, &argv, &options,
+              "Compares LIST-STATUS with a STATUS per folder on a mock IMAP "
+              "server.  Without --folders, it tries 10, 100 and 1000.");
+
+    if(options.folders > 0)
+        bench_imap_compare(options.folders);
+    else {
+        for(i = 0; i < G_N_ELEMENTS(default_folders); i++)
+            bench_imap_compare(default_folders[i]);
+    }
+
+    return test_finish();
+}
@@ -0,0 +1,201 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * times mbox_check_mail() on spools made with mbox-gen: a full scan with
+ * nothing in the page cache, full scans with no index to start from, checks
+ * of an unchanged spool, and checks after a message is delivered.  the
+ * delivered messages are truncated off again at the end.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test-common.h"
+
+#include "mailwatch-mailbox-mbox.c"
+
+#define APPENDED_MESSAGE \
+    "From bench@example.com Thu Jan  1 00:00:00 2026\n" \
+    "From: Bench <bench@example.com>\n" \
+    "To: user@example.org\n" \
+    "Subject: Delivered while watching\n" \
+    "\n" \
+    "This one is new.\n" \
+    "\n"
+
+static TestOptions options = { 5, 0, 0, 0, FALSE };
+
+/* drops the index, in memory and on disk, so the next check scans it all */
+static void
+bench_mbox_forget(XfceMailwatchMboxMailbox *mbox)
+{
+    GList *l;
+    gchar *index_filename;
+
+    for(l = mbox->files; l; l = l->next) {
+        index_filename = mbox_index_filename(((MboxFile *)l->data)->fn);
+        unlink(index_filename);
+        g_free(index_filename);
+        mbox_file_free(l->data);
+    }
+    g_list_free(mbox->files);
+    mbox->files = NULL;
+}
+
+static guint
+bench_mbox_check(XfceMailwatchMboxMailbox *mbox,
+                 TestCheckStats *stats)
+{
+    test_check_run(stats, NULL, &mbox->running, &mbox->thread,
+                   mbox_check_mail_thread, mbox);
+
+    return test_core_get()->new_messages;
+}
+
+static void
+bench_mbox_print(const TestCheckStats *stats,
+                 guint64 bytes_scanned)
+{
+    gdouble n = MAX(stats->n_checks, 1);
+
+    printf("%-32s %u checks: %.2f ms", stats->name, stats->n_checks,
+           stats->elapsed * 1000 / n);
+    if(bytes_scanned) {
+        printf(", %.0f MB/s",
+               bytes_scanned * n / (1024 * 1024) / MAX(stats->elapsed, 1e-9));
+    }
+    if(test_alloc_supported())
+        printf(", %.0f allocations", stats->allocs / n);
+    printf(" per check\n");
+    fflush(stdout);
+}
+
+static gboolean
+bench_mbox_append(const gchar *filename)
+{
+    FILE *fp;
+    gboolean ret;
+
+    if(!(fp = fopen(filename, "a")))
+        return FALSE;
+    ret = fputs(APPENDED_MESSAGE, fp) >= 0;
+
+    return !fclose(fp) && ret;
+}
+
+static void
+bench_mbox_run(const gchar *filename)
+{
+    XfceMailwatchMboxMailbox *mbox;
+    GList *params;
+    TestCheckStats stats;
+    struct stat st;
+    guint n_new, count;
+    gint fd, i;
+
+    if(stat(filename, &st) < 0 || !S_ISREG(st.st_mode)) {
+        test_expect(FALSE, "%s isn't a file", filename);
+        return;
+    }
+    printf("%s: %.0f MB\n", filename, (gdouble)st.st_size / (1024 * 1024));
+
+    params = test_params_add(NULL, "filename", "%s", filename);
+    mbox = XFCE_MAILWATCH_MBOX_MAILBOX(test_mailbox_new(&builtin_mailbox_type_mbox,
+                                                        params));
+
+    /* as close to cold as an unprivileged process gets */
+#ifdef POSIX_FADV_DONTNEED
+    if((fd = open(filename, O_RDONLY)) >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "full scan, cold cache";
+    n_new = bench_mbox_check(mbox, &stats);
+    bench_mbox_print(&stats, st.st_size);
+    printf("  %u new messages\n", n_new);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "full scan";
+    for(i = 0; i < options.iterations; i++) {
+        bench_mbox_forget(mbox);
+        count = bench_mbox_check(mbox, &stats);
+        test_expect(count == n_new, "%s: %u new messages, not %u", stats.name,
+                    count, n_new);
+    }
+    bench_mbox_print(&stats, st.st_size);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "unchanged";
+    for(i = 0; i < options.iterations; i++) {
+        count = bench_mbox_check(mbox, &stats);
+        test_expect(count == n_new, "%s: %u new messages, not %u", stats.name,
+                    count, n_new);
+    }
+    bench_mbox_print(&stats, 0);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "one message delivered";
+    for(i = 0; i < options.iterations; i++) {
+        if(!bench_mbox_append(filename)) {
+            test_expect(FALSE, "%s: can't append to %s: %s", stats.name,
+                        filename, g_strerror(errno));
+            break;
+        }
+        count = bench_mbox_check(mbox, &stats);
+        test_expect(count == n_new + i + 1, "%s: %u new messages, not %u",
+                    stats.name, count, n_new + i + 1);
+    }
+    bench_mbox_print(&stats, 0);
+    printf("\n");
+
+    if(truncate(filename, st.st_size) < 0)
+        test_expect(FALSE, "can't truncate %s: %s", filename, g_strerror(errno));
+
+    bench_mbox_forget(mbox);
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+}
+
+int
+main(int argc,
+     char **argv)
+{
+    gint i;
+
+    test_init(&argc, &argv, &options,
+              "Times checks of the mbox spools named on the command line, "
+              "which mbox-gen can make.  Messages are appended to them, and "
+              "truncated off again at the end.");
+
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s [OPTION...] FILE...\n", argv[0]);
+        test_finish();
+        return 2;
+    }
+
+    for(i = 1; i < argc; i++)
+        bench_mbox_run(argv[i]);
+
+    return test_finish();
+}
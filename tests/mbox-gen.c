@@ -0,0 +1,197 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * writes a synthetic mbox spool of a given size, for bench-mbox to scan.
+ * most messages have been read, and say so in a Status or
+ * X-Mozilla-Status header; the rest are new.  bodies vary in length, and
+ * now and then have a line that had to be quoted as ">From ".  the same
+ * seed always gives the same spool.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#define OUT_BUFFER_SIZE  (1024 * 1024)
+
+static gint size_mb = 1024;
+static gint new_percent = 1;
+static gint body_size = 4096;
+static gboolean content_length = FALSE;
+static gint seed = 1;
+
+static const gchar *body_lines[] = {
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod",
+    "tempor incididunt ut labore et dolore magna aliqua.  Ut enim ad minim",
+    "veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea",
+    "commodo consequat.",
+    "",
+    "> Duis aute irure dolor in reprehenderit in voluptate velit esse cillum",
+    "> dolore eu fugiat nulla pariatur.",
+    ">From the quoted reply: excepteur sint occaecat cupidatat non proident,",
+    "sunt in culpa qui officia deserunt mollit anim id est laborum.",
+    "Status: this line is in a body, and mustn't be read as a header",
+    "--",
+    "Sender",
+};
+
+static void
+mbox_gen_body(GString *body,
+              GRand *rand)
+{
+    gsize len = g_rand_int_range(rand, 0, 2 * body_size + 1);
+
+    g_string_truncate(body, 0);
+    while(body->len < len) {
+        g_string_append(body,
+                        body_lines[g_rand_int_range(rand, 0,
+                                                    G_N_ELEMENTS(body_lines))]);
+        g_string_append_c(body, '\n');
+    }
+}
+
+static void
+mbox_gen_message(GString *msg,
+                 GString *body,
+                 GRand *rand,
+                 guint n,
+                 gboolean is_new)
+{
+    mbox_gen_body(body, rand);
+
+    g_string_truncate(msg, 0);
+    g_string_append_printf(msg,
+                           "From sender%u@example.com Thu Jan  1 00:00:00 2026\n"
+                           "Return-Path: <sender%u@example.com>\n"
+                           "Received: from mx.example.com (mx.example.com [192.0.2.1])\n"
+                           "\tby mail.example.org with ESMTP id %08X\n"
+                           "\tfor <user@example.org>; Thu, 1 Jan 2026 00:00:00 +0000\n"
+                           "From: Sender %u <sender%u@example.com>\n"
+                           "To: user@example.org\n"
+                           "Subject: Message %u\n"
+                           "Date: Thu, 1 Jan 2026 00:00:00 +0000\n"
+                           "Message-ID: <%u.%08X@example.com>\n"
+                           "MIME-Version: 1.0\n"
+                           "Content-Type: text/plain; charset=us-ascii\n",
+                           n % 100, n % 100, g_rand_int(rand), n % 100,
+                           n % 100, n, n, g_rand_int(rand));
+    if(content_length)
+        g_string_append_printf(msg, "Content-Length: %lu\n", (gulong)body->len);
+    if(!is_new) {
+        if(n % 2)
+            g_string_append(msg, "Status: RO\n");
+        else
+            g_string_append(msg, "X-Mozilla-Status: 0001\n");
+    }
+    g_string_append_c(msg, '\n');
+    g_string_append_len(msg, body->str, body->len);
+    g_string_append_c(msg, '\n');
+}
+
+int
+main(int argc,
+     char **argv)
+{
+    GOptionEntry entries[] = {
+        { "size", 's', 0, G_OPTION_ARG_INT, &size_mb,
+          "Size of the spool (default 1024)", "MB" },
+        { "new", 'n', 0, G_OPTION_ARG_INT, &new_percent,
+          "Percentage of the messages that are new (default 1)", "PERCENT" },
+        { "body", 'b', 0, G_OPTION_ARG_INT, &body_size,
+          "Average body size (default 4096)", "BYTES" },
+        { "content-length", 'c', 0, G_OPTION_ARG_NONE, &content_length,
+          "Give every message a Content-Length header", NULL },
+        { "seed", 'r', 0, G_OPTION_ARG_INT, &seed,
+          "Random seed (default 1)", "N" },
+        { NULL }
+    };
+    GOptionContext *context;
+    GError *error = NULL;
+    GRand *rand;
+    GString *msg, *body;
+    FILE *fp;
+    gchar *buffer;
+    guint64 size, written = 0;
+    guint n, n_new = 0;
+    gboolean is_new;
+
+    context = g_option_context_new("FILE");
+    g_option_context_set_summary(context,
+                                 "Writes a synthetic mbox spool to FILE, for "
+                                 "bench-mbox.");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if(!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if(argc != 2 || size_mb <= 0 || body_size < 0
+       || new_percent < 0 || new_percent > 100)
+    {
+        fprintf(stderr, "Usage: %s [OPTION...] FILE\n", argv[0]);
+        return 2;
+    }
+
+    fp = fopen(argv[1], "w");
+    if(!fp) {
+        perror(argv[1]);
+        return 1;
+    }
+    buffer = g_malloc(OUT_BUFFER_SIZE);
+    setvbuf(fp, buffer, _IOFBF, OUT_BUFFER_SIZE);
+
+    rand = g_rand_new_with_seed(seed);
+    msg = g_string_sized_new(2 * body_size + 1024);
+    body = g_string_sized_new(2 * body_size + 128);
+    size = (guint64)size_mb * 1024 * 1024;
+
+    for(n = 0; written < size; n++) {
+        is_new = g_rand_int_range(rand, 0, 100) < new_percent;
+        mbox_gen_message(msg, body, rand, n, is_new);
+        if(fwrite(msg->str, 1, msg->len, fp) != msg->len) {
+            perror(argv[1]);
+            return 1;
+        }
+        written += msg->len;
+        if(is_new)
+            n_new++;
+    }
+
+    if(fclose(fp)) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    printf("%s: %u messages, %u new, %" G_GUINT64_FORMAT " bytes\n", argv[1],
+           n, n_new, written);
+
+    g_string_free(msg, TRUE);
+    g_string_free(body, TRUE);
+    g_rand_free(rand);
+    g_free(buffer);
+
+    return 0;
+}
@@ -0,0 +1,1241 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * just enough IMAP, POP3 and HTTP to answer what the mailboxes ask, on a
+ * loopback port.  every connection gets a thread that reads whatever the
+ * client has sent, answers each complete command, and then (after the
+ * configured delay) writes all the answers at once.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_SSL_SUPPORT
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <glib.h>
+
+#include "mock-server.h"
+#include "test-common.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MOCK_BUFSIZE        16384
+#define MOCK_HTTP_CHUNK     1024
+#define MOCK_FEED_ENTRIES   20
+
+struct _MockServer
+{
+    GMutex *mx;
+    MockServerConfig config;  /* strings are ours */
+    guint generation;  /* bumped by every mock_server_configure() */
+    guint drop_countdown;
+    MockServerStats stats;
+
+    gint listen_fd;
+    guint port;
+    gint stopping;
+    GThread *accept_th;
+    GList *conns;    /* (MockConn *), still talking */
+    GList *threads;  /* (GThread *), to join at the end */
+
+#ifdef HAVE_SSL_SUPPORT
+    gnutls_x509_privkey_t key;
+    gnutls_x509_crt_t crt;
+    gnutls_certificate_credentials_t creds;
+#endif
+};
+
+typedef struct
+{
+    MockServer *server;
+    gint fd;
+    gboolean secure;
+#ifdef HAVE_SSL_SUPPORT
+    gnutls_session_t session;
+#endif
+#ifdef HAVE_ZLIB
+    gboolean compressed;
+    z_stream inflater;
+    z_stream deflater;
+#endif
+
+    GString *in;   /* what the client sent, decrypted and decompressed */
+    GString *out;  /* answers waiting to go out */
+    gboolean start_compression;  /* once |out| is flushed */
+    gboolean closing;  /* hang up once |out| is flushed */
+    gboolean dropped;  /* hang up right away */
+} MockConn;
+
+
+static gboolean
+mock_conn_write_raw(MockConn *conn,
+                    const gchar *data,
+                    gsize len)
+{
+    gssize ret;
+
+    while(len) {
+#ifdef HAVE_SSL_SUPPORT
+        if(conn->secure)
+            ret = gnutls_record_send(conn->session, data, len);
+        else
+#endif
+            ret = send(conn->fd, data, len, MSG_NOSIGNAL);
+
+        if(ret < 0) {
+#ifdef HAVE_SSL_SUPPORT
+            if(conn->secure && (ret == GNUTLS_E_AGAIN
+                                || ret == GNUTLS_E_INTERRUPTED))
+            {
+                continue;
+            }
+#endif
+            if(!conn->secure && errno == EINTR)
+                continue;
+            return FALSE;
+        }
+
+        data += ret;
+        len -= ret;
+    }
+
+    return TRUE;
+}
+
+static gssize
+mock_conn_read_raw(MockConn *conn,
+                   gchar *buf,
+                   gsize len)
+{
+    gssize ret;
+
+    do {
+#ifdef HAVE_SSL_SUPPORT
+        if(conn->secure) {
+            ret = gnutls_record_recv(conn->session, buf, len);
+            if(ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED)
+                continue;
+            return ret < 0 ? -1 : ret;
+        }
+#endif
+        ret = recv(conn->fd, buf, len, 0);
+    } while(ret < 0 && errno == EINTR);
+
+    return ret;
+}
+
+/* writes out everything that's waiting, no faster than the configured
+ * throughput */
+static gboolean
+mock_conn_flush(MockConn *conn)
+{
+    MockServer *server = conn->server;
+    GString *out = conn->out;
+    guint latency_ms, throughput;
+    gsize chunk, n, pos;
+    gboolean ret = TRUE;
+
+    if(!conn->out->len)
+        return TRUE;
+
+    g_mutex_lock(server->mx);
+    latency_ms = server->config.latency_ms;
+    throughput = server->config.throughput;
+    g_mutex_unlock(server->mx);
+
+#ifdef HAVE_ZLIB
+    if(conn->compressed) {
+        gchar zbuf[MOCK_BUFSIZE];
+
+        out = g_string_sized_new(conn->out->len / 2 + 64);
+        conn->deflater.next_in = (Bytef *)conn->out->str;
+        conn->deflater.avail_in = conn->out->len;
+        do {
+            conn->deflater.next_out = (Bytef *)zbuf;
+            conn->deflater.avail_out = sizeof(zbuf);
+            deflate(&conn->deflater, Z_SYNC_FLUSH);
+            g_string_append_len(out, zbuf,
+                                sizeof(zbuf) - conn->deflater.avail_out);
+        } while(conn->deflater.avail_out == 0);
+    }
+#endif
+
+    if(latency_ms)
+        g_usleep(latency_ms * 1000);
+
+    /* 20ms worth at a time */
+    chunk = throughput ? MAX(throughput / 50, 1) : out->len;
+    for(pos = 0; pos < out->len && ret; pos += n) {
+        n = MIN(chunk, out->len - pos);
+        ret = mock_conn_write_raw(conn, out->str + pos, n);
+        if(throughput)
+            g_usleep((gulong)((guint64)n * G_USEC_PER_SEC / throughput));
+    }
+
+    g_mutex_lock(server->mx);
+    server->stats.bytes_sent += pos;
+    g_mutex_unlock(server->mx);
+
+    if(out != conn->out)
+        g_string_free(out, TRUE);
+    g_string_truncate(conn->out, 0);
+
+    return ret;
+}
+
+/* reads whatever the client has sent next onto the end of |conn->in| */
+static gboolean
+mock_conn_read(MockConn *conn)
+{
+    gchar buf[MOCK_BUFSIZE];
+    gssize n;
+
+    n = mock_conn_read_raw(conn, buf, sizeof(buf));
+    if(n <= 0)
+        return FALSE;
+
+    g_mutex_lock(conn->server->mx);
+    conn->server->stats.bytes_received += n;
+    g_mutex_unlock(conn->server->mx);
+
+#ifdef HAVE_ZLIB
+    if(conn->compressed) {
+        gchar zbuf[MOCK_BUFSIZE];
+        gint zret;
+
+        conn->inflater.next_in = (Bytef *)buf;
+        conn->inflater.avail_in = n;
+        do {
+            conn->inflater.next_out = (Bytef *)zbuf;
+            conn->inflater.avail_out = sizeof(zbuf);
+            zret = inflate(&conn->inflater, Z_SYNC_FLUSH);
+            if(zret != Z_OK && zret != Z_BUF_ERROR)
+                return FALSE;
+            g_string_append_len(conn->in, zbuf,
+                                sizeof(zbuf) - conn->inflater.avail_out);
+        } while(conn->inflater.avail_in > 0
+                || conn->inflater.avail_out == 0);
+
+        return TRUE;
+    }
+#endif
+
+    g_string_append_len(conn->in, buf, n);
+
+    return TRUE;
+}
+
+#ifdef HAVE_ZLIB
+/* raw deflate both ways, as COMPRESS=DEFLATE (RFC 4978) has it */
+static void
+mock_conn_start_compression(MockConn *conn)
+{
+    memset(&conn->inflater, 0, sizeof(conn->inflater));
+    memset(&conn->deflater, 0, sizeof(conn->deflater));
+    inflateInit2(&conn->inflater, -MAX_WBITS);
+    deflateInit2(&conn->deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                 -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    conn->compressed = TRUE;
+}
+#endif
+
+/* counts a command against the configured failures.  returns FALSE if the
+ * connection should be dropped instead of answering it; sets |refused| if
+ * the command should be refused.  called with the server locked. */
+static gboolean
+mock_server_count_command(MockServer *server,
+                          const gchar *command,
+                          gboolean *refused)
+{
+    const gchar *fail = server->config.fail_command;
+
+    server->stats.commands++;
+
+    if(server->drop_countdown && !--server->drop_countdown)
+        return FALSE;
+
+    *refused = (fail && *fail
+                && !g_ascii_strncasecmp(command, fail, strlen(fail)));
+
+    return TRUE;
+}
+
+
+/*
+ * IMAP
+ */
+
+static void
+mock_imap_append_caps(MockServer *server,
+                      GString *out)
+{
+    guint caps = server->config.imap_caps;
+
+    g_string_append(out, "IMAP4rev1 LIST-EXTENDED");
+    if(caps & MOCK_IMAP_LIST_STATUS)
+        g_string_append(out, " LIST-STATUS");
+    if(caps & MOCK_IMAP_CONDSTORE)
+        g_string_append(out, " CONDSTORE");
+    if(caps & MOCK_IMAP_SASL_IR)
+        g_string_append(out, " SASL-IR AUTH=PLAIN");
+#ifdef HAVE_ZLIB
+    if(caps & MOCK_IMAP_COMPRESS)
+        g_string_append(out, " COMPRESS=DEFLATE");
+#endif
+}
+
+/* reads an atom or a quoted string */
+static gchar *
+mock_imap_next_astring(const gchar **p)
+{
+    GString *str;
+    const gchar *q = *p;
+
+    while(*q == ' ')
+        q++;
+
+    if(*q == '"') {
+        str = g_string_new(NULL);
+        for(q++; *q && *q != '"'; q++) {
+            if(*q == '\\' && q[1])
+                q++;
+            g_string_append_c(str, *q);
+        }
+        if(*q == '"')
+            q++;
+    } else {
+        const gchar *start = q;
+
+        while(*q && *q != ' ' && *q != '(' && *q != ')')
+            q++;
+        if(q == start) {
+            *p = q;
+            return NULL;
+        }
+        str = g_string_new_len(start, q - start);
+    }
+
+    *p = q;
+
+    return g_string_free(str, FALSE);
+}
+
+/* returns the number of the folder called |name|, or -1 */
+static gint
+mock_imap_folder_index(MockServer *server,
+                       const gchar *name)
+{
+    gchar *end = NULL;
+    gulong n;
+
+    if(!g_ascii_strcasecmp(name, "INBOX"))
+        return server->config.n_folders ? 0 : -1;
+
+    if(strncmp(name, "folder", 6) || !g_ascii_isdigit(name[6]))
+        return -1;
+    n = strtoul(name + 6, &end, 10);
+    if(*end || n == 0 || n >= server->config.n_folders)
+        return -1;
+
+    return n;
+}
+
+static void
+mock_imap_append_folder_name(GString *out,
+                             gint folder)
+{
+    if(folder)
+        g_string_append_printf(out, "\"folder%d\"", folder);
+    else
+        g_string_append(out, "\"INBOX\"");
+}
+
+static void
+mock_imap_append_status(MockServer *server,
+                        GString *out,
+                        gint folder,
+                        gboolean condstore)
+{
+    g_string_append(out, "* STATUS ");
+    mock_imap_append_folder_name(out, folder);
+    g_string_append_printf(out, " (UNSEEN %u", server->config.unseen);
+    if(condstore) {
+        /* anything reconfigured counts as a change to every folder */
+        g_string_append_printf(out, " HIGHESTMODSEQ %u UIDNEXT %u UIDVALIDITY 1",
+                               server->generation + 1,
+                               server->config.unseen + server->generation + 1);
+    }
+    g_string_append(out, ")\r\n");
+}
+
+/* LIST "" <pattern>, or LIST "" (<pattern> ...) [RETURN (STATUS (...))];
+ * the patterns are either exact folder names or "*" or "%" */
+static gboolean
+mock_imap_list(MockServer *server,
+               MockConn *conn,
+               const gchar *args)
+{
+    const gchar *p = args, *ret;
+    gchar *reference, *pattern;
+    GList *patterns = NULL, *l;
+    gboolean with_status, condstore;
+    gint folder;
+    guint i;
+
+    reference = mock_imap_next_astring(&p);
+    if(!reference)
+        return FALSE;
+    g_free(reference);
+
+    while(*p == ' ')
+        p++;
+    if(*p == '(') {
+        p++;
+        while((pattern = mock_imap_next_astring(&p)))
+            patterns = g_list_append(patterns, pattern);
+        if(*p != ')') {
+            g_list_foreach(patterns, (GFunc)g_free, NULL);
+            g_list_free(patterns);
+            return FALSE;
+        }
+        p++;
+    } else if((pattern = mock_imap_next_astring(&p)))
+        patterns = g_list_append(patterns, pattern);
+    else
+        return FALSE;
+
+    ret = strstr(p, "RETURN (STATUS (");
+    with_status = (ret != NULL);
+    condstore = (ret && strstr(ret, "HIGHESTMODSEQ") != NULL);
+    if(with_status && !(server->config.imap_caps & MOCK_IMAP_LIST_STATUS)) {
+        g_list_foreach(patterns, (GFunc)g_free, NULL);
+        g_list_free(patterns);
+        return FALSE;
+    }
+
+    for(l = patterns; l; l = l->next) {
+        pattern = l->data;
+
+        if(!strcmp(pattern, "*") || !strcmp(pattern, "%")) {
+            for(i = 0; i < server->config.n_folders; i++) {
+                g_string_append(conn->out, "* LIST (\\HasNoChildren) \"/\" ");
+                mock_imap_append_folder_name(conn->out, i);
+                g_string_append(conn->out, "\r\n");
+                if(with_status)
+                    mock_imap_append_status(server, conn->out, i, condstore);
+            }
+        } else if((folder = mock_imap_folder_index(server, pattern)) >= 0) {
+            g_string_append(conn->out, "* LIST (\\HasNoChildren) \"/\" ");
+            mock_imap_append_folder_name(conn->out, folder);
+            g_string_append(conn->out, "\r\n");
+            if(with_status)
+                mock_imap_append_status(server, conn->out, folder, condstore);
+        }
+
+        g_free(pattern);
+    }
+    g_list_free(patterns);
+
+    return TRUE;
+}
+
+/* answers one tagged command.  called with the server locked. */
+static void
+mock_imap_command(MockServer *server,
+                  MockConn *conn,
+                  gchar *line)
+{
+    gchar *tag = line, *command, *args, *p;
+    gboolean refused = FALSE;
+
+    p = strchr(line, ' ');
+    if(!p) {
+        g_string_append(conn->out, "* BAD missing command\r\n");
+        return;
+    }
+    *p = 0;
+    command = p + 1;
+    p = strchr(command, ' ');
+    if(p) {
+        *p = 0;
+        args = p + 1;
+    } else
+        args = "";
+
+    if(!mock_server_count_command(server, command, &refused)) {
+        conn->dropped = TRUE;
+        return;
+    }
+
+    if(refused) {
+        g_string_append_printf(conn->out,
+                               "%s NO [UNAVAILABLE] %s failed on purpose\r\n",
+                               tag, command);
+    } else if(!g_ascii_strcasecmp(command, "CAPABILITY")) {
+        g_string_append(conn->out, "* CAPABILITY ");
+        mock_imap_append_caps(server, conn->out);
+        g_string_append_printf(conn->out, "\r\n%s OK CAPABILITY completed\r\n",
+                               tag);
+    } else if(!g_ascii_strcasecmp(command, "LOGIN")
+              || (!g_ascii_strcasecmp(command, "AUTHENTICATE")
+                  && !g_ascii_strncasecmp(args, "PLAIN ", 6)
+                  && (server->config.imap_caps & MOCK_IMAP_SASL_IR)))
+    {
+        g_string_append_printf(conn->out, "%s OK [CAPABILITY ", tag);
+        mock_imap_append_caps(server, conn->out);
+        g_string_append(conn->out, "] Logged in\r\n");
+    } else if(!g_ascii_strcasecmp(command, "NOOP"))
+        g_string_append_printf(conn->out, "%s OK NOOP completed\r\n", tag);
+#ifdef HAVE_ZLIB
+    else if(!g_ascii_strcasecmp(command, "COMPRESS")
+            && (server->config.imap_caps & MOCK_IMAP_COMPRESS)
+            && !conn->compressed)
+    {
+        g_string_append_printf(conn->out, "%s OK DEFLATE active\r\n", tag);
+        conn->start_compression = TRUE;
+    }
+#endif
+    else if(!g_ascii_strcasecmp(command, "STATUS")) {
+        const gchar *q = args;
+        gchar *name = mock_imap_next_astring(&q);
+        gint folder = name ? mock_imap_folder_index(server, name) : -1;
+
+        if(folder >= 0) {
+            mock_imap_append_status(server, conn->out, folder,
+                                    strstr(q, "HIGHESTMODSEQ") != NULL);
+            g_string_append_printf(conn->out, "%s OK STATUS completed\r\n",
+                                   tag);
+        } else {
+            g_string_append_printf(conn->out,
+                                   "%s NO [NONEXISTENT] no such mailbox\r\n",
+                                   tag);
+        }
+        g_free(name);
+    } else if(!g_ascii_strcasecmp(command, "LIST")) {
+        if(mock_imap_list(server, conn, args))
+            g_string_append_printf(conn->out, "%s OK LIST completed\r\n", tag);
+        else
+            g_string_append_printf(conn->out, "%s BAD bad LIST\r\n", tag);
+    } else if(!g_ascii_strcasecmp(command, "LOGOUT")) {
+        g_string_append_printf(conn->out, "* BYE logging out\r\n"
+                                          "%s OK LOGOUT completed\r\n", tag);
+        conn->closing = TRUE;
+    } else
+        g_string_append_printf(conn->out, "%s BAD unknown command\r\n", tag);
+}
+
+
+/*
+ * POP3
+ */
+
+/* answers one command.  called with the server locked. */
+static void
+mock_pop3_command(MockServer *server,
+                  MockConn *conn,
+                  gchar *line)
+{
+    const MockServerConfig *config = &server->config;
+    gchar *command = line, *arg, *p;
+    gboolean refused = FALSE;
+    guint i, msgno;
+
+    p = strchr(line, ' ');
+    if(p) {
+        *p = 0;
+        arg = p + 1;
+    } else
+        arg = NULL;
+
+    if(!mock_server_count_command(server, command, &refused)) {
+        conn->dropped = TRUE;
+        return;
+    }
+
+    if(refused) {
+        g_string_append_printf(conn->out, "-ERR %s failed on purpose\r\n",
+                               command);
+    } else if(!g_ascii_strcasecmp(command, "CAPA")) {
+        g_string_append(conn->out, "+OK\r\nUSER\r\nUIDL\r\n");
+        if(config->pop3_pipelining)
+            g_string_append(conn->out, "PIPELINING\r\n");
+        g_string_append(conn->out, ".\r\n");
+    } else if(!g_ascii_strcasecmp(command, "USER"))
+        g_string_append(conn->out, "+OK\r\n");
+    else if(!g_ascii_strcasecmp(command, "PASS"))
+        g_string_append(conn->out, "+OK logged in\r\n");
+    else if(!g_ascii_strcasecmp(command, "STAT")) {
+        g_string_append_printf(conn->out, "+OK %u %u\r\n", config->n_messages,
+                               config->n_messages * 1024);
+    } else if(!g_ascii_strcasecmp(command, "UIDL") && !arg) {
+        g_string_append(conn->out, "+OK\r\n");
+        for(i = 1; i <= config->n_messages; i++) {
+            g_string_append_printf(conn->out, "%u uid-%u\r\n", i,
+                                   config->first_uid + i - 1);
+        }
+        g_string_append(conn->out, ".\r\n");
+    } else if(!g_ascii_strcasecmp(command, "UIDL")) {
+        msgno = strtoul(arg, NULL, 10);
+        if(msgno >= 1 && msgno <= config->n_messages) {
+            g_string_append_printf(conn->out, "+OK %u uid-%u\r\n", msgno,
+                                   config->first_uid + msgno - 1);
+        } else
+            g_string_append(conn->out, "-ERR no such message\r\n");
+    } else if(!g_ascii_strcasecmp(command, "NOOP"))
+        g_string_append(conn->out, "+OK\r\n");
+    else if(!g_ascii_strcasecmp(command, "QUIT")) {
+        g_string_append(conn->out, "+OK bye\r\n");
+        conn->closing = TRUE;
+    } else
+        g_string_append(conn->out, "-ERR unknown command\r\n");
+}
+
+
+/*
+ * HTTP
+ */
+
+static gchar *
+mock_http_feed_new(MockServer *server)
+{
+    GString *feed = g_string_sized_new(1024);
+    guint i;
+
+    g_string_append_printf(feed,
+                           "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                           "<feed version=\"0.3\" xmlns=\"http://purl.org/atom/ns#\">\n"
+                           "<title>Gmail - Inbox for mock@example.com</title>\n"
+                           "<tagline>New messages in your Gmail Inbox</tagline>\n"
+                           "<fullcount>%u</fullcount>\n"
+                           "<link rel=\"alternate\" href=\"https://mail.google.com/mail\" type=\"text/html\" />\n"
+                           "<modified>2026-01-01T00:00:00Z</modified>\n",
+                           server->config.unseen);
+    for(i = 0; i < MIN(server->config.unseen, MOCK_FEED_ENTRIES); i++) {
+        g_string_append_printf(feed,
+                               "<entry>\n"
+                               "<title>Message %u</title>\n"
+                               "<summary>This is message number %u, and it says very little.</summary>\n"
+                               "<modified>2026-01-01T00:00:00Z</modified>\n"
+                               "<id>tag:gmail.google.com,2004:%u</id>\n"
+                               "<author><name>Sender</name><email>sender@example.com</email></author>\n"
+                               "</entry>\n",
+                               i + 1, i + 1, 1000000 + i);
+    }
+    g_string_append(feed, "</feed>\n");
+
+    return g_string_free(feed, FALSE);
+}
+
+#ifdef HAVE_ZLIB
+static GString *
+mock_http_gzip(const gchar *data,
+               gsize len)
+{
+    GString *gz = g_string_sized_new(len / 2 + 64);
+    gchar zbuf[MOCK_BUFSIZE];
+    z_stream zs;
+    gint zret;
+
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                 Z_DEFAULT_STRATEGY);
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+    do {
+        zs.next_out = (Bytef *)zbuf;
+        zs.avail_out = sizeof(zbuf);
+        zret = deflate(&zs, Z_FINISH);
+        g_string_append_len(gz, zbuf, sizeof(zbuf) - zs.avail_out);
+    } while(zret == Z_OK);
+    deflateEnd(&zs);
+
+    return gz;
+}
+#endif
+
+/* finds header |name| in a request head, returning a copy of its value */
+static gchar *
+mock_http_header(const gchar *head,
+                 const gchar *name)
+{
+    gsize name_len = strlen(name);
+    const gchar *p, *end;
+
+    for(p = strstr(head, "\r\n"); p; p = strstr(p, "\r\n")) {
+        p += 2;
+        if(!g_ascii_strncasecmp(p, name, name_len) && p[name_len] == ':') {
+            p += name_len + 1;
+            while(*p == ' ')
+                p++;
+            end = strstr(p, "\r\n");
+            return g_strndup(p, end ? (gsize)(end - p) : strlen(p));
+        }
+    }
+
+    return NULL;
+}
+
+/* answers one request, whose head (without the blank line) is |head|.
+ * called with the server locked. */
+static void
+mock_http_request(MockServer *server,
+                  MockConn *conn,
+                  gchar *head)
+{
+    const MockServerConfig *config = &server->config;
+    gchar *path, *p, *etag = NULL, *if_none_match, *value, *body;
+    gboolean refused = FALSE, gzip = FALSE;
+    GString *payload;
+
+    /* "GET <path> HTTP/1.1" */
+    path = strchr(head, ' ');
+    if(!path || strncmp(head, "GET ", 4)) {
+        g_string_append(conn->out, "HTTP/1.1 400 Bad Request\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n\r\n");
+        conn->closing = TRUE;
+        return;
+    }
+    path = g_strdup(path + 1);
+    if((p = strchr(path, ' ')))
+        *p = 0;
+
+    if(!mock_server_count_command(server, path, &refused)) {
+        conn->dropped = TRUE;
+        g_free(path);
+        return;
+    }
+
+    value = mock_http_header(head, "Connection");
+    if(value && strstr(value, "close"))
+        conn->closing = TRUE;
+    g_free(value);
+
+    if(refused) {
+        g_string_append(conn->out, "HTTP/1.1 503 Service Unavailable\r\n"
+                                   "Content-Length: 0\r\n\r\n");
+        g_free(path);
+        return;
+    }
+    if(config->http_path && strcmp(path, config->http_path)) {
+        g_string_append(conn->out, "HTTP/1.1 404 Not Found\r\n"
+                                   "Content-Length: 0\r\n\r\n");
+        g_free(path);
+        return;
+    }
+    g_free(path);
+
+    if(config->http_etag) {
+        etag = g_strdup_printf("\"mock-%u\"", server->generation);
+        if_none_match = mock_http_header(head, "If-None-Match");
+        if(if_none_match && !strcmp(if_none_match, etag)) {
+            g_string_append_printf(conn->out, "HTTP/1.1 304 Not Modified\r\n"
+                                              "ETag: %s\r\n\r\n", etag);
+            server->stats.not_modified++;
+            g_free(if_none_match);
+            g_free(etag);
+            return;
+        }
+        g_free(if_none_match);
+    }
+
+#ifdef HAVE_ZLIB
+    value = mock_http_header(head, "Accept-Encoding");
+    gzip = (config->http_gzip && value && strstr(value, "gzip"));
+    g_free(value);
+#endif
+
+    body = config->http_body ? g_strdup(config->http_body)
+                             : mock_http_feed_new(server);
+#ifdef HAVE_ZLIB
+    if(gzip) {
+        payload = mock_http_gzip(body, strlen(body));
+        g_free(body);
+    } else
+#endif
+        payload = g_string_new_len(body, strlen(body));
+
+    g_string_append_printf(conn->out, "HTTP/1.1 200 OK\r\n"
+                                      "Content-Type: %s\r\n",
+                           config->http_content_type
+                           ? config->http_content_type
+                           : "application/atom+xml; charset=UTF-8");
+    if(etag)
+        g_string_append_printf(conn->out, "ETag: %s\r\n", etag);
+    if(gzip)
+        g_string_append(conn->out, "Content-Encoding: gzip\r\n");
+
+    if(config->http_chunked) {
+        gsize pos, n;
+
+        g_string_append(conn->out, "Transfer-Encoding: chunked\r\n\r\n");
+        for(pos = 0; pos < payload->len; pos += n) {
+            n = MIN(MOCK_HTTP_CHUNK, payload->len - pos);
+            g_string_append_printf(conn->out, "%x\r\n", (guint)n);
+            g_string_append_len(conn->out, payload->str + pos, n);
+            g_string_append(conn->out, "\r\n");
+        }
+        g_string_append(conn->out, "0\r\n\r\n");
+    } else {
+        g_string_append_printf(conn->out, "Content-Length: %u\r\n\r\n",
+                               (guint)payload->len);
+        g_string_append_len(conn->out, payload->str, payload->len);
+    }
+
+    g_string_free(payload, TRUE);
+    g_free(etag);
+}
+
+
+/*
+ * connections
+ */
+
+/* answers every complete command in |conn->in| */
+static void
+mock_conn_process(MockConn *conn)
+{
+    MockServer *server = conn->server;
+    const gchar *terminator;
+    gchar *end, *line;
+
+    terminator = (server->config.protocol == MOCK_SERVER_HTTP)
+                 ? "\r\n\r\n" : "\r\n";
+
+    g_mutex_lock(server->mx);
+
+    while(!conn->closing && !conn->dropped && !conn->start_compression
+          && (end = strstr(conn->in->str, terminator)))
+    {
+        line = g_strndup(conn->in->str, end - conn->in->str);
+        g_string_erase(conn->in, 0, end - conn->in->str + strlen(terminator));
+
+        switch(server->config.protocol) {
+            case MOCK_SERVER_IMAP:
+                mock_imap_command(server, conn, line);
+                break;
+            case MOCK_SERVER_POP3:
+                mock_pop3_command(server, conn, line);
+                break;
+            case MOCK_SERVER_HTTP:
+                mock_http_request(server, conn, line);
+                break;
+        }
+
+        g_free(line);
+    }
+
+    g_mutex_unlock(server->mx);
+}
+
+#ifdef HAVE_SSL_SUPPORT
+static gboolean
+mock_conn_handshake(MockConn *conn)
+{
+    gint ret;
+
+    /* a client hanging up mustn't take the whole test down */
+#ifdef GNUTLS_NO_SIGNAL
+    gnutls_init(&conn->session, GNUTLS_SERVER | GNUTLS_NO_SIGNAL);
+#else
+    gnutls_init(&conn->session, GNUTLS_SERVER);
+#endif
+    gnutls_priority_set_direct(conn->session, "NORMAL", NULL);
+    gnutls_credentials_set(conn->session, GNUTLS_CRD_CERTIFICATE,
+                           conn->server->creds);
+    gnutls_transport_set_ptr(conn->session,
+                             (gnutls_transport_ptr_t)GINT_TO_POINTER(conn->fd));
+
+    do {
+        ret = gnutls_handshake(conn->session);
+    } while(ret < 0 && !gnutls_error_is_fatal(ret));
+
+    if(ret < 0) {
+        gnutls_deinit(conn->session);
+        return FALSE;
+    }
+
+    conn->secure = TRUE;
+
+    return TRUE;
+}
+#endif
+
+static gpointer
+mock_conn_th(gpointer user_data)
+{
+    MockConn *conn = user_data;
+    MockServer *server = conn->server;
+    MockServerProtocol protocol;
+    gboolean secure;
+
+    test_alloc_ignore_thread();
+
+    g_mutex_lock(server->mx);
+    protocol = server->config.protocol;
+    secure = server->config.secure;
+    g_mutex_unlock(server->mx);
+
+#ifdef HAVE_SSL_SUPPORT
+    if(secure && !mock_conn_handshake(conn))
+        goto out;
+#else
+    if(secure)
+        goto out;
+#endif
+
+    if(protocol == MOCK_SERVER_IMAP) {
+        g_mutex_lock(server->mx);
+        g_string_append_printf(conn->out, "* %s [CAPABILITY ",
+                               (server->config.imap_caps & MOCK_IMAP_PREAUTH)
+                               ? "PREAUTH" : "OK");
+        mock_imap_append_caps(server, conn->out);
+        g_string_append(conn->out, "] mock IMAP server ready\r\n");
+        g_mutex_unlock(server->mx);
+    } else if(protocol == MOCK_SERVER_POP3)
+        g_string_append(conn->out, "+OK mock POP3 server ready\r\n");
+
+    while(mock_conn_flush(conn) && !conn->closing
+          && mock_conn_read(conn))
+    {
+        mock_conn_process(conn);
+        if(conn->dropped)
+            break;
+
+#ifdef HAVE_ZLIB
+        if(conn->start_compression) {
+            if(!mock_conn_flush(conn))
+                break;
+            mock_conn_start_compression(conn);
+            conn->start_compression = FALSE;
+            /* anything else already read came in compressed */
+            if(conn->in->len) {
+                GString *in = conn->in;
+
+                conn->in = g_string_new(NULL);
+                conn->inflater.next_in = (Bytef *)in->str;
+                conn->inflater.avail_in = in->len;
+                while(conn->inflater.avail_in) {
+                    gchar zbuf[MOCK_BUFSIZE];
+
+                    conn->inflater.next_out = (Bytef *)zbuf;
+                    conn->inflater.avail_out = sizeof(zbuf);
+                    if(inflate(&conn->inflater, Z_SYNC_FLUSH) != Z_OK)
+                        break;
+                    g_string_append_len(conn->in, zbuf,
+                                        sizeof(zbuf) - conn->inflater.avail_out);
+                }
+                g_string_free(in, TRUE);
+                mock_conn_process(conn);
+            }
+        }
+#endif
+    }
+
+#ifdef HAVE_SSL_SUPPORT
+    if(conn->secure) {
+        if(!conn->dropped)
+            gnutls_bye(conn->session, GNUTLS_SHUT_WR);
+        gnutls_deinit(conn->session);
+    }
+#endif
+
+out:
+#ifdef HAVE_ZLIB
+    if(conn->compressed) {
+        inflateEnd(&conn->inflater);
+        deflateEnd(&conn->deflater);
+    }
+#endif
+
+    g_mutex_lock(server->mx);
+    server->conns = g_list_remove(server->conns, conn);
+    g_mutex_unlock(server->mx);
+
+    close(conn->fd);
+    g_string_free(conn->in, TRUE);
+    g_string_free(conn->out, TRUE);
+    g_free(conn);
+
+    return NULL;
+}
+
+static gpointer
+mock_server_accept_th(gpointer user_data)
+{
+    MockServer *server = user_data;
+    MockConn *conn;
+    GThread *th;
+    gint fd, one = 1;
+
+    test_alloc_ignore_thread();
+
+    for(;;) {
+        fd = accept(server->listen_fd, NULL, NULL);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        if(g_atomic_int_get(&server->stopping)) {
+            close(fd);
+            break;
+        }
+
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        conn = g_new0(MockConn, 1);
+        conn->server = server;
+        conn->fd = fd;
+        conn->in = g_string_sized_new(MOCK_BUFSIZE);
+        conn->out = g_string_sized_new(MOCK_BUFSIZE);
+
+        g_mutex_lock(server->mx);
+        server->stats.connections++;
+        server->conns = g_list_prepend(server->conns, conn);
+        g_mutex_unlock(server->mx);
+
+        th = g_thread_create(mock_conn_th, conn, TRUE, NULL);
+
+        g_mutex_lock(server->mx);
+        server->threads = g_list_prepend(server->threads, th);
+        g_mutex_unlock(server->mx);
+    }
+
+    return NULL;
+}
+
+#ifdef HAVE_SSL_SUPPORT
+/* a throwaway self-signed certificate; the mailboxes don't verify it */
+static gboolean
+mock_server_init_tls(MockServer *server)
+{
+    static const guchar serial[] = { 0x01 };
+    time_t now = time(NULL);
+
+    if(gnutls_x509_privkey_init(&server->key) < 0)
+        return FALSE;
+    if(gnutls_x509_privkey_generate(server->key, GNUTLS_PK_RSA, 2048, 0) < 0
+       || gnutls_x509_crt_init(&server->crt) < 0)
+    {
+        gnutls_x509_privkey_deinit(server->key);
+        return FALSE;
+    }
+
+    gnutls_x509_crt_set_version(server->crt, 3);
+    gnutls_x509_crt_set_serial(server->crt, serial, sizeof(serial));
+    gnutls_x509_crt_set_activation_time(server->crt, now - 3600);
+    gnutls_x509_crt_set_expiration_time(server->crt, now + 86400);
+    gnutls_x509_crt_set_dn_by_oid(server->crt, GNUTLS_OID_X520_COMMON_NAME,
+                                  0, "127.0.0.1", strlen("127.0.0.1"));
+    gnutls_x509_crt_set_key(server->crt, server->key);
+    if(gnutls_x509_crt_sign2(server->crt, server->crt, server->key,
+                             GNUTLS_DIG_SHA256, 0) < 0)
+    {
+        gnutls_x509_crt_deinit(server->crt);
+        gnutls_x509_privkey_deinit(server->key);
+        return FALSE;
+    }
+
+    gnutls_certificate_allocate_credentials(&server->creds);
+    gnutls_certificate_set_x509_key(server->creds, &server->crt, 1,
+                                    server->key);
+
+    return TRUE;
+}
+#endif
+
+static void
+mock_server_config_clear(MockServerConfig *config)
+{
+    g_free((gchar *)config->fail_command);
+    g_free((gchar *)config->http_path);
+    g_free((gchar *)config->http_body);
+    g_free((gchar *)config->http_content_type);
+    memset(config, 0, sizeof(*config));
+}
+
+static void
+mock_server_config_copy(MockServerConfig *dest,
+                        const MockServerConfig *src)
+{
+    *dest = *src;
+    dest->fail_command = g_strdup(src->fail_command);
+    dest->http_path = g_strdup(src->http_path);
+    dest->http_body = g_strdup(src->http_body);
+    dest->http_content_type = g_strdup(src->http_content_type);
+}
+
+MockServer *
+mock_server_new(const MockServerConfig *config)
+{
+    MockServer *server;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    gint one = 1;
+
+    g_return_val_if_fail(config, NULL);
+
+    server = g_new0(MockServer, 1);
+    server->mx = g_mutex_new();
+    mock_server_config_copy(&server->config, config);
+    server->drop_countdown = config->drop_after;
+
+#ifdef HAVE_SSL_SUPPORT
+    if(config->secure) {
+        gnutls_global_init();
+        if(!mock_server_init_tls(server)) {
+            g_warning("mock server: can't make a TLS certificate");
+            goto fail;
+        }
+    }
+#else
+    if(config->secure) {
+        g_warning("mock server: built without TLS support");
+        goto fail;
+    }
+#endif
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(server->listen_fd < 0)
+        goto fail;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if(bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+       || listen(server->listen_fd, 64) < 0
+       || getsockname(server->listen_fd, (struct sockaddr *)&addr,
+                      &addr_len) < 0)
+    {
+        close(server->listen_fd);
+        goto fail;
+    }
+    server->port = ntohs(addr.sin_port);
+
+    server->accept_th = g_thread_create(mock_server_accept_th, server, TRUE,
+                                        NULL);
+
+    return server;
+
+fail:
+    mock_server_config_clear(&server->config);
+    g_mutex_free(server->mx);
+    g_free(server);
+
+    return NULL;
+}
+
+void
+mock_server_configure(MockServer *server,
+                      const MockServerConfig *config)
+{
+    MockServerProtocol protocol;
+    gboolean secure;
+
+    g_return_if_fail(server && config);
+
+    g_mutex_lock(server->mx);
+
+    protocol = server->config.protocol;
+    secure = server->config.secure;
+    mock_server_config_clear(&server->config);
+    mock_server_config_copy(&server->config, config);
+    server->config.protocol = protocol;
+    server->config.secure = secure;
+    server->drop_countdown = config->drop_after;
+    server->generation++;
+
+    g_mutex_unlock(server->mx);
+}
+
+guint
+mock_server_get_port(MockServer *server)
+{
+    g_return_val_if_fail(server, 0);
+
+    return server->port;
+}
+
+void
+mock_server_get_stats(MockServer *server,
+                      MockServerStats *stats)
+{
+    g_return_if_fail(server && stats);
+
+    g_mutex_lock(server->mx);
+    *stats = server->stats;
+    g_mutex_unlock(server->mx);
+}
+
+void
+mock_server_destroy(MockServer *server)
+{
+    GList *l;
+
+    g_return_if_fail(server);
+
+    g_atomic_int_set(&server->stopping, TRUE);
+    shutdown(server->listen_fd, SHUT_RDWR);
+    g_thread_join(server->accept_th);
+    close(server->listen_fd);
+
+    g_mutex_lock(server->mx);
+    for(l = server->conns; l; l = l->next)
+        shutdown(((MockConn *)l->data)->fd, SHUT_RDWR);
+    g_mutex_unlock(server->mx);
+
+    for(l = server->threads; l; l = l->next)
+        g_thread_join(l->data);
+    g_list_free(server->threads);
+
+#ifdef HAVE_SSL_SUPPORT
+    if(server->config.secure) {
+        gnutls_certificate_free_credentials(server->creds);
+        gnutls_x509_crt_deinit(server->crt);
+        gnutls_x509_privkey_deinit(server->key);
+    }
+#endif
+
+    mock_server_config_clear(&server->config);
+    g_mutex_free(server->mx);
+    g_free(server);
+}
@@ -0,0 +1,114 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __MOCK_SERVER_H__
+#define __MOCK_SERVER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    MOCK_SERVER_IMAP = 0,
+    MOCK_SERVER_POP3,
+    MOCK_SERVER_HTTP,
+} MockServerProtocol;
+
+/* extensions the IMAP server offers */
+#define MOCK_IMAP_LIST_STATUS   (1 << 0)
+#define MOCK_IMAP_CONDSTORE     (1 << 1)
+#define MOCK_IMAP_COMPRESS      (1 << 2)
+#define MOCK_IMAP_SASL_IR       (1 << 3)  /* and AUTH=PLAIN */
+#define MOCK_IMAP_PREAUTH       (1 << 4)  /* no login needed */
+
+typedef struct _MockServer  MockServer;
+
+/* how the server behaves.  a test scripts a scenario by changing this
+ * between checks with mock_server_configure(), except for |protocol| and
+ * |secure|, which are fixed when the server starts.  strings are copied. */
+typedef struct
+{
+    MockServerProtocol protocol;
+    gboolean secure;  /* TLS from the first byte: imaps, pop3s or https */
+
+    /* the link.  the delay is paid once for each batch of commands the
+     * client sends, like a round trip, and replies trickle out at
+     * |throughput| bytes a second (0 for as fast as possible) */
+    guint latency_ms;
+    guint throughput;
+
+    /* failures.  the server hangs up once, after |drop_after| more commands
+     * (0 for never), and refuses every command (or HTTP path) that starts
+     * with |fail_command| */
+    guint drop_after;
+    const gchar *fail_command;
+
+    /* IMAP: "INBOX" and "folder1" to "folder<n_folders - 1>", each with
+     * |unseen| unseen messages */
+    guint n_folders;
+    guint imap_caps;  /* MOCK_IMAP_* */
+
+    /* POP3: |n_messages| messages, numbered from 1, whose UIDs count up
+     * from |first_uid|.  raising |first_uid| deletes messages from the
+     * front of the maildrop */
+    guint n_messages;
+    guint first_uid;
+    gboolean pop3_pipelining;
+
+    /* IMAP folders, and the <fullcount> of the default Atom feed */
+    guint unseen;
+
+    /* HTTP: the body served at |http_path|; NULL means a GMail-style Atom
+     * feed.  with |http_etag|, the body carries an ETag that changes
+     * whenever the server is reconfigured, and a matching If-None-Match
+     * gets a 304 */
+    const gchar *http_path;
+    const gchar *http_body;
+    const gchar *http_content_type;
+    gboolean http_etag;
+    gboolean http_chunked;
+    gboolean http_gzip;  /* if the client takes it */
+} MockServerConfig;
+
+typedef struct
+{
+    guint connections;  /* accepted */
+    guint commands;     /* command lines or HTTP requests */
+    guint not_modified; /* HTTP 304s */
+    guint64 bytes_sent;
+    guint64 bytes_received;
+} MockServerStats;
+
+/* starts a server on a free loopback port, in threads of its own */
+MockServer *mock_server_new(const MockServerConfig *config);
+
+void mock_server_configure(MockServer *server,
+                           const MockServerConfig *config);
+
+guint mock_server_get_port(MockServer *server);
+
+void mock_server_get_stats(MockServer *server,
+                           MockServerStats *stats);
+
+/* hangs up on every client and waits for the server threads to finish */
+void mock_server_destroy(MockServer *server);
+
+G_END_DECLS
+
+#endif  /* __MOCK_SERVER_H__ */
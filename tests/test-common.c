@@ -0,0 +1,591 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * what the tests share: a stand-in for the parts of the core the mailboxes
+ * report to, mailboxes set up the way the core sets them up, an allocation
+ * counter, and the bookkeeping for the numbers each test prints.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "mailwatch-utils.h"
+#include "test-common.h"
+
+static TestCoreState core_state;
+static gboolean verbose = FALSE;
+static guint n_failures = 0;
+static gchar *cache_dir = NULL;
+
+/* the counters of the connections the current check has finished with */
+static GStaticMutex collect_mx = G_STATIC_MUTEX_INIT;
+static XfceMailwatchNetConnStats collected;
+/* an HTTP connection lives across checks, so only what it did since the
+ * last check counts */
+static gboolean http_collected = FALSE;
+static gboolean http_open = FALSE;
+static XfceMailwatchNetConnStats http_now;
+static XfceMailwatchNetConnStats http_last;
+
+
+/*
+ * the core
+ */
+
+void
+xfce_mailwatch_signal_new_messages(XfceMailwatch *mailwatch,
+                                   XfceMailwatchMailbox *mailbox,
+                                   guint num_new_messages)
+{
+    core_state.n_signals++;
+    core_state.new_messages = num_new_messages;
+}
+
+void
+xfce_mailwatch_signal_new_messages_by_folder(XfceMailwatch *mailwatch,
+                                             XfceMailwatchMailbox *mailbox,
+                                             guint n_folders,
+                                             const gchar * const *folder_names,
+                                             const guint *num_new_messages)
+{
+    guint i;
+
+    core_state.n_signals++;
+    core_state.n_folders = n_folders;
+    core_state.new_messages = 0;
+    for(i = 0; i < n_folders; i++)
+        core_state.new_messages += num_new_messages[i];
+}
+
+void
+xfce_mailwatch_log_message(XfceMailwatch *mailwatch,
+                           XfceMailwatchMailbox *mailbox,
+                           XfceMailwatchLogLevel level,
+                           const gchar *fmt,
+                           ...)
+{
+    va_list args;
+    gchar *message;
+
+    if(level == XFCE_MAILWATCH_LOG_ERROR)
+        core_state.n_errors++;
+
+    if(!verbose)
+        return;
+
+    va_start(args, fmt);
+    message = g_strdup_vprintf(fmt, args);
+    va_end(args);
+    fprintf(stderr, "  [%s] %s\n",
+            level == XFCE_MAILWATCH_LOG_ERROR ? "error"
+            : level == XFCE_MAILWATCH_LOG_WARNING ? "warning" : "info",
+            message);
+    g_free(message);
+}
+
+void
+test_core_reset(void)
+{
+    memset(&core_state, 0, sizeof(core_state));
+}
+
+const TestCoreState *
+test_core_get(void)
+{
+    return &core_state;
+}
+
+
+/*
+ * mailboxes
+ */
+
+XfceMailwatchMailbox *
+test_mailbox_new(XfceMailwatchMailboxType *type,
+                 GList *params)
+{
+    XfceMailwatchMailbox *mailbox;
+    GList *l;
+
+    /* as the core does it */
+    mailbox = type->new_mailbox_func(NULL, type);
+    mailbox->type = type;
+    if(params)
+        type->restore_param_list_func(mailbox, params);
+
+    for(l = params; l; l = l->next) {
+        XfceMailwatchParam *param = l->data;
+
+        g_free(param->key);
+        g_free(param->value);
+        g_free(param);
+    }
+    g_list_free(params);
+
+    return mailbox;
+}
+
+void
+test_mailbox_free(XfceMailwatchMailbox *mailbox)
+{
+    mailbox->type->free_mailbox_func(mailbox);
+}
+
+GList *
+test_params_add(GList *params,
+                const gchar *key,
+                const gchar *fmt,
+                ...)
+{
+    XfceMailwatchParam *param;
+    va_list args;
+
+    param = g_new(XfceMailwatchParam, 1);
+    param->key = g_strdup(key);
+    va_start(args, fmt);
+    param->value = g_strdup_vprintf(fmt, args);
+    va_end(args);
+
+    return g_list_append(params, param);
+}
+
+GList *
+test_server_params(MockServer *server)
+{
+    GList *params = NULL;
+
+    params = test_params_add(params, "host", "127.0.0.1");
+    params = test_params_add(params, "username", "user");
+    params = test_params_add(params, "password", "secret");
+    params = test_params_add(params, "auth_type", "%d", AUTH_NONE);
+    params = test_params_add(params, "use_standard_port", "0");
+    params = test_params_add(params, "nonstandard_port", "%u",
+                             mock_server_get_port(server));
+
+    return params;
+}
+
+GList *
+test_folder_params(GList *params,
+                   guint n_folders)
+{
+    gchar *key;
+    guint i;
+
+    params = test_params_add(params, "n_newmail_boxes", "%u", n_folders);
+    for(i = 0; i < n_folders; i++) {
+        key = g_strdup_printf("newmail_box_%u", i);
+        if(i == 0)
+            params = test_params_add(params, key, "INBOX");
+        else
+            params = test_params_add(params, key, "folder%u", i);
+        g_free(key);
+    }
+
+    return params;
+}
+
+void
+test_server_config_init(MockServerConfig *config,
+                        MockServerProtocol protocol,
+                        const TestOptions *options)
+{
+    memset(config, 0, sizeof(*config));
+    config->protocol = protocol;
+    if(options) {
+        config->latency_ms = options->latency_ms;
+        config->throughput = options->throughput;
+    }
+}
+
+
+/*
+ * allocations.  glibc lets a program replace malloc() and friends, and
+ * everything it loads picks up the replacement.
+ */
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gint n_allocs = 0;
+static __thread gboolean alloc_ignored = FALSE;
+
+void *
+malloc(size_t size)
+{
+    if(!alloc_ignored)
+        g_atomic_int_inc(&n_allocs);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb,
+       size_t size)
+{
+    if(!alloc_ignored)
+        g_atomic_int_inc(&n_allocs);
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr,
+        size_t size)
+{
+    if(!alloc_ignored)
+        g_atomic_int_inc(&n_allocs);
+    return __libc_realloc(ptr, size);
+}
+
+gboolean
+test_alloc_supported(void)
+{
+    return TRUE;
+}
+
+guint64
+test_alloc_count(void)
+{
+    return (guint)g_atomic_int_get(&n_allocs);
+}
+
+void
+test_alloc_ignore_thread(void)
+{
+    alloc_ignored = TRUE;
+}
+#else
+gboolean
+test_alloc_supported(void)
+{
+    return FALSE;
+}
+
+guint64
+test_alloc_count(void)
+{
+    return 0;
+}
+
+void
+test_alloc_ignore_thread(void)
+{
+}
+#endif
+
+
+/*
+ * per-check numbers
+ */
+
+static void
+test_net_stats_add(XfceMailwatchNetConnStats *sum,
+                   const XfceMailwatchNetConnStats *stats)
+{
+    sum->bytes_sent += stats->bytes_sent;
+    sum->bytes_received += stats->bytes_received;
+    sum->send_calls += stats->send_calls;
+    sum->recv_calls += stats->recv_calls;
+    sum->select_calls += stats->select_calls;
+    sum->round_trips += stats->round_trips;
+    sum->plain_bytes_sent += stats->plain_bytes_sent;
+    sum->plain_bytes_received += stats->plain_bytes_received;
+    sum->connect_time += stats->connect_time;
+}
+
+static void
+test_net_stats_sub(XfceMailwatchNetConnStats *diff,
+                   const XfceMailwatchNetConnStats *stats)
+{
+    diff->bytes_sent -= stats->bytes_sent;
+    diff->bytes_received -= stats->bytes_received;
+    diff->send_calls -= stats->send_calls;
+    diff->recv_calls -= stats->recv_calls;
+    diff->select_calls -= stats->select_calls;
+    diff->round_trips -= stats->round_trips;
+    diff->plain_bytes_sent -= stats->plain_bytes_sent;
+    diff->plain_bytes_received -= stats->plain_bytes_received;
+    diff->connect_time -= stats->connect_time;
+}
+
+void
+test_add_net_stats(const XfceMailwatchNetConnStats *stats)
+{
+    g_static_mutex_lock(&collect_mx);
+    test_net_stats_add(&collected, stats);
+    g_static_mutex_unlock(&collect_mx);
+}
+
+void
+test_set_http_stats(const XfceMailwatchNetConnStats *stats,
+                    gboolean open)
+{
+    g_static_mutex_lock(&collect_mx);
+    http_collected = TRUE;
+    http_open = open;
+    if(open)
+        http_now = *stats;
+    g_static_mutex_unlock(&collect_mx);
+}
+
+static gdouble
+test_now(void)
+{
+    GTimeVal tv;
+
+    g_get_current_time(&tv);
+
+    return tv.tv_sec + (gdouble)tv.tv_usec / G_USEC_PER_SEC;
+}
+
+void
+test_check_begin(TestCheckStats *stats,
+                 MockServer *server)
+{
+    g_static_mutex_lock(&collect_mx);
+    memset(&collected, 0, sizeof(collected));
+    http_collected = FALSE;
+    g_static_mutex_unlock(&collect_mx);
+
+    test_core_reset();
+    if(server)
+        mock_server_get_stats(server, &stats->check_server);
+    stats->check_allocs = test_alloc_count();
+    stats->check_start = test_now();
+}
+
+void
+test_check_end(TestCheckStats *stats,
+               MockServer *server)
+{
+    MockServerStats server_stats;
+    XfceMailwatchNetConnStats delta;
+    guint connections = 0;
+
+    stats->elapsed += test_now() - stats->check_start;
+    stats->allocs += test_alloc_count() - stats->check_allocs;
+    stats->n_checks++;
+
+    if(server) {
+        mock_server_get_stats(server, &server_stats);
+        connections = server_stats.connections - stats->check_server.connections;
+        stats->connections += connections;
+    }
+
+    g_static_mutex_lock(&collect_mx);
+    if(http_collected) {
+        /* a new connection started from zero */
+        delta = http_now;
+        if(!connections)
+            test_net_stats_sub(&delta, &http_last);
+        test_net_stats_add(&collected, &delta);
+
+        if(http_open)
+            http_last = http_now;
+        else
+            memset(&http_last, 0, sizeof(http_last));
+    }
+    test_net_stats_add(&stats->net, &collected);
+    g_static_mutex_unlock(&collect_mx);
+}
+
+void
+test_stats_print(const TestCheckStats *stats)
+{
+    const XfceMailwatchNetConnStats *net = &stats->net;
+    gdouble n = MAX(stats->n_checks, 1);
+
+    /* every connection costs a socket() and a connect() as well */
+    printf("%-32s %u checks: %.2f ms, %.1f connections, %.1f round trips, "
+           "%.1f syscalls (%.1f send, %.1f recv, %.1f select), "
+           "%.0f bytes out, %.0f bytes in",
+           stats->name, stats->n_checks, stats->elapsed * 1000 / n,
+           stats->connections / n, net->round_trips / n,
+           (2 * stats->connections + net->send_calls + net->recv_calls
+            + net->select_calls) / n,
+           net->send_calls / n, net->recv_calls / n, net->select_calls / n,
+           net->bytes_sent / n, net->bytes_received / n);
+    if(test_alloc_supported())
+        printf(", %.0f allocations", stats->allocs / n);
+    printf(" per check\n");
+    fflush(stdout);
+}
+
+void
+test_check_run(TestCheckStats *stats,
+               MockServer *server,
+               gint *running,
+               gpointer *th,
+               GThreadFunc check_th,
+               gpointer mailbox)
+{
+    if(stats)
+        test_check_begin(stats, server);
+    else
+        test_core_reset();
+
+    /* and back again, so that freeing the mailbox doesn't try to stop
+     * a timeout that was never started */
+    g_atomic_int_set(running, TRUE);
+    g_atomic_pointer_set(th, mailbox);
+    check_th(mailbox);
+    g_atomic_int_set(running, FALSE);
+
+    if(stats)
+        test_check_end(stats, server);
+}
+
+
+/*
+ * running
+ */
+
+void
+test_expect(gboolean condition,
+            const gchar *fmt,
+            ...)
+{
+    va_list args;
+
+    if(condition)
+        return;
+
+    n_failures++;
+
+    va_start(args, fmt);
+    fprintf(stderr, "FAIL: ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+void
+test_expect_new(const gchar *name,
+                guint n_folders,
+                guint new_messages)
+{
+    test_expect(core_state.n_signals == 1, "%s: %u signals", name,
+                core_state.n_signals);
+    test_expect(core_state.n_folders == n_folders,
+                "%s: %u of %u folders reported", name, core_state.n_folders,
+                n_folders);
+    test_expect(core_state.new_messages == new_messages,
+                "%s: %u new messages, not %u", name, core_state.new_messages,
+                new_messages);
+}
+
+void
+test_expect_unreported(const gchar *name)
+{
+    test_expect(core_state.n_signals == 0, "%s: the check was reported",
+                name);
+}
+
+static void
+test_remove_tree(const gchar *path)
+{
+    GDir *dir;
+    const gchar *name;
+    gchar *child;
+
+    if((dir = g_dir_open(path, 0, NULL))) {
+        while((name = g_dir_read_name(dir))) {
+            child = g_build_filename(path, name, NULL);
+            test_remove_tree(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+        rmdir(path);
+    } else
+        unlink(path);
+}
+
+void
+test_init(gint *argc,
+          gchar ***argv,
+          TestOptions *options,
+          const gchar *description)
+{
+    GOptionEntry entries[] = {
+        { "iterations", 'n', 0, G_OPTION_ARG_INT, &options->iterations,
+          "Checks per scenario", "N" },
+        { "latency", 'l', 0, G_OPTION_ARG_INT, &options->latency_ms,
+          "Server delay per round trip", "MS" },
+        { "throughput", 't', 0, G_OPTION_ARG_INT, &options->throughput,
+          "Server bytes per second, 0 for no limit", "BPS" },
+        { "folders", 'f', 0, G_OPTION_ARG_INT, &options->folders,
+          "IMAP folders to watch", "N" },
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &options->verbose,
+          "Print what the mailboxes log", NULL },
+        { NULL }
+    };
+    GOptionContext *context;
+    GError *error = NULL;
+    gchar *tmpl;
+
+    if(!g_thread_supported())
+        g_thread_init(NULL);
+
+    context = g_option_context_new(NULL);
+    g_option_context_set_summary(context, description);
+    g_option_context_add_main_entries(context, entries, NULL);
+    if(!g_option_context_parse(context, argc, argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        exit(2);
+    }
+    g_option_context_free(context);
+
+    verbose = options->verbose;
+    options->iterations = MAX(options->iterations, 1);
+
+    /* the POP3 seen-sets and the IMAP folder cache go in here */
+    tmpl = g_build_filename(g_get_tmp_dir(), "mailwatch-test-XXXXXX", NULL);
+    cache_dir = mkdtemp(tmpl);
+    if(!cache_dir) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+}
+
+gint
+test_finish(void)
+{
+    if(cache_dir) {
+        test_remove_tree(cache_dir);
+        g_free(cache_dir);
+        cache_dir = NULL;
+    }
+
+    if(n_failures) {
+        fprintf(stderr, "%u expectation(s) failed\n", n_failures);
+        return 1;
+    }
+
+    return 0;
+}
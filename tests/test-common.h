@@ -0,0 +1,159 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __TEST_COMMON_H__
+#define __TEST_COMMON_H__
+
+#include <glib.h>
+
+#include "mailwatch.h"
+#include "mailwatch-net-conn.h"
+#include "mailwatch-http.h"
+#include "mock-server.h"
+
+G_BEGIN_DECLS
+
+/* what the mailboxes told the (fake) core */
+typedef struct
+{
+    guint n_signals;     /* new message signals */
+    guint new_messages;  /* from the last one */
+    guint n_folders;     /* from the last per-folder one */
+    guint n_errors;      /* logged */
+} TestCoreState;
+
+/* the cost of a run of checks against a mock server */
+typedef struct
+{
+    const gchar *name;
+    guint n_checks;
+    gdouble elapsed;
+    guint64 allocs;
+    guint connections;
+    XfceMailwatchNetConnStats net;
+
+    /* while a check is running */
+    gdouble check_start;
+    guint64 check_allocs;
+    MockServerStats check_server;
+} TestCheckStats;
+
+/* the options every test and benchmark takes */
+typedef struct
+{
+    gint iterations;
+    gint latency_ms;
+    gint throughput;
+    gint folders;
+    gboolean verbose;
+} TestOptions;
+
+void test_init(gint *argc,
+               gchar ***argv,
+               TestOptions *options,
+               const gchar *description);
+
+void test_core_reset(void);
+const TestCoreState *test_core_get(void);
+
+/* a mailbox of |type| set up from |params|, as if they had been saved;
+ * the list is freed */
+XfceMailwatchMailbox *test_mailbox_new(XfceMailwatchMailboxType *type,
+                                       GList *params);
+void test_mailbox_free(XfceMailwatchMailbox *mailbox);
+GList *test_params_add(GList *params,
+                       const gchar *key,
+                       const gchar *fmt,
+                       ...) G_GNUC_PRINTF(3, 4);
+/* what a mailbox needs to log in to |server| */
+GList *test_server_params(MockServer *server);
+/* watches the mock IMAP server's INBOX and folder1 up to |n_folders| */
+GList *test_folder_params(GList *params,
+                          guint n_folders);
+
+/* an empty |config| for |protocol|, slowed down as |options| says unless
+ * that's NULL */
+void test_server_config_init(MockServerConfig *config,
+                             MockServerProtocol protocol,
+                             const TestOptions *options);
+
+/* allocations made outside the mock servers, if they can be counted */
+gboolean test_alloc_supported(void);
+guint64 test_alloc_count(void);
+void test_alloc_ignore_thread(void);
+
+/* the counters of a connection a check has finished with, and of the
+ * HTTP connection as it stands after a check, if it's still |open| */
+void test_add_net_stats(const XfceMailwatchNetConnStats *stats);
+void test_set_http_stats(const XfceMailwatchNetConnStats *stats,
+                         gboolean open);
+
+/* take the place of the mailboxes' *_dump_stats() calls.  they're here so
+ * that only a test whose mailbox has connections links their code */
+static inline void
+test_collect_net_stats(XfceMailwatchNetConn *net_conn)
+{
+    XfceMailwatchNetConnStats stats;
+
+    xfce_mailwatch_net_conn_get_stats(net_conn, &stats);
+    test_add_net_stats(&stats);
+}
+
+static inline void
+test_collect_http_stats(XfceMailwatchHTTPConn *http_conn)
+{
+    XfceMailwatchNetConnStats stats;
+    gboolean open;
+
+    open = xfce_mailwatch_http_conn_get_stats(http_conn, &stats);
+    test_set_http_stats(&stats, open);
+}
+
+/* |server| is NULL for a mailbox that doesn't need one */
+void test_check_begin(TestCheckStats *stats,
+                      MockServer *server);
+void test_check_end(TestCheckStats *stats,
+                    MockServer *server);
+void test_stats_print(const TestCheckStats *stats);
+
+/* runs one check in this thread, as the mailbox's timeout would in a new
+ * one.  |running| and |th| are the mailbox's flags and |check_th| its
+ * thread function; |stats| is NULL when the cost doesn't matter */
+void test_check_run(TestCheckStats *stats,
+                    MockServer *server,
+                    gint *running,
+                    gpointer *th,
+                    GThreadFunc check_th,
+                    gpointer mailbox);
+
+/* records a failed expectation; test_finish() turns them into the exit
+ * status */
+void test_expect(gboolean condition,
+                 const gchar *fmt,
+                 ...) G_GNUC_PRINTF(2, 3);
+/* the last check reported |new_messages|, in |n_folders| folders unless
+ * that's 0, or reported nothing at all */
+void test_expect_new(const gchar *name,
+                     guint n_folders,
+                     guint new_messages);
+void test_expect_unreported(const gchar *name);
+gint test_finish(void);
+
+G_END_DECLS
+
+#endif  /* __TEST_COMMON_H__ */
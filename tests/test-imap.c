@@ -0,0 +1,267 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * runs imap_check_mail_th() against the mock IMAP server, checking what it
+ * reports and printing what each check cost.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test-common.h"
+
+#define xfce_mailwatch_net_conn_dump_stats(net_conn, what, elapsed) \
+    test_collect_net_stats(net_conn)
+#include "mailwatch-mailbox-imap.c"
+
+#define UNSEEN  3
+
+static TestOptions options = { 5, 0, 0, 16, FALSE };
+
+static XfceMailwatchIMAPMailbox *
+test_imap_mailbox_new(MockServer *server,
+                      guint n_folders,
+                      guint max_connections)
+{
+    GList *params;
+
+    params = test_server_params(server);
+    params = test_params_add(params, "max_connections", "%u", max_connections);
+    params = test_folder_params(params, n_folders);
+
+    return XFCE_MAILWATCH_IMAP_MAILBOX(test_mailbox_new(&builtin_mailbox_type_imap,
+                                                        params));
+}
+
+static void
+test_imap_check(XfceMailwatchIMAPMailbox *imailbox,
+                TestCheckStats *stats,
+                MockServer *server)
+{
+    test_check_run(stats, server, &imailbox->running, &imailbox->th,
+                   imap_check_mail_th, imailbox);
+}
+
+/* checks the same folders |options.iterations| times, expecting the full
+ * count every time */
+static void
+test_imap_scenario(const gchar *name,
+                   guint imap_caps,
+                   guint n_folders,
+                   guint max_connections,
+                   guint expect_connections)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchIMAPMailbox *imailbox;
+    gint i;
+
+    test_server_config_init(&config, MOCK_SERVER_IMAP, &options);
+    config.n_folders = n_folders;
+    config.imap_caps = imap_caps;
+    config.unseen = UNSEEN;
+    server = mock_server_new(&config);
+
+    imailbox = test_imap_mailbox_new(server, n_folders, max_connections);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = name;
+    for(i = 0; i < options.iterations; i++) {
+        guint connections = stats.connections;
+
+        test_imap_check(imailbox, &stats, server);
+        test_expect_new(name, n_folders, n_folders * UNSEEN);
+        test_expect(stats.connections - connections == expect_connections,
+                    "%s: %u connections, not %u", name,
+                    stats.connections - connections, expect_connections);
+    }
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(imailbox));
+    mock_server_destroy(server);
+}
+
+/* once the first check has seen COMPRESS=DEFLATE offered, every check
+ * after it reads its replies compressed, logging in first if it has to */
+static void
+test_imap_compress(const gchar *name,
+                   guint imap_caps)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchIMAPMailbox *imailbox;
+    gint i;
+
+    test_server_config_init(&config, MOCK_SERVER_IMAP, &options);
+    config.n_folders = options.folders;
+    config.imap_caps = imap_caps | MOCK_IMAP_COMPRESS;
+    config.unseen = UNSEEN;
+    server = mock_server_new(&config);
+
+    imailbox = test_imap_mailbox_new(server, options.folders, 1);
+
+    memset(&stats, 0, sizeof(stats));
+    test_imap_check(imailbox, &stats, server);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = name;
+    for(i = 0; i < options.iterations; i++) {
+        XfceMailwatchNetConnStats net = stats.net;
+
+        test_imap_check(imailbox, &stats, server);
+        test_expect_new(name, options.folders, options.folders * UNSEEN);
+        test_expect(stats.net.plain_bytes_received - net.plain_bytes_received
+                    > stats.net.bytes_received - net.bytes_received,
+                    "%s: check %d wasn't compressed", name, i + 2);
+    }
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(imailbox));
+    mock_server_destroy(server);
+}
+
+/* a CONDSTORE server lets an unchanged mailbox go unreported */
+static void
+test_imap_condstore(void)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchIMAPMailbox *imailbox;
+    gint i;
+
+    test_server_config_init(&config, MOCK_SERVER_IMAP, &options);
+    config.n_folders = options.folders;
+    config.imap_caps = MOCK_IMAP_LIST_STATUS | MOCK_IMAP_CONDSTORE;
+    config.unseen = UNSEEN;
+    server = mock_server_new(&config);
+
+    imailbox = test_imap_mailbox_new(server, options.folders, 1);
+
+    /* the first check finds out what the server offers, and the second
+     * gets the mod-sequences to compare against */
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "IMAP CONDSTORE, first checks";
+    for(i = 0; i < 2; i++) {
+        test_imap_check(imailbox, &stats, server);
+        test_expect_new(stats.name, options.folders, options.folders * UNSEEN);
+    }
+    test_stats_print(&stats);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "IMAP CONDSTORE, unchanged";
+    for(i = 0; i < options.iterations; i++) {
+        test_imap_check(imailbox, &stats, server);
+        test_expect_unreported(stats.name);
+    }
+    test_stats_print(&stats);
+
+    /* new mail bumps every folder's HIGHESTMODSEQ */
+    config.unseen = UNSEEN + 1;
+    mock_server_configure(server, &config);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "IMAP CONDSTORE, changed";
+    test_imap_check(imailbox, &stats, server);
+    test_expect_new(stats.name, options.folders,
+                    options.folders * (UNSEEN + 1));
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(imailbox));
+    mock_server_destroy(server);
+}
+
+/* a refused LIST-STATUS falls back to STATUS; a dropped connection fails
+ * the check, and the next one recovers */
+static void
+test_imap_failures(void)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchIMAPMailbox *imailbox;
+
+    test_server_config_init(&config, MOCK_SERVER_IMAP, NULL);
+    config.n_folders = options.folders;
+    config.imap_caps = MOCK_IMAP_LIST_STATUS;
+    config.unseen = UNSEEN;
+    server = mock_server_new(&config);
+
+    imailbox = test_imap_mailbox_new(server, options.folders, 1);
+
+    /* only once it knows about LIST-STATUS does the mailbox use it */
+    memset(&stats, 0, sizeof(stats));
+    test_imap_check(imailbox, &stats, server);
+
+    config.fail_command = "LIST";
+    mock_server_configure(server, &config);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "IMAP LIST-STATUS refused";
+    test_imap_check(imailbox, &stats, server);
+    test_expect_new(stats.name, options.folders, options.folders * UNSEEN);
+    test_stats_print(&stats);
+
+    config.fail_command = NULL;
+    config.drop_after = 2;
+    mock_server_configure(server, &config);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "IMAP dropped connection";
+    test_imap_check(imailbox, &stats, server);
+    test_expect_unreported(stats.name);
+    test_imap_check(imailbox, &stats, server);
+    test_expect_new(stats.name, options.folders, options.folders * UNSEEN);
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(imailbox));
+    mock_server_destroy(server);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+    test_init(&argc, &argv, &options,
+              "Checks the IMAP mailbox against a mock server.");
+
+    test_imap_scenario("IMAP STATUS", 0, options.folders, 1, 1);
+    test_imap_scenario("IMAP LIST-STATUS", MOCK_IMAP_LIST_STATUS,
+                       options.folders, 1, 1);
+    test_imap_scenario("IMAP SASL-IR", MOCK_IMAP_LIST_STATUS | MOCK_IMAP_SASL_IR,
+                       options.folders, 1, 1);
+#ifdef HAVE_ZLIB
+    test_imap_compress("IMAP COMPRESS", MOCK_IMAP_LIST_STATUS);
+    test_imap_compress("IMAP COMPRESS, PREAUTH",
+                       MOCK_IMAP_LIST_STATUS | MOCK_IMAP_PREAUTH);
+#endif
+    /* 96 folders are worth three connections of 32 */
+    test_imap_scenario("IMAP 96 folders, 4 connections", MOCK_IMAP_LIST_STATUS,
+                       96, 4, 3);
+    test_imap_condstore();
+    test_imap_failures();
+
+    return test_finish();
+}
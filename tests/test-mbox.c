@@ -0,0 +1,559 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * runs mbox_check_mail() on small spools as they're delivered to, edited,
+ * cut down and locked, checking that what the index lets it skip doesn't
+ * change the count.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "test-common.h"
+
+#include "mailwatch-mailbox-mbox.c"
+
+#define N_MESSAGES  40
+
+static TestOptions options = { 1, 0, 0, 0, FALSE };
+
+/* what a spool should hold; the messages are made up from this, so the
+ * same message always comes out as the same bytes */
+typedef struct
+{
+    guint n;
+    gboolean is_new;
+} TestMessage;
+
+typedef struct
+{
+    GArray *messages;  /* of TestMessage */
+    gsize body_len;
+} TestSpool;
+
+static XfceMailwatchMboxMailbox *
+test_mbox_mailbox_new(const gchar *source,
+                      gboolean fast)
+{
+    GList *params = NULL;
+
+    params = test_params_add(params, "filename", "%s", source);
+    params = test_params_add(params, "fast", "%d", fast);
+
+    return XFCE_MAILWATCH_MBOX_MAILBOX(test_mailbox_new(&builtin_mailbox_type_mbox,
+                                                        params));
+}
+
+static guint
+test_mbox_check(XfceMailwatchMboxMailbox *mbox)
+{
+    test_check_run(NULL, NULL, &mbox->running, &mbox->thread,
+                   mbox_check_mail_thread, mbox);
+
+    return test_core_get()->new_messages;
+}
+
+static gchar *
+test_mbox_path(const gchar *name)
+{
+    return g_build_filename(g_get_user_cache_dir(), name, NULL);
+}
+
+static void
+test_mbox_append_message(GString *out,
+                         guint n,
+                         gboolean is_new,
+                         gsize body_len)
+{
+    gsize start;
+
+    g_string_append_printf(out,
+                           "From sender%u@example.com Thu Jan  1 00:00:00 2026\n"
+                           "From: Sender %u <sender%u@example.com>\n"
+                           "To: user@example.org\n"
+                           "Subject: Message %u\n"
+                           "X-Mozilla-Status: %s\n"
+                           "\n",
+                           n, n, n, n, is_new ? "0000" : "0001");
+    start = out->len;
+    while(out->len - start < body_len)
+        g_string_append_printf(out, "Line %u of message %u.\n",
+                               (guint)(out->len - start), n);
+    g_string_append_c(out, '\n');
+}
+
+static TestSpool *
+test_spool_new(gsize body_len)
+{
+    TestSpool *spool = g_new0(TestSpool, 1);
+
+    spool->messages = g_array_new(FALSE, FALSE, sizeof(TestMessage));
+    spool->body_len = body_len;
+
+    return spool;
+}
+
+static void
+test_spool_free(TestSpool *spool)
+{
+    g_array_free(spool->messages, TRUE);
+    g_free(spool);
+}
+
+static TestMessage *
+test_spool_message(TestSpool *spool,
+                   guint i)
+{
+    return &g_array_index(spool->messages, TestMessage, i);
+}
+
+/* adds a message to the model, and to out if that's set */
+static void
+test_spool_add(TestSpool *spool,
+               gboolean is_new,
+               GString *out)
+{
+    TestMessage msg;
+
+    msg.n = spool->messages->len ? test_spool_message(spool, spool->messages->len - 1)->n + 1 : 0;
+    msg.is_new = is_new;
+    g_array_append_val(spool->messages, msg);
+    if(out)
+        test_mbox_append_message(out, msg.n, is_new, spool->body_len);
+}
+
+static guint
+test_spool_count(TestSpool *spool)
+{
+    guint i, count = 0;
+
+    for(i = 0; i < spool->messages->len; i++) {
+        if(test_spool_message(spool, i)->is_new)
+            count++;
+    }
+
+    return count;
+}
+
+/* writes the spool over the same file, the way a mail client rewrites
+ * it, rather than replacing it */
+static void
+test_spool_write(TestSpool *spool,
+                 const gchar *filename)
+{
+    GString *out = g_string_new(NULL);
+    TestMessage *msg;
+    FILE *fp;
+    guint i;
+
+    for(i = 0; i < spool->messages->len; i++) {
+        msg = test_spool_message(spool, i);
+        test_mbox_append_message(out, msg->n, msg->is_new, spool->body_len);
+    }
+
+    fp = fopen(filename, "r+");
+    if(!fp)
+        fp = fopen(filename, "w");
+    test_expect(fp && fwrite(out->str, 1, out->len, fp) == out->len
+                && !fclose(fp) && !truncate(filename, out->len),
+                "can't write %s", filename);
+    g_string_free(out, TRUE);
+}
+
+static void
+test_file_write(const gchar *filename,
+                const gchar *mode,
+                const gchar *contents)
+{
+    FILE *fp = fopen(filename, mode);
+
+    test_expect(fp && fputs(contents, fp) >= 0 && !fclose(fp),
+                "can't write %s", filename);
+}
+
+/* so that the next mailbox on the same spool starts from scratch */
+static void
+test_mbox_forget(const gchar *filename)
+{
+    gchar *index_filename = mbox_index_filename(filename);
+
+    unlink(index_filename);
+    g_free(index_filename);
+}
+
+static ino_t
+test_mbox_index_inode(const gchar *filename)
+{
+    gchar *index_filename = mbox_index_filename(filename);
+    struct stat st;
+
+    if(stat(index_filename, &st) < 0)
+        st.st_ino = 0;
+    g_free(index_filename);
+
+    return st.st_ino;
+}
+
+/* delivery, marking a message read in place, deleting one and cutting the
+ * spool short all come out the same as counting from scratch.  with small
+ * bodies it's cheaper to scan again than read the new messages' headers
+ * again; with large ones it's the other way round. */
+static void
+test_mbox_edits(const gchar *name,
+                gsize body_len)
+{
+    XfceMailwatchMboxMailbox *mbox;
+    TestSpool *spool;
+    GString *out;
+    gchar *filename;
+    guint count, i;
+    ino_t inode;
+
+    filename = test_mbox_path("edits");
+    spool = test_spool_new(body_len);
+    for(i = 0; i < N_MESSAGES; i++)
+        test_spool_add(spool, i % 2 == 0, NULL);
+    test_spool_write(spool, filename);
+
+    mbox = test_mbox_mailbox_new(filename, FALSE);
+
+    count = test_mbox_check(mbox);
+    test_expect(count == test_spool_count(spool), "%s: %u new messages, not %u",
+                name, count, test_spool_count(spool));
+
+    /* unless it was cheaper to scan it all again, a delivery only adds
+     * to the index */
+    inode = test_mbox_index_inode(filename);
+    out = g_string_new(NULL);
+    test_spool_add(spool, TRUE, out);
+    test_file_write(filename, "a", out->str);
+    g_string_free(out, TRUE);
+    count = test_mbox_check(mbox);
+    test_expect(count == test_spool_count(spool),
+                "%s: %u new messages after a delivery, not %u", name, count,
+                test_spool_count(spool));
+    test_expect(body_len < MBOX_REREAD_COST
+                || (inode && test_mbox_index_inode(filename) == inode),
+                "%s: the index was written anew after a delivery", name);
+
+    /* the same size, so only the headers tell */
+    for(i = 4; i < N_MESSAGES; i += 10)
+        test_spool_message(spool, i)->is_new = FALSE;
+    test_spool_write(spool, filename);
+    count = test_mbox_check(mbox);
+    test_expect(count == test_spool_count(spool),
+                "%s: %u new messages after marking some read, not %u", name,
+                count, test_spool_count(spool));
+
+    /* everything after it moves up */
+    g_array_remove_index(spool->messages, 10);
+    test_spool_write(spool, filename);
+    count = test_mbox_check(mbox);
+    test_expect(count == test_spool_count(spool),
+                "%s: %u new messages after a deletion, not %u", name, count,
+                test_spool_count(spool));
+
+    g_array_set_size(spool->messages, N_MESSAGES / 2 + 1);
+    test_spool_write(spool, filename);
+    count = test_mbox_check(mbox);
+    test_expect(count == test_spool_count(spool),
+                "%s: %u new messages after a truncation, not %u", name, count,
+                test_spool_count(spool));
+
+    /* and what was saved agrees */
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+    mbox = test_mbox_mailbox_new(filename, FALSE);
+    count = test_mbox_check(mbox);
+    test_expect(count == test_spool_count(spool),
+                "%s: %u new messages from the saved index, not %u", name, count,
+                test_spool_count(spool));
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+    test_mbox_forget(filename);
+    unlink(filename);
+    g_free(filename);
+    test_spool_free(spool);
+}
+
+/* a body that says how long it is can hold unquoted From lines, but a
+ * length that doesn't end where a message does is ignored */
+static void
+test_mbox_content_length(void)
+{
+    static const struct {
+        const gchar *name;
+        const gchar *length;
+        guint count;
+    } lengths[] = {
+        { "right Content-Length", "57", 2 },
+        { "short Content-Length", "20", 3 },
+        { "long Content-Length", "70", 3 },
+        { "Content-Length past the end", "100000", 3 },
+        { "bad Content-Length", "many", 3 },
+    };
+    XfceMailwatchMboxMailbox *mbox;
+    gchar *filename, *contents;
+    guint count, i;
+
+    filename = test_mbox_path("content-length");
+    for(i = 0; i < G_N_ELEMENTS(lengths); i++) {
+        /* the body is 57 bytes, up to the blank line */
+        contents = g_strdup_printf("From a@example.com Thu Jan  1 00:00:00 2026\n"
+                                   "Subject: quoting\n"
+                                   "Content-Length: %s\n"
+                                   "\n"
+                                   "Said:\n"
+                                   "From b@example.com Thu Jan  1 2026\n"
+                                   "Subject: quoted\n"
+                                   "\n"
+                                   "From c@example.com Thu Jan  1 00:00:00 2026\n"
+                                   "Subject: after\n"
+                                   "\n"
+                                   "New.\n",
+                                   lengths[i].length);
+        test_file_write(filename, "w", contents);
+        g_free(contents);
+
+        mbox = test_mbox_mailbox_new(filename, FALSE);
+        count = test_mbox_check(mbox);
+        test_expect(count == lengths[i].count, "%s: %u new messages, not %u",
+                    lengths[i].name, count, lengths[i].count);
+
+        test_file_write(filename, "a",
+                        "\n"
+                        "From d@example.com Thu Jan  1 00:00:00 2026\n"
+                        "\n"
+                        "Also new.\n");
+        count = test_mbox_check(mbox);
+        test_expect(count == lengths[i].count + 1,
+                    "%s: %u new messages after a delivery, not %u",
+                    lengths[i].name, count, lengths[i].count + 1);
+
+        test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+        test_mbox_forget(filename);
+    }
+    unlink(filename);
+    g_free(filename);
+}
+
+/* a spool that's locked keeps its last count until the lock goes away, or
+ * has been there too long */
+static void
+test_mbox_locked(void)
+{
+    XfceMailwatchMboxMailbox *mbox;
+    MboxFile *file;
+    TestSpool *spool;
+    gchar *filename, *lock_filename;
+    GString *out;
+    guint count;
+
+    filename = test_mbox_path("locked");
+    lock_filename = g_strconcat(filename, ".lock", NULL);
+    spool = test_spool_new(100);
+    test_spool_add(spool, FALSE, NULL);
+    test_spool_add(spool, TRUE, NULL);
+    test_spool_write(spool, filename);
+
+    mbox = test_mbox_mailbox_new(filename, FALSE);
+    count = test_mbox_check(mbox);
+    test_expect(count == 1, "locked: %u new messages, not 1", count);
+
+    test_file_write(lock_filename, "w", "");
+    out = g_string_new(NULL);
+    test_spool_add(spool, TRUE, out);
+    test_file_write(filename, "a", out->str);
+
+    count = test_mbox_check(mbox);
+    test_expect(count == 1, "locked: %u new messages while locked, not 1",
+                count);
+    test_expect(mbox->retry_id != 0, "locked: no retry was scheduled");
+
+    /* still locked, long enough to give up on it */
+    file = mbox->files->data;
+    file->busy_since -= MBOX_WRITE_WAIT + 1;
+    count = test_mbox_check(mbox);
+    test_expect(count == 2, "locked: %u new messages after waiting, not 2",
+                count);
+
+    /* a delivery under the same lock waits again */
+    g_string_truncate(out, 0);
+    test_spool_add(spool, TRUE, out);
+    test_file_write(filename, "a", out->str);
+    count = test_mbox_check(mbox);
+    test_expect(count == 2, "locked: %u new messages after a delivery, not 2",
+                count);
+
+    /* as does one that isn't finished when the lock goes away */
+    unlink(lock_filename);
+    test_file_write(filename, "a", "From f@example.com Thu Jan  1 00:00:00 2026\n"
+                                   "Subject: half");
+    count = test_mbox_check(mbox);
+    test_expect(count == 2, "locked: %u new messages while half written, not 2",
+                count);
+    test_file_write(filename, "a", " written\n\nNew.\n");
+    count = test_mbox_check(mbox);
+    test_expect(count == 4, "locked: %u new messages once written, not 4",
+                count);
+
+    g_string_free(out, TRUE);
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+    test_mbox_forget(filename);
+    unlink(filename);
+    g_free(lock_filename);
+    g_free(filename);
+    test_spool_free(spool);
+}
+
+static void
+test_mbox_set_times(const gchar *filename,
+                    time_t atime,
+                    time_t mtime)
+{
+    struct timeval tv[2];
+
+    tv[0].tv_sec = atime;
+    tv[0].tv_usec = 0;
+    tv[1].tv_sec = mtime;
+    tv[1].tv_usec = 0;
+    test_expect(utimes(filename, tv) == 0, "can't set the times of %s",
+                filename);
+}
+
+/* fast mode says there's new mail when the spool was written after it was
+ * read, and only counts when asked to */
+static void
+test_mbox_fast(void)
+{
+    XfceMailwatchMboxMailbox *mbox;
+    TestSpool *spool;
+    gchar *filename;
+    guint count;
+
+    filename = test_mbox_path("fast");
+    spool = test_spool_new(100);
+    test_spool_add(spool, TRUE, NULL);
+    test_spool_add(spool, FALSE, NULL);
+    test_spool_add(spool, TRUE, NULL);
+    test_spool_add(spool, TRUE, NULL);
+    test_spool_write(spool, filename);
+    test_mbox_set_times(filename, 1000000000, 1000000100);
+
+    mbox = test_mbox_mailbox_new(filename, TRUE);
+
+    count = test_mbox_check(mbox);
+    test_expect(count == 1, "fast: %u new messages, not 1", count);
+
+    g_atomic_int_set(&mbox->count_requested, TRUE);
+    count = test_mbox_check(mbox);
+    test_expect(count == 3, "fast: %u new messages when counting, not 3",
+                count);
+
+    /* the count holds until the spool changes */
+    count = test_mbox_check(mbox);
+    test_expect(count == 3, "fast: %u new messages after counting, not 3",
+                count);
+
+    test_mbox_set_times(filename, 1000000200, 1000000100);
+    count = test_mbox_check(mbox);
+    test_expect(count == 0, "fast: %u new messages once read, not 0", count);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+    test_mbox_forget(filename);
+    unlink(filename);
+    g_free(filename);
+    test_spool_free(spool);
+}
+
+/* a directory or a pattern watches each spool in it, reported like
+ * folders; lock files and dotfiles aren't spools */
+static void
+test_mbox_sources(void)
+{
+    static const struct {
+        const gchar *name;
+        guint count;
+    } files[] = {
+        { "inbox.mbox", 2 },
+        { "lists.mbox", 1 },
+        { "notes", 1 },
+        { ".hidden.mbox", 1 },
+        { "spool.lock", 1 },
+    };
+    XfceMailwatchMboxMailbox *mbox;
+    GString *out;
+    gchar *dirname, *filename, *pattern;
+    guint i, j;
+
+    dirname = test_mbox_path("spools");
+    mkdir(dirname, 0700);
+    for(i = 0; i < G_N_ELEMENTS(files); i++) {
+        out = g_string_new(NULL);
+        for(j = 0; j < files[i].count; j++)
+            test_mbox_append_message(out, j, TRUE, 100);
+        test_mbox_append_message(out, j, FALSE, 100);
+        filename = g_build_filename(dirname, files[i].name, NULL);
+        test_file_write(filename, "w", out->str);
+        g_free(filename);
+        g_string_free(out, TRUE);
+    }
+
+    mbox = test_mbox_mailbox_new(dirname, FALSE);
+    test_mbox_check(mbox);
+    test_expect_new("mbox directory", 3, 4);
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+
+    pattern = g_build_filename(dirname, "*.mbox", NULL);
+    mbox = test_mbox_mailbox_new(pattern, FALSE);
+    test_mbox_check(mbox);
+    test_expect_new("mbox pattern", 2, 3);
+
+    /* a spool that goes away stops being counted */
+    filename = g_build_filename(dirname, files[0].name, NULL);
+    unlink(filename);
+    g_free(filename);
+    test_mbox_check(mbox);
+    test_expect_new("mbox pattern, a spool removed", 1, 1);
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(mbox));
+
+    g_free(pattern);
+    g_free(dirname);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+    test_init(&argc, &argv, &options,
+              "Checks the mbox mailbox's counts as spools change under it.");
+
+    test_mbox_edits("mbox, short messages", 64);
+    test_mbox_edits("mbox, long messages", 64 * 1024);
+    test_mbox_content_length();
+    test_mbox_locked();
+    test_mbox_fast();
+    test_mbox_sources();
+
+    return test_finish();
+}
@@ -0,0 +1,193 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * runs pop3_check_mail_th() against the mock POP3 server, checking what it
+ * reports and printing what each check cost.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test-common.h"
+
+#define xfce_mailwatch_net_conn_dump_stats(net_conn, what, elapsed) \
+    test_collect_net_stats(net_conn)
+#include "mailwatch-mailbox-pop3.c"
+
+#define N_MESSAGES  200
+
+static TestOptions options = { 5, 0, 0, 0, FALSE };
+
+static XfceMailwatchPOP3Mailbox *
+test_pop3_mailbox_new(MockServer *server)
+{
+    return XFCE_MAILWATCH_POP3_MAILBOX(test_mailbox_new(&builtin_mailbox_type_pop3,
+                                                        test_server_params(server)));
+}
+
+static void
+test_pop3_check(XfceMailwatchPOP3Mailbox *pmailbox,
+                TestCheckStats *stats,
+                MockServer *server)
+{
+    test_check_run(stats, server, &pmailbox->running, &pmailbox->th,
+                   pop3_check_mail_th, pmailbox);
+}
+
+/* new mail arrives between checks, old mail is deleted, and the user reads
+ * what's new */
+static void
+test_pop3_scenario(const gchar *name,
+                   gboolean pipelining)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchPOP3Mailbox *pmailbox;
+    gchar *stats_name;
+    guint new_messages = 0;
+    gint i;
+
+    test_server_config_init(&config, MOCK_SERVER_POP3, &options);
+    config.n_messages = N_MESSAGES;
+    config.first_uid = 1;
+    config.pop3_pipelining = pipelining;
+    server = mock_server_new(&config);
+
+    pmailbox = test_pop3_mailbox_new(server);
+
+    /* what's there already has been seen */
+    memset(&stats, 0, sizeof(stats));
+    stats_name = g_strconcat(name, ", first check", NULL);
+    stats.name = stats_name;
+    test_pop3_check(pmailbox, &stats, server);
+    test_expect_new(stats.name, 0, 0);
+    test_stats_print(&stats);
+    g_free(stats_name);
+
+    memset(&stats, 0, sizeof(stats));
+    stats_name = g_strconcat(name, ", unchanged", NULL);
+    stats.name = stats_name;
+    for(i = 0; i < options.iterations; i++) {
+        test_pop3_check(pmailbox, &stats, server);
+        test_expect_new(stats.name, 0, 0);
+    }
+    test_stats_print(&stats);
+    g_free(stats_name);
+
+    memset(&stats, 0, sizeof(stats));
+    stats_name = g_strconcat(name, ", new mail", NULL);
+    stats.name = stats_name;
+    for(i = 0; i < options.iterations; i++) {
+        config.n_messages += 2;
+        new_messages += 2;
+        mock_server_configure(server, &config);
+
+        test_pop3_check(pmailbox, &stats, server);
+        test_expect_new(stats.name, 0, new_messages);
+    }
+    test_stats_print(&stats);
+    g_free(stats_name);
+
+    /* the oldest messages go, the new ones are still new */
+    memset(&stats, 0, sizeof(stats));
+    stats_name = g_strconcat(name, ", old mail deleted", NULL);
+    stats.name = stats_name;
+    config.first_uid += 10;
+    config.n_messages -= 10;
+    mock_server_configure(server, &config);
+    test_pop3_check(pmailbox, &stats, server);
+    test_expect_new(stats.name, 0, new_messages);
+    test_stats_print(&stats);
+    g_free(stats_name);
+
+    g_atomic_int_set(&pmailbox->mark_seen, TRUE);
+    test_pop3_check(pmailbox, &stats, server);
+    test_expect_new("POP3 marked seen", 0, 0);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(pmailbox));
+    mock_server_destroy(server);
+}
+
+/* a server without UIDL gets a STAT; a dropped connection fails the check,
+ * and the next one recovers */
+static void
+test_pop3_failures(void)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchPOP3Mailbox *pmailbox;
+
+    test_server_config_init(&config, MOCK_SERVER_POP3, NULL);
+    config.n_messages = N_MESSAGES;
+    config.first_uid = 1;
+    config.fail_command = "UIDL";
+    server = mock_server_new(&config);
+
+    pmailbox = test_pop3_mailbox_new(server);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "POP3 UIDL refused";
+    test_pop3_check(pmailbox, &stats, server);
+    test_expect_new(stats.name, 0, N_MESSAGES);
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(pmailbox));
+
+    config.fail_command = NULL;
+    mock_server_configure(server, &config);
+    pmailbox = test_pop3_mailbox_new(server);
+
+    memset(&stats, 0, sizeof(stats));
+    test_pop3_check(pmailbox, &stats, server);
+
+    config.n_messages += 1;
+    config.drop_after = 3;
+    mock_server_configure(server, &config);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "POP3 dropped connection";
+    test_pop3_check(pmailbox, &stats, server);
+    test_expect_unreported(stats.name);
+    test_pop3_check(pmailbox, &stats, server);
+    test_expect_new(stats.name, 0, 1);
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(pmailbox));
+    mock_server_destroy(server);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+    test_init(&argc, &argv, &options,
+              "Checks the POP3 mailbox against a mock server.");
+
+    test_pop3_scenario("POP3", FALSE);
+    test_pop3_scenario("POP3 PIPELINING", TRUE);
+    test_pop3_failures();
+
+    return test_finish();
+}
@@ -0,0 +1,419 @@
+/*
+ *  xfce4-mailwatch-plugin - a mail notification applet for the xfce4 panel
+ *  Copyright (c) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License ONLY.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * runs webfeed_check_mail_th() against the mock HTTP server with each kind of
+ * rule, and as the GMail mailbox against the mock HTTPS server, checking the
+ * counts it finds and printing what each check cost.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test-common.h"
+
+#define xfce_mailwatch_http_conn_dump_stats(http_conn, what, elapsed) \
+    test_collect_http_stats(http_conn)
+#include "mailwatch-mailbox-webfeed.c"
+
+#define FEED_PATH         "/feed"
+#define MAX_FEED_ENTRIES  20
+
+static TestOptions options = { 5, 0, 0, 0, FALSE };
+
+/* a body is a format with one %u, for the count */
+typedef struct
+{
+    const gchar *name;
+    XfceMailwatchWebFeedRuleType rule_type;
+    const gchar *rule;
+    const gchar *content_type;
+    const gchar *body;
+} TestWebFeedRule;
+
+static const TestWebFeedRule rules[] = {
+    /* NULL is the mock's Atom feed, whose <fullcount> is the count */
+    { "web feed XML element", RULE_XML_ELEMENT, "fullcount", NULL, NULL },
+    { "web feed XML entries", RULE_XML_ELEMENT, "", NULL, NULL },
+    { "web feed JSON pointer", RULE_JSON_POINTER, "/folders/0/un~1read",
+      "application/json",
+      "{\"user\": \"mock\", \"folders\": [{\"name\": \"INBOX\", "
+      "\"un/read\": %u}, {\"name\": \"Spam\", \"un/read\": 99}]}" },
+    { "web feed JSON pointer, string", RULE_JSON_POINTER, "/unread",
+      "application/json", "{\"total\": 100, \"unread\": \"%u\"}" },
+    { "web feed regex", RULE_REGEX, "unread=\"(\\d+)\"", "text/html",
+      "<html><body><span class=\"inbox\" unread=\"%u\">Inbox</span>"
+      "</body></html>" },
+};
+
+static XfceMailwatchWebFeedMailbox *
+test_webfeed_mailbox_new(XfceMailwatchMailboxType *type,
+                         GList *params)
+{
+    return XFCE_MAILWATCH_WEBFEED_MAILBOX(test_mailbox_new(type, params));
+}
+
+/* points the mailbox at |path| on the mock server, and reads it with |rule|
+ * unless that's NULL */
+static void
+test_webfeed_set_feed(XfceMailwatchWebFeedMailbox *wfmailbox,
+                      MockServer *server,
+                      gboolean secure,
+                      const gchar *path,
+                      const TestWebFeedRule *rule)
+{
+    g_free(wfmailbox->url);
+    wfmailbox->url = g_strdup_printf("%s://127.0.0.1:%u%s",
+                                     secure ? "https" : "http",
+                                     mock_server_get_port(server), path);
+    if(rule) {
+        wfmailbox->rule_type = rule->rule_type;
+        g_free(wfmailbox->rule);
+        wfmailbox->rule = g_strdup(rule->rule);
+    }
+}
+
+static void
+test_webfeed_check(XfceMailwatchWebFeedMailbox *wfmailbox,
+                   TestCheckStats *stats,
+                   MockServer *server)
+{
+    test_check_run(stats, server, &wfmailbox->running, &wfmailbox->th,
+                   webfeed_check_mail_th, wfmailbox);
+}
+
+static void
+test_webfeed_configure(MockServer *server,
+                       MockServerConfig *config,
+                       const TestWebFeedRule *rule,
+                       guint unseen)
+{
+    gchar *body = NULL;
+
+    config->unseen = unseen;
+    config->http_content_type = rule->content_type;
+    if(rule->body)
+        body = g_strdup_printf(rule->body, unseen);
+    config->http_body = body;
+    mock_server_configure(server, config);
+
+    g_free(body);
+    config->http_body = NULL;
+}
+
+/* the count changes before every check, so every check gets the body; all
+ * but the first reuse the connection */
+static void
+test_webfeed_rule(const TestWebFeedRule *rule)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchWebFeedMailbox *wfmailbox;
+    guint unseen;
+    gint i;
+
+    test_server_config_init(&config, MOCK_SERVER_HTTP, &options);
+    config.http_path = FEED_PATH;
+    server = mock_server_new(&config);
+
+    wfmailbox = test_webfeed_mailbox_new(&builtin_mailbox_type_webfeed, NULL);
+    test_webfeed_set_feed(wfmailbox, server, FALSE, FEED_PATH, rule);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = rule->name;
+    for(i = 0; i < options.iterations; i++) {
+        /* the Atom feed lists no more than MAX_FEED_ENTRIES entries */
+        unseen = i % MAX_FEED_ENTRIES + 1;
+        test_webfeed_configure(server, &config, rule, unseen);
+
+        test_webfeed_check(wfmailbox, &stats, server);
+        test_expect_new(rule->name, 0, unseen);
+    }
+    test_expect(stats.connections == 1, "%s: %u connections, not 1", rule->name,
+                stats.connections);
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(wfmailbox));
+    mock_server_destroy(server);
+}
+
+/* an unchanged body costs a 304 and keeps the last count, but only for the
+ * same feed read the same way */
+static void
+test_webfeed_not_modified(void)
+{
+    const TestWebFeedRule *rule = &rules[2];
+    TestWebFeedRule other_rule = *rule;
+    MockServerConfig config;
+    MockServerStats server_stats;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchWebFeedMailbox *wfmailbox;
+    guint not_modified;
+    gint i;
+
+    test_server_config_init(&config, MOCK_SERVER_HTTP, &options);
+    config.http_path = FEED_PATH;
+    config.http_etag = TRUE;
+    server = mock_server_new(&config);
+    test_webfeed_configure(server, &config, rule, 7);
+
+    wfmailbox = test_webfeed_mailbox_new(&builtin_mailbox_type_webfeed, NULL);
+    test_webfeed_set_feed(wfmailbox, server, FALSE, FEED_PATH, rule);
+
+    memset(&stats, 0, sizeof(stats));
+    test_webfeed_check(wfmailbox, &stats, server);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "web feed 304 Not Modified";
+    for(i = 0; i < options.iterations; i++) {
+        test_webfeed_check(wfmailbox, &stats, server);
+        test_expect_new(stats.name, 0, 7);
+    }
+    mock_server_get_stats(server, &server_stats);
+    test_expect(server_stats.not_modified == (guint)options.iterations,
+                "%s: %u 304s, not %d", stats.name, server_stats.not_modified,
+                options.iterations);
+    test_stats_print(&stats);
+    not_modified = server_stats.not_modified;
+
+    /* the same body read with another rule has to be fetched again */
+    other_rule.rule = "/folders/1/un~1read";
+    test_webfeed_set_feed(wfmailbox, server, FALSE, FEED_PATH, &other_rule);
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_new(stats.name, 0, 99);
+    mock_server_get_stats(server, &server_stats);
+    test_expect(server_stats.not_modified == not_modified,
+                "%s: a new rule got a 304", stats.name);
+
+    /* a new ETag */
+    test_webfeed_set_feed(wfmailbox, server, FALSE, FEED_PATH, rule);
+    test_webfeed_configure(server, &config, rule, 8);
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_new(stats.name, 0, 8);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(wfmailbox));
+    mock_server_destroy(server);
+}
+
+/* a missing feed, a body without the count, and one too large to look
+ * through all fail the check, and log why */
+static void
+test_webfeed_failures(void)
+{
+    const TestWebFeedRule *rule = &rules[2];
+    TestWebFeedRule missing_rule = *rule;
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchWebFeedMailbox *wfmailbox;
+    GString *large;
+
+    test_server_config_init(&config, MOCK_SERVER_HTTP, NULL);
+    config.http_path = FEED_PATH;
+    server = mock_server_new(&config);
+    test_webfeed_configure(server, &config, rule, 4);
+
+    wfmailbox = test_webfeed_mailbox_new(&builtin_mailbox_type_webfeed, NULL);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "web feed 404";
+    test_webfeed_set_feed(wfmailbox, server, FALSE, "/nothing", rule);
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_unreported(stats.name);
+    test_expect(test_core_get()->n_errors == 1, "%s: %u errors logged",
+                stats.name, test_core_get()->n_errors);
+    test_stats_print(&stats);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "web feed count missing";
+    missing_rule.rule = "/folders/2/un~1read";
+    test_webfeed_set_feed(wfmailbox, server, FALSE, FEED_PATH, &missing_rule);
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_unreported(stats.name);
+    test_expect(test_core_get()->n_errors == 1, "%s: %u errors logged",
+                stats.name, test_core_get()->n_errors);
+    test_stats_print(&stats);
+
+    /* the count is there, but past the limit */
+    large = g_string_sized_new(WEBFEED_MAX_BODY_SIZE + 64);
+    g_string_append(large, "{\"padding\": \"");
+    while(large->len < WEBFEED_MAX_BODY_SIZE)
+        g_string_append(large, "0123456789abcdef");
+    g_string_append(large, "\", \"unread\": 4}");
+    config.http_body = large->str;
+    mock_server_configure(server, &config);
+    config.http_body = NULL;
+    g_string_free(large, TRUE);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "web feed too large";
+    test_webfeed_set_feed(wfmailbox, server, FALSE, FEED_PATH, &rules[3]);
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_unreported(stats.name);
+    test_expect(test_core_get()->n_errors == 1, "%s: %u errors logged",
+                stats.name, test_core_get()->n_errors);
+    test_stats_print(&stats);
+
+    /* and the next check recovers */
+    test_webfeed_set_feed(wfmailbox, server, FALSE, FEED_PATH, rule);
+    test_webfeed_configure(server, &config, rule, 4);
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_new(stats.name, 0, 4);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(wfmailbox));
+    mock_server_destroy(server);
+}
+
+#ifdef HAVE_SSL_SUPPORT
+/* the GMail mailbox is the GMail feed read by <fullcount>.  the feed is the
+ * same as the first rule's, but over TLS and in any transfer encoding; the
+ * connection is reused for every check */
+static void
+test_webfeed_gmail(const gchar *name,
+                   gboolean chunked,
+                   gboolean gzip)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchWebFeedMailbox *wfmailbox;
+    GList *params = NULL;
+    gint i;
+
+    test_server_config_init(&config, MOCK_SERVER_HTTP, NULL);
+    config.secure = TRUE;
+    config.latency_ms = options.latency_ms;
+    config.throughput = options.throughput;
+    config.http_chunked = chunked;
+    config.http_gzip = gzip;
+    server = mock_server_new(&config);
+
+    params = test_params_add(params, "username", "user");
+    params = test_params_add(params, "password", "secret");
+    wfmailbox = test_webfeed_mailbox_new(&builtin_mailbox_type_gmail, params);
+    test_expect(wfmailbox->fixed && !strcmp(wfmailbox->url, GMAIL_FEED_URL)
+                && wfmailbox->rule_type == RULE_XML_ELEMENT
+                && !strcmp(wfmailbox->rule, GMAIL_FEED_RULE),
+                "%s: not set up to read the GMail feed", name);
+    test_webfeed_set_feed(wfmailbox, server, TRUE, "/mail/feed/atom", NULL);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = name;
+    for(i = 0; i < options.iterations; i++) {
+        config.unseen = i % MAX_FEED_ENTRIES + 1;
+        mock_server_configure(server, &config);
+
+        test_webfeed_check(wfmailbox, &stats, server);
+        test_expect_new(name, 0, config.unseen);
+    }
+    test_expect(stats.connections == 1, "%s: %u connections, not 1", name,
+                stats.connections);
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(wfmailbox));
+    mock_server_destroy(server);
+}
+
+/* an error response fails the check.  a reused connection that's been
+ * dropped gets a new one, but a new connection that's dropped fails the
+ * check; the next check recovers */
+static void
+test_webfeed_dropped(void)
+{
+    MockServerConfig config;
+    TestCheckStats stats;
+    MockServer *server;
+    XfceMailwatchWebFeedMailbox *wfmailbox;
+
+    test_server_config_init(&config, MOCK_SERVER_HTTP, NULL);
+    config.secure = TRUE;
+    config.unseen = 4;
+    config.fail_command = FEED_PATH;
+    server = mock_server_new(&config);
+
+    wfmailbox = test_webfeed_mailbox_new(&builtin_mailbox_type_gmail, NULL);
+    test_webfeed_set_feed(wfmailbox, server, TRUE, FEED_PATH, NULL);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "GMail 503";
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_unreported(stats.name);
+    test_expect(test_core_get()->n_errors == 1, "%s: %u errors logged",
+                stats.name, test_core_get()->n_errors);
+    test_stats_print(&stats);
+
+    config.fail_command = NULL;
+    config.drop_after = 1;
+    mock_server_configure(server, &config);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "GMail dropped, reused connection";
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_new(stats.name, 0, 4);
+    test_expect(stats.connections == 1, "%s: %u connections, not 1",
+                stats.name, stats.connections);
+    test_stats_print(&stats);
+
+    xfce_mailwatch_http_conn_disconnect(wfmailbox->http_conn);
+    mock_server_configure(server, &config);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.name = "GMail dropped, new connection";
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_unreported(stats.name);
+    test_webfeed_check(wfmailbox, &stats, server);
+    test_expect_new(stats.name, 0, 4);
+    test_stats_print(&stats);
+
+    test_mailbox_free(XFCE_MAILWATCH_MAILBOX(wfmailbox));
+    mock_server_destroy(server);
+}
+#endif
+
+int
+main(int argc,
+     char **argv)
+{
+    guint i;
+
+    test_init(&argc, &argv, &options,
+              "Checks the web feed and GMail mailboxes against mock HTTP and "
+              "HTTPS servers.");
+
+    for(i = 0; i < G_N_ELEMENTS(rules); i++)
+        test_webfeed_rule(&rules[i]);
+    test_webfeed_not_modified();
+    test_webfeed_failures();
+#ifdef HAVE_SSL_SUPPORT
+    test_webfeed_gmail("GMail", FALSE, FALSE);
+    test_webfeed_gmail("GMail chunked", TRUE, FALSE);
+#ifdef HAVE_ZLIB
+    test_webfeed_gmail("GMail gzip", FALSE, TRUE);
+    test_webfeed_gmail("GMail gzip, chunked", TRUE, TRUE);
+#endif
+    test_webfeed_dropped();
+#endif
+
+    return test_finish();
+}